@@ -0,0 +1,280 @@
+/* -*- linux-c -*- */
+/* fbmon.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include "fewbody.h"
+
+#define FBMON_SHMDIR "/dev/shm" /* where the segments show up as files */
+#define FBMON_MAXSEG 1024 /* most segments watched at once */
+
+/* the last sample of a block, to work out rates from */
+typedef struct{
+  int pid;
+  int slot;
+  long id;
+  fb_telem_status_t status;
+} fbmon_sample_t;
+
+typedef struct{
+  fbmon_sample_t *sample;
+  long n;
+  long size;
+} fbmon_history_t;
+
+/* print the usage */
+void print_usage(FILE *stream)
+{
+  fprintf(stream, "USAGE:\n");
+  fprintf(stream, "  fbmon [options...] [<segment>...]\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "Watches the live status that triple --telemetry publishes in the shared-memory segments\n");
+  fprintf(stream, "<segment> (\"%s<pid>\", or just the pid), or in every one there is, showing how far\n", FB_TELEM_PREFIX);
+  fprintf(stream, "each integration has got and how fast, in steps/s and t_dyn/s of wall-clock time.\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "OPTIONS:\n");
+  fprintf(stream, "  -i --interval <s> : seconds between refreshes [1]\n");
+  fprintf(stream, "  -n --count <n>    : refreshes before exiting (0 for no end) [0]\n");
+  fprintf(stream, "  -a --all          : show the idle and finished blocks too\n");
+  fprintf(stream, "  -V --version      : print version info\n");
+  fprintf(stream, "  -h --help         : display this help text\n");
+}
+
+/* the previous sample of block slot of process pid, or NULL if there is none */
+fbmon_sample_t *fbmon_find(fbmon_history_t *hist, int pid, int slot)
+{
+  long k;
+
+  for (k=0; k<hist->n; k++) {
+    if (hist->sample[k].pid == pid && hist->sample[k].slot == slot) {
+      return(&(hist->sample[k]));
+    }
+  }
+
+  return(NULL);
+}
+
+/* remember a sample of block slot of process pid */
+void fbmon_store(fbmon_history_t *hist, int pid, int slot, long id, fb_telem_status_t *status)
+{
+  fbmon_sample_t *sample;
+
+  if ((sample = fbmon_find(hist, pid, slot)) == NULL) {
+    if (hist->n == hist->size) {
+      hist->size = FB_MAX(2 * hist->size, 64);
+      hist->sample = (fbmon_sample_t *) realloc(hist->sample, hist->size * sizeof(fbmon_sample_t));
+    }
+    sample = &(hist->sample[hist->n++]);
+    sample->pid = pid;
+    sample->slot = slot;
+  }
+  sample->id = id;
+  sample->status = *status;
+}
+
+/* the names of the segments to watch: those given, or else every one in FBMON_SHMDIR */
+int fbmon_segments(int nname, char **name, char seg[][FB_MAX_STRING_LENGTH])
+{
+  int i, n=0, len=strlen(FB_TELEM_PREFIX)-1;
+  char *end;
+  DIR *dir;
+  struct dirent *ent;
+
+  if (nname > 0) {
+    for (i=0; i<nname && n<FBMON_MAXSEG; i++) {
+      strtol(name[i], &end, 10);
+      if (*end == '\0') {
+        snprintf(seg[n++], FB_MAX_STRING_LENGTH, "%s%s", FB_TELEM_PREFIX, name[i]);
+      } else {
+        snprintf(seg[n++], FB_MAX_STRING_LENGTH, "%s%s", (name[i][0] == '/' ? "" : "/"), name[i]);
+      }
+    }
+    return(n);
+  }
+
+  if ((dir = opendir(FBMON_SHMDIR)) == NULL) {
+    return(0);
+  }
+  while ((ent = readdir(dir)) != NULL && n < FBMON_MAXSEG) {
+    /* FB_TELEM_PREFIX without its slash */
+    if (strncmp(ent->d_name, &(FB_TELEM_PREFIX[1]), len) == 0) {
+      snprintf(seg[n++], FB_MAX_STRING_LENGTH, "/%s", ent->d_name);
+    }
+  }
+  closedir(dir);
+
+  return(n);
+}
+
+/* print a line per block of the segments, with the rates since the last refresh; returns the
+   number of blocks shown */
+long fbmon_refresh(FILE *stream, int nname, char **name, fbmon_history_t *hist, int all, int quiet)
+{
+  static char seg[FBMON_MAXSEG][FB_MAX_STRING_LENGTH];
+  int i, s, nseg, alive;
+  long id, nshown=0;
+  double dt, stepsps, tdynps, sumsteps=0.0, sumtdyn=0.0, now;
+  char state[16], srate[32], trate[32];
+  fb_telem_seg_t telem;
+  fb_telem_status_t status;
+  fbmon_sample_t *prev;
+
+  now = fb_telem_clock();
+  nseg = fbmon_segments(nname, name, seg);
+
+  if (!quiet) {
+    fprintf(stream, "# %-7s %4s %8s %12s %12s %12s %10s %10s %10s %10s %16s %9s %8s %9s %s\n",
+      "pid", "slot", "job", "t/t_dyn", "tstop", "count", "steps/s", "t_dyn/s", "h", "dE/E0", "hier",
+      "classify", "restarts", "t_cpu/s", "state");
+  }
+
+  for (i=0; i<nseg; i++) {
+    if (fb_telem_attach(&telem, seg[i]) != 0) {
+      if (nname > 0 && !quiet) {
+        fprintf(stream, "# %s: no such segment, or not one this version can read\n", seg[i]);
+      }
+      continue;
+    }
+    alive = (kill((pid_t) telem.head->pid, 0) == 0 || errno == EPERM);
+
+    for (s=0; s<telem.head->nslot; s++) {
+      if (fb_telem_read(&(telem.slot[s]), &id, &status) != 0) {
+        continue;
+      }
+      prev = fbmon_find(hist, telem.head->pid, s);
+
+      /* the rates, if this job was seen at an earlier update */
+      stepsps = tdynps = 0.0;
+      snprintf(srate, sizeof(srate), "-");
+      snprintf(trate, sizeof(trate), "-");
+      if (prev != NULL && prev->id == id && status.twall > prev->status.twall && status.count >= prev->status.count) {
+        dt = status.twall - prev->status.twall;
+        stepsps = (double) (status.count - prev->status.count) / dt;
+        tdynps = (status.t - prev->status.t) / dt;
+        snprintf(srate, sizeof(srate), "%.4g", stepsps);
+        snprintf(trate, sizeof(trate), "%.4g", tdynps);
+      }
+      fbmon_store(hist, telem.head->pid, s, id, &status);
+
+      if (status.twall == 0.0) {
+        snprintf(state, sizeof(state), "idle");
+      } else if (!alive) {
+        snprintf(state, sizeof(state), "dead");
+      } else if (!status.active) {
+        snprintf(state, sizeof(state), "done");
+      } else {
+        /* an active block that has not been updated for a while is worth knowing about */
+        snprintf(state, sizeof(state), (now - status.twall > 10.0 ? "stalled" : "running"));
+        sumsteps += stepsps;
+        sumtdyn += tdynps;
+      }
+
+      if (quiet || (!all && (status.twall == 0.0 || !status.active || !alive))) {
+        continue;
+      }
+      fprintf(stream, "  %-7d %4d %8ld %12.6g %12.6g %12ld %10s %10s %10.3g %10.3g %016lx %9ld %8ld %9.4g %s\n",
+        telem.head->pid, s, id, status.t, status.tstop, status.count, srate, trate, status.h, status.dE,
+        status.hier, status.iclassify, status.nrestart, status.tcpu, state);
+      nshown++;
+    }
+
+    fb_telem_close(&telem);
+  }
+
+  if (!quiet) {
+    fprintf(stream, "# running: %.6g steps/s  %.6g t_dyn/s\n\n", sumsteps, sumtdyn);
+    fflush(stream);
+  }
+
+  return(nshown);
+}
+
+/* the main attraction */
+int main(int argc, char *argv[])
+{
+  int i, all=0;
+  long count=0, n;
+  double interval=1.0;
+  struct timespec ts;
+  fbmon_history_t hist={NULL, 0, 0};
+  const char *short_opts = "i:n:aVh";
+  const struct option long_opts[] = {
+    {"interval", required_argument, NULL, 'i'},
+    {"count", required_argument, NULL, 'n'},
+    {"all", no_argument, NULL, 'a'},
+    {"version", no_argument, NULL, 'V'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((i = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
+    switch (i) {
+    case 'i':
+      interval = atof(optarg);
+      if (interval <= 0.0) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'n':
+      count = atol(optarg);
+      if (count < 0) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'a':
+      all = 1;
+      break;
+    case 'V':
+      fb_print_version(stdout);
+      return(0);
+    case 'h':
+      fb_print_version(stdout);
+      fprintf(stdout, "\n");
+      print_usage(stdout);
+      return(0);
+    default:
+      print_usage(stdout);
+      return(1);
+    }
+  }
+
+  ts.tv_sec = (time_t) interval;
+  ts.tv_nsec = (long) (1.0e9 * (interval - (double) ts.tv_sec));
+
+  /* a first, silent, sample, so that even the first refresh has rates */
+  fbmon_refresh(stdout, argc - optind, &(argv[optind]), &hist, all, 1);
+  for (n=0; count == 0 || n < count; n++) {
+    nanosleep(&ts, NULL);
+    fbmon_refresh(stdout, argc - optind, &(argv[optind]), &hist, all, 0);
+  }
+
+  free(hist.sample);
+  return(0);
+}
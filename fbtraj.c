@@ -0,0 +1,200 @@
+/* -*- linux-c -*- */
+/* fbtraj.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "fewbody.h"
+
+/* print the usage */
+void print_usage(FILE *stream)
+{
+  fprintf(stream, "USAGE:\n");
+  fprintf(stream, "  fbtraj [options...] <file>\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "Prints the binary trajectory <file> written by triple --binary as the text lines that\n");
+  fprintf(stream, "triple would have printed (\"-\" reads stdin).\n");
+  fprintf(stream, "\n");
+  fprintf(stream, "OPTIONS:\n");
+  fprintf(stream, "  -H --header  : print the header (units, run parameters and columns) instead\n");
+  fprintf(stream, "  -a --all     : print every column of every record, with the kind first\n");
+  fprintf(stream, "  -t --time <t>: print only the last record at or before time <t> (N-body units), found\n");
+  fprintf(stream, "                 by bisection of the mapped file, which may still be being written\n");
+  fprintf(stream, "  -V --version : print version info\n");
+  fprintf(stream, "  -h --help    : display this help text\n");
+}
+
+/* print the header of a binary trajectory */
+void fbtraj_print_header(FILE *stream, fb_traj_header_t *head)
+{
+  int k;
+
+  fprintf(stream, "# version=%.16s  ncol=%d  nrowmax=%d  eps=%.6g\n", head->version, head->ncol, head->nrowmax, head->eps);
+  fprintf(stream, "# units: v=%.6g cm/s  l=%.6g cm  t=%.6g s  m=%.6g g  E=%.6g erg\n",
+    head->units.v, head->units.l, head->units.t, head->units.m, head->units.E);
+  fprintf(stream, "# tstop=%.6g  dt=%.6g  tcpustop=%.6g  absacc=%.6g  relacc=%.6g\n",
+    head->tstop, head->dt, head->tcpustop, head->absacc, head->relacc);
+  fprintf(stream, "# tidaltol=%.6g  speedtol=%.6g  fexp=%.6g  ks=%d  ncount=%d  outfreq=%d\n",
+    head->tidaltol, head->speedtol, head->fexp, head->ks, head->ncount, head->outfreq);
+  fprintf(stream, "# PN1=%d  PN2=%d  PN25=%d  PN3=%d  PN35=%d\n",
+    head->PN1, head->PN2, head->PN25, head->PN3, head->PN35);
+  fprintf(stream, "# columns:");
+  for (k=0; k<head->ncol; k++) {
+    fprintf(stream, " %.*s", FB_TRAJ_NAMELEN, head->name[k]);
+  }
+  fprintf(stream, "\n");
+}
+
+/* print a record, as the text line or with every column */
+void fbtraj_print_row(FILE *stream, double row[FB_TRAJ_NCOL], int all)
+{
+  int k;
+
+  if (all) {
+    for (k=0; k<FB_TRAJ_NCOL; k++) {
+      fprintf(stream, (k == 0 ? "%g" : (k == 1 ? " %.12f" : " %g")), row[k]);
+    }
+    fprintf(stream, "\n");
+  } else {
+    fb_traj_print_text(stream, row);
+  }
+}
+
+/* print the last record at or before time t of the trajectory filename */
+int fbtraj_find(FILE *stream, char *filename, double t, int all)
+{
+  int i;
+  long b;
+  double row[FB_TRAJ_NCOL];
+  fb_traj_map_t map;
+
+  if (fb_traj_map(&map, filename) != 0) {
+    fprintf(stderr, "cannot map \"%s\" as an uncompressed trajectory file this version can read\n", filename);
+    return(1);
+  }
+
+  if (fb_traj_map_find(&map, t, &b, &i) != 0) {
+    fprintf(stderr, "\"%s\" has no record at or before t=%.6g\n", filename, t);
+    fb_traj_unmap(&map);
+    return(1);
+  }
+  fb_traj_map_row(&map, b, i, row);
+  fbtraj_print_row(stream, row, all);
+
+  fb_traj_unmap(&map);
+  return(0);
+}
+
+/* the main attraction */
+int main(int argc, char *argv[])
+{
+  int i, k, nrow, header=0, all=0, find=0;
+  long nrecord=0;
+  double *col, row[FB_TRAJ_NCOL], t=0.0;
+  FILE *stream;
+  fb_traj_header_t head;
+  fb_traj_block_t block;
+  const char *short_opts = "Hat:Vh";
+  const struct option long_opts[] = {
+    {"header", no_argument, NULL, 'H'},
+    {"all", no_argument, NULL, 'a'},
+    {"time", required_argument, NULL, 't'},
+    {"version", no_argument, NULL, 'V'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while ((i = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
+    switch (i) {
+    case 'H':
+      header = 1;
+      break;
+    case 'a':
+      all = 1;
+      break;
+    case 't':
+      t = atof(optarg);
+      find = 1;
+      break;
+    case 'V':
+      fb_print_version(stdout);
+      return(0);
+    case 'h':
+      fb_print_version(stdout);
+      fprintf(stdout, "\n");
+      print_usage(stdout);
+      return(0);
+    default:
+      print_usage(stdout);
+      return(1);
+    }
+  }
+
+  if (optind != argc - 1) {
+    print_usage(stdout);
+    return(1);
+  }
+
+  if (find) {
+    return(fbtraj_find(stdout, argv[optind], t, all));
+  }
+
+  if (strcmp(argv[optind], "-") == 0) {
+    stream = stdin;
+  } else if ((stream = fopen(argv[optind], "rb")) == NULL) {
+    fprintf(stderr, "cannot open \"%s\"\n", argv[optind]);
+    return(1);
+  }
+
+  if (fb_traj_read_header(stream, &head) != 0) {
+    fprintf(stderr, "\"%s\" is not a trajectory file this version can read\n", argv[optind]);
+    return(1);
+  }
+
+  if (header) {
+    fbtraj_print_header(stdout, &head);
+    return(0);
+  }
+
+  col = fb_malloc_vector(head.ncol * head.nrowmax);
+  while ((nrow = fb_traj_read_block(stream, &head, &block, col)) > 0) {
+    for (i=0; i<nrow; i++) {
+      for (k=0; k<head.ncol; k++) {
+        row[k] = col[k*head.nrowmax + i];
+      }
+      fbtraj_print_row(stdout, row, all);
+    }
+    nrecord += nrow;
+  }
+  fb_free_vector(col);
+
+  if (nrow < 0) {
+    fprintf(stderr, "\"%s\" is damaged after %ld records\n", argv[optind], nrecord);
+    return(1);
+  }
+
+  if (stream != stdin) {
+    fclose(stream);
+  }
+
+  return(0);
+}
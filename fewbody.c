@@ -23,51 +23,125 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <sys/times.h>
+#include <time.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <gsl/gsl_errno.h>
 #include <gsl/gsl_odeiv.h>
 #include "fewbody.h"
 
-int fb_debug = 0;
+__thread int fb_debug = 0;
+
+/* the cpu time of this thread, in seconds, for timing the parts of a step */
+static double fb_cputime(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return(((double) now.tv_sec) + 1.0e-9 * ((double) now.tv_nsec));
+}
+
+/* keep track in retval of the extremes of the orbit of a bound triple, from the elements
+   fb_classify() has just worked out */
+void fb_track_extrema(fb_hier_t *hier, fb_ret_t *retval)
+{
+  if (hier->nstar == 3 && hier->nobj == 1 && hier->hier[hier->hi[2]+0].e > retval->emax) {
+    retval->emax = hier->hier[hier->hi[2]+0].e;
+  }
+}
+
+/* the total energy and angular momentum of the stars of hier, internal ones included */
+static void fb_conserved(fb_hier_t *hier, double *E, double L[3])
+{
+  int i;
+  double Lint[3];
+
+  *E = fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) +
+    fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar);
+  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, L);
+  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
+  for (i=0; i<3; i++) {
+    L[i] += Lint[i];
+  }
+}
+
+/* publish the live status of the integration, whose energy is now E, in its telemetry block */
+static void fb_publish_status(fb_telem_t *block, fb_telem_status_t *status, double t, double h, double E,
+                              double Ei, fb_ret_t *retval)
+{
+  status->t = t;
+  status->count = retval->count;
+  status->h = h;
+  status->dE = E/Ei - 1.0;
+  status->iclassify = retval->iclassify;
+  status->tcpu = retval->tcpu;
+  fb_telem_write(block, status);
+}
 
 fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t, gsl_rng *rng)
 {
-  int i, j, k=0, status, done=0, forceclassify=0, restart, restep;
-  long clk_tck;
+  int i, j, k=0, status, err=FB_OK, done=0, forceclassify=0, restart, restep, nint, story, fresh;
   double s, slast, sstop=FB_SSTOP, tout, h=FB_H, *y, texpand, tnew, R[3];
-  double Ei, E, Lint[3], Li[3], L[3], DeltaL[3];
-  double s2, s2prev=GSL_POSINF, s2prevprev=GSL_POSINF, s2minprev=GSL_POSINF, s2max=0.0, s2min;
-  struct tms firsttimebuf, currtimebuf;
-  clock_t firstclock, currclock;
+  double Ei, E, Li[3], L[3], DeltaL[3];
+  double s2, s2prev=GSL_POSINF, s2prevprev=GSL_POSINF, s2minprev=GSL_POSINF, s2max=0.0, s2min=0.0;
+  double tcheckpoint, tsection;
+  struct timespec firsttime, currtime;
   fb_hier_t phier;
+  fb_traj_events_t events;
+  fb_traj_t eventtraj, *evtraj=NULL;
+  FILE *chan[FB_NCHAN];
+  fb_checkpoint_t chk;
+  fb_telem_status_t telem;
   fb_ret_t retval;
   fb_nonks_params_t nonks_params;
   fb_ks_params_t ks_params;
-  char string1[FB_MAX_STRING_LENGTH], string2[FB_MAX_STRING_LENGTH], logentry[FB_MAX_LOGENTRY_LENGTH];
+  char string1[FB_MAX_STRING_LENGTH], string2[FB_MAX_STRING_LENGTH];
+  fb_log_t storylog;
   const gsl_odeiv_step_type *ode_type=gsl_odeiv_step_rk8pd;
   gsl_odeiv_step *ode_step;
   gsl_odeiv_control *ode_control;
   gsl_odeiv_evolve *ode_evolve;
   gsl_odeiv_system ode_sys;
 
-  /* initialize a few things */
-  fb_init_hier(hier);
+  /* initialize a few things; when resuming from a checkpoint, hier is the checkpoint's
+     hierarchy and everything else is taken from the checkpoint further down */
+  if (input.resume == NULL) {
+    fb_init_hier(hier);
+  }
   retval.iclassify = 0;
   retval.Rmin = FB_RMIN;
   retval.Rmin_i = -1;
   retval.Rmin_j = -1;
   retval.Nosc = 0;
-  strncpy(logentry, input.firstlogentry, FB_MAX_LOGENTRY_LENGTH);
+  retval.emax = 0.0;
+  fb_log_init(&storylog, input.firstlogentry);
+
+  /* where the channels go; the events go with the trajectory unless they have a sink of their
+     own, and a discarded channel is not even formatted */
+  for (i=0; i<FB_NCHAN; i++) {
+    chan[i] = fb_sink_stream(input.sink[i], input.out);
+  }
+  if (input.sink[FB_CHAN_EVENTS] == NULL) {
+    chan[FB_CHAN_EVENTS] = chan[FB_CHAN_TRAJ];
+  }
+  story = (input.Dflag == 1 && chan[FB_CHAN_STORY] != NULL);
 
   /* set up the perturbation tree, initially flat */
-  phier.nstarinit = hier->nstar;
-  phier.nstar = hier->nstar;
-  fb_malloc_hier(&phier);
-  fb_init_hier(&phier);
-  for (i=0; i<phier.nstar; i++) {
-    fb_objcpy(&(phier.hier[phier.hi[1]+i]), &(hier->hier[hier->hi[1]+i]));
+  if (input.resume == NULL) {
+    phier.nstarinit = hier->nstar;
+    phier.nstar = hier->nstar;
+    fb_malloc_hier(&phier);
+    fb_init_hier(&phier);
+    for (i=0; i<phier.nstar; i++) {
+      fb_objcpy(&(phier.hier[phier.hi[1]+i]), &(hier->hier[hier->hi[1]+i]));
+    }
+    nint = hier->nstar;
+  } else {
+    phier.nstarinit = input.resume->phier.nstarinit;
+    phier.nstar = input.resume->phier.nstar;
+    fb_malloc_hier(&phier);
+    fb_hiercpy(&phier, &(input.resume->phier));
+    nint = input.resume->nint;
   }
 
   fb_dprintf("hier triple x-coor: %g\n", hier->hier[hier->hi[3]].x[0]);
@@ -75,33 +149,43 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
 
   /* initialize GSL integration routine */
   if (input.ks) {
-    ode_step = gsl_odeiv_step_alloc(ode_type, 8 * (hier->nstar * (hier->nstar - 1) / 2) + 1);
+    ode_step = gsl_odeiv_step_alloc(ode_type, 8 * (nint * (nint - 1) / 2) + 1);
     ode_control = gsl_odeiv_control_y_new(input.absacc, input.relacc);
-    ode_evolve = gsl_odeiv_evolve_alloc(8 * (hier->nstar * (hier->nstar - 1) / 2) + 1);
+    ode_evolve = gsl_odeiv_evolve_alloc(8 * (nint * (nint - 1) / 2) + 1);
     ode_sys.function = fb_ks_func;
     ode_sys.jacobian = NULL;
-    ode_sys.dimension = 8 * (hier->nstar * (hier->nstar - 1) / 2) + 1;
+    ode_sys.dimension = 8 * (nint * (nint - 1) / 2) + 1;
     ode_sys.params = &ks_params;
   } else {
-    ode_step = gsl_odeiv_step_alloc(ode_type, 6 * hier->nstar);
+    ode_step = gsl_odeiv_step_alloc(ode_type, 6 * nint);
     ode_control = gsl_odeiv_control_y_new(input.absacc, input.relacc);
-    ode_evolve = gsl_odeiv_evolve_alloc(6 * hier->nstar);
+    ode_evolve = gsl_odeiv_evolve_alloc(6 * nint);
     ode_sys.function = fb_nonks_func;
     ode_sys.jacobian = fb_nonks_jac;
-    ode_sys.dimension = 6 * hier->nstar;
+    ode_sys.dimension = 6 * nint;
     ode_sys.params = &nonks_params;
   }
 
   /* set parameters for integrator */
   if (input.ks) {
-    ks_params.nstar = hier->nstar;
+    ks_params.nstar = nint;
     ks_params.kstar = ks_params.nstar*(ks_params.nstar-1)/2;
     fb_malloc_ks_params(&ks_params);
-    fb_init_ks_params(&ks_params, *hier);
+    ks_params.nfunc = 0;
+    if (input.resume == NULL) {
+      err = fb_init_ks_params(&ks_params, *hier);
+    } else {
+      fb_restore_ks_params(&ks_params, input.resume->mint, input.resume->state.Einit);
+    }
   } else {
-    nonks_params.nstar = hier->nstar;
+    nonks_params.nstar = nint;
     fb_malloc_nonks_params(&nonks_params);
-    fb_init_nonks_params(&nonks_params, *hier);
+    nonks_params.nfunc = 0;
+    if (input.resume == NULL) {
+      err = fb_init_nonks_params(&nonks_params, *hier);
+    } else {
+      fb_restore_nonks_params(&nonks_params, input.resume->mint);
+    }
     nonks_params.PN1 = input.PN1;
     nonks_params.PN2 = input.PN2;
     nonks_params.PN25 = input.PN25;
@@ -122,15 +206,15 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
     s = *t;
   }
 
-  /* store the initial energy and angular momentum */
-  Ei = fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) + 
-    fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar);
-  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, Li);
-  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
-  for (i=0; i<3; i++) {
-    Li[i] += Lint[i];
+  /* the non-regularized integration variable is the time itself, so the last step can be
+     made to land on tstop */
+  if (input.tstopexact && !input.ks) {
+    sstop = input.tstop;
   }
 
+  /* store the initial energy and angular momentum */
+  fb_conserved(hier, &Ei, Li);
+
   /* integrate along */
   fb_dprintf("fewbody: integrating...\n");
   
@@ -138,11 +222,71 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
   // when declared.
   //done = 0;
   retval.count = 0;
+  retval.nrhs = 0;
   tout = *t;
   texpand = 0.0;
-  clk_tck = sysconf(_SC_CLK_TCK);
-  firstclock = times(&firsttimebuf);
+
+  /* or carry on from where the checkpoint left off; the checkpoint was taken at the end of
+     a step, so the loop below picks up exactly as it would have */
+  if (input.resume != NULL) {
+    if (input.resume->state.ks != input.ks || input.resume->state.ydim != ode_sys.dimension) {
+      fb_dprintf("fewbody: checkpoint does not match the integrator\n");
+      err = FB_E_CHECKPOINT;
+    } else {
+      for (i=0; i<input.resume->state.ydim; i++) {
+        y[i] = input.resume->y[i];
+      }
+    }
+    *t = input.resume->state.t;
+    s = input.resume->state.s;
+    h = input.resume->state.h;
+    tout = input.resume->state.tout;
+    texpand = input.resume->state.texpand;
+    Ei = input.resume->state.Ei;
+    for (i=0; i<3; i++) {
+      Li[i] = input.resume->state.Li[i];
+    }
+    s2prev = input.resume->state.s2prev;
+    s2prevprev = input.resume->state.s2prevprev;
+    s2minprev = input.resume->state.s2minprev;
+    s2max = input.resume->state.s2max;
+    s2min = input.resume->state.s2min;
+    retval = input.resume->state.retval;
+    fb_log_clear(&storylog);
+    fb_log_printf(&storylog, "%s", input.resume->logentry);
+  }
+
+  /* use the cpu time of this thread only, so that several integrations can run side by side;
+     the cpu time, and so the cpu stopping time, counts from the start of this call */
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &firsttime);
   retval.tcpu = 0.0;
+  retval.tclassify = 0.0;
+  retval.toutput = 0.0;
+  tcheckpoint = input.checkpointdt;
+  memset(&telem, 0, sizeof(fb_telem_status_t));
+  telem.active = 1;
+  telem.tstop = input.tstop;
+  if (input.telem != NULL) {
+    fb_conserved(hier, &E, L);
+    fb_publish_status(input.telem, &telem, *t, h, E, Ei, &retval);
+  }
+  /* the event records are recognized late, and have to be put in order of time with the
+     rest; that takes a writer, even for text lines */
+  if (input.events && input.sink[FB_CHAN_EVENTS] == NULL && (input.traj != NULL || chan[FB_CHAN_TRAJ] != NULL)) {
+    fb_traj_events_init(&events, &input);
+    if (input.traj == NULL) {
+      fb_traj_open_text(&eventtraj, chan[FB_CHAN_TRAJ]);
+      input.traj = &eventtraj;
+    }
+    evtraj = input.traj;
+    fb_traj_sort(evtraj);
+  } else if (input.events && chan[FB_CHAN_EVENTS] != NULL) {
+    /* a writer of their own, to keep them in order */
+    fb_traj_events_init(&events, &input);
+    fb_traj_open_text(&eventtraj, chan[FB_CHAN_EVENTS]);
+    evtraj = &eventtraj;
+    fb_traj_sort(evtraj);
+  }
 
   // JMA 6-7-12 -- One might want the code to output the instantaneous
   // positions and velocities of the stars.  In that case, uncomment and
@@ -155,7 +299,12 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
   //fprintf(stdout, "%g %g %g\n", *t, fb_mod(hier->hier[hier->hi[1] + 1].x),
   //  fb_mod(hier->hier[hier->hi[1] + 2].x));
 
-  while (*t < input.tstop && retval.tcpu < input.tcpustop && !done) {
+  /* any error from the core routines abandons the integration and ends up in retval.retval;
+     E and L, when fresh, are those of the stars as this step has left them, and are shared by
+     the story, the telemetry and the final tally */
+  fresh = 0;
+  while (*t < input.tstop && retval.tcpu < input.tcpustop && !done && !err) {
+    fresh = 0;
     fb_dprintf("\n");
     fb_dprintf("new step...\n");
     fb_dprintf("time: %.16f\n", *t);
@@ -164,11 +313,13 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
     fb_dprintf("star coors: %.16f %.16f\n", hier->hier[hier->hi[2]].x[0], hier->hier[hier->hi[3]].x[0]);
     /* DEBUG: printing of time, semimajor axis, and eccentricity when there is currently a 
        single binary and we started with a single binary */
-    if (hier->nstarinit == 2 && hier->nstar == 2 && hier->nobj == 1) {
-      fb_upsync(&(hier->hier[hier->hi[2]+0]), *t, input, units);
-      fprintf(stdout, "%g %g %g\n", 
+    if (chan[FB_CHAN_DEBUG] != NULL && hier->nstarinit == 2 && hier->nstar == 2 && hier->nobj == 1) {
+      if ((err = fb_upsync(&(hier->hier[hier->hi[2]+0]), *t, input, units)) != FB_OK) {
+        break;
+      }
+      fprintf(chan[FB_CHAN_DEBUG], "%g %g %g\n", 
         *t, hier->hier[hier->hi[2]+0].a, hier->hier[hier->hi[2]+0].e);
-      /* fprintf(stdout, "%g %g %g\n", 
+      /* fprintf(input.out, "%g %g %g\n", 
                  *t * units.t, hier->hier[hier->hi[2]+0].a * units.l, hier->hier[hier->hi[2]+0].e); */
     }
     /* DEBUG */
@@ -180,37 +331,13 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
      * gibberish.)
      *
      */
-    if (input.outfreq != -1) {
+    if (input.outfreq != -1 && (input.traj != NULL || chan[FB_CHAN_TRAJ] != NULL)) {
       if (retval.count % input.outfreq == 0) {
-        fprintf(stdout, "%.12f %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n", *t,
-          hier->hier[hier->hi[2]+0].a, hier->hier[hier->hi[2]+0].e,
-          hier->hier[hier->hi[3]+0].a, hier->hier[hier->hi[3]+0].e,
-          fb_dot(hier->hier[hier->hi[2]+0].Lhat, hier->hier[hier->hi[2]+1].Lhat),
-          acos(fb_dot(hier->hier[hier->hi[2]+0].Ahat, hier->hier[hier->hi[2]+1].Ahat)) * 180 / FB_CONST_PI,
-          hier->hier[hier->hi[2]+0].Lhat[0],
-          hier->hier[hier->hi[2]+0].Lhat[1],
-          hier->hier[hier->hi[2]+0].Lhat[2],
-          hier->hier[hier->hi[1]+1].x[0] - hier->hier[hier->hi[1]+0].x[0], 
-          hier->hier[hier->hi[1]+1].x[1] - hier->hier[hier->hi[1]+0].x[1],
-          hier->hier[hier->hi[1]+1].x[2] - hier->hier[hier->hi[1]+0].x[2],
-          hier->hier[hier->hi[1]+0].x[0],
-          hier->hier[hier->hi[1]+0].x[1],
-          hier->hier[hier->hi[1]+0].x[2],
-          hier->hier[hier->hi[1]+1].x[0],
-          hier->hier[hier->hi[1]+1].x[1],
-          hier->hier[hier->hi[1]+1].x[2],
-          hier->hier[hier->hi[1]+2].x[0],
-          hier->hier[hier->hi[1]+2].x[1],
-          hier->hier[hier->hi[1]+2].x[2],
-          hier->hier[hier->hi[1]+1].v[0] - hier->hier[hier->hi[1]+0].v[0], 
-          hier->hier[hier->hi[1]+1].v[1] - hier->hier[hier->hi[1]+0].v[1],
-          hier->hier[hier->hi[1]+1].v[2] - hier->hier[hier->hi[1]+0].v[2],
-          hier->hier[hier->hi[1]+1].v[0],
-          hier->hier[hier->hi[1]+1].v[1],
-          hier->hier[hier->hi[1]+1].v[2]
-          );
+        tsection = fb_cputime();
+        fb_traj_output(chan[FB_CHAN_TRAJ], input.traj, FB_TRAJ_STEP, hier, *t);
+        retval.toutput += fb_cputime() - tsection;
         /*
-        fprintf(stdout, "%.12f %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n", *t,
+        fprintf(input.out, "%.12f %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n", *t,
           hier->hier[hier->hi[2]+0].a, hier->hier[hier->hi[2]+0].e,
           hier->hier[hier->hi[3]+0].a, hier->hier[hier->hi[3]+0].e,
           fb_dot(hier->hier[hier->hi[2]+0].Lhat, hier->hier[hier->hi[2]+1].Lhat),
@@ -252,8 +379,16 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
     /* take one step */
     slast = s;
     status = gsl_odeiv_evolve_apply(ode_evolve, ode_control, ode_step, &ode_sys, &s, sstop, &h, y);
+    if (input.ks) {
+      retval.nrhs += ks_params.nfunc;
+      ks_params.nfunc = 0;
+    } else {
+      retval.nrhs += nonks_params.nfunc;
+      nonks_params.nfunc = 0;
+    }
     if (status != GSL_SUCCESS) {
       fb_dprintf("GSL failure.\n");
+      err = FB_E_GSL;
       break;
     }
 
@@ -278,7 +413,10 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
     forceclassify = 0;
 
     /* see if we need to expand or collapse the perturbation hierarchy */
-    if (fb_expand(&phier, tnew, input.tidaltol)) {
+    if ((status = fb_expand(&phier, tnew, input.tidaltol)) < 0) {
+      err = status;
+      break;
+    } else if (status) {
       fb_dprintf("expanding...\n");
       texpand = tnew;
       s = slast;
@@ -290,10 +428,15 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
           phier.hier[phier.hi[1]+i].v[k] = hier->hier[hier->hi[1]+i].v[k];
         }
       }
-      fb_elkcirt(&phier, *t, input, units);
+      if ((err = fb_elkcirt(&phier, *t, input, units)) != FB_OK) {
+        break;
+      }
     } else if (tnew >= texpand) {
       *t = tnew;
-      if (fb_collapse(&phier, tnew, input.tidaltol, input.speedtol, units, input)) {
+      if ((status = fb_collapse(&phier, tnew, input.tidaltol, input.speedtol, units, input)) < 0) {
+        err = status;
+        break;
+      } else if (status) {
         fb_dprintf("collapsing...\n");
         *t = tnew;
         /* if there is only one object, then it's stable---force classify() */
@@ -315,7 +458,9 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
     /* if we're not repeating the previous integration step, then do physics */
     if (!restep) {
       /* trickle down so updated information is in hier */
-      fb_trickle(&phier, *t);
+      if ((err = fb_trickle(&phier, *t)) != FB_OK) {
+        break;
+      }
 
       // JMA 1-24-2013 -- To try to mitigate the effect of roundoff error,
       // we are going to recenter the entire system on the center of mass
@@ -350,7 +495,9 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
       fb_dprintf("before phier trickle\n");
       fb_dprintf("phier coors: %.16f %.16f %.16f\n", phier.hier[phier.hi[1]].x[0], phier.hier[phier.hi[1]+1].x[0], phier.hier[phier.hi[1]+2].x[0]);
 
-      fb_trickle(&phier, *t);
+      if ((err = fb_trickle(&phier, *t)) != FB_OK) {
+        break;
+      }
 
       fb_dprintf("after phier trickle\n");
       fb_dprintf("phier coors: %.16f %.16f %.16f\n", phier.hier[phier.hi[1]].x[0], phier.hier[phier.hi[1]+1].x[0], phier.hier[phier.hi[1]+2].x[0]);
@@ -387,7 +534,10 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
       }
       
       /* do physical collisions */
-      if (fb_collide(hier, input.fexp, units, rng, t)) {
+      if ((status = fb_collide(hier, input.fexp, units, rng, t, chan[FB_CHAN_TRAJ], input.traj)) < 0) {
+        err = status;
+        break;
+      } else if (status) {
         /* initialize phier to a flat tree */
         phier.nstar = hier->nstar;
         fb_init_hier(&phier);
@@ -443,8 +593,15 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
       if (retval.count % input.ncount == 0 || forceclassify) {
         fb_dprintf("before classify: %g %g %g %g\n", hier->hier[hier->hi[3]].x[0], hier->hier[hier->hi[2]].x[0], hier->hier[hier->hi[1]].x[0], hier->hier[hier->hi[1]+1].x[0]);
         fb_dprintf("phier coors: %.16f %.16f %.16f\n", phier.hier[phier.hi[1]].x[0], phier.hier[phier.hi[1]+1].x[0], phier.hier[phier.hi[1]+2].x[0]);
+        tsection = fb_cputime();
         status = fb_classify(hier, *t, input.tidaltol, input.speedtol, units, input);
+        retval.tclassify += fb_cputime() - tsection;
         retval.iclassify++;
+        fb_track_extrema(hier, &retval);
+        if (status < 0) {
+          err = status;
+          break;
+        }
         fb_dprintf("before current status\n");
         fb_dprintf("triple x-coor: %g\n", hier->hier[hier->hi[3]].x[0]);
         fb_dprintf("binary x-coor: %g\n", hier->hier[hier->hi[2]].x[0]);
@@ -452,15 +609,24 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
         fb_dprintf("fewbody: current status:  t=%.6g  %s  (%s)\n",
              *t, fb_sprint_hier(*hier, string1),
              fb_sprint_hier_hr(*hier, string2));
-        snprintf(&(logentry[strlen(logentry)]), FB_MAX_LOGENTRY_LENGTH-strlen(logentry),
-           "  current status:  t=%.6g  %s  (%s)\n", *t, fb_sprint_hier(*hier, string1),
-           fb_sprint_hier_hr(*hier, string2));
+        /* the log is only ever read in a story */
+        if (story) {
+          fb_log_printf(&storylog, "  current status:  t=%.6g  %s  (%s)\n", *t, fb_sprint_hier(*hier, string1),
+                        fb_sprint_hier_hr(*hier, string2));
+        }
         if (status) {
           fb_dprintf("fb_classify() yielded true status.\n");
           done = 1;
         }
       }
 
+      /* record the events of this step */
+      if (evtraj != NULL) {
+        tsection = fb_cputime();
+        fb_traj_events(NULL, evtraj, &events, hier, *t, (retval.count % input.ncount == 0 || forceclassify));
+        retval.toutput += fb_cputime() - tsection;
+      }
+
       /* JMA 6-8-12 -- If the inner binary has merged, we are done. */
       if (hier->nstar == 2) {
         fb_dprintf("Inner binary merged.\n");
@@ -478,22 +644,30 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
       }
       
       /* print stuff if necessary */
-      if (input.Dflag == 1 && (*t >= tout || done)) {
+      if (story && (*t >= tout || done)) {
         tout = *t + input.dt;
-        fb_print_story(&(hier->hier[hier->hi[1]]), hier->nstar, *t, logentry);
+        if (input.traj != NULL && input.traj->text) {
+          fb_traj_flush(input.traj);
+        }
+        if (!fresh) {
+          fb_conserved(hier, &E, L);
+          fresh = 1;
+        }
+        fb_print_story(chan[FB_CHAN_STORY], &(hier->hier[hier->hi[1]]), hier->nstar, *t, E, L, &storylog);
       }
     }
     
     /* restart integrator if necessary */
     if (restart) {
       fb_dprintf("fewbody: restarting integrator: nobj=%d count=%ld\n", phier.nobj, retval.count);
+      telem.nrestart++;
       fb_free_vector(y);
       if (input.ks) {
         fb_free_ks_params(ks_params);
         ks_params.nstar = phier.nobj;
         ks_params.kstar = ks_params.nstar*(ks_params.nstar-1)/2;
         fb_malloc_ks_params(&ks_params);
-        fb_init_ks_params(&ks_params, phier);
+        err = fb_init_ks_params(&ks_params, phier);
         
         y = fb_malloc_vector(8*ks_params.kstar+1);
         y[0] = *t;
@@ -502,7 +676,7 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
         fb_free_nonks_params(nonks_params);
         nonks_params.nstar = phier.nobj;
         fb_malloc_nonks_params(&nonks_params);
-        fb_init_nonks_params(&nonks_params, phier);
+        err = fb_init_nonks_params(&nonks_params, phier);
         nonks_params.PN1 = input.PN1;
         nonks_params.PN2 = input.PN2;
         nonks_params.PN25 = input.PN25;
@@ -535,62 +709,100 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
 
     /* update variables that change on every integration step */
     retval.count++;
-    currclock = times(&currtimebuf);
-    retval.tcpu = ((double) (currtimebuf.tms_utime + currtimebuf.tms_stime - firsttimebuf.tms_utime - firsttimebuf.tms_stime))/((double) clk_tck);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &currtime);
+    retval.tcpu = ((double) (currtime.tv_sec - firsttime.tv_sec)) + 1.0e-9 * ((double) (currtime.tv_nsec - firsttime.tv_nsec));
+    /* let a monitor see how the integration is getting on; the hierarchy is the one left by
+       the latest classification, and is only formatted for a snapshot */
+    if (input.telem != NULL && retval.count % input.telemfreq == 0) {
+      telem.hier = fb_telem_hash(fb_sprint_hier(*hier, string1));
+      if (!fresh) {
+        fb_conserved(hier, &E, L);
+        fresh = 1;
+      }
+      fb_publish_status(input.telem, &telem, *t, h, E, Ei, &retval);
+    }
+
+    /* checkpoint every checkpointdt of cpu time, and whenever the integration is about to
+       stop without having finished, so that it can be resumed with a later stopping time */
+    if (input.checkpoint != NULL && !done && !err &&
+        (retval.tcpu >= tcheckpoint || *t >= input.tstop || retval.tcpu >= input.tcpustop)) {
+      chk.input = input;
+      chk.units = units;
+      chk.state.ks = input.ks;
+      chk.state.ydim = ode_sys.dimension;
+      chk.state.t = *t;
+      chk.state.s = s;
+      chk.state.h = h;
+      chk.state.tout = tout;
+      chk.state.texpand = texpand;
+      chk.state.Ei = Ei;
+      for (i=0; i<3; i++) {
+        chk.state.Li[i] = Li[i];
+      }
+      chk.state.s2prev = s2prev;
+      chk.state.s2prevprev = s2prevprev;
+      chk.state.s2minprev = s2minprev;
+      chk.state.s2max = s2max;
+      chk.state.s2min = s2min;
+      chk.state.Einit = (input.ks ? ks_params.Einit : 0.0);
+      chk.state.retval = retval;
+      chk.nint = (input.ks ? ks_params.nstar : nonks_params.nstar);
+      chk.mint = (input.ks ? ks_params.m : nonks_params.m);
+      chk.y = y;
+      chk.hier = *hier;
+      chk.phier = phier;
+      chk.logentry = storylog.buf;
+      if (fb_write_checkpoint(input.checkpoint, &chk, rng) != FB_OK) {
+        fprintf(stderr, "fewbody: cannot write checkpoint %s\n", input.checkpoint);
+      }
+      tcheckpoint = retval.tcpu + input.checkpointdt;
+    }
   }
 
   // JMA 4-9-13 -- Print out the data at the final step. 
-  fprintf(stdout, "%.12f %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n", *t,
-    hier->hier[hier->hi[2]+0].a, hier->hier[hier->hi[2]+0].e,
-    hier->hier[hier->hi[3]+0].a, hier->hier[hier->hi[3]+0].e,
-    fb_dot(hier->hier[hier->hi[2]+0].Lhat, hier->hier[hier->hi[2]+1].Lhat),
-    acos(fb_dot(hier->hier[hier->hi[2]+0].Ahat, hier->hier[hier->hi[2]+1].Ahat)) * 180 / FB_CONST_PI,
-    hier->hier[hier->hi[2]+0].Lhat[0],
-    hier->hier[hier->hi[2]+0].Lhat[1],
-    hier->hier[hier->hi[2]+0].Lhat[2],
-    hier->hier[hier->hi[1]+1].x[0] - hier->hier[hier->hi[1]+0].x[0], 
-    hier->hier[hier->hi[1]+1].x[1] - hier->hier[hier->hi[1]+0].x[1],
-    hier->hier[hier->hi[1]+1].x[2] - hier->hier[hier->hi[1]+0].x[2],
-    hier->hier[hier->hi[1]+0].x[0],
-    hier->hier[hier->hi[1]+0].x[1],
-    hier->hier[hier->hi[1]+0].x[2],
-    hier->hier[hier->hi[1]+1].x[0],
-    hier->hier[hier->hi[1]+1].x[1],
-    hier->hier[hier->hi[1]+1].x[2],
-    hier->hier[hier->hi[1]+2].x[0],
-    hier->hier[hier->hi[1]+2].x[1],
-    hier->hier[hier->hi[1]+2].x[2],
-    hier->hier[hier->hi[1]+1].v[0] - hier->hier[hier->hi[1]+0].v[0], 
-    hier->hier[hier->hi[1]+1].v[1] - hier->hier[hier->hi[1]+0].v[1],
-    hier->hier[hier->hi[1]+1].v[2] - hier->hier[hier->hi[1]+0].v[2],
-    hier->hier[hier->hi[1]+1].v[0],
-    hier->hier[hier->hi[1]+1].v[1],
-    hier->hier[hier->hi[1]+1].v[2]
-    );
-
-  /* do final classification */
-  retval.retval = fb_classify(hier, *t, input.tidaltol, input.speedtol, units, input);
-  retval.iclassify++;
+  fb_traj_output(chan[FB_CHAN_TRAJ], input.traj, FB_TRAJ_FINAL, hier, *t);
+  if (evtraj == &eventtraj) {
+    fb_traj_close(&eventtraj);
+  } else if (evtraj != NULL) {
+    fb_traj_hold(evtraj, GSL_POSINF);
+  }
+
+  /* do final classification, unless the integration had to be abandoned */
+  if (err) {
+    fb_dprintf("fewbody: abandoning integration: %s\n", fb_strerror(err));
+    fb_log_printf(&storylog, "  error:  t=%.6g  %s\n", *t, fb_strerror(err));
+    retval.retval = err;
+  } else {
+    retval.retval = fb_classify(hier, *t, input.tidaltol, input.speedtol, units, input);
+    retval.iclassify++;
+    fb_track_extrema(hier, &retval);
+  }
   fb_dprintf("fewbody: current status:  t=%.6g  %s  (%s)\n",
        *t, fb_sprint_hier(*hier, string1),
        fb_sprint_hier_hr(*hier, string2));
-  snprintf(&(logentry[strlen(logentry)]), FB_MAX_LOGENTRY_LENGTH-strlen(logentry),
-     "  current status:  t=%.6g  %s  (%s)\n", *t, fb_sprint_hier(*hier, string1),
-     fb_sprint_hier_hr(*hier, string2));
+  fb_log_printf(&storylog, "  current status:  t=%.6g  %s  (%s)\n", *t, fb_sprint_hier(*hier, string1),
+                fb_sprint_hier_hr(*hier, string2));
+  /* the final classification leaves the stars where they are */
+  if (!fresh) {
+    fb_conserved(hier, &E, L);
+  }
+  if (input.telem != NULL) {
+    telem.active = 0;
+    telem.hier = fb_telem_hash(string1);
+    fb_publish_status(input.telem, &telem, *t, h, E, Ei, &retval);
+  }
   
   /* print final story */
-  if (input.Dflag == 1) {
-    fb_print_story(&(hier->hier[hier->hi[1]]), hier->nstar, *t, logentry);
+  if (story) {
+    if (input.traj != NULL && input.traj->text) {
+      fb_traj_flush(input.traj);
+    }
+    fb_print_story(chan[FB_CHAN_STORY], &(hier->hier[hier->hi[1]]), hier->nstar, *t, E, L, &storylog);
   }
   
   fb_dprintf("fewbody: final: phier.nobj = %d\n", phier.nobj);
 
-  E = fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) + 
-    fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar);
-  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, L);
-  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
   for (i=0; i<3; i++) {
-    L[i] += Lint[i];
     DeltaL[i] = L[i] - Li[i];
   }
 
@@ -602,6 +814,7 @@ fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t,
   /* free our own stuff */
   fb_free_vector(y);
   fb_free_hier(phier);
+  fb_log_free(&storylog);
 
   if (input.ks) {
     fb_free_ks_params(ks_params);
@@ -22,6 +22,8 @@
 #define _FEWBODY_H 1
 
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <gsl/gsl_nan.h>
 #include <gsl/gsl_rng.h>
 
@@ -52,6 +54,41 @@
 #define FB_ROOTSOLVER_REL_ACC 1.0e-11
 #define FB_MAX_STRING_LENGTH 2048
 #define FB_MAX_LOGENTRY_LENGTH (32 * FB_MAX_STRING_LENGTH)
+#define FB_LOG_LENGTH 4096 /* initial size of the log of a story */
+
+/* the output channels of fewbody(), each of which can be sent to its own sink (see
+   fewbody_sink.c) */
+#define FB_CHAN_TRAJ 0 /* the trajectory records: every outfreq steps, at mergers and at the end */
+#define FB_CHAN_EVENTS 1 /* the event records (see fb_traj_events()) */
+#define FB_CHAN_STORY 2 /* the Starlab stories */
+#define FB_CHAN_SUMMARY 3 /* the summary records of the driver (fewbody() writes none) */
+#define FB_CHAN_DEBUG 4 /* the elements of a lone binary at every step, when starting with one */
+#define FB_NCHAN 5
+
+/* the kinds of sink */
+#define FB_SINK_DISCARD 0 /* nothing is written, nor formatted */
+#define FB_SINK_FILE 1 /* a file, stdout or an inherited descriptor */
+#define FB_SINK_RING 2 /* only the last bytes are kept in memory, and written out at the end */
+
+/* number of three-body systems the lockstep integrator (fewbody_simd.c) advances together;
+   its loops over the systems are what the compiler vectorizes, so this should be a multiple
+   of the number of doubles in a vector register */
+#ifndef FB_SIMD_WIDTH
+#define FB_SIMD_WIDTH 4
+#endif
+
+/* status codes returned by the core routines; the errors are negative so that they can be
+   told apart from the 0/1 result of fb_classify(), and fewbody() passes them on in
+   fb_ret_t.retval when it has to abandon an integration.  Drivers that run many systems in
+   one process should also call gsl_set_error_handler_off(), since the default GSL handler
+   aborts. */
+#define FB_OK 0
+#define FB_E_UNBOUND -1 /* fb_upsync(): a pair that should be bound has E >= 0 */
+#define FB_E_KEPLER -2 /* fb_kepler(): the root finder did not converge */
+#define FB_E_MERGE -3 /* fb_merge(): one of the objects is not a single star */
+#define FB_E_PARAMS -4 /* fb_init_*_params(): the parameters do not match the hierarchy */
+#define FB_E_GSL -5 /* the GSL integrator failed */
+#define FB_E_CHECKPOINT -6 /* a checkpoint could not be written, or read back */
 
 /* a struct containing the units used */
 typedef struct{
@@ -92,6 +129,7 @@ typedef struct{
   double **amat; /* amat[nstar][kstar] */
   double **Tmat; /* Tmat[kstar][kstar] */
   double Einit; /* initial energy used in integration scheme */
+  long nfunc; /* calls to fb_ks_func() since fewbody() last counted them */
 } fb_ks_params_t;
 
 /* parameters for the non-regularized integrator */
@@ -104,6 +142,7 @@ typedef struct{
   int PN3;
   int PN35;
   fb_units_t units;
+  long nfunc; /* calls to fb_nonks_func() since fewbody() last counted them */
 } fb_nonks_params_t;
 
 /* JMA 8-16-2012 -- Knowledge about the PN terms we are interested in is
@@ -130,11 +169,34 @@ typedef struct{
   fb_obj_t **obj; /* array of pointers to top nodes of binary trees */
 } fb_hier_t;
 
+/* the log of a story: a buffer that grows as entries are appended, up to
+   FB_MAX_LOGENTRY_LENGTH, after which the entries that do not fit are left out and counted */
+typedef struct{
+  char *buf; /* the log, NUL-terminated */
+  size_t len; /* strlen(buf) */
+  size_t size; /* bytes allocated for buf */
+  long ndrop; /* entries left out since the log was last printed */
+} fb_log_t;
+
+/* where a channel goes */
+typedef struct fb_sink{
+  int kind; /* FB_SINK_DISCARD, FB_SINK_FILE or FB_SINK_RING */
+  char name[FB_MAX_STRING_LENGTH]; /* the spec the sink was opened with, for messages */
+  FILE *stream; /* what the channel is written to, or NULL to discard it */
+  int owned; /* 1 if stream is to be closed with the sink */
+  char *ring; /* the last size bytes written to a ring */
+  size_t size;
+  size_t head; /* where the next byte goes in ring */
+  size_t len; /* bytes held in ring, up to size */
+  long nbyte; /* bytes written in all */
+  FILE *dump; /* where the ring is written out when the sink is closed */
+} fb_sink_t;
+
 /* input parameters */
 typedef struct{
   int ks; /* 0=no regularization, 1=K-S regularization */
   double tstop; /* stopping time, in units of t_dyn */
-  int Dflag; /* 0=don't print to stdout, 1=print to stdout */
+  int Dflag; /* 0=don't print stories to out, 1=print stories to out */
   double dt; /* time interval between printouts will always be greater than this value */
   double tcpustop; /* cpu stopping time, in units of seconds */
   double absacc; /* absolute accuracy of the integrator */
@@ -150,14 +212,33 @@ typedef struct{
   int PN25;
   int PN3;
   int PN35;
+  FILE *out; /* stream for the output channels that have no sink of their own (usually stdout) */
+  char *checkpoint; /* file to write checkpoints to, or NULL for none */
+  double checkpointdt; /* cpu time between checkpoints, in units of seconds */
+  struct fb_checkpoint *resume; /* checkpoint to carry on from, or NULL to start afresh */
+  int tstopexact; /* 1 to end exactly at tstop instead of at the end of the step that passes it
+                     (non-K-S only), as a time-sliced integration needs */
+  struct fb_traj *traj; /* binary trajectory writer, or NULL for text lines on out */
+  int events; /* 1 to write event records: extrema of the inner e and the mutual inclination,
+                 and changes of classification (see fb_traj_events()) */
+  int eventperi; /* 1 to add a record at every pericentre of the inner binary */
+  double eventetol; /* how far e has to turn back from an extremum for it to count */
+  double eventitol; /* the same for the mutual inclination, in degrees */
+  struct fb_telem *telem; /* live status block to update, or NULL for none (see fewbody_telem.c) */
+  int telemfreq; /* number of integration steps between updates of telem */
+  fb_sink_t *sink[FB_NCHAN]; /* where each channel goes, or NULL for out (for the events, NULL
+                                for wherever the trajectory goes, and with it in order of time) */
 } fb_input_t;
 
 /* return parameters */
 typedef struct{
   long count; /* number of integration steps */
-  int retval; /* return value */
+  int retval; /* return value: 1 if the encounter is complete, 0 if not, or a negative FB_E_* error */
   long iclassify; /* number of times classify was called */
+  long nrhs; /* number of evaluations of the equations of motion */
   double tcpu; /* cpu time taken */
+  double tclassify; /* the part of tcpu spent in fb_classify() */
+  double toutput; /* the part of tcpu spent writing trajectory and event records */
   double DeltaE; /* change in energy */
   double DeltaEfrac; /* change in energy, as a fraction of initial energy */
   double DeltaL; /* change in ang. mom. */
@@ -166,10 +247,282 @@ typedef struct{
   int Rmin_i; /* index of star i participating in minimum close approach */
   int Rmin_j; /* index of star j participating in minimum close approach */
   int Nosc; /* number of oscillations of the quantity s^2 (McMillan & Hut 1996) (Nosc=Nmin-1, so resonance if Nosc>=1) */
+  double emax; /* largest inner eccentricity of the bound triple at the calls of fb_classify() */
 } fb_ret_t;
 
+/* the state fewbody() carries from one integration step to the next; together with the
+   hierarchies, the integrator masses, y and the rng it is all that is needed to carry on
+   with an integration exactly where it left off (the rk8pd stepper keeps nothing between
+   steps apart from the step size h) */
+typedef struct{
+  int ks; /* the regularization the integration was started with */
+  int ydim; /* length of y */
+  double t; /* time */
+  double s; /* integration variable (t, or the KS fictitious time) */
+  double h; /* next step size */
+  double tout; /* time of the next story printout */
+  double texpand; /* time of the last expansion of the perturbation tree */
+  double Ei; /* initial energy */
+  double Li[3]; /* initial angular momentum */
+  double s2prev; /* s^2 oscillation tracking */
+  double s2prevprev;
+  double s2minprev;
+  double s2max;
+  double s2min;
+  double Einit; /* KS energy constant */
+  fb_ret_t retval; /* counters accumulated so far */
+} fb_state_t;
+
+/* a checkpoint of a running integration */
+typedef struct fb_checkpoint{
+  fb_input_t input; /* the input the integration was started with */
+  fb_units_t units;
+  fb_state_t state;
+  int nint; /* number of bodies seen by the integrator */
+  double *mint; /* their masses */
+  double *y; /* the integrator's state vector */
+  fb_hier_t hier; /* the hierarchy */
+  fb_hier_t phier; /* the perturbation hierarchy */
+  char *logentry; /* the log so far */
+} fb_checkpoint_t;
+
+/* the binary trajectory format of fewbody_traj.c: a fb_traj_header_t, then blocks of up to
+   nrowmax records, each a fb_traj_block_t followed by the FB_TRAJ_NCOL columns of the block
+   one after the other, nrowmax float64 each of which the first nrow are records.  The columns
+   are those of the text lines, in N-body units, preceded by the kind of record.  The numbers
+   are in the byte order of the writer; the header's "one" is 1.0, so a reader can tell.
+
+   Every block takes the same space, so block b is at a fixed offset and the blocks' times
+   index the file: a reader that maps it finds any t by bisection, and reads the columns in
+   place.  A block is written with its magic blank, which is filled in once the rest of the
+   block is on disk, so a reader of a file still being written stops at the first block
+   without its magic.
+
+   A compressed trajectory (eps > 0) has the columns of a block coded instead: each value is
+   predicted by extrapolating the last three decoded values of its column with a quadratic,
+   and the residual, rounded to a multiple of 2 eps, is coded as a zig-zag LEB128 varint, plus
+   one so that 0 can mean an 8-byte float64 follows (for a value the rounding would take more
+   than eps from, such as a NaN).  Every value decodes to within eps, except the kind, which
+   is coded exactly.  The blocks then differ in size, and can only be read in turn. */
+#define FB_TRAJ_MAGIC "FBTRAJ3"
+#define FB_TRAJ_BLOCK_MAGIC "BLK"
+#define FB_TRAJ_NCOL 29
+#define FB_TRAJ_NROW 1024 /* records per block */
+#define FB_TRAJ_NAMELEN 16
+#define FB_TRAJ_NSLOT 4096 /* default records in the ring of the writer thread */
+#define FB_TRAJ_LINELEN 1024 /* longest text line */
+#define FB_TRAJ_NPEND 4096 /* most records held back to keep them in order of time */
+#define FB_TRAJ_MAXCODE 9 /* most bytes a compressed value takes */
+
+/* kinds of trajectory record (column 0) */
+#define FB_TRAJ_STEP 0 /* every outfreq steps */
+#define FB_TRAJ_FINAL 1 /* at the end of the integration */
+#define FB_TRAJ_MERGER 2 /* just before two stars merge; the text line has fewer columns */
+#define FB_TRAJ_PERI 3 /* pericentre of the inner binary; this and the rest are events, whose */
+#define FB_TRAJ_EMAX 4 /* text lines start with the name of the kind */
+#define FB_TRAJ_EMIN 5
+#define FB_TRAJ_IMAX 6 /* extrema of the mutual inclination */
+#define FB_TRAJ_IMIN 7
+#define FB_TRAJ_CLASSIFY 8 /* fb_classify() has changed its mind about the hierarchy */
+#define FB_TRAJ_NKIND 9
+
+typedef struct{
+  char magic[8]; /* FB_TRAJ_MAGIC */
+  char version[16]; /* FB_VERSION of the writer */
+  int32_t ncol; /* FB_TRAJ_NCOL */
+  int32_t nrowmax; /* most records in a block */
+  double one; /* 1.0 */
+  double eps; /* error bound of the compressed columns, or 0 for float64 columns */
+  fb_units_t units; /* units of the integration, in cgs */
+  double tstop; /* run parameters, as in fb_input_t */
+  double dt;
+  double tcpustop;
+  double absacc;
+  double relacc;
+  double tidaltol;
+  double speedtol;
+  double fexp;
+  int32_t ks;
+  int32_t ncount;
+  int32_t outfreq;
+  int32_t PN1;
+  int32_t PN2;
+  int32_t PN25;
+  int32_t PN3;
+  int32_t PN35;
+  char name[FB_TRAJ_NCOL][FB_TRAJ_NAMELEN]; /* column names */
+} fb_traj_header_t;
+
+typedef struct{
+  char magic[4]; /* FB_TRAJ_BLOCK_MAGIC */
+  int32_t nrow; /* number of records */
+  double tmin; /* first and last time in the block */
+  double tmax;
+  int64_t nbyte; /* bytes of columns that follow */
+} fb_traj_block_t;
+
+/* a trajectory writer; the records of a block are collected column by column in col, and
+   the block is written out when it is full.  After fb_traj_start() the integrator only copies
+   each record into the ring, and a writer thread formats and writes them, half a ring at a
+   time; the writer owns the stream until fb_traj_flush() or fb_traj_close(). */
+typedef struct fb_traj{
+  FILE *stream;
+  int text; /* write text lines instead of blocks */
+  double *col; /* FB_TRAJ_NCOL columns of FB_TRAJ_NROW */
+  int nrow; /* records in col */
+  long nrecord; /* records written so far */
+  long nblock; /* blocks written so far */
+  int err; /* set once a write has failed */
+  int async; /* records go through the ring to the writer thread */
+  int nslot; /* records the ring holds */
+  double *ring; /* nslot records of FB_TRAJ_NCOL */
+  char *buf; /* text the writer thread has formatted but not yet written */
+  long head; /* records put in the ring so far */
+  long tail; /* records taken out of the ring so far */
+  int flushreq; /* the writer should empty the ring now */
+  int done; /* the writer should empty the ring and exit */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t nonempty; /* signalled when the ring is half full, or on flushing or closing */
+  pthread_cond_t nonfull; /* signalled when the writer has taken records out of the ring */
+  long nbatch; /* batches the writer has taken out of the ring */
+  long nstall; /* times the integrator found the ring full and had to wait */
+  double tstall; /* wall-clock time the integrator spent waiting, in seconds */
+  long maxfill; /* most records in the ring at once */
+  int seekable; /* the stream can seek, so blocks can be marked written after the fact */
+  double *pend; /* records held back in order of time, or NULL (see fb_traj_sort()) */
+  int npend;
+  double hold; /* records after this time are held back */
+  double eps; /* error bound of the compression, or 0 for none */
+  unsigned char *code; /* the block being compressed */
+  long nbyteraw; /* bytes of the blocks before and after compression */
+  long nbytecode;
+} fb_traj_t;
+
+/* the state of the event detection of fb_traj_events(): the extrema are found by following
+   each quantity up (dir=1) or down (dir=-1) and taking the most extreme record so far once the
+   quantity has turned back by more than the tolerance */
+typedef struct{
+  int peri; /* eventperi, eventetol and eventitol of fb_input_t */
+  double etol;
+  double itol;
+  long nstep; /* steps seen */
+  double r; /* separation of the inner binary at the last step, and the step before */
+  double rprev;
+  double row[FB_TRAJ_NCOL]; /* record of the last step */
+  int edir; /* direction of e and of the inclination, or 0 until they have moved */
+  int idir;
+  double eext; /* most extreme e and inclination so far in that direction, and their records */
+  double iext;
+  double erow[FB_TRAJ_NCOL];
+  double irow[FB_TRAJ_NCOL];
+  char hier[FB_MAX_STRING_LENGTH]; /* last classification */
+  long nevent; /* event records so far */
+} fb_traj_events_t;
+
+/* a binary trajectory mapped into memory for reading, perhaps while it is being written */
+typedef struct{
+  int fd;
+  char *map; /* the file, as mapped */
+  size_t size; /* bytes mapped */
+  fb_traj_header_t *head; /* the header, at the start of map */
+  size_t blocksize; /* bytes in a block */
+  long nblock; /* blocks that are complete */
+} fb_traj_map_t;
+
+/* The live status of running integrations goes to a POSIX shared-memory segment, so that a
+   monitor (fbmon) can watch them without disturbing them.  The segment is a header followed by
+   nslot blocks, one for each integration that can run at once, and fewbody() updates its
+   block every telemfreq steps and at the end.  A block is written under a sequence lock: seq
+   is odd while the block is being written, so a reader copies the block until seq is even
+   and unchanged across the copy. */
+#define FB_TELEM_MAGIC "FBTELEM"
+#define FB_TELEM_PREFIX "/fewbody." /* the segment of a process is named by this and its pid */
+#define FB_TELEM_NTRY 1000 /* most copies a reader tries before giving up on a block */
+
+typedef struct{
+  char magic[8]; /* FB_TELEM_MAGIC */
+  char version[8]; /* FB_VERSION */
+  int pid; /* the process that created the segment */
+  int nslot; /* blocks that follow the header */
+  int size; /* sizeof(fb_telem_t), as a check */
+  int pad;
+} fb_telem_header_t;
+
+/* what fewbody() publishes */
+typedef struct{
+  int active; /* 1 while the integration is running, 0 once it has ended */
+  int pad;
+  double t; /* time, in units of t_dyn */
+  double tstop;
+  long count; /* integration steps */
+  double h; /* current step size of the integrator */
+  double dE; /* E/E0-1 at the last update */
+  unsigned long hier; /* hash of fb_sprint_hier() at the last classification */
+  long iclassify; /* calls to fb_classify() */
+  long nrestart; /* restarts of the integrator */
+  double tcpu; /* cpu time of the integration, in seconds */
+  double twall; /* time of the update on the monotonic clock, in seconds */
+} fb_telem_status_t;
+
+typedef struct fb_telem{
+  volatile unsigned long seq; /* odd while the block is being written */
+  long id; /* the job the block is about, as set by the driver */
+  fb_telem_status_t status;
+} fb_telem_t;
+
+/* a telemetry segment, as mapped */
+typedef struct{
+  char name[FB_MAX_STRING_LENGTH];
+  size_t size; /* bytes mapped */
+  fb_telem_header_t *head;
+  fb_telem_t *slot; /* the blocks, after the header */
+  int owner; /* 1 if this process created the segment, and removes it when done */
+} fb_telem_seg_t;
+
+/* the state of a lane of the lockstep integrator */
+#define FB_SIMD_EMPTY 0 /* no system loaded */
+#define FB_SIMD_RUNNING 1 /* being integrated */
+#define FB_SIMD_CLASSIFY 2 /* due for a call to fb_classify(), after ncount steps */
+#define FB_SIMD_COLLISION 3 /* two stars touch, and fb_collide() should merge them */
+#define FB_SIMD_TSTOP 4 /* reached tstop */
+#define FB_SIMD_TCPUSTOP 5 /* used up its share of tcpustop */
+#define FB_SIMD_GSL 6 /* the step size underflowed, as when the state is not finite */
+
+/* FB_SIMD_WIDTH three-body systems integrated in lockstep with the non-regularized equations
+   of motion, each with its own masses, units and step size.  The per-system arrays are
+   indexed [...][lane], so that the same operation on all the lanes is contiguous. */
+typedef struct{
+  double absacc; /* integration parameters, the same for all the lanes */
+  double relacc;
+  double tstop;
+  double tcpustop;
+  int ncount;
+  int tstopexact;
+  int PN1, PN2, PN25, PN3, PN35;
+  double y[18][FB_SIMD_WIDTH]; /* positions and velocities of the three stars */
+  double f[18][FB_SIMD_WIDTH]; /* their derivatives, reused as the first stage of the next step */
+  double m[3][FB_SIMD_WIDTH]; /* masses */
+  double R[3][FB_SIMD_WIDTH]; /* radii */
+  double clight[FB_SIMD_WIDTH]; /* speed of light, in the units of the system */
+  double t[FB_SIMD_WIDTH]; /* time */
+  double h[FB_SIMD_WIDTH]; /* next step size */
+  int status[FB_SIMD_WIDTH]; /* FB_SIMD_* */
+  int fresh[FB_SIMD_WIDTH]; /* 1 if f has not been evaluated for y yet */
+  fb_ret_t retval[FB_SIMD_WIDTH]; /* count, tcpu and Rmin of each system so far */
+  long nstep; /* number of lockstep steps taken */
+  long nlane; /* number of lanes integrated, summed over the steps */
+  long nreject; /* number of those whose step was rejected */
+} fb_simd_t;
+
 /* fewbody.c */
 fb_ret_t fewbody(fb_input_t input, fb_units_t units, fb_hier_t *hier, double *t, gsl_rng *rng);
+void fb_track_extrema(fb_hier_t *hier, fb_ret_t *retval);
+
+/* fewbody_checkpoint.c */
+int fb_write_checkpoint(char *filename, fb_checkpoint_t *chk, gsl_rng *rng);
+int fb_read_checkpoint(char *filename, fb_checkpoint_t *chk, gsl_rng *rng);
+void fb_free_checkpoint(fb_checkpoint_t *chk);
 
 /* fewbody_classify.c */
 int fb_classify(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_units_t units, fb_input_t params);
@@ -181,38 +534,47 @@ int fb_mardling(fb_obj_t *obj, int ib, int is);
 
 /* fewbody_coll.c */
 int fb_is_collision(double r, double R1, double R2);
-int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, double *t);
-void fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_units_t units, gsl_rng *rng);
+int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, double *t, FILE *stream, fb_traj_t *traj);
+int fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_units_t units, gsl_rng *rng);
 double fb_vkick(double m1, double m2);
 
 /* fewbody_hier.c */
 void fb_malloc_hier(fb_hier_t *hier);
 void fb_init_hier(fb_hier_t *hier);
 void fb_free_hier(fb_hier_t hier);
-void fb_trickle(fb_hier_t *hier, double t);
-void fb_elkcirt(fb_hier_t *hier, double t, fb_input_t params, fb_units_t units);
+int fb_trickle(fb_hier_t *hier, double t);
+int fb_elkcirt(fb_hier_t *hier, double t, fb_input_t params, fb_units_t units);
 int fb_create_indices(int *hi, int nstar);
 int fb_n_hier(fb_obj_t *obj);
 char *fb_sprint_hier(fb_hier_t hier, char string[FB_MAX_STRING_LENGTH]);
 char *fb_sprint_hier_hr(fb_hier_t hier, char string[FB_MAX_STRING_LENGTH]);
-void fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units);
+int fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units);
 double fb_incpartition(fb_obj_t *obj[1], double inc);
 void fb_binaryorient(fb_obj_t *obj, gsl_rng *rng, double cosi, double peri, double ascnode);
 void fb_randorient(fb_obj_t *obj, gsl_rng *rng);
-void fb_downsync(fb_obj_t *obj, double t);
+int fb_downsync(fb_obj_t *obj, double t);
 void fb_objcpy(fb_obj_t *obj1, fb_obj_t *obj2);
+void fb_hiercpy(fb_hier_t *hier1, fb_hier_t *hier2);
 
 /* fewbody_int.c */
 void fb_malloc_ks_params(fb_ks_params_t *ks_params);
-void fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier);
+int fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier);
+void fb_restore_ks_params(fb_ks_params_t *ks_params, double *m, double Einit);
 void fb_free_ks_params(fb_ks_params_t ks_params);
 void fb_malloc_nonks_params(fb_nonks_params_t *nonks_params);
-void fb_init_nonks_params(fb_nonks_params_t *nonks_params, fb_hier_t hier);
+int fb_init_nonks_params(fb_nonks_params_t *nonks_params, fb_hier_t hier);
+void fb_restore_nonks_params(fb_nonks_params_t *nonks_params, double *m);
 void fb_free_nonks_params(fb_nonks_params_t nonks_params);
 
 /* fewbody_io.c */
 void fb_print_version(FILE *stream);
-void fb_print_story(fb_obj_t *star, int nstar, double t, char *logentry);
+void fb_log_init(fb_log_t *log, const char *first);
+void fb_log_printf(fb_log_t *log, const char *format, ...);
+void fb_log_clear(fb_log_t *log);
+void fb_log_free(fb_log_t *log);
+int fb_sprint_g9(char *buf, double x);
+void fb_print_story(FILE *stream, fb_obj_t *star, int nstar, double t, double E, double *L, fb_log_t *log);
+const char *fb_strerror(int status);
 
 /* fewbody_isolate.c */
 int fb_collapse(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_units_t units, fb_input_t input);
@@ -236,10 +598,60 @@ int fb_nonks_jac(double t, const double *y, double *dfdy, double *dfdt, void *pa
 void fb_euclidean_to_nonks(fb_obj_t **star, double *y, int nstar);
 void fb_nonks_to_euclidean(double *y, fb_obj_t **star, int nstar);
 
+/* fewbody_simd.c */
+void fb_simd_init(fb_simd_t *simd, fb_input_t input);
+void fb_simd_load(fb_simd_t *simd, int lane, fb_hier_t *hier, fb_units_t units, double t);
+void fb_simd_store(fb_simd_t *simd, int lane, fb_hier_t *hier, double *t);
+void fb_simd_resume(fb_simd_t *simd, int lane);
+void fb_simd_unload(fb_simd_t *simd, int lane);
+int fb_simd_step(fb_simd_t *simd);
+
 /* fewbody_scat.c */
 void fb_init_scattering(fb_obj_t *obj[2], double vinf, double b, double rtid);
 void fb_normalize(fb_hier_t *hier, fb_units_t units);
 
+/* fewbody_telem.c */
+double fb_telem_clock(void);
+unsigned long fb_telem_hash(char *string);
+int fb_telem_create(fb_telem_seg_t *seg, int nslot);
+int fb_telem_attach(fb_telem_seg_t *seg, char *name);
+void fb_telem_close(fb_telem_seg_t *seg);
+void fb_telem_start(fb_telem_t *telem, long id);
+void fb_telem_write(fb_telem_t *telem, fb_telem_status_t *status);
+int fb_telem_read(fb_telem_t *telem, long *id, fb_telem_status_t *status);
+
+/* fewbody_traj.c */
+void fb_traj_row(fb_hier_t *hier, double t, int kind, double row[FB_TRAJ_NCOL]);
+void fb_traj_print_text(FILE *stream, double row[FB_TRAJ_NCOL]);
+int fb_traj_sprint_text(char *buf, double row[FB_TRAJ_NCOL]);
+void fb_traj_emit(FILE *stream, fb_traj_t *traj, double row[FB_TRAJ_NCOL]);
+void fb_traj_output(FILE *stream, fb_traj_t *traj, int kind, fb_hier_t *hier, double t);
+void fb_traj_events_init(fb_traj_events_t *ev, fb_input_t *input);
+void fb_traj_events(FILE *stream, fb_traj_t *traj, fb_traj_events_t *ev, fb_hier_t *hier, double t, int classified);
+int fb_traj_open(fb_traj_t *traj, FILE *stream, fb_units_t units, fb_input_t input, double eps);
+void fb_traj_open_text(fb_traj_t *traj, FILE *stream);
+int fb_traj_start(fb_traj_t *traj, int nslot);
+void fb_traj_sort(fb_traj_t *traj);
+void fb_traj_hold(fb_traj_t *traj, double t);
+void fb_traj_write(fb_traj_t *traj, double row[FB_TRAJ_NCOL]);
+int fb_traj_flush(fb_traj_t *traj);
+int fb_traj_close(fb_traj_t *traj);
+int fb_traj_read_header(FILE *stream, fb_traj_header_t *head);
+int fb_traj_read_block(FILE *stream, fb_traj_header_t *head, fb_traj_block_t *block, double *col);
+int fb_traj_map(fb_traj_map_t *map, char *filename);
+int fb_traj_remap(fb_traj_map_t *map);
+void fb_traj_unmap(fb_traj_map_t *map);
+fb_traj_block_t *fb_traj_map_block(fb_traj_map_t *map, long b);
+double *fb_traj_map_column(fb_traj_map_t *map, long b, int k);
+int fb_traj_map_find(fb_traj_map_t *map, double t, long *b, int *i);
+void fb_traj_map_row(fb_traj_map_t *map, long b, int i, double row[FB_TRAJ_NCOL]);
+
+/* fewbody_sink.c */
+int fb_sink_channel(char *name);
+int fb_sink_open(fb_sink_t *sink, char *spec);
+FILE *fb_sink_stream(fb_sink_t *sink, FILE *out);
+int fb_sink_close(fb_sink_t *sink);
+
 /* fewbody_utils.c */
 inline double *fb_malloc_vector(int n);
 inline double **fb_malloc_matrix(int nr, int nc);
@@ -258,7 +670,7 @@ double fb_petot(fb_obj_t *star, int nstar);
 double fb_ketot(fb_obj_t *star, int nstar);
 double fb_outerpetot(fb_obj_t **obj, int nobj);
 double fb_outerketot(fb_obj_t **obj, int nobj);
-double fb_kepler(double e, double mean_anom);
+int fb_kepler(double e, double mean_anom, double *ecc_anom);
 double fb_keplerfunc(double mean_anom, void *params);
 double fb_reltide(fb_obj_t *bin, fb_obj_t *single, double r);
 
@@ -274,8 +686,9 @@ double fb_reltide(fb_obj_t *bin, fb_obj_t *single, double r);
 #define FB_DELTA(i, j) ((i)==(j)?1:0)
 #define FB_KS_K(i, j, nstar) ((i)*(nstar)-((i)+1)*((i)+2)/2+(j))
 
-/* there is just one global variable */
-extern int fb_debug;
+/* there is just one global variable; it is thread-local so that each thread running
+   fewbody() can turn debugging on or off on its own */
+extern __thread int fb_debug;
 
 /* radiation rocket canonical kick speed */
 #define FB_VKICK 120.0e5
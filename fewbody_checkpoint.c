@@ -0,0 +1,298 @@
+/* -*- linux-c -*- */
+/* fewbody_checkpoint.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <gsl/gsl_errno.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+
+/* Checkpoints are raw dumps of fewbody()'s state, meant to be read back by the same build
+   on the same kind of machine; the header records the version and the sizes of the structs
+   that are dumped whole, so that a checkpoint from an incompatible build is refused rather
+   than misread.  Pointers inside the hierarchies are stored as indices into hier->hier[]. */
+#define FB_CHECKPOINT_MAGIC "FBCHKPT"
+#define FB_CHECKPOINT_FORMAT 1
+
+typedef struct{
+  char magic[8];
+  char version[16];
+  int format;
+  int sizeof_obj; /* sizeof(fb_obj_t) */
+  int sizeof_input; /* sizeof(fb_input_t) */
+  int sizeof_state; /* sizeof(fb_state_t) */
+} fb_checkpoint_header_t;
+
+static void fb_checkpoint_header(fb_checkpoint_header_t *head)
+{
+  memset(head, 0, sizeof(fb_checkpoint_header_t));
+  strncpy(head->magic, FB_CHECKPOINT_MAGIC, sizeof(head->magic));
+  strncpy(head->version, FB_VERSION, sizeof(head->version)-1);
+  head->format = FB_CHECKPOINT_FORMAT;
+  head->sizeof_obj = sizeof(fb_obj_t);
+  head->sizeof_input = sizeof(fb_input_t);
+  head->sizeof_state = sizeof(fb_state_t);
+}
+
+/* index of obj in hier->hier[], or -1 for NULL */
+static int fb_obj_index(fb_hier_t *hier, fb_obj_t *obj)
+{
+  if (obj == NULL) {
+    return(-1);
+  } else {
+    return((int) (obj - hier->hier));
+  }
+}
+
+static void fb_write_hier(FILE *fp, fb_hier_t *hier)
+{
+  int i, idx[2];
+
+  fwrite(&(hier->nstarinit), sizeof(int), 1, fp);
+  fwrite(&(hier->nstar), sizeof(int), 1, fp);
+  fwrite(&(hier->nobj), sizeof(int), 1, fp);
+  if (hier->nstarinit > 1) {
+    fwrite(&(hier->narr[2]), sizeof(int), hier->nstarinit-1, fp);
+  }
+
+  for (i=0; i<hier->hi[hier->nstarinit]+1; i++) {
+    fwrite(&(hier->hier[i]), sizeof(fb_obj_t), 1, fp);
+    fwrite(hier->hier[i].id, sizeof(long), hier->hier[i].ncoll, fp);
+    idx[0] = fb_obj_index(hier, hier->hier[i].obj[0]);
+    idx[1] = fb_obj_index(hier, hier->hier[i].obj[1]);
+    fwrite(idx, sizeof(int), 2, fp);
+  }
+
+  for (i=0; i<hier->nobj; i++) {
+    idx[0] = fb_obj_index(hier, hier->obj[i]);
+    fwrite(idx, sizeof(int), 1, fp);
+  }
+}
+
+/* read a hierarchy written by fb_write_hier(), malloc()ing it */
+static int fb_read_hier(FILE *fp, fb_hier_t *hier)
+{
+  int i, j, n, idx[2];
+  long *id;
+
+  if (fread(&(hier->nstarinit), sizeof(int), 1, fp) != 1 ||
+      fread(&(hier->nstar), sizeof(int), 1, fp) != 1 ||
+      fread(&(hier->nobj), sizeof(int), 1, fp) != 1) {
+    return(FB_E_CHECKPOINT);
+  }
+  if (hier->nstarinit < 1 || hier->nstar < 1 || hier->nstar > hier->nstarinit ||
+      hier->nobj < 1 || hier->nobj > hier->nstar) {
+    return(FB_E_CHECKPOINT);
+  }
+
+  fb_malloc_hier(hier);
+  if (hier->nstarinit > 1 &&
+      fread(&(hier->narr[2]), sizeof(int), hier->nstarinit-1, fp) != hier->nstarinit-1) {
+    return(FB_E_CHECKPOINT);
+  }
+
+  n = hier->hi[hier->nstarinit] + 1;
+  for (i=0; i<n; i++) {
+    id = hier->hier[i].id;
+    if (fread(&(hier->hier[i]), sizeof(fb_obj_t), 1, fp) != 1) {
+      hier->hier[i].id = id;
+      return(FB_E_CHECKPOINT);
+    }
+    hier->hier[i].id = id;
+    if (hier->hier[i].ncoll < 0 || hier->hier[i].ncoll > hier->nstarinit) {
+      hier->hier[i].ncoll = 0;
+      return(FB_E_CHECKPOINT);
+    }
+    if (fread(id, sizeof(long), hier->hier[i].ncoll, fp) != hier->hier[i].ncoll ||
+        fread(idx, sizeof(int), 2, fp) != 2) {
+      return(FB_E_CHECKPOINT);
+    }
+    for (j=0; j<2; j++) {
+      if (idx[j] < -1 || idx[j] >= n) {
+        return(FB_E_CHECKPOINT);
+      }
+      hier->hier[i].obj[j] = (idx[j] == -1 ? NULL : &(hier->hier[idx[j]]));
+    }
+  }
+
+  for (i=0; i<hier->nobj; i++) {
+    if (fread(idx, sizeof(int), 1, fp) != 1 || idx[0] < 0 || idx[0] >= n) {
+      return(FB_E_CHECKPOINT);
+    }
+    hier->obj[i] = &(hier->hier[idx[0]]);
+  }
+
+  return(FB_OK);
+}
+
+/* write a checkpoint; it goes to a temporary file first, which is renamed over filename
+   only once it is complete, so a crash while writing leaves the previous checkpoint intact */
+int fb_write_checkpoint(char *filename, fb_checkpoint_t *chk, gsl_rng *rng)
+{
+  int len, ok;
+  char tmpname[FB_MAX_STRING_LENGTH];
+  const char *rngname;
+  fb_checkpoint_header_t head;
+  FILE *fp;
+
+  snprintf(tmpname, FB_MAX_STRING_LENGTH, "%s.tmp", filename);
+  if ((fp = fopen(tmpname, "wb")) == NULL) {
+    return(FB_E_CHECKPOINT);
+  }
+
+  fb_checkpoint_header(&head);
+  fwrite(&head, sizeof(fb_checkpoint_header_t), 1, fp);
+  fwrite(&(chk->input), sizeof(fb_input_t), 1, fp);
+  fwrite(&(chk->units), sizeof(fb_units_t), 1, fp);
+  fwrite(&(chk->state), sizeof(fb_state_t), 1, fp);
+  fwrite(&(chk->nint), sizeof(int), 1, fp);
+  fwrite(chk->mint, sizeof(double), chk->nint, fp);
+  fwrite(chk->y, sizeof(double), chk->state.ydim, fp);
+  fb_write_hier(fp, &(chk->hier));
+  fb_write_hier(fp, &(chk->phier));
+
+  len = strlen(chk->logentry);
+  fwrite(&len, sizeof(int), 1, fp);
+  fwrite(chk->logentry, sizeof(char), len, fp);
+
+  rngname = gsl_rng_name(rng);
+  len = strlen(rngname);
+  fwrite(&len, sizeof(int), 1, fp);
+  fwrite(rngname, sizeof(char), len, fp);
+  gsl_rng_fwrite(fp, rng);
+
+  ok = (fflush(fp) == 0 && !ferror(fp) && fsync(fileno(fp)) == 0);
+  ok = (fclose(fp) == 0 && ok);
+  if (!ok || rename(tmpname, filename) != 0) {
+    remove(tmpname);
+    return(FB_E_CHECKPOINT);
+  }
+
+  return(FB_OK);
+}
+
+/* read a checkpoint written by fb_write_checkpoint(), malloc()ing everything in chk and
+   restoring the state of rng, which must be of the same type as the one checkpointed;
+   on error chk holds nothing that needs freeing */
+int fb_read_checkpoint(char *filename, fb_checkpoint_t *chk, gsl_rng *rng)
+{
+  int len;
+  char rngname[FB_MAX_STRING_LENGTH];
+  fb_checkpoint_header_t head, filehead;
+  FILE *fp;
+
+  if ((fp = fopen(filename, "rb")) == NULL) {
+    return(FB_E_CHECKPOINT);
+  }
+
+  /* refuse checkpoints from other builds */
+  fb_checkpoint_header(&head);
+  if (fread(&filehead, sizeof(fb_checkpoint_header_t), 1, fp) != 1 ||
+      memcmp(&head, &filehead, sizeof(fb_checkpoint_header_t)) != 0) {
+    fb_dprintf("fb_read_checkpoint(): %s is not a checkpoint from this build\n", filename);
+    fclose(fp);
+    return(FB_E_CHECKPOINT);
+  }
+
+  memset(chk, 0, sizeof(fb_checkpoint_t));
+  if (fread(&(chk->input), sizeof(fb_input_t), 1, fp) != 1 ||
+      fread(&(chk->units), sizeof(fb_units_t), 1, fp) != 1 ||
+      fread(&(chk->state), sizeof(fb_state_t), 1, fp) != 1 ||
+      fread(&(chk->nint), sizeof(int), 1, fp) != 1) {
+    goto fail;
+  }
+
+  /* the pointers belonged to the process that wrote the checkpoint */
+  chk->input.out = NULL;
+  chk->input.checkpoint = NULL;
+  chk->input.resume = NULL;
+  chk->input.traj = NULL;
+  chk->input.telem = NULL;
+  memset(chk->input.sink, 0, sizeof(chk->input.sink));
+
+  if (chk->nint < 1 || chk->state.ydim < 1) {
+    goto fail;
+  }
+  chk->mint = fb_malloc_vector(chk->nint);
+  chk->y = fb_malloc_vector(chk->state.ydim);
+  if (fread(chk->mint, sizeof(double), chk->nint, fp) != chk->nint ||
+      fread(chk->y, sizeof(double), chk->state.ydim, fp) != chk->state.ydim) {
+    goto fail;
+  }
+
+  if (fb_read_hier(fp, &(chk->hier)) != FB_OK) {
+    goto fail;
+  }
+  if (fb_read_hier(fp, &(chk->phier)) != FB_OK || chk->nint > chk->phier.nstarinit) {
+    goto fail;
+  }
+
+  chk->logentry = (char *) malloc(FB_MAX_LOGENTRY_LENGTH * sizeof(char));
+  if (fread(&len, sizeof(int), 1, fp) != 1 || len < 0 || len >= FB_MAX_LOGENTRY_LENGTH ||
+      fread(chk->logentry, sizeof(char), len, fp) != len) {
+    goto fail;
+  }
+  chk->logentry[len] = '\0';
+
+  if (fread(&len, sizeof(int), 1, fp) != 1 || len < 0 || len >= FB_MAX_STRING_LENGTH ||
+      fread(rngname, sizeof(char), len, fp) != len) {
+    goto fail;
+  }
+  rngname[len] = '\0';
+  if (strcmp(rngname, gsl_rng_name(rng)) != 0) {
+    fb_dprintf("fb_read_checkpoint(): checkpoint has a %s rng, not %s\n", rngname, gsl_rng_name(rng));
+    goto fail;
+  }
+  if (gsl_rng_fread(fp, rng) != GSL_SUCCESS) {
+    goto fail;
+  }
+
+  fclose(fp);
+  return(FB_OK);
+
+ fail:
+  fclose(fp);
+  fb_free_checkpoint(chk);
+  return(FB_E_CHECKPOINT);
+}
+
+/* free what fb_read_checkpoint() malloc()ed */
+void fb_free_checkpoint(fb_checkpoint_t *chk)
+{
+  if (chk->mint != NULL) {
+    fb_free_vector(chk->mint);
+  }
+  if (chk->y != NULL) {
+    fb_free_vector(chk->y);
+  }
+  if (chk->hier.hier != NULL) {
+    fb_free_hier(chk->hier);
+  }
+  if (chk->phier.hier != NULL) {
+    fb_free_hier(chk->phier);
+  }
+  if (chk->logentry != NULL) {
+    free(chk->logentry);
+  }
+  memset(chk, 0, sizeof(fb_checkpoint_t));
+}
@@ -24,10 +24,11 @@
 #include <math.h>
 #include "fewbody.h"
 
-/* classify the stars into hierarchies; i.e., build the binary tree */
+/* classify the stars into hierarchies; i.e., build the binary tree; returns 1 if the system
+   is done, 0 if not, or a negative FB_E_* error */
 int fb_classify(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_units_t units, fb_input_t params)
 {
-  int i, j, k, n, isave[2], cont=1;
+  int i, j, k, n, isave[2], cont=1, status;
   double a, amin, E, xrel[3], v0[3], v1[3], vcm[3], vrel[3], ftid;
 
   /* initialize to flat hier */
@@ -88,7 +89,9 @@ int fb_classify(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_
       hier->hier[hier->hi[n]+hier->narr[n]].obj[0] = hier->obj[isave[0]];
       hier->hier[hier->hi[n]+hier->narr[n]].obj[1] = hier->obj[isave[1]];
       fb_dprintf("before upsync: %g %g\n", hier->hier[hier->hi[3]].x[0], hier->hier[hier->hi[2]].x[0]);
-      fb_upsync(&(hier->hier[hier->hi[n]+hier->narr[n]]), t, params, units);
+      if ((status = fb_upsync(&(hier->hier[hier->hi[n]+hier->narr[n]]), t, params, units)) != FB_OK) {
+        return(status);
+      }
       fb_dprintf("after upsync: %g %g\n", hier->hier[hier->hi[3]].x[0], hier->hier[hier->hi[2]].x[0]);
       hier->obj[isave[0]] = &(hier->hier[hier->hi[n]+hier->narr[n]]);
       hier->narr[n]++;
@@ -47,9 +47,11 @@ int fb_is_collision(double r, double R1, double R2) {
   }
 }
 
-int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, double *t)
+/* merge the stars that touch; returns 1 if there was a collision, 0 if not, or a negative
+   FB_E_* error if a merger failed */
+int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, double *t, FILE *stream, fb_traj_t *traj)
 {
-  int i, j=-1, k, retval=0, cont=1, sma_cont=1;
+  int i, j=-1, k, status, retval=0, cont=1, sma_cont=1;
   double R[3], peinit;
 
   /* this is a non-recursive way to perform a recursive operation: keep going until there are no more
@@ -69,24 +71,7 @@ int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, do
           /* JMA 11-12-2012 -- Print the state of the system right before
            * merger.
            */
-          fprintf(stdout, "%.12f %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g %g\n", *t,
-            hier->hier[hier->hi[2]+0].a, hier->hier[hier->hi[2]+0].e,
-            hier->hier[hier->hi[3]+0].a, hier->hier[hier->hi[3]+0].e,
-            fb_dot(hier->hier[hier->hi[2]+0].Lhat, hier->hier[hier->hi[2]+1].Lhat),
-            acos(fb_dot(hier->hier[hier->hi[2]+0].Ahat, hier->hier[hier->hi[2]+1].Ahat)) * 180 / FB_CONST_PI,
-            hier->hier[hier->hi[2]+0].Lhat[0],
-            hier->hier[hier->hi[2]+0].Lhat[1],
-            hier->hier[hier->hi[2]+0].Lhat[2],
-            hier->hier[hier->hi[1]+1].x[0] - hier->hier[hier->hi[1]+0].x[0], 
-            hier->hier[hier->hi[1]+1].x[1] - hier->hier[hier->hi[1]+0].x[1],
-            hier->hier[hier->hi[1]+1].x[2] - hier->hier[hier->hi[1]+0].x[2],
-            hier->hier[hier->hi[1]+2].x[0],
-            hier->hier[hier->hi[1]+2].x[1],
-            hier->hier[hier->hi[1]+2].x[2],
-            hier->hier[hier->hi[1]+1].v[0] - hier->hier[hier->hi[1]+0].v[0], 
-            hier->hier[hier->hi[1]+1].v[1] - hier->hier[hier->hi[1]+0].v[1],
-            hier->hier[hier->hi[1]+1].v[2] - hier->hier[hier->hi[1]+0].v[2]
-            );
+          fb_traj_output(stream, traj, FB_TRAJ_MERGER, hier, *t);
 
           cont = 1;
           /* break out of the double loop if there is a collision, so we can merge
@@ -112,7 +97,9 @@ int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, do
       
       /* do the actual merger */
       fb_dprintf("fewbody: collide(): merging stars: i=%d j=%d\n", i, j);
-      fb_merge(&(hier->hier[hier->hi[1]+i]), &(hier->hier[hier->hi[1]+j]), hier->nstarinit, f_exp, units, rng);
+      if ((status = fb_merge(&(hier->hier[hier->hi[1]+i]), &(hier->hier[hier->hi[1]+j]), hier->nstarinit, f_exp, units, rng)) != FB_OK) {
+        return(status);
+      }
       fb_objcpy(&(hier->hier[hier->hi[1]+j]), &(hier->hier[hier->hi[1]+hier->nstar-1]));
       hier->nstar--;
 
@@ -173,7 +160,9 @@ int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, do
       
       /* do the actual merger */
       //fb_dprintf("fewbody: collide(): merging stars: i=%d j=%d\n", i, j);
-      fb_merge(&(hier->hier[hier->hi[1]+0]), &(hier->hier[hier->hi[1]+1]), hier->nstarinit, f_exp, units, rng);
+      if ((status = fb_merge(&(hier->hier[hier->hi[1]+0]), &(hier->hier[hier->hi[1]+1]), hier->nstarinit, f_exp, units, rng)) != FB_OK) {
+        return(status);
+      }
       fb_objcpy(&(hier->hier[hier->hi[1]+1]), &(hier->hier[hier->hi[1]+hier->nstar-1]));
       hier->nstar--;
 
@@ -189,7 +178,8 @@ int fb_collide(fb_hier_t *hier, double f_exp, fb_units_t units, gsl_rng *rng, do
   return(retval);
 }
 
-void fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_units_t units, gsl_rng *rng)
+/* merge two single stars into obj1; returns FB_E_MERGE if either is not single */
+int fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_units_t units, gsl_rng *rng)
 {
   int i;
   double x1[3], x2[3], v1[3], v2[3], l1[3], l2[3];
@@ -200,8 +190,8 @@ void fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_un
 
   /* sanity check */
   if (obj1->n != 1 || obj2->n != 1) {
-    fprintf(stderr, "fb_merge: trying to merge an object that isn't single?!\n");
-    exit(1);
+    fb_dprintf("fb_merge: trying to merge an object that isn't single?!\n");
+    return(FB_E_MERGE);
   }
 
   /* need some temporary storage here */
@@ -284,6 +274,8 @@ void fb_merge(fb_obj_t *obj1, fb_obj_t *obj2, int nstarinit, double f_exp, fb_un
   fb_objcpy(obj1, &tmpobj);
 
   free(tmpobj.id);
+
+  return(FB_OK);
 }
 
 /* radiation rocket kick speed; output is in CGS; input is in arbitrary units */
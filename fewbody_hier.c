@@ -77,28 +77,36 @@ void fb_free_hier(fb_hier_t hier)
   free(hier.obj);
 }
 
-/* trickle down hier */
-void fb_trickle(fb_hier_t *hier, double t)
+/* trickle down hier; returns FB_OK, or the error code of the first fb_downsync() that failed */
+int fb_trickle(fb_hier_t *hier, double t)
 {
-  int i, j;
+  int i, j, status;
   
   for (i=hier->nstar; i>=2; i--) {
     for (j=0; j<hier->narr[i]; j++) {
-      fb_downsync(&(hier->hier[hier->hi[i] + j]), t);
+      if ((status = fb_downsync(&(hier->hier[hier->hi[i] + j]), t)) != FB_OK) {
+        return(status);
+      }
     }
   }
+
+  return(FB_OK);
 }
 
-/* trickle up hier */
-void fb_elkcirt(fb_hier_t *hier, double t, fb_input_t params, fb_units_t units)
+/* trickle up hier; returns FB_OK, or the error code of the first fb_upsync() that failed */
+int fb_elkcirt(fb_hier_t *hier, double t, fb_input_t params, fb_units_t units)
 {
-  int i, j;
+  int i, j, status;
   
   for (i=2; i<=hier->nstar; i++) {
     for (j=0; j<hier->narr[i]; j++) {
-      fb_upsync(&(hier->hier[hier->hi[i] + j]), t, params, units);
+      if ((status = fb_upsync(&(hier->hier[hier->hi[i] + j]), t, params, units)) != FB_OK) {
+        return(status);
+      }
     }
   }
+
+  return(FB_OK);
 }
 
 /* created the index array */
@@ -188,8 +196,8 @@ char *fb_sprint_hier_hr(fb_hier_t hier, char string[FB_MAX_STRING_LENGTH])
 }
 
 /* merge the object's properties up---calculate the binary's properties from the
-   stars' properties */
-void fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units)
+   stars' properties; returns FB_E_UNBOUND if the pair is not bound */
+int fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units)
 {
   int i;
   double m0, m1, x0[3], x1[3], xrel[3], v0[3], v1[3], vrel[3], E, l0[3], l1[3], l[3];
@@ -371,8 +379,8 @@ void fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units)
   E = E0 + E1 + E2 + E3;
   
   if (E >= 0.0) {
-    fprintf(stderr, "fb_upsync: E = %g >= 0!\n", E);
-    exit(1);
+    fb_dprintf("fb_upsync: E = %g >= 0!\n", E);
+    return(FB_E_UNBOUND);
   }
   
   obj->a = -m0 * m1 / (2.0 * E);
@@ -430,6 +438,8 @@ void fb_upsync(fb_obj_t *obj, double t, fb_input_t params, fb_units_t units)
     ecc_anom = 2.0 * FB_CONST_PI - ecc_anom;
   }
   obj->mean_anom = ecc_anom - obj->e * sin(ecc_anom);
+
+  return(FB_OK);
 }
 
 /* JMA 7-10-12 -- Return the inclination of the triple above the invariant
@@ -544,10 +554,10 @@ void fb_randorient(fb_obj_t *obj, gsl_rng *rng)
 }
 
 /* merge the object's properties down---calculate the objs' properties from the
-   binary's properties */
-void fb_downsync(fb_obj_t *obj, double t)
+   binary's properties; returns FB_E_KEPLER if the Kepler equation could not be solved */
+int fb_downsync(fb_obj_t *obj, double t)
 {
-  int i;
+  int i, status;
   double xpp[3], ypp[3], zpp[3], er[3], epsi[3];
   double a, e, m0, m1, omega, mean_anom, ecc_anom, psi, r0, r1, L, psidot, E, r0dot, r0dot2, r1dot;
 
@@ -563,7 +573,9 @@ void fb_downsync(fb_obj_t *obj, double t)
   mean_anom = (obj->mean_anom + omega * (t - obj->t)) / (2.0 * FB_CONST_PI);
   mean_anom = (mean_anom - floor(mean_anom)) * 2.0 * FB_CONST_PI;
   /* eccentric anomaly, from solving the Kepler equation */
-  ecc_anom = fb_kepler(e, mean_anom);
+  if ((status = fb_kepler(e, mean_anom, &ecc_anom)) != FB_OK) {
+    return(status);
+  }
   /* true anomaly, between 0 and 2PI */
   psi = acos((cos(ecc_anom) - e) / (1.0 - e * cos(ecc_anom)));
   /* this step is necessary because acos() returns a value between 0 and PI */
@@ -606,6 +618,8 @@ void fb_downsync(fb_obj_t *obj, double t)
     obj->obj[1]->x[i] = -r1 * er[i] + obj->x[i];
     obj->obj[1]->v[i] = -r1dot * er[i] - r1 * psidot * epsi[i] + obj->v[i];
   }
+
+  return(FB_OK);
 }
 
 /* copy one object to another, being careful about any pointers */
@@ -623,3 +637,29 @@ void fb_objcpy(fb_obj_t *obj1, fb_obj_t *obj2)
   *obj1 = *obj2;
   obj1->id = longptr;
 }
+
+/* copy hier2 into hier1, which must have been malloc()ed with the same nstarinit; the
+   pointers in the copy point into hier1 itself */
+void fb_hiercpy(fb_hier_t *hier1, fb_hier_t *hier2)
+{
+  int i, j;
+
+  hier1->nstar = hier2->nstar;
+  hier1->nobj = hier2->nobj;
+  for (i=2; i<=hier2->nstarinit; i++) {
+    hier1->narr[i] = hier2->narr[i];
+  }
+
+  for (i=0; i<hier2->hi[hier2->nstarinit]+1; i++) {
+    fb_objcpy(&(hier1->hier[i]), &(hier2->hier[i]));
+    for (j=0; j<2; j++) {
+      if (hier2->hier[i].obj[j] != NULL) {
+        hier1->hier[i].obj[j] = hier1->hier + (hier2->hier[i].obj[j] - hier2->hier);
+      }
+    }
+  }
+
+  for (i=0; i<hier2->nobj; i++) {
+    hier1->obj[i] = hier1->hier + (hier2->obj[i] - hier2->hier);
+  }
+}
@@ -34,28 +34,15 @@ void fb_malloc_ks_params(fb_ks_params_t *ks_params)
 	ks_params->Tmat = fb_malloc_matrix(ks_params->kstar, ks_params->kstar);
 }
 
-/* initialize ks_params; assumes ks_params is already malloc()ed */
-void fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier)
+/* calculate the M_k and the a and T matrices from the masses in ks_params->m */
+static void fb_set_ks_masses(fb_ks_params_t *ks_params)
 {
 	int i, j, k;
-	double *y;
-
-	/* exit if hier is not consistent with ks_params */
-	if (ks_params->nstar != hier.nobj) {
-		fprintf(stderr, "fb_init_ks_params(): ks_params->nstar != hier.nobj: ks_params->nstar=%d  hier.nobj=%d\n", \
-			ks_params->nstar, hier.nobj);
-		exit(1);
-	}
 
-	/* first set the mass matrix */
-	for (i=0; i<hier.nobj; i++) {
-		ks_params->m[i] = hier.obj[i]->m;
-	}
-	
 	/* calculate the M_k */
 	k = -1;
-	for (i=0; i<hier.nobj-1; i++) {
-		for (j=i+1; j<hier.nobj; j++) {
+	for (i=0; i<ks_params->nstar-1; i++) {
+		for (j=i+1; j<ks_params->nstar; j++) {
 			k++;
 			ks_params->M[k] = ks_params->m[i] * ks_params->m[j];
 		}
@@ -64,6 +51,27 @@ void fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier)
 	/* calculate and set the a and T matrices */
 	fb_calc_amat(ks_params->amat, ks_params->nstar, ks_params->kstar);
 	fb_calc_Tmat(ks_params->amat, ks_params->m, ks_params->Tmat, ks_params->nstar, ks_params->kstar);
+}
+
+/* initialize ks_params; assumes ks_params is already malloc()ed */
+int fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier)
+{
+	int i;
+	double *y;
+
+	/* bail out if hier is not consistent with ks_params */
+	if (ks_params->nstar != hier.nobj) {
+		fb_dprintf("fb_init_ks_params(): ks_params->nstar != hier.nobj: ks_params->nstar=%d  hier.nobj=%d\n", \
+			ks_params->nstar, hier.nobj);
+		return(FB_E_PARAMS);
+	}
+
+	/* first set the mass matrix */
+	for (i=0; i<hier.nobj; i++) {
+		ks_params->m[i] = hier.obj[i]->m;
+	}
+	
+	fb_set_ks_masses(ks_params);
 
 	/* set Einit */
 	y = fb_malloc_vector(8*ks_params->kstar+1);
@@ -71,6 +79,23 @@ void fb_init_ks_params(fb_ks_params_t *ks_params, fb_hier_t hier)
 	ks_params->Einit = fb_ks_Einit(y, *ks_params);
 
 	fb_free_vector(y);
+
+	return(FB_OK);
+}
+
+/* set ks_params from the masses and energy constant of a checkpointed integration, rather
+   than from a hierarchy; assumes ks_params is already malloc()ed */
+void fb_restore_ks_params(fb_ks_params_t *ks_params, double *m, double Einit)
+{
+	int i;
+
+	for (i=0; i<ks_params->nstar; i++) {
+		ks_params->m[i] = m[i];
+	}
+
+	fb_set_ks_masses(ks_params);
+
+	ks_params->Einit = Einit;
 }
 
 /* free memory for ks_params */
@@ -89,21 +114,34 @@ void fb_malloc_nonks_params(fb_nonks_params_t *nonks_params)
 }
 
 /* initialize nonks_params; assumes nonks_params is already malloc()ed */
-void fb_init_nonks_params(fb_nonks_params_t *nonks_params, fb_hier_t hier)
+int fb_init_nonks_params(fb_nonks_params_t *nonks_params, fb_hier_t hier)
 {
 	int i;
 
-	/* exit if hier is not consistent with nonks_params */
+	/* bail out if hier is not consistent with nonks_params */
 	if (nonks_params->nstar != hier.nobj) {
-		fprintf(stderr, "fb_init_nonks_params(): nonks_params->nstar != hier.nobj: nonks_params->nstar=%d  hier.nobj=%d\n", \
+		fb_dprintf("fb_init_nonks_params(): nonks_params->nstar != hier.nobj: nonks_params->nstar=%d  hier.nobj=%d\n", \
 			nonks_params->nstar, hier.nobj);
-		exit(1);
+		return(FB_E_PARAMS);
 	}
 
 	/* set the mass vector */
 	for (i=0; i<hier.nobj; i++) {
 		nonks_params->m[i] = hier.obj[i]->m;
 	}
+
+	return(FB_OK);
+}
+
+/* set nonks_params from the masses of a checkpointed integration; assumes nonks_params is
+   already malloc()ed */
+void fb_restore_nonks_params(fb_nonks_params_t *nonks_params, double *m)
+{
+	int i;
+
+	for (i=0; i<nonks_params->nstar; i++) {
+		nonks_params->m[i] = m[i];
+	}
 }
 
 /* free memory for ks_params */
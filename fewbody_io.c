@@ -21,6 +21,8 @@
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdarg.h>
+#include <float.h>
 #include <math.h>
 #include "fewbody.h"
 
@@ -30,11 +32,181 @@ void fb_print_version(FILE *stream)
 	fprintf(stream, "** Fewbody %s (%s) [%s] **\n", FB_VERSION, FB_NICK, FB_DATE);
 }
 
-/* print the output in Starlab story format */
-void fb_print_story(fb_obj_t *star, int nstar, double t, char *logentry)
+/* start a log with the entry first */
+void fb_log_init(fb_log_t *log, const char *first)
 {
-	int i, j;
-	double mtot, r[3], v[3], E, L[3], Lint[3];
+	log->size = FB_LOG_LENGTH;
+	log->buf = (char *) malloc(log->size * sizeof(char));
+	fb_log_clear(log);
+	fb_log_printf(log, "%s", first);
+}
+
+/* append an entry to a log, in constant time; an entry that would take the log past
+   FB_MAX_LOGENTRY_LENGTH is left out whole, and counted */
+void fb_log_printf(fb_log_t *log, const char *format, ...)
+{
+	int n;
+	va_list ap;
+
+	while (1) {
+		va_start(ap, format);
+		n = vsnprintf(&(log->buf[log->len]), log->size - log->len, format, ap);
+		va_end(ap);
+		if (n < 0) {
+			log->buf[log->len] = '\0';
+			return;
+		} else if (log->len + n < log->size) {
+			log->len += n;
+			return;
+		} else if (log->len + n >= FB_MAX_LOGENTRY_LENGTH) {
+			log->buf[log->len] = '\0';
+			log->ndrop++;
+			return;
+		}
+		log->size = FB_MIN(2 * (log->len + n), FB_MAX_LOGENTRY_LENGTH);
+		log->buf = (char *) realloc(log->buf, log->size * sizeof(char));
+	}
+}
+
+/* empty a log, keeping its buffer */
+void fb_log_clear(fb_log_t *log)
+{
+	log->buf[0] = '\0';
+	log->len = 0;
+	log->ndrop = 0;
+}
+
+void fb_log_free(fb_log_t *log)
+{
+	free(log->buf);
+	log->buf = NULL;
+	log->len = 0;
+	log->size = 0;
+}
+
+/* the powers of ten that a long double holds exactly (5^27 < 2^63) */
+static const long double fb_pow10l[28] = {
+	1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+	1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L,
+	1e26L, 1e27L
+};
+
+/* write x to buf as printf()'s "%.9g" would, and return the length; buf must have room for
+   32 characters.  The nine digits come from a single long double multiplication or
+   division by a power of ten, which is close enough to the exact product that the rounding
+   comes out the same, unless the product is within a few rounding errors of halfway between
+   two integers; that, and a number too large or small for the power of ten to be exact, goes
+   to snprintf() */
+int fb_sprint_g9(char *buf, double x)
+{
+	int i, e, k, ndig, len=0;
+	long double y;
+	long long d;
+	char dig[9];
+
+	if (x == 0.0 || !isfinite(x)) {
+		return(snprintf(buf, 32, "%.9g", x));
+	}
+
+	/* scale |x| to [1e8, 1e9), with e its decimal exponent */
+	e = (int) floor(log10(fabs(x)));
+	for (i=0; i<2; i++) {
+		k = 8 - e;
+		if (k > 27 || k < -27) {
+			return(snprintf(buf, 32, "%.9g", x));
+		}
+		y = (k >= 0 ? fabs(x) * fb_pow10l[k] : fabs(x) / fb_pow10l[-k]);
+		if (y < 1e8L) {
+			e--;
+		} else if (y >= 1e9L) {
+			e++;
+		} else {
+			break;
+		}
+	}
+	if (i == 2) {
+		return(snprintf(buf, 32, "%.9g", x));
+	}
+
+	d = (long long) y;
+	if (fabsl(y - d - 0.5L) < 4.0L * 1e9L * LDBL_EPSILON) {
+		return(snprintf(buf, 32, "%.9g", x));
+	} else if (y - d > 0.5L) {
+		d++;
+	}
+	if (d == 1000000000LL) {
+		d = 100000000LL;
+		e++;
+	}
+
+	for (i=8; i>=0; i--) {
+		dig[i] = '0' + (char) (d % 10);
+		d /= 10;
+	}
+	for (ndig=9; ndig>1 && dig[ndig-1]=='0'; ndig--);
+
+	if (x < 0.0) {
+		buf[len++] = '-';
+	}
+	if (e < -4 || e >= 9) {
+		buf[len++] = dig[0];
+		if (ndig > 1) {
+			buf[len++] = '.';
+			for (i=1; i<ndig; i++) {
+				buf[len++] = dig[i];
+			}
+		}
+		len += sprintf(&(buf[len]), "e%c%02d", (e < 0 ? '-' : '+'), abs(e));
+	} else if (e >= 0) {
+		for (i=0; i<=e; i++) {
+			buf[len++] = dig[i];
+		}
+		if (ndig > e + 1) {
+			buf[len++] = '.';
+			for (i=e+1; i<ndig; i++) {
+				buf[len++] = dig[i];
+			}
+		}
+	} else {
+		buf[len++] = '0';
+		buf[len++] = '.';
+		for (i=0; i<-e-1; i++) {
+			buf[len++] = '0';
+		}
+		for (i=0; i<ndig; i++) {
+			buf[len++] = dig[i];
+		}
+	}
+	buf[len] = '\0';
+
+	return(len);
+}
+
+/* append a story line "  name  =  x[0]  x[1] ..." to buf at len, and return the new length */
+static int fb_story_line(char *buf, int len, const char *name, const double *x, int n)
+{
+	int i;
+
+	len += sprintf(&(buf[len]), "  %s  =", name);
+	for (i=0; i<n; i++) {
+		buf[len++] = ' ';
+		buf[len++] = ' ';
+		len += fb_sprint_g9(&(buf[len]), x[i]);
+	}
+	buf[len++] = '\n';
+	buf[len] = '\0';
+
+	return(len);
+}
+
+/* print the output in Starlab story format, emptying the log; E and L are the total energy and
+   angular momentum, which the caller already has.  Each part of the story is put together in a
+   buffer and written at once */
+void fb_print_story(FILE *stream, fb_obj_t *star, int nstar, double t, double E, double *L, fb_log_t *log)
+{
+	int i, j, len;
+	double mtot, r[3], v[3], zero=0.0;
+	char buf[FB_MAX_STRING_LENGTH];
 	
 	/* calculate total mass and the motion of the center of mass (should be zero) */
 	mtot = 0.0;
@@ -53,53 +225,61 @@ void fb_print_story(fb_obj_t *star, int nstar, double t, char *logentry)
 		r[j] /= mtot;
 		v[j] /= mtot;
 	}
-
-	E = fb_petot(star, nstar) + fb_ketot(star, nstar) + fb_einttot(star, nstar);
-	fb_angmom(star, nstar, L);
-	fb_angmomint(star, nstar, Lint);
-	for (j=0; j<3; j++) {
-		L[j] += Lint[j];
-	}
-	
-	fprintf(stdout, "(Particle\n");
-	fprintf(stdout, "  N  =  %d\n", nstar);
 	
-	fprintf(stdout, "(Log\n");
-	fprintf(stdout, "%s", logentry);
-	logentry[0] = '\0';
-	fprintf(stdout, ")Log\n");
+	len = sprintf(buf, "(Particle\n  N  =  %d\n(Log\n", nstar);
+	fwrite(buf, sizeof(char), len, stream);
+	fwrite(log->buf, sizeof(char), log->len, stream);
+	if (log->ndrop > 0) {
+		fprintf(stream, "  (%ld more log entries left out for lack of room)\n", log->ndrop);
+	}
+	fb_log_clear(log);
 	
-	fprintf(stdout, "(Dynamics\n");
-	fprintf(stdout, "  system_time  =  %.9g\n", t);
-	fprintf(stdout, "  t  =  %.9g\n", t);
-	fprintf(stdout, "  m  =  %.9g\n", mtot);
-	fprintf(stdout, "  r  =  %.9g  %.9g  %.9g\n", r[0], r[1], r[2]);
-	fprintf(stdout, "  v  =  %.9g  %.9g  %.9g\n", v[0], v[1], v[2]);
+	len = sprintf(buf, ")Log\n(Dynamics\n");
+	len = fb_story_line(buf, len, "system_time", &t, 1);
+	len = fb_story_line(buf, len, "t", &t, 1);
+	len = fb_story_line(buf, len, "m", &mtot, 1);
+	len = fb_story_line(buf, len, "r", r, 3);
+	len = fb_story_line(buf, len, "v", v, 3);
 	/* what to do here? */
-	fprintf(stdout, "  R_eff  =  %.9g\n", 0.0);
-	fprintf(stdout, "  E  =  %.9g\n", E);
-	fprintf(stdout, "  L  =  %.9g  %.9g  %.9g\n", L[0], L[1], L[2]);
-	fprintf(stdout, ")Dynamics\n");
-	
-	fprintf(stdout, "(Hydro\n");
-	fprintf(stdout, ")Hydro\n");
-	
-	fprintf(stdout, "(Star\n");
-	fprintf(stdout, ")Star\n");
+	len = fb_story_line(buf, len, "R_eff", &zero, 1);
+	len = fb_story_line(buf, len, "E", &E, 1);
+	len = fb_story_line(buf, len, "L", L, 3);
+	len += sprintf(&(buf[len]), ")Dynamics\n(Hydro\n)Hydro\n(Star\n)Star\n");
+	fwrite(buf, sizeof(char), len, stream);
 	
 	for (i=0; i<nstar; i++) {
-		fprintf(stdout, "(Particle\n");
-		fprintf(stdout, "  i  =  %d\n", i+1);
-		fprintf(stdout, "  N  =  %d\n", 1);
-		fprintf(stdout, "(Dynamics\n");
-		fprintf(stdout, "  t  =  %.9g\n", t);
-		fprintf(stdout, "  m  =  %.9g\n", star[i].m);
-		fprintf(stdout, "  r  =  %.9g  %.9g  %.9g\n", star[i].x[0], star[i].x[1], star[i].x[2]);
-		fprintf(stdout, "  v  =  %.9g  %.9g  %.9g\n", star[i].v[0], star[i].v[1], star[i].v[2]);
-		fprintf(stdout, "  R_eff  =  %.9g\n", star[i].R);
-		fprintf(stdout, ")Dynamics\n");
-		fprintf(stdout, ")Particle\n");
+		len = sprintf(buf, "(Particle\n  i  =  %d\n  N  =  %d\n(Dynamics\n", i+1, 1);
+		len = fb_story_line(buf, len, "t", &t, 1);
+		len = fb_story_line(buf, len, "m", &(star[i].m), 1);
+		len = fb_story_line(buf, len, "r", star[i].x, 3);
+		len = fb_story_line(buf, len, "v", star[i].v, 3);
+		len = fb_story_line(buf, len, "R_eff", &(star[i].R), 1);
+		len += sprintf(&(buf[len]), ")Dynamics\n)Particle\n");
+		fwrite(buf, sizeof(char), len, stream);
 	}
 	
-	fprintf(stdout, ")Particle\n");
+	fwrite(")Particle\n", sizeof(char), 10, stream);
+}
+
+/* a short description of a status code returned by the core routines */
+const char *fb_strerror(int status)
+{
+	switch (status) {
+	case FB_OK:
+		return("no error");
+	case FB_E_UNBOUND:
+		return("binary with non-negative energy in fb_upsync()");
+	case FB_E_KEPLER:
+		return("Kepler equation root finder did not converge");
+	case FB_E_MERGE:
+		return("tried to merge an object that isn't single");
+	case FB_E_PARAMS:
+		return("integrator parameters inconsistent with hierarchy");
+	case FB_E_GSL:
+		return("GSL integrator failure");
+	case FB_E_CHECKPOINT:
+		return("cannot write or read checkpoint");
+	default:
+		return("unknown error");
+	}
 }
@@ -24,10 +24,11 @@
 #include <math.h>
 #include "fewbody.h"
 
-/* build the binary tree, subject to tidal criterion */
+/* build the binary tree, subject to tidal criterion; returns 1 if anything was collapsed, 0 if
+   not, or a negative FB_E_* error */
 int fb_collapse(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_units_t units, fb_input_t input)
 {
-	int i, j, k, n, isave[2], cont=1, retval=0;
+	int i, j, k, n, isave[2], cont=1, retval=0, status;
 	double a, amin, E, xrel[3], v0[3], v1[3], vcm[3], ftid;
 
 	/* first find the tightest binary and test to see whether it is unperturbed */
@@ -73,7 +74,9 @@ int fb_collapse(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_
 			n = hier->obj[isave[0]]->n + hier->obj[isave[1]]->n;
 			hier->hier[hier->hi[n]+hier->narr[n]].obj[0] = hier->obj[isave[0]];
 			hier->hier[hier->hi[n]+hier->narr[n]].obj[1] = hier->obj[isave[1]];
-			fb_upsync(&(hier->hier[hier->hi[n]+hier->narr[n]]), t, input, units);
+			if ((status = fb_upsync(&(hier->hier[hier->hi[n]+hier->narr[n]]), t, input, units)) != FB_OK) {
+				return(status);
+			}
 			
 			/* test for tidal perturbation */
 			ftid = 0.0;
@@ -131,10 +134,11 @@ int fb_collapse(fb_hier_t *hier, double t, double tidaltol, double speedtol, fb_
 	return(retval);
 }
 
-/* expand the tree if a tide is exceeded */
+/* expand the tree if a tide is exceeded; returns 1 if anything was expanded, 0 if not, or a
+   negative FB_E_* error */
 int fb_expand(fb_hier_t *hier, double t, double tidaltol)
 {
-	int i, j, k, cont=1, retval=0, n;
+	int i, j, k, cont=1, retval=0, n, status;
 	double xrel[3], ftid;
 	fb_obj_t *obj1ptr, *obj2ptr;
 	
@@ -168,7 +172,9 @@ int fb_expand(fb_hier_t *hier, double t, double tidaltol)
 			obj2ptr = &(hier->hier[hier->hi[n]+hier->narr[n]-1]);
 
 			/* make new obj */
-			fb_downsync(hier->obj[i], t);			
+			if ((status = fb_downsync(hier->obj[i], t)) != FB_OK) {
+				return(status);
+			}
 			hier->obj[hier->nobj] = hier->obj[i]->obj[1];
 			hier->obj[i] = hier->obj[i]->obj[0];
 			hier->nobj++;
@@ -138,6 +138,7 @@ int fb_ks_func(double s, const double *y, double *f, void *params)
   amat = (*(fb_ks_params_t *) params).amat;
   Tmat = (*(fb_ks_params_t *) params).Tmat;
   Einit = (*(fb_ks_params_t *) params).Einit;
+  (*(fb_ks_params_t *) params).nfunc++;
 
   /* allocate memory */
   Q = fb_malloc_matrix(kstar, 4);
@@ -47,6 +47,7 @@ int fb_nonks_func(double t, const double *y, double *f, void *params)
   PN3 = (*(fb_nonks_params_t *) params).PN3;
   PN35 = (*(fb_nonks_params_t *) params).PN35;
   units = (*(fb_nonks_params_t *) params).units;
+  (*(fb_nonks_params_t *) params).nfunc++;
 
   clight = FB_CONST_C / units.v;
   clight2 = fb_sqr(clight);
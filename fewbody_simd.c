@@ -0,0 +1,528 @@
+/* -*- linux-c -*- */
+/* fewbody_simd.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include "fewbody.h"
+
+#define pi2 9.869604401089359
+
+/* the Dormand-Prince 5(4) tableau; the equations of motion do not depend on the time, so the
+   nodes are not needed */
+#define FB_SIMD_A21 (1.0/5.0)
+#define FB_SIMD_A31 (3.0/40.0)
+#define FB_SIMD_A32 (9.0/40.0)
+#define FB_SIMD_A41 (44.0/45.0)
+#define FB_SIMD_A42 (-56.0/15.0)
+#define FB_SIMD_A43 (32.0/9.0)
+#define FB_SIMD_A51 (19372.0/6561.0)
+#define FB_SIMD_A52 (-25360.0/2187.0)
+#define FB_SIMD_A53 (64448.0/6561.0)
+#define FB_SIMD_A54 (-212.0/729.0)
+#define FB_SIMD_A61 (9017.0/3168.0)
+#define FB_SIMD_A62 (-355.0/33.0)
+#define FB_SIMD_A63 (46732.0/5247.0)
+#define FB_SIMD_A64 (49.0/176.0)
+#define FB_SIMD_A65 (-5103.0/18656.0)
+#define FB_SIMD_B1 (35.0/384.0)
+#define FB_SIMD_B3 (500.0/1113.0)
+#define FB_SIMD_B4 (125.0/192.0)
+#define FB_SIMD_B5 (-2187.0/6784.0)
+#define FB_SIMD_B6 (11.0/84.0)
+#define FB_SIMD_E1 (71.0/57600.0)
+#define FB_SIMD_E3 (-71.0/16695.0)
+#define FB_SIMD_E4 (71.0/1920.0)
+#define FB_SIMD_E5 (-17253.0/339200.0)
+#define FB_SIMD_E6 (22.0/525.0)
+#define FB_SIMD_E7 (-1.0/40.0)
+
+/* the derivatives of all the lanes, with the same Newtonian and post-Newtonian terms as
+   fb_nonks_func().  Each pair of stars is done for all the lanes at once, and the PN terms
+   that are on are added in loops of their own, so that every loop over the lanes is free of
+   branches and vectorizes. */
+static void fb_simd_func(fb_simd_t *simd, double y[18][FB_SIMD_WIDTH], double f[18][FB_SIMD_WIDTH])
+{
+  int i, j, k, p, l, PN1=simd->PN1, PN2=simd->PN2, PN25=simd->PN25, PN3=simd->PN3, PN35=simd->PN35;
+  double rv[3][FB_SIMD_WIDTH], pv[3][FB_SIMD_WIDTH], pr[FB_SIMD_WIDTH], pr2[FB_SIMD_WIDTH], pv2[FB_SIMD_WIDTH];
+  double prdot[FB_SIMD_WIDTH], pSM[FB_SIMD_WIDTH], pnu[FB_SIMD_WIDTH], A[FB_SIMD_WIDTH], B[FB_SIMD_WIDTH];
+  double r, r2, v2, rdot, SM, nu, A2, B2, A4, B4, A5, B5, A6, B6, A7, B7;
+  double clight2, clight4, clight5, acc;
+
+  for (i=0; i<3; i++) {
+    for (k=0; k<3; k++) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        f[i*6+k][l] = y[i*6+k+3][l];
+        f[i*6+k+3][l] = 0.0;
+      }
+    }
+  }
+
+  /* the pairs (0,1), (0,2) and (1,2) */
+  for (p=0; p<3; p++) {
+    i = (p == 2 ? 1 : 0);
+    j = (p == 0 ? 1 : 2);
+
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      for (k=0; k<3; k++) {
+        rv[k][l] = y[j*6+k][l] - y[i*6+k][l];
+        pv[k][l] = y[j*6+k+3][l] - y[i*6+k+3][l];
+      }
+      pr2[l] = rv[0][l]*rv[0][l] + rv[1][l]*rv[1][l] + rv[2][l]*rv[2][l];
+      pr[l] = sqrt(pr2[l]);
+      pv2[l] = pv[0][l]*pv[0][l] + pv[1][l]*pv[1][l] + pv[2][l]*pv[2][l];
+      prdot[l] = (rv[0][l]*pv[0][l] + rv[1][l]*pv[1][l] + rv[2][l]*pv[2][l]) / pr[l];
+      pSM[l] = simd->m[i][l] + simd->m[j][l];
+      pnu[l] = simd->m[i][l] * simd->m[j][l] / (pSM[l]*pSM[l]);
+      A[l] = 0.0;
+      B[l] = 0.0;
+    }
+
+    if (PN1) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        r = pr[l];
+        r2 = pr2[l];
+        v2 = pv2[l];
+        rdot = prdot[l];
+        SM = pSM[l];
+        nu = pnu[l];
+        clight2 = simd->clight[l] * simd->clight[l];
+        clight4 = clight2 * clight2;
+        clight5 = clight4 * simd->clight[l];
+        A2 = (-3*rdot*rdot*nu/2. + v2 + 3*nu*v2 - \
+              SM*(4+2*nu)/r)/clight2;
+        B2 = (-4 + 2*nu)*rdot/clight2;
+        A[l] += A2;
+        B[l] += B2;
+      }
+    }
+    if (PN2) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        r = pr[l];
+        r2 = pr2[l];
+        v2 = pv2[l];
+        rdot = prdot[l];
+        SM = pSM[l];
+        nu = pnu[l];
+        clight2 = simd->clight[l] * simd->clight[l];
+        clight4 = clight2 * clight2;
+        clight5 = clight4 * simd->clight[l];
+        A4 = (15*rdot*rdot*rdot*rdot*nu/8-45*rdot*rdot*rdot*rdot*nu*nu/8-\
+              9*rdot*rdot*nu*v2/2+6*rdot*rdot*nu*nu*v2+\
+              3*nu*v2*v2-4*nu*nu*v2*\
+              v2+SM*(-2*rdot*rdot-25*rdot*rdot*nu-2*rdot*rdot*nu*nu-\
+                  13*nu*v2/2+2*nu*nu*v2)\
+              /r+SM*SM*(9+87*nu/4)/r2)/clight4;
+        B4 = (9*rdot*rdot*rdot*nu/2+3*rdot*rdot*rdot*nu*nu-15*rdot*nu*v2/\
+              2-2*rdot*nu*nu*v2+SM*(2*rdot+41*rdot*nu/2+4*rdot*nu*nu)/\
+              r)/clight4;
+        A[l] += A4;
+        B[l] += B4;
+      }
+    }
+    if (PN25) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        r = pr[l];
+        r2 = pr2[l];
+        v2 = pv2[l];
+        rdot = prdot[l];
+        SM = pSM[l];
+        nu = pnu[l];
+        clight2 = simd->clight[l] * simd->clight[l];
+        clight4 = clight2 * clight2;
+        clight5 = clight4 * simd->clight[l];
+        A5 = (-24*rdot*nu*v2*SM/(5*r)-\
+              136*rdot*nu*SM*SM/(15*r2))/clight5;
+        B5 = (8*nu*v2*SM/(5*r) + \
+              24*nu*SM*SM/(5*r2))/clight5;
+        A[l] += A5;
+        B[l] += B5;
+      }
+    }
+    if (PN3) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        r = pr[l];
+        r2 = pr2[l];
+        v2 = pv2[l];
+        rdot = prdot[l];
+        SM = pSM[l];
+        nu = pnu[l];
+        clight2 = simd->clight[l] * simd->clight[l];
+        clight4 = clight2 * clight2;
+        clight5 = clight4 * simd->clight[l];
+        A6 = -((16+(1399/12.-41*pi2/16)*nu+35.5*nu*nu)*SM*SM*SM/r/r/r+\
+               nu*v2*SM*SM*(20827/840.+123*pi2/64.-nu*nu)/r2 - \
+               rdot*rdot*SM*SM*(1+(22717/168.+615/64.*pi2)*nu+11*nu*nu/8.-7*nu*nu*nu)/r2 - \
+               0.25*nu*v2*v2*v2*(11-49*nu+52*nu*nu) + \
+               35*rdot*rdot*rdot*rdot*rdot*rdot*nu*(1-5*nu+5*nu*nu)/16. -\
+               0.25*nu*SM*v2*v2*(75+32*nu-40*nu*nu)/r - \
+               0.5*nu*rdot*rdot*rdot*rdot*SM*(158-69*nu-60*nu*nu)/r + \
+               nu*SM*rdot*rdot*v2*(121-16*nu-20*nu*nu)/r  + \
+               3*nu*v2*v2*rdot*rdot*(20-79*nu+60*nu*nu)/8. -\
+               15*nu*rdot*rdot*rdot*rdot*v2*(4-18*nu+17*nu*nu)/8. )/clight4/clight2;
+        B6 = -rdot*((4+((5849/840.)+(123/32.)*pi2)*nu-25*nu*nu-8*nu*nu*nu)*SM*SM/\
+              r2+nu*v2*v2*(65-152*nu-48*nu*nu)/8.+\
+              15*nu*rdot*rdot*rdot*rdot*(3-8*nu-2*nu*nu)/8.+nu*(15+27*nu+10*nu*nu)*v2*\
+              SM/r-nu*SM*rdot*rdot*(329+177*nu+108*nu*nu)/r/6.-\
+              0.75*nu*rdot*rdot*v2*(16-37*nu-16*nu*nu))/clight4/clight2;
+        A[l] += A6;
+        B[l] += B6;
+      }
+    }
+    if (PN35) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        r = pr[l];
+        r2 = pr2[l];
+        v2 = pv2[l];
+        rdot = prdot[l];
+        SM = pSM[l];
+        nu = pnu[l];
+        clight2 = simd->clight[l] * simd->clight[l];
+        clight4 = clight2 * clight2;
+        clight5 = clight4 * simd->clight[l];
+        A7 =  1.6*nu*SM*rdot*(23*SM*SM*(43+14*nu)/r2/14+\
+                  3*v2*v2*(61+70*nu)/\
+                  28+70*rdot*rdot*rdot*rdot+SM*v2*(519-1267*nu)/42/r +\
+                  SM*rdot*rdot*(147+188*nu)/4/r-\
+                  15*rdot*rdot*v2*(19+2*nu)/4)/r/clight5/clight2;
+        B7 = -1.6*nu*SM*(SM*SM*(1325+546*nu)/r2/42+\
+             v2*v2*(313+42*nu)/28+75*rdot*rdot*rdot*rdot-\
+             SM*v2*(205+777*nu)/r/42   +\
+             SM*rdot*rdot*(205+424*nu)/r/12-\
+             0.75*rdot*rdot*v2*(113+2*nu))/r/clight5/clight2;
+        A[l] += A7;
+        B[l] += B7;
+      }
+    }
+
+    for (k=0; k<3; k++) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        acc = rv[k][l] / (pr[l] * pr2[l]) + (A[l]*rv[k][l]/pr[l] + B[l]*pv[k][l]) / pr2[l] / pSM[l];
+        f[i*6+k+3][l] += simd->m[j][l] * acc;
+        f[j*6+k+3][l] -= simd->m[i][l] * acc;
+      }
+    }
+  }
+}
+
+/* put a lane in a harmless state that the force kernel can chew on while it is empty */
+static void fb_simd_clear(fb_simd_t *simd, int lane)
+{
+  int i, k;
+
+  for (i=0; i<3; i++) {
+    for (k=0; k<6; k++) {
+      simd->y[i*6+k][lane] = (k == i - 1 ? 1.0 : 0.0);
+      simd->f[i*6+k][lane] = 0.0;
+    }
+    simd->m[i][lane] = 1.0;
+    simd->R[i][lane] = 0.0;
+  }
+  simd->clight[lane] = 1.0;
+  simd->t[lane] = 0.0;
+  simd->h[lane] = 0.0;
+  simd->status[lane] = FB_SIMD_EMPTY;
+  simd->fresh[lane] = 0;
+}
+
+/* whether a running lane has reached one of the stopping conditions */
+static int fb_simd_stopped(fb_simd_t *simd, int lane)
+{
+  if (simd->t[lane] >= simd->tstop) {
+    return(FB_SIMD_TSTOP);
+  } else if (simd->retval[lane].tcpu >= simd->tcpustop) {
+    return(FB_SIMD_TCPUSTOP);
+  } else {
+    return(FB_SIMD_RUNNING);
+  }
+}
+
+/* set up an empty lockstep integrator with the accuracies, stopping conditions and PN terms of
+   input, which all the systems share */
+void fb_simd_init(fb_simd_t *simd, fb_input_t input)
+{
+  int l;
+
+  simd->absacc = input.absacc;
+  simd->relacc = input.relacc;
+  simd->tstop = input.tstop;
+  simd->tcpustop = input.tcpustop;
+  simd->ncount = input.ncount;
+  simd->tstopexact = input.tstopexact;
+  simd->PN1 = input.PN1;
+  simd->PN2 = input.PN2;
+  simd->PN25 = input.PN25;
+  simd->PN3 = input.PN3;
+  simd->PN35 = input.PN35;
+  simd->nstep = 0;
+  simd->nlane = 0;
+  simd->nreject = 0;
+
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    fb_simd_clear(simd, l);
+  }
+}
+
+/* start integrating the three stars of hier from time t in an empty lane, with the counters
+   of its retval reset as fewbody() does */
+void fb_simd_load(fb_simd_t *simd, int lane, fb_hier_t *hier, fb_units_t units, double t)
+{
+  int i, k;
+  fb_obj_t *star=&(hier->hier[hier->hi[1]]);
+
+  for (i=0; i<3; i++) {
+    for (k=0; k<3; k++) {
+      simd->y[i*6+k][lane] = star[i].x[k];
+      simd->y[i*6+k+3][lane] = star[i].v[k];
+    }
+    simd->m[i][lane] = star[i].m;
+    simd->R[i][lane] = star[i].R;
+  }
+  simd->clight[lane] = FB_CONST_C / units.v;
+  simd->t[lane] = t;
+  simd->h[lane] = FB_H;
+  simd->status[lane] = FB_SIMD_RUNNING;
+  simd->fresh[lane] = 1;
+
+  memset(&(simd->retval[lane]), 0, sizeof(fb_ret_t));
+  simd->retval[lane].Rmin = FB_RMIN;
+  simd->retval[lane].Rmin_i = -1;
+  simd->retval[lane].Rmin_j = -1;
+}
+
+/* copy the positions and velocities of a lane back to the stars of hier, and its time to t */
+void fb_simd_store(fb_simd_t *simd, int lane, fb_hier_t *hier, double *t)
+{
+  int i, k;
+  fb_obj_t *star=&(hier->hier[hier->hi[1]]);
+
+  for (i=0; i<3; i++) {
+    for (k=0; k<3; k++) {
+      star[i].x[k] = simd->y[i*6+k][lane];
+      star[i].v[k] = simd->y[i*6+k+3][lane];
+    }
+  }
+  *t = simd->t[lane];
+}
+
+/* carry on with a lane that stopped for fb_classify() without being done */
+void fb_simd_resume(fb_simd_t *simd, int lane)
+{
+  simd->status[lane] = fb_simd_stopped(simd, lane);
+}
+
+/* empty a lane, so that it can be loaded again */
+void fb_simd_unload(fb_simd_t *simd, int lane)
+{
+  fb_simd_clear(simd, lane);
+}
+
+/* try one Dormand-Prince 5(4) step in every running lane at once.  The error of each lane is
+   controlled on its own, as gsl_odeiv_control_y_new() does: a lane whose error is too large
+   stays where it was with a smaller step size, to be tried again in the next call, and the
+   lanes that are not running are carried along with a zero step.  After an accepted step a
+   lane stops if two stars touch, if it is due for fb_classify() (before every ncount-th
+   step, counting from the first, as in fewbody()), or at tstop or tcpustop; the cpu time
+   of the step is shared among the running lanes.  Returns the number of lanes that stopped,
+   whose status then says why. */
+int fb_simd_step(fb_simd_t *simd)
+{
+  int i, j, k, l, p, nrun=0, nfresh=0, nstop=0;
+  double k2[18][FB_SIMD_WIDTH], k3[18][FB_SIMD_WIDTH], k4[18][FB_SIMD_WIDTH], k5[18][FB_SIMD_WIDTH];
+  double k6[18][FB_SIMD_WIDTH], k7[18][FB_SIMD_WIDTH], ytmp[18][FB_SIMD_WIDTH], ynew[18][FB_SIMD_WIDTH];
+  double hh[FB_SIMD_WIDTH], err[FB_SIMD_WIDTH], e, fac, R[3], tcpu;
+  struct timespec firsttime, currtime;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &firsttime);
+
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    if (simd->status[l] == FB_SIMD_RUNNING) {
+      nrun++;
+      nfresh += simd->fresh[l];
+      simd->retval[l].nrhs += 6 + simd->fresh[l];
+      hh[l] = simd->h[l];
+      if (simd->tstopexact && simd->t[l] + hh[l] > simd->tstop) {
+        hh[l] = simd->tstop - simd->t[l];
+      }
+    } else {
+      hh[l] = 0.0;
+    }
+  }
+
+  if (nrun == 0) {
+    return(0);
+  }
+
+  /* lanes loaded since the last step need the derivatives at their initial state; the others
+     have them from the end of their last accepted step */
+  if (nfresh) {
+    fb_simd_func(simd, simd->y, k2);
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      if (simd->fresh[l]) {
+        for (i=0; i<18; i++) {
+          simd->f[i][l] = k2[i][l];
+        }
+        simd->fresh[l] = 0;
+      }
+    }
+  }
+
+  /* the stages */
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ytmp[i][l] = simd->y[i][l] + hh[l] * FB_SIMD_A21 * simd->f[i][l];
+    }
+  }
+  fb_simd_func(simd, ytmp, k2);
+
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ytmp[i][l] = simd->y[i][l] + hh[l] * (FB_SIMD_A31 * simd->f[i][l] + FB_SIMD_A32 * k2[i][l]);
+    }
+  }
+  fb_simd_func(simd, ytmp, k3);
+
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ytmp[i][l] = simd->y[i][l] + hh[l] * (FB_SIMD_A41 * simd->f[i][l] + FB_SIMD_A42 * k2[i][l] +
+                                            FB_SIMD_A43 * k3[i][l]);
+    }
+  }
+  fb_simd_func(simd, ytmp, k4);
+
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ytmp[i][l] = simd->y[i][l] + hh[l] * (FB_SIMD_A51 * simd->f[i][l] + FB_SIMD_A52 * k2[i][l] +
+                                            FB_SIMD_A53 * k3[i][l] + FB_SIMD_A54 * k4[i][l]);
+    }
+  }
+  fb_simd_func(simd, ytmp, k5);
+
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ytmp[i][l] = simd->y[i][l] + hh[l] * (FB_SIMD_A61 * simd->f[i][l] + FB_SIMD_A62 * k2[i][l] +
+                                            FB_SIMD_A63 * k3[i][l] + FB_SIMD_A64 * k4[i][l] +
+                                            FB_SIMD_A65 * k5[i][l]);
+    }
+  }
+  fb_simd_func(simd, ytmp, k6);
+
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      ynew[i][l] = simd->y[i][l] + hh[l] * (FB_SIMD_B1 * simd->f[i][l] + FB_SIMD_B3 * k3[i][l] +
+                                            FB_SIMD_B4 * k4[i][l] + FB_SIMD_B5 * k5[i][l] +
+                                            FB_SIMD_B6 * k6[i][l]);
+    }
+  }
+  fb_simd_func(simd, ynew, k7);
+
+  /* the largest error of each lane, relative to absacc + relacc |y|; a NaN sticks */
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    err[l] = 0.0;
+  }
+  for (i=0; i<18; i++) {
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      e = fabs(hh[l] * (FB_SIMD_E1 * simd->f[i][l] + FB_SIMD_E3 * k3[i][l] + FB_SIMD_E4 * k4[i][l] +
+                        FB_SIMD_E5 * k5[i][l] + FB_SIMD_E6 * k6[i][l] + FB_SIMD_E7 * k7[i][l])) /
+        (simd->absacc + simd->relacc * fabs(ynew[i][l]));
+      if (!(e <= err[l])) {
+        err[l] = e;
+      }
+    }
+  }
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &currtime);
+  tcpu = ((double) (currtime.tv_sec - firsttime.tv_sec)) + 1.0e-9 * ((double) (currtime.tv_nsec - firsttime.tv_nsec));
+  simd->nstep++;
+
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    if (simd->status[l] != FB_SIMD_RUNNING) {
+      continue;
+    }
+    simd->nlane++;
+    simd->retval[l].tcpu += tcpu / ((double) nrun);
+
+    /* reject: shrink the step by at most a factor of 5, or give up once it is lost in the
+       round-off of t */
+    if (!(err[l] <= 1.1)) {
+      simd->nreject++;
+      fac = 0.9 * pow(err[l], -1.0/5.0);
+      simd->h[l] = hh[l] * (fac > 0.2 ? fac : 0.2);
+      if (!(simd->h[l] > DBL_EPSILON * fabs(simd->t[l]))) {
+        simd->status[l] = FB_SIMD_GSL;
+        nstop++;
+      } else if ((simd->status[l] = fb_simd_stopped(simd, l)) != FB_SIMD_RUNNING) {
+        nstop++;
+      }
+      continue;
+    }
+
+    /* accept, keeping the derivatives at the new state for the next step, and grow the step
+       by at most a factor of 5 if the error is well below the tolerance */
+    for (i=0; i<18; i++) {
+      simd->y[i][l] = ynew[i][l];
+      simd->f[i][l] = k7[i][l];
+    }
+    simd->t[l] += hh[l];
+    if (err[l] < 0.5) {
+      fac = 0.9 * pow(err[l], -1.0/6.0);
+      simd->h[l] = hh[l] * FB_MIN(FB_MAX(fac, 1.0), 5.0);
+    } else {
+      simd->h[l] = hh[l];
+    }
+
+    /* closest approach, and collisions */
+    for (p=0; p<3; p++) {
+      i = (p == 2 ? 1 : 0);
+      j = (p == 0 ? 1 : 2);
+      for (k=0; k<3; k++) {
+        R[k] = simd->y[i*6+k][l] - simd->y[j*6+k][l];
+      }
+      if (fb_mod(R) < simd->retval[l].Rmin) {
+        simd->retval[l].Rmin = fb_mod(R);
+        simd->retval[l].Rmin_i = i;
+        simd->retval[l].Rmin_j = j;
+      }
+      if (fb_is_collision(fb_mod(R), simd->R[i][l], simd->R[j][l])) {
+        simd->status[l] = FB_SIMD_COLLISION;
+      }
+    }
+
+    if (simd->status[l] == FB_SIMD_RUNNING && simd->retval[l].count % simd->ncount == 0) {
+      simd->status[l] = FB_SIMD_CLASSIFY;
+    }
+    simd->retval[l].count++;
+
+    if (simd->status[l] == FB_SIMD_RUNNING) {
+      simd->status[l] = fb_simd_stopped(simd, l);
+    }
+    if (simd->status[l] != FB_SIMD_RUNNING) {
+      nstop++;
+    }
+  }
+
+  return(nstop);
+}
+
+#undef pi2
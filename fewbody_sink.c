@@ -0,0 +1,201 @@
+/* -*- linux-c -*- */
+/* fewbody_sink.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* fopencookie() */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include "fewbody.h"
+
+/* A sink is where one output channel of fewbody() goes.  Every sink is written to through a
+   stream, so that the writers of the channels (fb_traj_output(), fb_print_story() and the
+   rest) need not know about sinks; a discarded channel has no stream, and fewbody() then skips
+   its output altogether, formatting included.  A ring is a stream whose bytes go round a
+   buffer in memory, so that a long run keeps only the tail of a channel, which is written out
+   when the sink is closed. */
+
+/* the names of the channels, as given to fb_sink_channel() */
+static const char *fb_sink_chan_name[FB_NCHAN] = {"traj", "events", "story", "summary", "debug"};
+
+/* the channel called name, or -1 if there is none */
+int fb_sink_channel(char *name)
+{
+  int c;
+
+  for (c=0; c<FB_NCHAN; c++) {
+    if (strcmp(name, fb_sink_chan_name[c]) == 0) {
+      return(c);
+    }
+  }
+
+  return(-1);
+}
+
+/* the write function of a ring: only the last sink->size bytes can survive */
+static ssize_t fb_sink_ring_write(void *cookie, const char *buf, size_t size)
+{
+  fb_sink_t *sink=(fb_sink_t *) cookie;
+  size_t n, k;
+
+  sink->nbyte += size;
+
+  n = FB_MIN(size, sink->size);
+  buf += size - n;
+  k = FB_MIN(n, sink->size - sink->head);
+  memcpy(&(sink->ring[sink->head]), buf, k);
+  memcpy(sink->ring, &(buf[k]), n - k);
+  sink->head = (sink->head + n) % sink->size;
+  sink->len = FB_MIN(sink->len + n, sink->size);
+
+  return((ssize_t) size);
+}
+
+/* write out what the ring holds, oldest first, from the first whole line if it has gone round */
+static int fb_sink_ring_dump(fb_sink_t *sink)
+{
+  size_t start, n, k;
+
+  start = (sink->head + sink->size - sink->len) % sink->size;
+  n = sink->len;
+  if ((size_t) sink->nbyte > sink->size) {
+    /* the oldest line has lost its beginning */
+    for (k=0; k<n && sink->ring[(start + k) % sink->size] != '\n'; k++);
+    k = FB_MIN(k + 1, n);
+    start = (start + k) % sink->size;
+    n -= k;
+  }
+
+  k = FB_MIN(n, sink->size - start);
+  if (fwrite(&(sink->ring[start]), 1, k, sink->dump) != k ||
+      fwrite(sink->ring, 1, n - k, sink->dump) != n - k) {
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* open a sink as spec says:
+     null               discard the channel
+     -                  stdout
+     &<n>               the open descriptor <n>
+     ring:<n>[:<file>]  keep the last <n> bytes, and write them to <file> (stdout if not given)
+                        when the sink is closed
+     <file>             the file <file>
+   returns 0, or -1 if it cannot be opened */
+int fb_sink_open(fb_sink_t *sink, char *spec)
+{
+  char *end;
+  long n;
+  cookie_io_functions_t io={NULL, fb_sink_ring_write, NULL, NULL};
+
+  memset(sink, 0, sizeof(fb_sink_t));
+  strncpy(sink->name, spec, FB_MAX_STRING_LENGTH-1);
+
+  if (strcmp(spec, "null") == 0) {
+    sink->kind = FB_SINK_DISCARD;
+    return(0);
+  }
+
+  if (strncmp(spec, "ring:", 5) == 0) {
+    sink->kind = FB_SINK_RING;
+    n = strtol(&(spec[5]), &end, 10);
+    if (end == &(spec[5]) || (*end != '\0' && *end != ':') || n < 1) {
+      return(-1);
+    }
+    if (*end == '\0' || strcmp(&(end[1]), "-") == 0) {
+      sink->dump = stdout;
+    } else if ((sink->dump = fopen(&(end[1]), "w")) == NULL) {
+      return(-1);
+    }
+    sink->size = (size_t) n;
+    if ((sink->ring = (char *) malloc(sink->size)) == NULL ||
+        (sink->stream = fopencookie(sink, "w", io)) == NULL) {
+      free(sink->ring);
+      sink->ring = NULL;
+      if (sink->dump != stdout) {
+        fclose(sink->dump);
+      }
+      return(-1);
+    }
+    sink->owned = 1;
+    return(0);
+  }
+
+  sink->kind = FB_SINK_FILE;
+  if (strcmp(spec, "-") == 0) {
+    sink->stream = stdout;
+  } else if (spec[0] == '&') {
+    n = strtol(&(spec[1]), &end, 10);
+    if (end == &(spec[1]) || *end != '\0' || n < 0 || (sink->stream = fdopen((int) n, "w")) == NULL) {
+      return(-1);
+    }
+    sink->owned = 1;
+  } else if ((sink->stream = fopen(spec, "w")) == NULL) {
+    return(-1);
+  } else {
+    sink->owned = 1;
+  }
+
+  return(0);
+}
+
+/* the stream a channel is to be written to: that of its sink, which is NULL if the channel is
+   discarded, or out if it has none */
+FILE *fb_sink_stream(fb_sink_t *sink, FILE *out)
+{
+  return(sink == NULL ? out : sink->stream);
+}
+
+/* close a sink, writing out what a ring holds; returns 0, or -1 if any write has failed */
+int fb_sink_close(fb_sink_t *sink)
+{
+  int status=0;
+
+  if (sink->stream == NULL) {
+    return(0);
+  }
+
+  if (sink->owned) {
+    status = (fclose(sink->stream) != 0 ? -1 : 0);
+  } else {
+    status = (fflush(sink->stream) != 0 ? -1 : 0);
+  }
+  sink->stream = NULL;
+
+  if (sink->kind == FB_SINK_RING) {
+    if (fb_sink_ring_dump(sink) != 0) {
+      status = -1;
+    }
+    if (sink->dump != stdout) {
+      if (fclose(sink->dump) != 0) {
+        status = -1;
+      }
+    } else if (fflush(sink->dump) != 0) {
+      status = -1;
+    }
+    free(sink->ring);
+    sink->ring = NULL;
+  }
+
+  return(status);
+}
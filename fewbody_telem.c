@@ -0,0 +1,182 @@
+/* -*- linux-c -*- */
+/* fewbody_telem.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fewbody.h"
+
+/* the time on the monotonic clock, in seconds, which is the same for every process */
+double fb_telem_clock(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((double) ts.tv_sec + 1.0e-9 * (double) ts.tv_nsec);
+}
+
+/* the 64-bit FNV-1a hash of a string, such as that of a hierarchy */
+unsigned long fb_telem_hash(char *string)
+{
+  unsigned long long hash=0xcbf29ce484222325ULL;
+
+  for (; *string != '\0'; string++) {
+    hash = (hash ^ (unsigned char) *string) * 0x100000001b3ULL;
+  }
+
+  return((unsigned long) hash);
+}
+
+/* create the segment of this process, with nslot blocks, and map it; returns 0, or -1 if it
+   cannot be created */
+int fb_telem_create(fb_telem_seg_t *seg, int nslot)
+{
+  int fd;
+
+  memset(seg, 0, sizeof(fb_telem_seg_t));
+  snprintf(seg->name, FB_MAX_STRING_LENGTH, "%s%d", FB_TELEM_PREFIX, (int) getpid());
+  seg->size = sizeof(fb_telem_header_t) + (size_t) nslot * sizeof(fb_telem_t);
+
+  /* a segment left behind by a dead process of the same pid is stale */
+  shm_unlink(seg->name);
+  if ((fd = shm_open(seg->name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+    return(-1);
+  }
+  if (ftruncate(fd, (off_t) seg->size) != 0 ||
+      (seg->head = (fb_telem_header_t *) mmap(NULL, seg->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    shm_unlink(seg->name);
+    seg->head = NULL;
+    return(-1);
+  }
+  close(fd);
+
+  /* the blocks are zero, and so idle, until they are started */
+  seg->slot = (fb_telem_t *) &(seg->head[1]);
+  seg->owner = 1;
+  seg->head->pid = (int) getpid();
+  seg->head->nslot = nslot;
+  seg->head->size = sizeof(fb_telem_t);
+  strncpy(seg->head->version, FB_VERSION, sizeof(seg->head->version));
+  __sync_synchronize();
+  memcpy(seg->head->magic, FB_TELEM_MAGIC, sizeof(seg->head->magic));
+
+  return(0);
+}
+
+/* map the segment called name for reading; returns 0, or -1 if it is not a segment that this
+   build can read */
+int fb_telem_attach(fb_telem_seg_t *seg, char *name)
+{
+  int fd;
+  struct stat st;
+
+  memset(seg, 0, sizeof(fb_telem_seg_t));
+  strncpy(seg->name, name, FB_MAX_STRING_LENGTH-1);
+
+  if ((fd = shm_open(seg->name, O_RDONLY, 0)) < 0) {
+    return(-1);
+  }
+  if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(fb_telem_header_t) ||
+      (seg->head = (fb_telem_header_t *) mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    close(fd);
+    seg->head = NULL;
+    return(-1);
+  }
+  close(fd);
+  seg->size = (size_t) st.st_size;
+  seg->slot = (fb_telem_t *) &(seg->head[1]);
+
+  if (memcmp(seg->head->magic, FB_TELEM_MAGIC, sizeof(seg->head->magic)) != 0 ||
+      seg->head->size != sizeof(fb_telem_t) || seg->head->nslot < 0 ||
+      seg->size < sizeof(fb_telem_header_t) + (size_t) seg->head->nslot * sizeof(fb_telem_t)) {
+    fb_telem_close(seg);
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* unmap a segment, and remove it if this process created it */
+void fb_telem_close(fb_telem_seg_t *seg)
+{
+  if (seg->head == NULL) {
+    return;
+  }
+
+  munmap(seg->head, seg->size);
+  if (seg->owner) {
+    shm_unlink(seg->name);
+  }
+  seg->head = NULL;
+  seg->slot = NULL;
+}
+
+/* hand a block over to job id, which has not started yet */
+void fb_telem_start(fb_telem_t *telem, long id)
+{
+  telem->seq++;
+  __sync_synchronize();
+  telem->id = id;
+  memset(&(telem->status), 0, sizeof(fb_telem_status_t));
+  __sync_synchronize();
+  telem->seq++;
+}
+
+/* publish the status of the integration in a block, timing the update */
+void fb_telem_write(fb_telem_t *telem, fb_telem_status_t *status)
+{
+  status->twall = fb_telem_clock();
+
+  telem->seq++;
+  __sync_synchronize();
+  memcpy(&(telem->status), status, sizeof(fb_telem_status_t));
+  __sync_synchronize();
+  telem->seq++;
+}
+
+/* copy a block that another process may be writing; returns 0, or -1 if no copy came out
+   whole */
+int fb_telem_read(fb_telem_t *telem, long *id, fb_telem_status_t *status)
+{
+  int n;
+  unsigned long seq;
+
+  for (n=0; n<FB_TELEM_NTRY; n++) {
+    seq = telem->seq;
+    __sync_synchronize();
+    if (seq % 2 == 0) {
+      *id = telem->id;
+      memcpy(status, &(telem->status), sizeof(fb_telem_status_t));
+      __sync_synchronize();
+      if (telem->seq == seq) {
+        return(0);
+      }
+    }
+  }
+
+  return(-1);
+}
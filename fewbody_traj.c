@@ -0,0 +1,938 @@
+/* -*- linux-c -*- */
+/* fewbody_traj.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fewbody.h"
+
+/* the column names of the binary format; the last 27 are the columns of the text lines */
+static const char *fb_traj_name[FB_TRAJ_NCOL] = {
+  "kind", "t", "a_in", "e_in", "a_out", "e_out", "cosi", "omega",
+  "Lhat_in_x", "Lhat_in_y", "Lhat_in_z",
+  "x01_x", "x01_y", "x01_z", "x0_x", "x0_y", "x0_z", "x1_x", "x1_y", "x1_z", "x2_x", "x2_y", "x2_z",
+  "v01_x", "v01_y", "v01_z", "v1_x", "v1_y", "v1_z"
+};
+
+/* the columns of a trajectory record of kind for hier at time t: the orbital elements of the
+   inner and outer binaries, the cosine of and the angle in degrees between their Runge-Lenz
+   vectors, the inner binary's Lhat, and the positions and velocities of the stars */
+void fb_traj_row(fb_hier_t *hier, double t, int kind, double row[FB_TRAJ_NCOL])
+{
+  int k;
+  fb_obj_t *star=&(hier->hier[hier->hi[1]]), *bin=&(hier->hier[hier->hi[2]]), *tri=&(hier->hier[hier->hi[3]]);
+
+  row[0] = (double) kind;
+  row[1] = t;
+  row[2] = bin[0].a;
+  row[3] = bin[0].e;
+  row[4] = tri[0].a;
+  row[5] = tri[0].e;
+  row[6] = fb_dot(bin[0].Lhat, bin[1].Lhat);
+  row[7] = acos(fb_dot(bin[0].Ahat, bin[1].Ahat)) * 180 / FB_CONST_PI;
+  for (k=0; k<3; k++) {
+    row[8+k] = bin[0].Lhat[k];
+    row[11+k] = star[1].x[k] - star[0].x[k];
+    row[14+k] = star[0].x[k];
+    row[17+k] = star[1].x[k];
+    row[20+k] = star[2].x[k];
+    row[23+k] = star[1].v[k] - star[0].v[k];
+    row[26+k] = star[1].v[k];
+  }
+}
+
+/* the names of the kinds of record, which start the text lines of events */
+static const char *fb_traj_kind_name[FB_TRAJ_NKIND] = {
+  "step", "final", "merger", "peri", "emax", "emin", "imax", "imin", "classify"
+};
+
+/* format a trajectory record as the text line fewbody() and fb_collide() have always printed:
+   all the columns but the kind, or for a merger only t through x01, x2 and v01; an event's
+   line starts with the name of its kind.  buf must have room for FB_TRAJ_LINELEN characters.
+   Returns the length of the line. */
+int fb_traj_sprint_text(char *buf, double row[FB_TRAJ_NCOL])
+{
+  int k, len=0, kind=(int) row[0];
+
+  if (kind >= FB_TRAJ_PERI && kind < FB_TRAJ_NKIND) {
+    len = snprintf(buf, FB_TRAJ_LINELEN, "%s ", fb_traj_kind_name[kind]);
+  }
+  len += snprintf(&(buf[len]), FB_TRAJ_LINELEN-len, "%.12f", row[1]);
+  for (k=2; k<FB_TRAJ_NCOL && len<FB_TRAJ_LINELEN; k++) {
+    if ((int) row[0] != FB_TRAJ_MERGER || k < 14 || (k >= 20 && k < 26)) {
+      len += snprintf(&(buf[len]), FB_TRAJ_LINELEN-len, " %g", row[k]);
+    }
+  }
+  if (len < FB_TRAJ_LINELEN-1) {
+    buf[len++] = '\n';
+    buf[len] = '\0';
+  }
+
+  return(len < FB_TRAJ_LINELEN ? len : FB_TRAJ_LINELEN-1);
+}
+
+/* print a trajectory record as a text line */
+void fb_traj_print_text(FILE *stream, double row[FB_TRAJ_NCOL])
+{
+  char buf[FB_TRAJ_LINELEN];
+
+  fb_traj_sprint_text(buf, row);
+  fputs(buf, stream);
+}
+
+/* output a trajectory record: to traj if there is one, or else as a text line to stream, if
+   there is one */
+void fb_traj_emit(FILE *stream, fb_traj_t *traj, double row[FB_TRAJ_NCOL])
+{
+  if (traj != NULL) {
+    fb_traj_write(traj, row);
+  } else if (stream != NULL) {
+    fb_traj_print_text(stream, row);
+  }
+}
+
+/* output a trajectory record of kind for hier at time t */
+void fb_traj_output(FILE *stream, fb_traj_t *traj, int kind, fb_hier_t *hier, double t)
+{
+  double row[FB_TRAJ_NCOL];
+
+  if (traj == NULL && stream == NULL) {
+    return;
+  }
+
+  fb_traj_row(hier, t, kind, row);
+  fb_traj_emit(stream, traj, row);
+}
+
+/* start the event detection of a run */
+void fb_traj_events_init(fb_traj_events_t *ev, fb_input_t *input)
+{
+  ev->peri = input->eventperi;
+  ev->etol = input->eventetol;
+  ev->itol = input->eventitol;
+  ev->nstep = 0;
+  ev->edir = 0;
+  ev->idir = 0;
+  ev->hier[0] = '\0';
+  ev->nevent = 0;
+}
+
+/* follow quantity x of the record row, which starts at ext with its record extrow, and output
+   the most extreme record so far as kind max or min once x has turned back by more than tol */
+static void fb_traj_events_extremum(FILE *stream, fb_traj_t *traj, fb_traj_events_t *ev, double x, double tol,
+                                    int *dir, double *ext, double *extrow, double *row, int kind_max, int kind_min)
+{
+  if ((*dir >= 0 && x >= *ext) || (*dir <= 0 && x <= *ext)) {
+    /* further along the same way, or not yet moved */
+    if (*dir != 0 || fabs(x - *ext) > tol) {
+      *dir = (*dir != 0 ? *dir : (x > *ext ? 1 : -1));
+      *ext = x;
+      memcpy(extrow, row, FB_TRAJ_NCOL * sizeof(double));
+    }
+  } else if (*dir != 0 && fabs(x - *ext) > tol) {
+    /* turned back: the extremum is real */
+    extrow[0] = (double) (*dir > 0 ? kind_max : kind_min);
+    fb_traj_emit(stream, traj, extrow);
+    ev->nevent++;
+    *dir = -(*dir);
+    *ext = x;
+    memcpy(extrow, row, FB_TRAJ_NCOL * sizeof(double));
+  }
+}
+
+/* detect the events of the step just taken, at time t, and output a record for each: the
+   pericentres of the inner binary (the step before the separation starts to grow), the extrema
+   of its eccentricity and of the mutual inclination, and, if fb_classify() has just been called,
+   a change of classification.  The extrema need the elements, which are only as fresh as the
+   last call to fb_classify(), and are recognized some steps after they happen; their records
+   are those of the steps at which they happened, so traj has to hold back the records (see
+   fb_traj_sort()) until no earlier event can come. */
+void fb_traj_events(FILE *stream, fb_traj_t *traj, fb_traj_events_t *ev, fb_hier_t *hier, double t, int classified)
+{
+  double row[FB_TRAJ_NCOL], r, inc;
+  char string[FB_MAX_STRING_LENGTH];
+
+  if (traj == NULL && stream == NULL) {
+    return;
+  }
+
+  if (classified) {
+    fb_sprint_hier(*hier, string);
+    if (ev->hier[0] != '\0' && strcmp(string, ev->hier) != 0) {
+      fb_traj_output(stream, traj, FB_TRAJ_CLASSIFY, hier, t);
+      ev->nevent++;
+    }
+    strncpy(ev->hier, string, FB_MAX_STRING_LENGTH-1);
+    ev->hier[FB_MAX_STRING_LENGTH-1] = '\0';
+  }
+
+  /* the elements only mean something for a bound triple */
+  if (hier->nstar != 3 || hier->nobj != 1) {
+    ev->nstep = 0;
+    ev->edir = 0;
+    ev->idir = 0;
+    if (traj != NULL) {
+      fb_traj_hold(traj, t);
+    }
+    return;
+  }
+
+  fb_traj_row(hier, t, FB_TRAJ_STEP, row);
+  r = sqrt(fb_sqr(row[11]) + fb_sqr(row[12]) + fb_sqr(row[13]));
+  inc = acos(FB_MIN(FB_MAX(row[6], -1.0), 1.0)) * 180.0 / FB_CONST_PI;
+
+  if (ev->nstep == 0) {
+    ev->eext = row[3];
+    ev->iext = inc;
+  }
+
+  if (ev->peri && ev->nstep >= 2 && r > ev->r && ev->r <= ev->rprev) {
+    ev->row[0] = (double) FB_TRAJ_PERI;
+    fb_traj_emit(stream, traj, ev->row);
+    ev->nevent++;
+  }
+
+  fb_traj_events_extremum(stream, traj, ev, row[3], ev->etol, &(ev->edir), &(ev->eext), ev->erow, row,
+                          FB_TRAJ_EMAX, FB_TRAJ_EMIN);
+  fb_traj_events_extremum(stream, traj, ev, inc, ev->itol, &(ev->idir), &(ev->iext), ev->irow, row,
+                          FB_TRAJ_IMAX, FB_TRAJ_IMIN);
+
+  ev->rprev = ev->r;
+  ev->r = r;
+  memcpy(ev->row, row, FB_TRAJ_NCOL * sizeof(double));
+  ev->nstep++;
+
+  /* the earliest event still to come is one of the extrema being followed */
+  if (traj != NULL) {
+    fb_traj_hold(traj, FB_MIN(t, FB_MIN((ev->edir ? ev->erow[1] : t), (ev->idir ? ev->irow[1] : t))));
+  }
+}
+
+/* set up a writer on stream, without a writer thread */
+static void fb_traj_init(fb_traj_t *traj, FILE *stream, int text)
+{
+  traj->stream = stream;
+  traj->text = text;
+  traj->col = (text ? NULL : fb_malloc_vector(FB_TRAJ_NCOL * FB_TRAJ_NROW));
+  traj->nrow = 0;
+  traj->nrecord = 0;
+  traj->nblock = 0;
+  traj->err = 0;
+  traj->async = 0;
+  traj->nslot = 0;
+  traj->ring = NULL;
+  traj->buf = NULL;
+  traj->head = 0;
+  traj->tail = 0;
+  traj->nbatch = 0;
+  traj->nstall = 0;
+  traj->tstall = 0.0;
+  traj->maxfill = 0;
+  traj->seekable = 0;
+  traj->pend = NULL;
+  traj->npend = 0;
+  traj->eps = 0.0;
+  traj->code = NULL;
+  traj->nbyteraw = 0;
+  traj->nbytecode = 0;
+}
+
+/* start a binary trajectory on stream, writing the header with the units and run parameters;
+   the columns are compressed to within eps if it is positive.  Returns 0, or -1 if the header
+   cannot be written. */
+int fb_traj_open(fb_traj_t *traj, FILE *stream, fb_units_t units, fb_input_t input, double eps)
+{
+  int k;
+  fb_traj_header_t head;
+
+  memset(&head, 0, sizeof(fb_traj_header_t));
+  strncpy(head.magic, FB_TRAJ_MAGIC, sizeof(head.magic));
+  strncpy(head.version, FB_VERSION, sizeof(head.version)-1);
+  head.ncol = FB_TRAJ_NCOL;
+  head.nrowmax = FB_TRAJ_NROW;
+  head.one = 1.0;
+  head.eps = FB_MAX(eps, 0.0);
+  head.units = units;
+  head.tstop = input.tstop;
+  head.dt = input.dt;
+  head.tcpustop = input.tcpustop;
+  head.absacc = input.absacc;
+  head.relacc = input.relacc;
+  head.tidaltol = input.tidaltol;
+  head.speedtol = input.speedtol;
+  head.fexp = input.fexp;
+  head.ks = input.ks;
+  head.ncount = input.ncount;
+  head.outfreq = input.outfreq;
+  head.PN1 = input.PN1;
+  head.PN2 = input.PN2;
+  head.PN25 = input.PN25;
+  head.PN3 = input.PN3;
+  head.PN35 = input.PN35;
+  for (k=0; k<FB_TRAJ_NCOL; k++) {
+    strncpy(head.name[k], fb_traj_name[k], FB_TRAJ_NAMELEN-1);
+  }
+
+  fb_traj_init(traj, stream, 0);
+  traj->seekable = (ftell(stream) >= 0);
+  if (eps > 0.0) {
+    traj->eps = eps;
+    traj->code = (unsigned char *) malloc((size_t) FB_TRAJ_NCOL * FB_TRAJ_NROW * FB_TRAJ_MAXCODE);
+  }
+  traj->err = (fwrite(&head, sizeof(fb_traj_header_t), 1, stream) != 1);
+
+  return(traj->err ? -1 : 0);
+}
+
+/* start a writer of the legacy text lines on stream, so that they too can be handed to a
+   writer thread */
+void fb_traj_open_text(fb_traj_t *traj, FILE *stream)
+{
+  fb_traj_init(traj, stream, 1);
+}
+
+/* the quantum of the residuals of column k: the kind is coded exactly */
+static double fb_traj_quantum(int k, double eps)
+{
+  return(k == 0 ? 1.0 : 2.0 * eps);
+}
+
+/* the prediction of value i of a column from the decoded values before it */
+static double fb_traj_predict(double *x, int i)
+{
+  if (i >= 3) {
+    return(3.0 * x[i-1] - 3.0 * x[i-2] + x[i-3]);
+  } else if (i == 2) {
+    return(2.0 * x[i-1] - x[i-2]);
+  } else if (i == 1) {
+    return(x[0]);
+  } else {
+    return(0.0);
+  }
+}
+
+/* compress the nrow values of column x, whose values are replaced by the decoded ones, into
+   code; returns the number of bytes */
+static long fb_traj_encode(double *x, int nrow, double quantum, unsigned char *code)
+{
+  int i;
+  long n=0;
+  double p, r, q;
+  uint64_t u;
+
+  for (i=0; i<nrow; i++) {
+    p = fb_traj_predict(x, i);
+    q = floor((x[i] - p) / quantum + 0.5);
+    r = p + q * quantum;
+    if (fabs(q) < 4.0e15 && fabs(x[i] - r) <= 0.5 * quantum) {
+      /* zig-zag, plus one, as LEB128 */
+      u = (q >= 0.0 ? 2 * (uint64_t) q : 2 * (uint64_t) (-q) - 1) + 1;
+      while (u >= 0x80) {
+        code[n++] = (unsigned char) (u | 0x80);
+        u >>= 7;
+      }
+      code[n++] = (unsigned char) u;
+      x[i] = r;
+    } else {
+      code[n++] = 0;
+      memcpy(&(code[n]), &(x[i]), sizeof(double));
+      n += sizeof(double);
+    }
+  }
+
+  return(n);
+}
+
+/* decode the nrow values of column x from the nbyte bytes of code; returns the number of bytes
+   used, or -1 if code runs out */
+static long fb_traj_decode(unsigned char *code, long nbyte, int nrow, double quantum, double *x)
+{
+  int i, shift;
+  long n=0;
+  uint64_t u;
+
+  for (i=0; i<nrow; i++) {
+    u = 0;
+    shift = 0;
+    do {
+      if (n >= nbyte || shift > 63) {
+        return(-1);
+      }
+      u |= ((uint64_t) (code[n] & 0x7f)) << shift;
+      shift += 7;
+    } while (code[n++] & 0x80);
+
+    if (u == 0) {
+      if (n + (long) sizeof(double) > nbyte) {
+        return(-1);
+      }
+      memcpy(&(x[i]), &(code[n]), sizeof(double));
+      n += sizeof(double);
+    } else {
+      u--;
+      x[i] = fb_traj_predict(x, i) + ((u & 1) ? -(double) ((u + 1) / 2) : (double) (u / 2)) * quantum;
+    }
+  }
+
+  return(n);
+}
+
+/* write out the records collected so far as a block, padded to nrowmax records or compressed;
+   the magic goes in last, if the stream can seek, so that a reader never takes a block being
+   written for a complete one */
+static void fb_traj_write_block(fb_traj_t *traj)
+{
+  int k;
+  fb_traj_block_t block;
+
+  memset(&block, 0, sizeof(fb_traj_block_t));
+  block.nrow = traj->nrow;
+  block.tmin = traj->col[1*FB_TRAJ_NROW];
+  block.tmax = traj->col[1*FB_TRAJ_NROW + traj->nrow - 1];
+  if (!traj->seekable) {
+    strncpy(block.magic, FB_TRAJ_BLOCK_MAGIC, sizeof(block.magic));
+  }
+
+  if (traj->code != NULL) {
+    for (k=0; k<FB_TRAJ_NCOL; k++) {
+      block.nbyte += fb_traj_encode(&(traj->col[k*FB_TRAJ_NROW]), traj->nrow, fb_traj_quantum(k, traj->eps),
+                                    &(traj->code[block.nbyte]));
+    }
+    traj->nbyteraw += FB_TRAJ_NCOL * traj->nrow * sizeof(double);
+    traj->nbytecode += block.nbyte;
+    if (fwrite(&block, sizeof(fb_traj_block_t), 1, traj->stream) != 1 ||
+        fwrite(traj->code, 1, block.nbyte, traj->stream) != (size_t) block.nbyte) {
+      traj->err = 1;
+    }
+  } else {
+    for (k=0; k<FB_TRAJ_NCOL; k++) {
+      memset(&(traj->col[k*FB_TRAJ_NROW + traj->nrow]), 0, (FB_TRAJ_NROW - traj->nrow) * sizeof(double));
+    }
+    block.nbyte = FB_TRAJ_NCOL * FB_TRAJ_NROW * sizeof(double);
+    if (fwrite(&block, sizeof(fb_traj_block_t), 1, traj->stream) != 1 ||
+        fwrite(traj->col, sizeof(double), FB_TRAJ_NCOL * FB_TRAJ_NROW, traj->stream) != FB_TRAJ_NCOL * FB_TRAJ_NROW) {
+      traj->err = 1;
+    }
+  }
+
+  if (traj->seekable) {
+    strncpy(block.magic, FB_TRAJ_BLOCK_MAGIC, sizeof(block.magic));
+    if (fflush(traj->stream) != 0 ||
+        fseek(traj->stream, -(long) (sizeof(fb_traj_block_t) + block.nbyte), SEEK_CUR) != 0 ||
+        fwrite(block.magic, sizeof(block.magic), 1, traj->stream) != 1 ||
+        fflush(traj->stream) != 0 || fseek(traj->stream, 0, SEEK_END) != 0) {
+      traj->err = 1;
+    }
+  }
+
+  traj->nrow = 0;
+  traj->nblock++;
+}
+
+/* write a record out, or add it to the block being collected: done by the integrator, or by
+   the writer thread if there is one */
+static void fb_traj_put(fb_traj_t *traj, double *row)
+{
+  int k;
+
+  if (traj->text) {
+    fb_traj_print_text(traj->stream, row);
+  } else {
+    for (k=0; k<FB_TRAJ_NCOL; k++) {
+      traj->col[k*FB_TRAJ_NROW + traj->nrow] = row[k];
+    }
+    traj->nrow++;
+    if (traj->nrow == FB_TRAJ_NROW) {
+      fb_traj_write_block(traj);
+    }
+  }
+}
+
+/* wall-clock time, in seconds */
+static double fb_traj_wall_time(void)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return((double) now.tv_sec + 1.0e-9 * ((double) now.tv_nsec));
+}
+
+/* the writer thread: wait until the ring is half full, take out everything in it, and format
+   and write it; text lines are collected in buf so that each batch is one large write */
+static void *fb_traj_writer(void *arg)
+{
+  long i, n, len, size;
+  fb_traj_t *traj=(fb_traj_t *) arg;
+
+  size = (long) traj->nslot / 2 * FB_TRAJ_LINELEN;
+
+  pthread_mutex_lock(&(traj->lock));
+  while (1) {
+    while (traj->head - traj->tail < traj->nslot / 2 && !traj->flushreq && !traj->done) {
+      pthread_cond_wait(&(traj->nonempty), &(traj->lock));
+    }
+    n = traj->head - traj->tail;
+    if (n == 0 && traj->done) {
+      break;
+    }
+    pthread_mutex_unlock(&(traj->lock));
+
+    /* the integrator only writes the slots from head on, so these are ours until tail moves */
+    len = 0;
+    for (i=traj->tail; i<traj->tail+n; i++) {
+      if (traj->text) {
+        len += fb_traj_sprint_text(&(traj->buf[len]), &(traj->ring[(i % traj->nslot) * FB_TRAJ_NCOL]));
+        if (len > size - FB_TRAJ_LINELEN) {
+          traj->err |= (fwrite(traj->buf, 1, len, traj->stream) != (size_t) len);
+          len = 0;
+        }
+      } else {
+        fb_traj_put(traj, &(traj->ring[(i % traj->nslot) * FB_TRAJ_NCOL]));
+      }
+    }
+    if (len > 0) {
+      traj->err |= (fwrite(traj->buf, 1, len, traj->stream) != (size_t) len);
+    }
+
+    pthread_mutex_lock(&(traj->lock));
+    traj->tail += n;
+    traj->nbatch += (n > 0);
+    if (traj->head == traj->tail) {
+      traj->flushreq = 0;
+    }
+    pthread_cond_broadcast(&(traj->nonfull));
+  }
+  pthread_mutex_unlock(&(traj->lock));
+
+  return(NULL);
+}
+
+/* hand the formatting and writing of the records to a writer thread, through a ring of nslot
+   records; returns 0, or -1 if the thread cannot be started, in which case the integrator
+   carries on writing the records itself */
+int fb_traj_start(fb_traj_t *traj, int nslot)
+{
+  traj->nslot = FB_MAX(nslot, 2);
+  traj->ring = fb_malloc_vector(traj->nslot * FB_TRAJ_NCOL);
+  traj->buf = (traj->text ? (char *) malloc((size_t) (traj->nslot / 2) * FB_TRAJ_LINELEN) : NULL);
+  traj->head = 0;
+  traj->tail = 0;
+  traj->flushreq = 0;
+  traj->done = 0;
+  pthread_mutex_init(&(traj->lock), NULL);
+  pthread_cond_init(&(traj->nonempty), NULL);
+  pthread_cond_init(&(traj->nonfull), NULL);
+
+  if ((traj->text && traj->buf == NULL) || pthread_create(&(traj->thread), NULL, fb_traj_writer, traj) != 0) {
+    pthread_mutex_destroy(&(traj->lock));
+    pthread_cond_destroy(&(traj->nonempty));
+    pthread_cond_destroy(&(traj->nonfull));
+    fb_free_vector(traj->ring);
+    free(traj->buf);
+    traj->ring = NULL;
+    traj->buf = NULL;
+    return(-1);
+  }
+  traj->async = 1;
+
+  return(0);
+}
+
+/* send a record on: put it in the ring if there is a writer thread, waiting while the ring is
+   full, or else write it out directly */
+static void fb_traj_send(fb_traj_t *traj, double *row)
+{
+  long fill;
+  double tstart;
+
+  if (!traj->async) {
+    fb_traj_put(traj, row);
+    return;
+  }
+
+  pthread_mutex_lock(&(traj->lock));
+  if (traj->head - traj->tail == traj->nslot) {
+    traj->nstall++;
+    tstart = fb_traj_wall_time();
+    while (traj->head - traj->tail == traj->nslot) {
+      pthread_cond_signal(&(traj->nonempty));
+      pthread_cond_wait(&(traj->nonfull), &(traj->lock));
+    }
+    traj->tstall += fb_traj_wall_time() - tstart;
+  }
+  memcpy(&(traj->ring[(traj->head % traj->nslot) * FB_TRAJ_NCOL]), row, FB_TRAJ_NCOL * sizeof(double));
+  traj->head++;
+  fill = traj->head - traj->tail;
+  traj->maxfill = FB_MAX(traj->maxfill, fill);
+  if (fill == traj->nslot / 2) {
+    pthread_cond_signal(&(traj->nonempty));
+  }
+  pthread_mutex_unlock(&(traj->lock));
+}
+
+/* send on the held-back records up to time t, in order of time */
+static void fb_traj_release(fb_traj_t *traj, double t)
+{
+  int n;
+
+  for (n=0; n<traj->npend && traj->pend[n*FB_TRAJ_NCOL + 1] <= t; n++) {
+    fb_traj_send(traj, &(traj->pend[n*FB_TRAJ_NCOL]));
+  }
+  if (n > 0) {
+    memmove(traj->pend, &(traj->pend[n*FB_TRAJ_NCOL]), (traj->npend - n) * FB_TRAJ_NCOL * sizeof(double));
+    traj->npend -= n;
+  }
+}
+
+/* hold records back from now on until no record of an earlier time can come, as told by
+   fb_traj_hold(), so that the records stay in order of time although events are only
+   recognized some steps after they happen */
+void fb_traj_sort(fb_traj_t *traj)
+{
+  if (traj->pend == NULL) {
+    traj->pend = fb_malloc_vector(FB_TRAJ_NPEND * FB_TRAJ_NCOL);
+    traj->npend = 0;
+    traj->hold = GSL_NEGINF;
+  }
+}
+
+/* no record earlier than time t is to come, so the held-back records up to t can go */
+void fb_traj_hold(fb_traj_t *traj, double t)
+{
+  if (traj->pend != NULL) {
+    traj->hold = t;
+    fb_traj_release(traj, t);
+  }
+}
+
+/* write a record, holding it back among the others in order of time if fb_traj_sort() has
+   been called */
+void fb_traj_write(fb_traj_t *traj, double row[FB_TRAJ_NCOL])
+{
+  int n;
+
+  traj->nrecord++;
+
+  if (traj->pend == NULL) {
+    fb_traj_send(traj, row);
+    return;
+  }
+
+  if (traj->npend == FB_TRAJ_NPEND) {
+    /* held back for too long: the oldest goes now, out of order if need be */
+    fb_traj_release(traj, traj->pend[1]);
+  }
+  for (n=traj->npend; n>0 && traj->pend[(n-1)*FB_TRAJ_NCOL + 1] > row[1]; n--);
+  memmove(&(traj->pend[(n+1)*FB_TRAJ_NCOL]), &(traj->pend[n*FB_TRAJ_NCOL]), (traj->npend - n) * FB_TRAJ_NCOL * sizeof(double));
+  memcpy(&(traj->pend[n*FB_TRAJ_NCOL]), row, FB_TRAJ_NCOL * sizeof(double));
+  traj->npend++;
+  fb_traj_release(traj, traj->hold);
+}
+
+/* write out every record so far, the held-back ones, the ones in the ring and the partial
+   block, and flush the stream, so that a reader sees every record written before the call;
+   returns 0, or -1 if any write has failed */
+int fb_traj_flush(fb_traj_t *traj)
+{
+  if (traj->pend != NULL) {
+    fb_traj_release(traj, GSL_POSINF);
+  }
+
+  if (traj->async) {
+    pthread_mutex_lock(&(traj->lock));
+    traj->flushreq = 1;
+    pthread_cond_signal(&(traj->nonempty));
+    while (traj->flushreq) {
+      pthread_cond_wait(&(traj->nonfull), &(traj->lock));
+    }
+  }
+
+  /* the writer thread is idle now, waiting for the ring to fill up again */
+  if (!traj->text && traj->nrow > 0) {
+    fb_traj_write_block(traj);
+  }
+  if (fflush(traj->stream) != 0) {
+    traj->err = 1;
+  }
+
+  if (traj->async) {
+    pthread_mutex_unlock(&(traj->lock));
+  }
+
+  return(traj->err ? -1 : 0);
+}
+
+/* write out everything, stop the writer thread and free the writer (the stream stays open);
+   returns 0, or -1 if any write has failed */
+int fb_traj_close(fb_traj_t *traj)
+{
+  if (traj->pend != NULL) {
+    fb_traj_release(traj, GSL_POSINF);
+    fb_free_vector(traj->pend);
+    traj->pend = NULL;
+  }
+
+  if (traj->async) {
+    pthread_mutex_lock(&(traj->lock));
+    traj->done = 1;
+    pthread_cond_signal(&(traj->nonempty));
+    pthread_mutex_unlock(&(traj->lock));
+    pthread_join(traj->thread, NULL);
+
+    pthread_mutex_destroy(&(traj->lock));
+    pthread_cond_destroy(&(traj->nonempty));
+    pthread_cond_destroy(&(traj->nonfull));
+    fb_free_vector(traj->ring);
+    free(traj->buf);
+    traj->ring = NULL;
+    traj->buf = NULL;
+    traj->async = 0;
+  }
+
+  fb_traj_flush(traj);
+  if (traj->col != NULL) {
+    fb_free_vector(traj->col);
+    traj->col = NULL;
+  }
+  free(traj->code);
+  traj->code = NULL;
+
+  return(traj->err ? -1 : 0);
+}
+
+/* read and check the header of a binary trajectory; returns 0, or -1 if it is not one that
+   this build can read */
+int fb_traj_read_header(FILE *stream, fb_traj_header_t *head)
+{
+  if (fread(head, sizeof(fb_traj_header_t), 1, stream) != 1 ||
+      strncmp(head->magic, FB_TRAJ_MAGIC, sizeof(head->magic)) != 0 ||
+      head->one != 1.0 || head->ncol != FB_TRAJ_NCOL || head->nrowmax < 1) {
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* read the next block of a binary trajectory into col, which must have room for ncol columns
+   of nrowmax records, decoding it if it is compressed; column k of the block starts at
+   col[k*nrowmax].  Returns the number of records, 0 at the end of the complete blocks, or -1
+   if the block is damaged. */
+int fb_traj_read_block(FILE *stream, fb_traj_header_t *head, fb_traj_block_t *block, double *col)
+{
+  int k;
+  long n, nbyte;
+  char blank[sizeof(block->magic)];
+  unsigned char *code;
+
+  memset(blank, 0, sizeof(blank));
+  if (fread(block, sizeof(fb_traj_block_t), 1, stream) != 1 ||
+      memcmp(block->magic, blank, sizeof(blank)) == 0) {
+    return(0);
+  }
+  if (strncmp(block->magic, FB_TRAJ_BLOCK_MAGIC, sizeof(block->magic)) != 0 ||
+      block->nrow < 1 || block->nrow > head->nrowmax || block->nbyte < 0 ||
+      block->nbyte > (int64_t) head->ncol * head->nrowmax * FB_TRAJ_MAXCODE) {
+    return(-1);
+  }
+
+  if (head->eps <= 0.0) {
+    if (fread(col, sizeof(double), head->ncol * head->nrowmax, stream) != (size_t) (head->ncol * head->nrowmax)) {
+      return(0);
+    }
+    return(block->nrow);
+  }
+
+  nbyte = (long) block->nbyte;
+  if ((code = (unsigned char *) malloc((size_t) FB_MAX(nbyte, 1))) == NULL) {
+    return(-1);
+  }
+  if (fread(code, 1, nbyte, stream) != (size_t) nbyte) {
+    free(code);
+    return(0);
+  }
+  for (k=0, n=0; k<head->ncol; k++) {
+    if ((nbyte = fb_traj_decode(&(code[n]), (long) block->nbyte - n, block->nrow, fb_traj_quantum(k, head->eps),
+                                &(col[k*head->nrowmax]))) < 0) {
+      free(code);
+      return(-1);
+    }
+    n += nbyte;
+  }
+  free(code);
+
+  return(block->nrow);
+}
+
+/* map the binary trajectory filename into memory, for reading it in place; returns 0, or -1
+   if it cannot be mapped or is not an uncompressed trajectory this build can read */
+int fb_traj_map(fb_traj_map_t *map, char *filename)
+{
+  map->map = NULL;
+  map->size = 0;
+  map->nblock = 0;
+
+  if ((map->fd = open(filename, O_RDONLY)) < 0) {
+    return(-1);
+  }
+
+  if (fb_traj_remap(map) != 0) {
+    fb_traj_unmap(map);
+    return(-1);
+  }
+
+  return(0);
+}
+
+/* map the file again, to take in the blocks written since it was mapped; returns 0, or -1 if
+   it cannot be mapped or is not a trajectory this build can read */
+int fb_traj_remap(fb_traj_map_t *map)
+{
+  long b;
+  struct stat st;
+
+  if (fstat(map->fd, &st) != 0 || (size_t) st.st_size < sizeof(fb_traj_header_t)) {
+    return(-1);
+  }
+
+  if ((size_t) st.st_size != map->size) {
+    if (map->map != NULL) {
+      munmap(map->map, map->size);
+    }
+    map->size = (size_t) st.st_size;
+    if ((map->map = (char *) mmap(NULL, map->size, PROT_READ, MAP_SHARED, map->fd, 0)) == MAP_FAILED) {
+      map->map = NULL;
+      map->size = 0;
+      return(-1);
+    }
+  }
+
+  map->head = (fb_traj_header_t *) map->map;
+  if (strncmp(map->head->magic, FB_TRAJ_MAGIC, sizeof(map->head->magic)) != 0 ||
+      map->head->one != 1.0 || map->head->ncol != FB_TRAJ_NCOL || map->head->nrowmax < 1 ||
+      map->head->eps > 0.0) {
+    return(-1);
+  }
+  map->blocksize = sizeof(fb_traj_block_t) + (size_t) map->head->ncol * map->head->nrowmax * sizeof(double);
+
+  /* the blocks that fit in the file, less any at the end still being written */
+  map->nblock = (long) ((map->size - sizeof(fb_traj_header_t)) / map->blocksize);
+  for (b=map->nblock-1; b>=0 && fb_traj_map_block(map, b) == NULL; b--) {
+    map->nblock = b;
+  }
+
+  return(0);
+}
+
+/* unmap the file */
+void fb_traj_unmap(fb_traj_map_t *map)
+{
+  if (map->map != NULL) {
+    munmap(map->map, map->size);
+  }
+  close(map->fd);
+  map->map = NULL;
+  map->size = 0;
+  map->nblock = 0;
+}
+
+/* the header of block b, or NULL if it is not complete */
+fb_traj_block_t *fb_traj_map_block(fb_traj_map_t *map, long b)
+{
+  fb_traj_block_t *block;
+
+  if (b < 0 || sizeof(fb_traj_header_t) + (size_t) (b+1) * map->blocksize > map->size) {
+    return(NULL);
+  }
+
+  block = (fb_traj_block_t *) (map->map + sizeof(fb_traj_header_t) + (size_t) b * map->blocksize);
+  if (strncmp(block->magic, FB_TRAJ_BLOCK_MAGIC, sizeof(block->magic)) != 0 ||
+      block->nrow < 1 || block->nrow > map->head->nrowmax) {
+    return(NULL);
+  }
+
+  return(block);
+}
+
+/* column k of block b, in place; the first nrow of the block's records are valid */
+double *fb_traj_map_column(fb_traj_map_t *map, long b, int k)
+{
+  return((double *) (map->map + sizeof(fb_traj_header_t) + (size_t) b * map->blocksize +
+                     sizeof(fb_traj_block_t) + (size_t) k * map->head->nrowmax * sizeof(double)));
+}
+
+/* find the last record at or before time t, by bisection over the blocks and then over the
+   times of the block; returns 0 with the record in block b at row i, or -1 if every record is
+   after t (or there are none) */
+int fb_traj_map_find(fb_traj_map_t *map, double t, long *b, int *i)
+{
+  long lo, hi, mid;
+  double *tcol;
+
+  if (map->nblock == 0 || fb_traj_map_block(map, 0)->tmin > t) {
+    return(-1);
+  }
+
+  /* the last block that starts at or before t */
+  lo = 0;
+  hi = map->nblock - 1;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (fb_traj_map_block(map, mid)->tmin <= t) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  *b = lo;
+
+  /* the last record of it at or before t */
+  tcol = fb_traj_map_column(map, lo, 1);
+  lo = 0;
+  hi = fb_traj_map_block(map, *b)->nrow - 1;
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (tcol[mid] <= t) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  *i = (int) lo;
+
+  return(0);
+}
+
+/* copy record i of block b into row */
+void fb_traj_map_row(fb_traj_map_t *map, long b, int i, double row[FB_TRAJ_NCOL])
+{
+  int k;
+
+  for (k=0; k<FB_TRAJ_NCOL; k++) {
+    row[k] = fb_traj_map_column(map, b, k)[i];
+  }
+}
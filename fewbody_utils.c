@@ -217,11 +217,12 @@ double fb_outerketot(fb_obj_t **obj, int nobj)
   return(ke);
 }
 
-/* solve the Kepler equation for the eccentric anomaly, given the mean anomaly and eccentricity */
-double fb_kepler(double e, double mean_anom)
+/* solve the Kepler equation for the eccentric anomaly, given the mean anomaly and eccentricity;
+   returns FB_E_KEPLER if the root finder fails */
+int fb_kepler(double e, double mean_anom, double *ecc_anom)
 {
   int status, iter;
-  double ecc_anom, params[2];
+  double params[2];
   gsl_function F;
   const gsl_root_fsolver_type *T;
   gsl_root_fsolver *s;
@@ -236,29 +237,35 @@ double fb_kepler(double e, double mean_anom)
 
   T = gsl_root_fsolver_brent;
   s = gsl_root_fsolver_alloc(T);
-  gsl_root_fsolver_set(s, &F, 0.0, 2.0*FB_CONST_PI);
+  status = gsl_root_fsolver_set(s, &F, 0.0, 2.0*FB_CONST_PI);
   
   /* get eccentric anomaly by root-finding */
   iter = 0;
-  do {
+  while (status == GSL_SUCCESS || status == GSL_CONTINUE) {
     iter++;
-    gsl_root_fsolver_iterate(s);
+    if ((status = gsl_root_fsolver_iterate(s)) != GSL_SUCCESS) {
+      break;
+    }
     status = gsl_root_test_interval(gsl_root_fsolver_x_lower(s), gsl_root_fsolver_x_upper(s), \
             FB_ROOTSOLVER_ABS_ACC, FB_ROOTSOLVER_REL_ACC);
-  } while (status == GSL_CONTINUE && iter < FB_ROOTSOLVER_MAX_ITER);
+    if (status == GSL_SUCCESS || iter >= FB_ROOTSOLVER_MAX_ITER) {
+      break;
+    }
+  }
 
-  if (iter >= FB_ROOTSOLVER_MAX_ITER) {
-    fprintf(stderr, "Root finder failed to converge.\n");
-    exit(1);
+  if (status != GSL_SUCCESS) {
+    fb_dprintf("fb_kepler: root finder failed to converge: e=%g mean_anom=%g iter=%d\n", e, mean_anom, iter);
+    gsl_root_fsolver_free(s);
+    return(FB_E_KEPLER);
   }
 
   /* we've got the root */
-  ecc_anom = gsl_root_fsolver_root(s);
+  *ecc_anom = gsl_root_fsolver_root(s);
   
   /* free memory associated with root solver */
   gsl_root_fsolver_free(s);
 
-  return(ecc_anom);
+  return(FB_OK);
 }
 
 /* the Kepler function for the root finder */
@@ -33,6 +33,82 @@
 #include "fewbody.h"
 #include "triple.h"
 
+/* the options that have no short form */
+#define TRIPLE_OPT_ASYNC 256
+#define TRIPLE_OPT_EVENTS 257
+#define TRIPLE_OPT_COMPRESS 258
+#define TRIPLE_OPT_SUMMARY 259
+#define TRIPLE_OPT_SUMMARYBINARY 260
+#define TRIPLE_OPT_REDUCE 261
+#define TRIPLE_OPT_SINK 262
+#define TRIPLE_OPT_TELEMETRY 263
+
+/* the sinks of the output channels, which outlive the runs */
+static fb_sink_t triple_sink[FB_NCHAN];
+
+/* the live status of the runs, for fbmon */
+static fb_telem_seg_t triple_telem;
+
+/* parse an events spec, a comma-separated list of e=<tol>, i=<tol in degrees> and peri=0|1;
+   returns 1 if it is invalid */
+static int triple_parse_events(char *spec, fb_input_t *input)
+{
+  int status=0;
+  char buf[FB_MAX_STRING_LENGTH], *item, *value, *saveptr, *end;
+
+  strncpy(buf, spec, FB_MAX_STRING_LENGTH-1);
+  buf[FB_MAX_STRING_LENGTH-1] = '\0';
+
+  for (item=strtok_r(buf, ",", &saveptr); item!=NULL; item=strtok_r(NULL, ",", &saveptr)) {
+    if ((value = strchr(item, '=')) == NULL) {
+      status = 1;
+      break;
+    }
+    *(value++) = '\0';
+
+    if (strcmp(item, "e") == 0) {
+      input->eventetol = strtod(value, &end);
+      status = (*end != '\0' || input->eventetol < 0.0);
+    } else if (strcmp(item, "i") == 0) {
+      input->eventitol = strtod(value, &end);
+      status = (*end != '\0' || input->eventitol < 0.0);
+    } else if (strcmp(item, "peri") == 0) {
+      input->eventperi = strtol(value, &end, 10);
+      status = (*end != '\0' || (input->eventperi != 0 && input->eventperi != 1));
+    } else {
+      status = 1;
+    }
+
+    if (status) {
+      break;
+    }
+  }
+
+  return(status);
+}
+
+/* parse a sink spec, <channel>=<sink>, into sinkspec[channel]; returns 1 if it is invalid */
+static int triple_parse_sink(char *spec, char *sinkspec[FB_NCHAN])
+{
+  int c;
+  char buf[FB_MAX_STRING_LENGTH], *value;
+
+  strncpy(buf, spec, FB_MAX_STRING_LENGTH-1);
+  buf[FB_MAX_STRING_LENGTH-1] = '\0';
+
+  if ((value = strchr(buf, '=')) == NULL || value[1] == '\0') {
+    return(1);
+  }
+  *value = '\0';
+
+  if ((c = fb_sink_channel(buf)) < 0) {
+    return(1);
+  }
+  sinkspec[c] = &(spec[value + 1 - buf]);
+
+  return(0);
+}
+
 /* print the usage */
 void print_usage(FILE *stream)
 {
@@ -60,6 +136,36 @@ void print_usage(FILE *stream)
   fprintf(stream, "  -N --ncount <ncount>         : set number of integration steps between calls\n");
   fprintf(stream, "                                 to fb_classify() [%d]\n", FB_NCOUNT);
   fprintf(stream, "  -O --outputfreq <outputfreq> : set the output frequency (-1 for no output) [%d]\n", FB_OUTFREQ);
+  fprintf(stream, "  -v --binary <file>           : write the trajectory to <file> in the binary columnar format\n");
+  fprintf(stream, "                                 of fewbody.h instead of as text lines on stdout (single runs\n");
+  fprintf(stream, "                                 only; fbtraj converts it back to text)\n");
+  fprintf(stream, "     --compress <eps>         : compress the binary trajectory of -v, keeping every value to\n");
+  fprintf(stream, "                                 within <eps> (N-body units); fbtraj decodes it, but cannot\n");
+  fprintf(stream, "                                 look up a time in it with -t\n");
+  fprintf(stream, "     --events[=<spec>]        : write a record at each extremum of the inner eccentricity and of\n");
+  fprintf(stream, "                                 the mutual inclination, and at each change of classification,\n");
+  fprintf(stream, "                                 instead of every -O steps (unless -O is given too); an event's\n");
+  fprintf(stream, "                                 text line starts with its name (emax, emin, imax, imin, classify,\n");
+  fprintf(stream, "                                 peri); spec is a comma-separated list of\n");
+  fprintf(stream, "                                   e=<how far e has to turn back for an extremum to count>\n");
+  fprintf(stream, "                                   i=<the same for the inclination, in degrees>\n");
+  fprintf(stream, "                                   peri=1  (a record at every pericentre of the inner binary too)\n");
+  fprintf(stream, "                                 [e=%.6g,i=%.6g,peri=0]\n", FB_EVENTETOL, FB_EVENTITOL);
+  fprintf(stream, "     --async <nslot>          : hand the trajectory of a single run to a writer thread through\n");
+  fprintf(stream, "                                 a ring of <nslot> records, so that the integrator does not wait\n");
+  fprintf(stream, "                                 for formatting and writes (0 for %d)\n", FB_TRAJ_NSLOT);
+  fprintf(stream, "     --sink <chan>=<sink>     : send an output channel to a sink of its own instead of stdout;\n");
+  fprintf(stream, "                                 chan is traj, events, story, summary or debug, and sink is\n");
+  fprintf(stream, "                                   <file>, - (stdout), &<n> (the open descriptor <n>),\n");
+  fprintf(stream, "                                   null (discard, without even formatting the output) or\n");
+  fprintf(stream, "                                   ring:<bytes>[:<file>] (keep only the last <bytes> in memory,\n");
+  fprintf(stream, "                                   and write them to <file>, or stdout, at the end)\n");
+  fprintf(stream, "                                 the events go with the trajectory, in order of time, unless\n");
+  fprintf(stream, "                                 given a sink of their own; -b, -l, -Y and -L take only\n");
+  fprintf(stream, "                                 summary and null sinks (may be given once per channel)\n");
+  fprintf(stream, "     --telemetry[=<nstep>]    : publish the live status of each integration every <nstep> steps\n");
+  fprintf(stream, "                                 in the shared-memory segment %s<pid>, for fbmon to\n", FB_TELEM_PREFIX);
+  fprintf(stream, "                                 watch (-f, -l, -Y and -L cannot be used) [%d]\n", FB_TELEMFREQ);
   fprintf(stream, "  -z --tidaltol <tidaltol>     : set tidal tolerance [%.6g]\n", FB_TIDALTOL);
   fprintf(stream, "  -y --speedtol <speedtol>     : set speed tolerance [%.6g]\n", FB_SPEEDTOL);
   fprintf(stream, "  -P --PN1 <PN1>               : PN1 terms on? [%d]\n", FB_PN1);
@@ -70,6 +176,89 @@ void print_usage(FILE *stream)
   fprintf(stream, "  -x --fexp <f_exp>            : set expansion factor of merger product [%.6g]\n", FB_FEXP);
   fprintf(stream, "  -k --ks                      : turn K-S regularization on or off [%d]\n", FB_KS);
   fprintf(stream, "  -s --seed                    : set random seed [%ld]\n", FB_SEED);
+  fprintf(stream, "  -b --batch <file>            : run the initial conditions in <file> (\"-\" for stdin) one after\n");
+  fprintf(stream, "                                 another, one per line:\n");
+  fprintf(stream, "                                   m000 m001 m01 a00 a0 e00 e0 inc peri_in peri_out [seed]\n");
+  fprintf(stream, "                                 (units as above); a summary line per system goes to stderr\n");
+  fprintf(stream, "     --summary <sink>         : write a summary record of every run to <sink> (see --sink) as\n");
+  fprintf(stream, "                                 a JSON line, with the inputs, the outcome, the step, force\n");
+  fprintf(stream, "                                 evaluation and classify counts and where the cpu time went\n");
+  fprintf(stream, "                                 (see triple.h; -X, -G, -J and -Z cannot be used)\n");
+  fprintf(stream, "     --summary-binary <sink>  : the same, as fixed-size binary records\n");
+  fprintf(stream, "     --reduce <file>          : write to <file> (\"-\" for stdout) the outcome counts and the\n");
+  fprintf(stream, "                                 histograms and quantiles of the merger time, 1-e_max and the cpu\n");
+  fprintf(stream, "                                 time of all the runs of -b, -Y or -l, weighted by the importance\n");
+  fprintf(stream, "                                 weights, instead of the trajectories (unless -O is given too)\n");
+  fprintf(stream, "  -j --threads <n>             : run the batch on <n> threads; lines without a seed get one\n");
+  fprintf(stream, "                                 derived from --seed, and each trajectory is preceded by a\n");
+  fprintf(stream, "                                 \"# job\" line [%d]\n", FB_NTHREADS);
+  fprintf(stream, "  -f --lockstep                : integrate the batch %d systems at a time on each of the -j\n", FB_SIMD_WIDTH);
+  fprintf(stream, "                                 threads, in lockstep so that the force evaluations of the\n");
+  fprintf(stream, "                                 systems vectorize, with a Dormand-Prince 5(4) integrator and\n");
+  fprintf(stream, "                                 without trajectories (-k and -H cannot be used)\n");
+  fprintf(stream, "  -w --workers <n>             : run the batch in <n> forked worker processes instead, so\n");
+  fprintf(stream, "                                 that a crash only loses the job it happened in [%d]\n", FB_NWORKERS);
+  fprintf(stream, "  -u --shard <i>/<n>           : run only shard <i> of <n> of the batch (the jobs whose line\n");
+  fprintf(stream, "                                 number is <i> modulo <n>), with the -j threads or -w workers;\n");
+  fprintf(stream, "                                 the master seed is --seed or else a hash of the batch file,\n");
+  fprintf(stream, "                                 so every shard derives the same seed for a job\n");
+  fprintf(stream, "  -W --results <file>          : write the results of the shard to the binary file <file>\n");
+  fprintf(stream, "  -J --merge <file>            : check the shard results files given after the options for\n");
+  fprintf(stream, "                                 missing and duplicated shards and jobs, concatenate them into\n");
+  fprintf(stream, "                                 <file> (\"-\" to print them as summary lines to stdout instead)\n");
+  fprintf(stream, "                                 and exit, with status 1 if anything is missing or duplicated\n");
+  fprintf(stream, "  -G --generate <n>            : write a batch table of <n> stable triples drawn from the\n");
+  fprintf(stream, "                                 population of -M, with the masses above, and exit\n");
+  fprintf(stream, "  -M --population <spec>       : set the population, as a comma-separated list of\n");
+  fprintf(stream, "                                   a00=<min>:<max> a0=<min>:<max>  (AU, log-uniform)\n");
+  fprintf(stream, "                                   e00=<e> e0=<e>  (thermal, uniform or a value)\n");
+  fprintf(stream, "                                   sampler=sobol|random\n");
+  fprintf(stream, "                                 and for importance sampling of rare outcomes\n");
+  fprintf(stream, "                                   incbias=<w>  (f(cos i) ~ exp(-|cos i|/w))\n");
+  fprintf(stream, "                                   e00bias=<k>  (f(e00) ~ e00^k)\n");
+  fprintf(stream, "                                 which add seed and weight columns to the table\n");
+  fprintf(stream, "                                 [a00=%.6g:%.6g,a0=%.6g:%.6g,e00=thermal,e0=thermal,sampler=sobol]\n",
+    TRIPLE_POP_A00MIN, TRIPLE_POP_A00MAX, TRIPLE_POP_A0MIN, TRIPLE_POP_A0MAX);
+  fprintf(stream, "  -l --listen <socket>         : run as a job server on the Unix domain socket <socket> (\"-\"\n");
+  fprintf(stream, "                                 for stdin/stdout), integrating requests on the -j threads\n");
+  fprintf(stream, "                                 and streaming the results back (see triple.h)\n");
+  fprintf(stream, "  -Y --refine <spec>           : map the outcome over (inc, e0, a0/a00) by adaptive refinement on\n");
+  fprintf(stream, "                                 the -j threads, splitting the cells whose corners differ in\n");
+  fprintf(stream, "                                 retval, merging or merger time; spec is a comma-separated list of\n");
+  fprintf(stream, "                                   inc=<min>:<max>  (degrees)  e0=<min>:<max>\n");
+  fprintf(stream, "                                   ratio=<min>:<max>  (a0/a00, log-uniform)\n");
+  fprintf(stream, "                                   n=<coarse points per axis>  depth=<levels>\n");
+  fprintf(stream, "                                   ttol=<merger time tolerance in dex>\n");
+  fprintf(stream, "                                 and the map goes to stdout, without trajectories\n");
+  fprintf(stream, "                                 [inc=%.6g:%.6g,e0=%.6g:%.6g,ratio=%.6g:%.6g,n=%d,depth=%d,ttol=%.6g]\n",
+    TRIPLE_REFINE_INCMIN, TRIPLE_REFINE_INCMAX, TRIPLE_REFINE_E0MIN, TRIPLE_REFINE_E0MAX,
+    TRIPLE_REFINE_RATIOMIN, TRIPLE_REFINE_RATIOMAX, TRIPLE_REFINE_N, TRIPLE_REFINE_DEPTH, TRIPLE_REFINE_TTOL);
+  fprintf(stream, "  -L --parareal <spec>         : integrate the single triple by Parareal, running the time\n");
+  fprintf(stream, "                                 slices on the -j threads, each corrected by a coarse\n");
+  fprintf(stream, "                                 integration with looser accuracies; spec is a comma-separated\n");
+  fprintf(stream, "                                 list of\n");
+  fprintf(stream, "                                   slices=<n>  (0 for one per thread)  iter=<most iterations>\n");
+  fprintf(stream, "                                   tol=<largest change of a boundary state, N-body units>\n");
+  fprintf(stream, "                                   coarse=<factor by which -A and -R are loosened>\n");
+  fprintf(stream, "                                 (-t must be given, and finite; -k, -C and -X cannot be used)\n");
+  fprintf(stream, "                                 [slices=%d,iter=slices,tol=%.6g,coarse=%.6g]\n",
+    TRIPLE_PARAREAL_NSLICE, TRIPLE_PARAREAL_TOL, TRIPLE_PARAREAL_COARSE);
+  fprintf(stream, "  -C --checkpoint <file>       : checkpoint the integration to <file> periodically, and when\n");
+  fprintf(stream, "                                 it stops on tstop or tcpustop without having finished\n");
+  fprintf(stream, "  -K --checkpointdt <dt/sec>   : set cpu time between checkpoints [%.6g]\n", FB_CHECKPOINTDT);
+  fprintf(stream, "  -X --resume <file>           : carry on with the integration checkpointed in <file>; only\n");
+  fprintf(stream, "                                 -t, -D, -c, -O, --events, -C and -K are taken from the command line,\n");
+  fprintf(stream, "                                 and -c counts from the resumption\n");
+  fprintf(stream, "  -E --screen                  : skip the integration of triples that provably cannot merge\n");
+  fprintf(stream, "                                 before tstop (from the quadrupole Kozai maximum eccentricity,\n");
+  fprintf(stream, "                                 with 1PN quenching if PN1 is on and the GW inspiral time if\n");
+  fprintf(stream, "                                 PN2.5 is on); the summary line names the reason\n");
+  fprintf(stream, "  -H --cache <file>            : keep the results of batch, server and refinement runs in\n");
+  fprintf(stream, "                                 <file>, and look each run up there first; a run with the same\n");
+  fprintf(stream, "                                 initial conditions, seed, integration parameters and code\n");
+  fprintf(stream, "                                 version is not integrated again (and prints no trajectory)\n");
+  fprintf(stream, "  -Z --compact                 : compact the cache of -H, keeping the latest result of each\n");
+  fprintf(stream, "                                 run of this code version, and exit\n");
   fprintf(stream, "  -d --debug                   : turn on debugging\n");
   fprintf(stream, "  -V --version                 : print version info\n");
   fprintf(stream, "  -h --help                    : display this help text\n");
@@ -101,24 +290,471 @@ int calc_units(fb_obj_t *obj[1], fb_units_t *units)
   return(0);
 }
 
+/* draw a random seed from /dev/urandom */
+unsigned long int triple_urandom_seed(void)
+{
+  int random_data;
+  unsigned long int seed=0UL;
+  ssize_t result;
+
+  random_data = open("/dev/urandom", O_RDONLY);
+  result = read(random_data, &seed, sizeof seed);
+  close(random_data);
+
+  if (result != sizeof seed) {
+    fprintf(stderr, "triple_urandom_seed(): could not read from /dev/urandom\n");
+  }
+
+  return(seed);
+}
+
+/* set up the hierarchy for a triple with the given initial conditions; 
+   assumes hier has been malloc()ed with nstarinit=3 and rng has been seeded;
+   returns FB_OK, or the FB_E_* error of the orbit setup */
+int triple_setup(triple_ic_t ic, fb_hier_t *hier, fb_units_t *units, double *t, gsl_rng *rng)
+{
+  int j, status;
+  double inc_in, inc_out;
+
+  /* initialize a few things for integrator */
+  *t = 0.0;
+  hier->nstar = 3;
+  fb_init_hier(hier);
+
+  /* create hierarchies */
+  hier->narr[2] = 1;
+  hier->narr[3] = 1;
+  /* inner binary of triple */
+  hier->hier[hier->hi[2]+0].obj[0] = &(hier->hier[hier->hi[1]+0]);
+  hier->hier[hier->hi[2]+0].obj[1] = &(hier->hier[hier->hi[1]+1]);
+  hier->hier[hier->hi[2]+0].t = *t;
+  /* outer binary of triple */
+  hier->hier[hier->hi[3]+0].obj[0] = &(hier->hier[hier->hi[2]+0]);
+  hier->hier[hier->hi[3]+0].obj[1] = &(hier->hier[hier->hi[1]+2]);
+  hier->hier[hier->hi[3]+0].t = *t;
+
+  /* give the objects some properties */
+  for (j=0; j<hier->nstar; j++) {
+    hier->hier[hier->hi[1]+j].ncoll = 1;
+    hier->hier[hier->hi[1]+j].id[0] = j;
+    snprintf(hier->hier[hier->hi[1]+j].idstring, FB_MAX_STRING_LENGTH, "%d", j);
+    hier->hier[hier->hi[1]+j].n = 1;
+    hier->hier[hier->hi[1]+j].obj[0] = NULL;
+    hier->hier[hier->hi[1]+j].obj[1] = NULL;
+    hier->hier[hier->hi[1]+j].Eint = 0.0;
+    hier->hier[hier->hi[1]+j].Lint[0] = 0.0;
+    hier->hier[hier->hi[1]+j].Lint[1] = 0.0;
+    hier->hier[hier->hi[1]+j].Lint[2] = 0.0;
+  }
+
+  // JMA 6-1-12 
+  hier->hier[hier->hi[1]+0].R = ic.r000*2*FB_CONST_G*ic.m000/(FB_CONST_C*FB_CONST_C);
+  hier->hier[hier->hi[1]+1].R = ic.r000*2*FB_CONST_G*ic.m001/(FB_CONST_C*FB_CONST_C);
+  hier->hier[hier->hi[1]+2].R = ic.r000*2*FB_CONST_G*ic.m01/(FB_CONST_C*FB_CONST_C);
+
+  hier->hier[hier->hi[1]+0].m = ic.m000;
+  hier->hier[hier->hi[1]+1].m = ic.m001;
+  hier->hier[hier->hi[1]+2].m = ic.m01;
+
+  hier->hier[hier->hi[2]+0].n = 2;
+  hier->hier[hier->hi[3]+0].n = 3;
+
+  hier->hier[hier->hi[2]+0].m = ic.m000 + ic.m001;
+  hier->hier[hier->hi[3]+0].m = ic.m000 + ic.m001 + ic.m01;
+
+  hier->hier[hier->hi[2]+0].a = ic.a00;
+  hier->hier[hier->hi[3]+0].a = ic.a0;
+  
+  hier->hier[hier->hi[2]+0].e = ic.e00;
+  hier->hier[hier->hi[3]+0].e = ic.e0;
+
+  hier->nobj = 1;
+  hier->obj[0] = &(hier->hier[hier->hi[3]+0]);
+  hier->obj[1] = NULL;
+  hier->obj[2] = NULL;
+
+  /* get the units and normalize */
+  calc_units(hier->obj, units);
+  fb_normalize(hier, *units);
+  
+  /* place triple at origin */
+  for (j=0; j<3; j++) {
+    hier->obj[0]->x[j] = 0.0;
+    hier->obj[0]->v[j] = 0.0;
+  }
+
+  /* JMA 7-10-12 -- Partition the inclination about the invariant plane. */
+  inc_out = fb_incpartition(hier->obj, ic.inc);
+  inc_in = ic.inc - inc_out;
+
+  /* randomize binary orientations and downsync */
+  fb_binaryorient(&(hier->hier[hier->hi[3]+0]), rng, inc_out, ic.peri_out, 0.0);
+  if ((status = fb_downsync(&(hier->hier[hier->hi[3]+0]), *t)) != FB_OK) {
+    return(status);
+  }
+  fb_binaryorient(&(hier->hier[hier->hi[2]+0]), rng, inc_in, ic.peri_in, FB_CONST_PI);
+  if ((status = fb_downsync(&(hier->hier[hier->hi[2]+0]), *t)) != FB_OK) {
+    return(status);
+  }
+  
+  fb_dprintf("triple x-coor: %g\n", hier->obj[0]->x[0]);
+  fb_dprintf("triple x-coor: %g\n", hier->hier[hier->hi[3]].x[0]);
+  fb_dprintf("binary x-coor: %g\n", hier->hier[hier->hi[2]].x[0]);
+  fb_dprintf("star coors: %.16f %.16f %.16f\n", hier->hier[hier->hi[1]].x[0], hier->hier[hier->hi[1]+1].x[0], hier->hier[hier->hi[1]+2].x[0]);
+  fb_dprintf("\n");
+
+  /* trickle down properties (not sure if this is actually needed here, but it doesn't harm anything) */
+  if ((status = fb_trickle(hier, *t)) != FB_OK) {
+    return(status);
+  }
+
+  fb_dprintf("after first trickle...\n");
+  fb_dprintf("triple x-coor: %g\n", hier->obj[0]->x[0]);
+  fb_dprintf("triple x-coor: %g\n", hier->hier[hier->hi[3]].x[0]);
+  fb_dprintf("binary x-coor: %g\n", hier->hier[hier->hi[2]].x[0]);
+  fb_dprintf("\n");
+
+  return(FB_OK);
+}
+
+/* the double-averaged quadrupole potential of the inner binary, in units of
+     Phi0 = G m000 m001 m01 a00^2 / ((m000+m001) a0^3 (1-e0^2)^(3/2)),
+   at j=sqrt(1-e^2), mutual inclination acos(cosi) and sin^2(omega)=s2w, plus the 1PN term of
+   strength epsgr (Liu, Munoz & Lai 2015) */
+static double triple_screen_phi_cosi(double j, double cosi, double s2w, double epsgr)
+{
+  double e2=1.0-j*j;
+
+  return((1.0 - 6.0 * e2 + 15.0 * e2 * (1.0 - cosi * cosi) * s2w - 3.0 * j * j * cosi * cosi) / 8.0 - epsgr / j);
+}
+
+/* the same, with the inclination following from conservation of the total angular momentum,
+   with eta=L_in(e=0)/L_out and jtot2=(L_tot/L_out)^2.  Returns 0 if no inclination is
+   consistent with j. */
+static int triple_screen_phi(double j, double s2w, double eta, double jtot2, double epsgr, double *phi)
+{
+  double cosi;
+
+  cosi = (jtot2 - eta * eta * j * j - 1.0) / (2.0 * eta * j);
+  if (fabs(cosi) > 1.0) {
+    return(0);
+  }
+
+  *phi = triple_screen_phi_cosi(j, cosi, s2w, epsgr);
+  return(1);
+}
+
+/* an upper bound on the inner eccentricity of a quadrupole Kozai cycle starting from e00 and
+   mutual inclination acos(cosi0), whatever the initial argument of periapsis: the largest e
+   at which some argument of periapsis has the initial energy of some other.  The
+   eccentricities are tried on a grid in log(1-e^2), and the bound is taken one grid point
+   beyond the last that is reachable, and at least the first grid point, since the maximum
+   can lie anywhere before it. */
+static double triple_screen_emax(double e00, double eta, double cosi0, double epsgr)
+{
+  int k;
+  double j0, jmin=1.0e-10, jtot2, phi0, phi1, lo0, hi0, j, emax;
+
+  j0 = sqrt(1.0 - e00 * e00);
+  if (j0 <= jmin) {
+    return(1.0);
+  }
+  jtot2 = eta * eta * j0 * j0 + 1.0 + 2.0 * eta * j0 * cosi0;
+
+  /* the initial energy spans [lo0,hi0] over the initial argument of periapsis; the
+     inclination at j0 is cosi0 itself, which working it back out of jtot2 can round past +-1
+     for a coplanar triple */
+  phi0 = triple_screen_phi_cosi(j0, cosi0, 0.0, epsgr);
+  phi1 = triple_screen_phi_cosi(j0, cosi0, 1.0, epsgr);
+  lo0 = FB_MIN(phi0, phi1);
+  hi0 = FB_MAX(phi0, phi1);
+
+  j = j0 * pow(jmin/j0, 1.0/((double) TRIPLE_SCREEN_NGRID));
+  emax = sqrt(1.0 - j * j);
+  for (k=1; k<=TRIPLE_SCREEN_NGRID; k++) {
+    j = j0 * pow(jmin/j0, ((double) k)/((double) TRIPLE_SCREEN_NGRID));
+    if (triple_screen_phi(j, 0.0, eta, jtot2, epsgr, &phi0) &&
+        triple_screen_phi(j, 1.0, eta, jtot2, epsgr, &phi1) &&
+        FB_MAX(FB_MIN(phi0, phi1), lo0) <= FB_MIN(FB_MAX(phi0, phi1), hi0)) {
+      j = j0 * pow(jmin/j0, ((double) (k+1))/((double) TRIPLE_SCREEN_NGRID));
+      emax = sqrt(1.0 - j * j);
+    }
+  }
+
+  return(emax);
+}
+
+/* whether an inner binary that reaches eccentricity emax still cannot merge: its pericentre
+   must clear the merge radius, with PN2.5 on the lower bound on its GW inspiral time there,
+     t_GW > (5/256) c^5 a00^4 (1-emax^2)^(7/2) / (G^3 m000 m001 (m000+m001)),
+   must exceed tstop, and the Kozai cycle must still be secular at emax, i.e. the time it
+   spends near emax must be longer than the outer period (Antonini, Murray & Mikkola 2014) */
+static int triple_screen_safe(triple_ic_t ic, fb_input_t input, fb_units_t units, double emax)
+{
+  double m12=ic.m000+ic.m001, rmerge, tgw;
+
+  rmerge = ic.r000 * 2.0 * FB_CONST_G * m12 / fb_sqr(FB_CONST_C);
+  if (ic.a00 * (1.0 - emax) < TRIPLE_SCREEN_RPERI * rmerge) {
+    return(0);
+  }
+
+  if (input.PN25) {
+    tgw = 5.0/256.0 * pow(FB_CONST_C, 5.0) * pow(ic.a00, 4.0) * pow(1.0 - emax * emax, 3.5) /
+      (pow(FB_CONST_G, 3.0) * ic.m000 * ic.m001 * m12);
+    if (tgw < TRIPLE_SCREEN_TGW * input.tstop * units.t) {
+      return(0);
+    }
+  }
+
+  if (sqrt(1.0 - emax) < 5.0 * FB_CONST_PI * ic.m01 / m12 * pow(ic.a00 / (ic.a0 * (1.0 - ic.e0)), 3.0)) {
+    return(0);
+  }
+
+  return(1);
+}
+
+/* decide from the initial orbital elements alone whether a triple set up by triple_setup()
+   can merge before tstop.  Only stable triples with a known mutual inclination and a weak
+   octupole term are considered, since for those the quadrupole Kozai maximum eccentricity
+   *emax, lowered by the 1PN precession if PN1 is on, bounds the inner eccentricity.  Returns
+   the TRIPLE_SCREEN_* reason the system cannot merge, or TRIPLE_SCREEN_NONE if it has to be
+   integrated. */
+int triple_screen(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, fb_units_t units, double *emax)
+{
+  double m12=ic.m000+ic.m001, m123=m12+ic.m01, eta, epsgr, epsoct;
+
+  *emax = 1.0;
+  epsoct = fabs(ic.m000 - ic.m001) / m12 * ic.a00 / ic.a0 * ic.e0 / (1.0 - ic.e0 * ic.e0);
+  if (ic.inc < 0.0 || epsoct >= TRIPLE_SCREEN_EPSOCT || !fb_mardling(&(hier->hier[hier->hi[3]+0]), 0, 1)) {
+    return(TRIPLE_SCREEN_NONE);
+  }
+
+  /* L_in(e=0)/L_out, and the strength of the 1PN precession relative to the Kozai torque */
+  eta = (ic.m000 * ic.m001 / m12 * sqrt(m12 * ic.a00)) /
+    (m12 * ic.m01 / m123 * sqrt(m123 * ic.a0 * (1.0 - ic.e0 * ic.e0)));
+  epsgr = 3.0 * FB_CONST_G * m12 * m12 * pow(ic.a0, 3.0) * pow(1.0 - ic.e0 * ic.e0, 1.5) /
+    (fb_sqr(FB_CONST_C) * ic.m01 * pow(ic.a00, 4.0));
+
+  *emax = triple_screen_emax(ic.e00, eta, cos(ic.inc), 0.0);
+  if (triple_screen_safe(ic, input, units, *emax)) {
+    return(TRIPLE_SCREEN_KOZAI);
+  }
+
+  if (input.PN1) {
+    *emax = triple_screen_emax(ic.e00, eta, cos(ic.inc), epsgr);
+    if (triple_screen_safe(ic, input, units, *emax)) {
+      return(TRIPLE_SCREEN_PN);
+    }
+  }
+
+  return(TRIPLE_SCREEN_NONE);
+}
+
+/* the name of a TRIPLE_SCREEN_* reason, as in the summary lines */
+const char *triple_screen_name(int screen)
+{
+  switch (screen) {
+  case TRIPLE_SCREEN_KOZAI:
+    return("kozai");
+  case TRIPLE_SCREEN_PN:
+    return("pn");
+  default:
+    return("none");
+  }
+}
+
+/* set up a triple for integration; the seed in ic must already be set, and hier must have
+   been malloc()ed with nstarinit=3.  Returns 1 if hier is ready to be integrated from
+   result->t, or 0 if result->retval already says how the run ended: with the (negative)
+   FB_E_* error if the setup failed, or not complete if ic.screen is set and triple_screen()
+   rules out a merger, in which case result->screen says why. */
+int triple_start(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, gsl_rng *rng, triple_result_t *result)
+{
+  int status;
+  double emax;
+
+  gsl_rng_set(rng, ic.seed);
+  result->screen = TRIPLE_SCREEN_NONE;
+  if ((status = triple_setup(ic, hier, &(result->units), &(result->t), rng)) != FB_OK ||
+      (ic.screen && (result->screen = triple_screen(ic, input, hier, result->units, &emax)) != TRIPLE_SCREEN_NONE)) {
+    /* a screened run ends where it started, not complete but counted as not merging */
+    memset(&(result->retval), 0, sizeof(fb_ret_t));
+    result->retval.retval = status;
+    result->retval.Rmin = FB_RMIN;
+    result->retval.Rmin_i = -1;
+    result->retval.Rmin_j = -1;
+    return(0);
+  }
+
+  return(1);
+}
+
+/* fill in the rest of result from the final hierarchy of a run begun by triple_start(), and
+   keep it in the result cache */
+void triple_finish(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, triple_result_t *result)
+{
+  char string1[FB_MAX_STRING_LENGTH];
+
+  result->ic = ic;
+  result->nstar = hier->nstar;
+  result->nobj = hier->nobj;
+  result->a_in = hier->hier[hier->hi[2]+0].a;
+  result->e_in = hier->hier[hier->hi[2]+0].e;
+  result->a_out = hier->hier[hier->hi[3]+0].a;
+  result->e_out = hier->hier[hier->hi[3]+0].e;
+  result->cosi = fb_dot(hier->hier[hier->hi[2]+0].Lhat, hier->hier[hier->hi[2]+1].Lhat);
+  fb_sprint_hier_hr(*hier, string1);
+  strncpy(result->hier, string1, TRIPLE_HIER_LENGTH-1);
+  result->hier[TRIPLE_HIER_LENGTH-1] = '\0';
+  fb_sprint_hier(*hier, string1);
+  strncpy(result->hierid, string1, TRIPLE_HIER_LENGTH-1);
+  result->hierid[TRIPLE_HIER_LENGTH-1] = '\0';
+
+  triple_cache_store(ic, input, result);
+}
+
+/* set up and integrate a single triple (see triple_start()); if anything fails,
+   result->retval.retval holds the (negative) FB_E_* error.  With a result cache open, a run
+   that has been done before is not done again (and prints no trajectory). */
+void triple_run(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, gsl_rng *rng, triple_result_t *result)
+{
+  if (triple_cache_lookup(ic, input, result)) {
+    return;
+  }
+
+  if (input.telem != NULL) {
+    fb_telem_start(input.telem, ic.id);
+  }
+
+  if (triple_start(ic, input, hier, rng, result)) {
+    result->retval = fewbody(input, result->units, hier, &(result->t), rng);
+  }
+
+  triple_finish(ic, input, hier, result);
+}
+
+/* print the column names of the one-line summaries written by triple_print_result() */
+void triple_print_result_header(FILE *stream)
+{
+  fprintf(stream, "# id seed retval t_final/t_dyn t_final/yr t_cpu/s count iclassify DeltaE/E0 DeltaL/L0 Rmin/RSUN Rmin_i Rmin_j Nosc nstar nobj a_in/AU e_in a_out/AU e_out cosi weight screen hier\n");
+}
+
+/* print a one-line summary of a triple integration */
+void triple_print_result(FILE *stream, triple_result_t *result)
+{
+  fprintf(stream, "%ld %lu %d %.9g %.9g %.6g %ld %ld %.6g %.6g %.6g %d %d %d %d %d %.9g %.9g %.9g %.9g %.9g %.9g %s %s\n",
+    result->ic.id, result->ic.seed, result->retval.retval, result->t, result->t*result->units.t/FB_CONST_YR,
+    result->retval.tcpu, result->retval.count, result->retval.iclassify,
+    result->retval.DeltaEfrac, result->retval.DeltaLfrac, result->retval.Rmin*result->units.l/FB_CONST_RSUN,
+    result->retval.Rmin_i, result->retval.Rmin_j, result->retval.Nosc,
+    result->nstar, result->nobj, result->a_in*result->units.l/FB_CONST_AU, result->e_in,
+    result->a_out*result->units.l/FB_CONST_AU, result->e_out, result->cosi, result->ic.weight, triple_screen_name(result->screen), result->hier);
+}
+
+/* add a result to the merger fraction estimate; failed runs are left out */
+void triple_tally(triple_tally_t *tally, triple_result_t *result)
+{
+  double w=result->ic.weight;
+
+  if (result->retval.retval < 0) {
+    return;
+  }
+
+  tally->n++;
+  tally->sw += w;
+  tally->sw2 += w * w;
+  if (result->nstar < 3) {
+    tally->nmerge++;
+    tally->swm += w;
+    tally->sw2m += w * w;
+  }
+}
+
+/* print the self-normalized importance sampling estimate of the merger fraction,
+     p = sum(w I) / sum(w),
+   with its delta-method standard error,
+     sigma^2 = sum(w^2 (I - p)^2) / sum(w)^2,
+   and the effective sample size sum(w)^2 / sum(w^2) of the weights; with unit weights these
+   are the plain fraction, its binomial error and the number of runs */
+void triple_print_tally(FILE *stream, triple_tally_t *tally)
+{
+  double p, sigma, ess;
+
+  if (tally->n == 0 || tally->sw <= 0.0) {
+    fprintf(stream, "# merger fraction: no completed runs\n");
+    return;
+  }
+
+  p = tally->swm / tally->sw;
+  sigma = sqrt(FB_MAX(tally->sw2m * (1.0 - 2.0 * p) + p * p * tally->sw2, 0.0)) / tally->sw;
+  ess = tally->sw * tally->sw / tally->sw2;
+  fprintf(stream, "# merger fraction: %.6g +/- %.6g  (%ld of %ld completed runs merged, ESS=%.6g)\n",
+    p, sigma, tally->nmerge, tally->n, ess);
+}
+
+/* write the summary record of the single run of the command line */
+static void triple_summary_single(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, fb_units_t units,
+                                  double t, fb_ret_t retval, int screen)
+{
+  triple_result_t result;
+
+  memset(&result, 0, sizeof(triple_result_t));
+  result.retval = retval;
+  result.units = units;
+  result.t = t;
+  result.screen = screen;
+  triple_finish(ic, input, hier, &result);
+  triple_summary(&result, input);
+}
+
+/* the name of where the text trajectory goes, for messages */
+static char *triple_traj_name(fb_input_t input)
+{
+  return(input.sink[FB_CHAN_TRAJ] != NULL ? input.sink[FB_CHAN_TRAJ]->name : "stdout");
+}
+
+/* finish with what outlives the runs: the cache, the summaries, the reductions and the sinks */
+static void triple_close(FILE *stream)
+{
+  int c;
+
+  triple_cache_close(stream);
+  triple_summary_close(stream);
+  triple_reduce_close(stream);
+  for (c=0; c<FB_NCHAN; c++) {
+    if (fb_sink_close(&(triple_sink[c])) != 0) {
+      fprintf(stderr, "error writing sink \"%s\"\n", triple_sink[c].name);
+    }
+  }
+  fb_telem_close(&triple_telem);
+}
+
 /* the main attraction */
 int main(int argc, char *argv[])
 {
-  int i, j;
-  unsigned long int seed, input_seed;
-  double m000, m001, m01, r000, r001, r01, a00, a0, e00, e0, inc, peri_in;
-  double peri_out, inc_in, inc_out;
-  double Ei, Lint[3], Li[3], t;
+  int i, j, nsink=0, nroute=0, telemetry=0;
+  double Ei, Lint[3], Li[3], t, emax;
+  triple_ic_t ic;
   fb_hier_t hier;
   fb_input_t input;
   fb_ret_t retval;
   fb_units_t units;
-  int random_data;
-  ssize_t result;
+  fb_checkpoint_t chk;
   char string1[FB_MAX_STRING_LENGTH], string2[FB_MAX_STRING_LENGTH];
+  int nthreads=FB_NTHREADS, nworkers=FB_NWORKERS, nslot=-1, outfreqset=0, tstopset=0;
+  double eps=0.0;
+  long ngenerate=0;
+  triple_population_t pop;
+  char *batchfile=NULL, *resumefile=NULL, *listenpath=NULL, *cachefile=NULL;
+  char *resultsfile=NULL, *mergefile=NULL, *trajfile=NULL, *reducefile=NULL, *sinkspec[FB_NCHAN];
+  int summarybinary=0, compact=0, refine=0, shard=-1, nshard=0, parareal=0, lockstep=0;
+  triple_parareal_t par;
+  triple_refine_t ref;
+  FILE *batchstream, *trajstream=NULL;
+  fb_traj_t traj;
   gsl_rng *rng;
   const gsl_rng_type *rng_type=gsl_rng_mt19937;
-  const char *short_opts = "m:n:o:r:g:i:a:q:e:F:p:B:I:t:D:c:A:R:N:O:z:x:y:P:Q:S:T:U:k:s:dVh";
+  const char *short_opts = "m:n:o:r:g:i:a:q:e:F:p:B:I:t:D:c:A:R:N:O:v:z:x:y:P:Q:S:T:U:k:s:b:j:fw:u:W:J:G:M:l:C:K:X:EH:ZY:L:dVh";
   const struct option long_opts[] = {
     {"m000", required_argument, NULL, 'm'},
     {"m001", required_argument, NULL, 'n'},
@@ -138,10 +774,37 @@ int main(int argc, char *argv[])
     {"relacc", required_argument, NULL, 'R'},
     {"ncount", required_argument, NULL, 'N'},
     {"outputfreq", required_argument, NULL, 'O'},
+    {"binary", required_argument, NULL, 'v'},
+    {"async", required_argument, NULL, TRIPLE_OPT_ASYNC},
+    {"events", optional_argument, NULL, TRIPLE_OPT_EVENTS},
+    {"compress", required_argument, NULL, TRIPLE_OPT_COMPRESS},
+    {"summary", required_argument, NULL, TRIPLE_OPT_SUMMARY},
+    {"summary-binary", required_argument, NULL, TRIPLE_OPT_SUMMARYBINARY},
+    {"reduce", required_argument, NULL, TRIPLE_OPT_REDUCE},
+    {"sink", required_argument, NULL, TRIPLE_OPT_SINK},
+    {"telemetry", optional_argument, NULL, TRIPLE_OPT_TELEMETRY},
     {"tidaltol", required_argument, NULL, 'z'},
     {"fexp", required_argument, NULL, 'x'},
     {"ks", required_argument, NULL, 'k'},
     {"seed", required_argument, NULL, 's'},
+    {"batch", required_argument, NULL, 'b'},
+    {"threads", required_argument, NULL, 'j'},
+    {"lockstep", no_argument, NULL, 'f'},
+    {"workers", required_argument, NULL, 'w'},
+    {"shard", required_argument, NULL, 'u'},
+    {"results", required_argument, NULL, 'W'},
+    {"merge", required_argument, NULL, 'J'},
+    {"generate", required_argument, NULL, 'G'},
+    {"population", required_argument, NULL, 'M'},
+    {"listen", required_argument, NULL, 'l'},
+    {"checkpoint", required_argument, NULL, 'C'},
+    {"checkpointdt", required_argument, NULL, 'K'},
+    {"resume", required_argument, NULL, 'X'},
+    {"screen", no_argument, NULL, 'E'},
+    {"cache", required_argument, NULL, 'H'},
+    {"compact", no_argument, NULL, 'Z'},
+    {"refine", required_argument, NULL, 'Y'},
+    {"parareal", required_argument, NULL, 'L'},
     {"debug", no_argument, NULL, 'd'},
     {"version", no_argument, NULL, 'V'},
     {"help", no_argument, NULL, 'h'},
@@ -149,17 +812,21 @@ int main(int argc, char *argv[])
   };
 
   /* set parameters to default values */
-  m000 = FB_M000;
-  m001 = FB_M001;
-  m01 = FB_M01;
-  r000 = FB_REFF_BH;
-  a00 = FB_A00;
-  a0 = FB_A0;
-  e00 = FB_E00;
-  e0 = FB_E0;
-  peri_in = FB_PERIARG_IN;
-  peri_out = FB_PERIARG_OUT;
-  inc = FB_INC;
+  ic.id = 0;
+  ic.m000 = FB_M000;
+  ic.m001 = FB_M001;
+  ic.m01 = FB_M01;
+  ic.r000 = FB_REFF_BH;
+  ic.a00 = FB_A00;
+  ic.a0 = FB_A0;
+  ic.e00 = FB_E00;
+  ic.e0 = FB_E0;
+  ic.peri_in = FB_PERIARG_IN;
+  ic.peri_out = FB_PERIARG_OUT;
+  ic.inc = FB_INC;
+  ic.seed = FB_SEED;
+  ic.weight = 1.0;
+  ic.screen = 0;
   input.ks = FB_KS;
   input.tstop = FB_TSTOP;
   input.Dflag = 0;
@@ -171,84 +838,124 @@ int main(int argc, char *argv[])
   input.outfreq = FB_OUTFREQ;
   input.tidaltol = FB_TIDALTOL;
   input.fexp = FB_FEXP;
-  input_seed = FB_SEED;
   input.speedtol = FB_SPEEDTOL;
   input.PN1 = FB_PN1;
   input.PN2 = FB_PN2;
   input.PN25 = FB_PN25;
   input.PN3 = FB_PN3;
   input.PN35 = FB_PN35;
+  input.out = stdout;
+  input.traj = NULL;
+  input.events = 0;
+  input.eventperi = 0;
+  input.eventetol = FB_EVENTETOL;
+  input.eventitol = FB_EVENTITOL;
+  input.telem = NULL;
+  input.telemfreq = FB_TELEMFREQ;
+  for (j=0; j<FB_NCHAN; j++) {
+    input.sink[j] = NULL;
+    sinkspec[j] = NULL;
+  }
+  input.checkpoint = NULL;
+  input.checkpointdt = FB_CHECKPOINTDT;
+  input.resume = NULL;
+  input.tstopexact = 0;
+  pop.a00min = TRIPLE_POP_A00MIN;
+  pop.a00max = TRIPLE_POP_A00MAX;
+  pop.a0min = TRIPLE_POP_A0MIN;
+  pop.a0max = TRIPLE_POP_A0MAX;
+  pop.e00dist = TRIPLE_EDIST_THERMAL;
+  pop.e00 = 0.0;
+  pop.e0dist = TRIPLE_EDIST_THERMAL;
+  pop.e0 = 0.0;
+  pop.sobol = 1;
+  pop.incbias = 0.0;
+  pop.e00bias = -1.0;
+  ref.incmin = TRIPLE_REFINE_INCMIN;
+  ref.incmax = TRIPLE_REFINE_INCMAX;
+  ref.e0min = TRIPLE_REFINE_E0MIN;
+  ref.e0max = TRIPLE_REFINE_E0MAX;
+  ref.ratiomin = TRIPLE_REFINE_RATIOMIN;
+  ref.ratiomax = TRIPLE_REFINE_RATIOMAX;
+  ref.n = TRIPLE_REFINE_N;
+  ref.depth = TRIPLE_REFINE_DEPTH;
+  ref.ttol = TRIPLE_REFINE_TTOL;
+  par.nslice = TRIPLE_PARAREAL_NSLICE;
+  par.maxiter = 0;
+  par.tol = TRIPLE_PARAREAL_TOL;
+  par.coarse = TRIPLE_PARAREAL_COARSE;
   fb_debug = FB_DEBUG;
   
   while ((i = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
     switch (i) {
     case 'm':
-      m000 = atof(optarg) * FB_CONST_MSUN;
+      ic.m000 = atof(optarg) * FB_CONST_MSUN;
       break;
     case 'n':
-      m001 = atof(optarg) * FB_CONST_MSUN;
+      ic.m001 = atof(optarg) * FB_CONST_MSUN;
       break;
     case 'o':
-      m01 = atof(optarg) * FB_CONST_MSUN;
+      ic.m01 = atof(optarg) * FB_CONST_MSUN;
       break;
     case 'r':
-      r000 = atof(optarg);
+      ic.r000 = atof(optarg);
       break;
     case 'a':
-      a00 = atof(optarg) * FB_CONST_AU;
+      ic.a00 = atof(optarg) * FB_CONST_AU;
       break;
     case 'q':
-      a0 = atof(optarg) * FB_CONST_AU;
+      ic.a0 = atof(optarg) * FB_CONST_AU;
       break;
     case 'e':
-      e00 = atof(optarg);
-      if (e00 >= 1.0) {
+      ic.e00 = atof(optarg);
+      if (ic.e00 >= 1.0) {
         fprintf(stderr, "e00 must be less than 1\n");
         return(1);
       }
       break;
     case 'F':
-      e0 = atof(optarg);
-      if (e0 >= 1.0) {
+      ic.e0 = atof(optarg);
+      if (ic.e0 >= 1.0) {
         fprintf(stderr, "e0 must be less than 1\n");
         return(1);
       }
       break;
     case 'p':
       if (atof(optarg) > 0) {
-        peri_in = atof(optarg) * FB_CONST_PI / 180.;
+        ic.peri_in = atof(optarg) * FB_CONST_PI / 180.;
       } else {
-        peri_in = atof(optarg);
+        ic.peri_in = atof(optarg);
       }
-      if (peri_in > 360 || (peri_in < 0.0 && peri_in != -1.0)) {
+      if (ic.peri_in > 360 || (ic.peri_in < 0.0 && ic.peri_in != -1.0)) {
         fprintf(stderr, "argument of periapsis must be between 0 and 360 (or -1 for random argument).\n");
         return(1);
       }
       break;
     case 'B':
       if (atof(optarg) > 0) {
-        peri_out = atof(optarg) * FB_CONST_PI / 180.;
+        ic.peri_out = atof(optarg) * FB_CONST_PI / 180.;
       } else {
-        peri_out = atof(optarg);
+        ic.peri_out = atof(optarg);
       }
-      if (peri_out > 360 || (peri_out < 0.0 && peri_out != -1.0)) {
+      if (ic.peri_out > 360 || (ic.peri_out < 0.0 && ic.peri_out != -1.0)) {
         fprintf(stderr, "argument of periapsis must be between 0 and 360 (or -1 for random argument).\n");
         return(1);
       }
       break;
     case 'I':
       if (atof(optarg) > 0) {
-        inc = atof(optarg) * FB_CONST_PI / 180.;
+        ic.inc = atof(optarg) * FB_CONST_PI / 180.;
       } else {
-        inc = atof(optarg);
+        ic.inc = atof(optarg);
       }
-      if (inc > 360. || (inc < 0.0 && inc != -1.0)) {
+      if (ic.inc > 360. || (ic.inc < 0.0 && ic.inc != -1.0)) {
         fprintf(stderr, "inclination must be between 0 and 180 (or -1 for random inclination).\n");
         return(1);
       }
       break;
     case 't':
       input.tstop = atof(optarg);
+      tstopset = 1;
       break;
     case 'D':
       input.Dflag = 1;
@@ -268,6 +975,45 @@ int main(int argc, char *argv[])
       break;
     case 'O':
       input.outfreq = atoi(optarg);
+      outfreqset = 1;
+      break;
+    case 'v':
+      trajfile = optarg;
+      break;
+    case TRIPLE_OPT_EVENTS:
+      if (optarg != NULL && triple_parse_events(optarg, &input)) {
+        print_usage(stdout);
+        return(1);
+      }
+      input.events = 1;
+      break;
+    case TRIPLE_OPT_COMPRESS:
+      eps = atof(optarg);
+      break;
+    case TRIPLE_OPT_SUMMARY:
+    case TRIPLE_OPT_SUMMARYBINARY:
+      sinkspec[FB_CHAN_SUMMARY] = optarg;
+      summarybinary = (i == TRIPLE_OPT_SUMMARYBINARY);
+      break;
+    case TRIPLE_OPT_TELEMETRY:
+      if (optarg != NULL && (input.telemfreq = atoi(optarg)) < 1) {
+        print_usage(stdout);
+        return(1);
+      }
+      telemetry = 1;
+      break;
+    case TRIPLE_OPT_SINK:
+      if (triple_parse_sink(optarg, sinkspec)) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case TRIPLE_OPT_REDUCE:
+      reducefile = optarg;
+      break;
+    case TRIPLE_OPT_ASYNC:
+      nslot = atoi(optarg);
+      nslot = (nslot == 0 ? FB_TRAJ_NSLOT : nslot);
       break;
     case 'z':
       input.tidaltol = atof(optarg);
@@ -297,7 +1043,87 @@ int main(int argc, char *argv[])
       input.ks = atoi(optarg);
       break;
     case 's':
-      input_seed = atol(optarg);
+      ic.seed = atol(optarg);
+      break;
+    case 'b':
+      batchfile = optarg;
+      break;
+    case 'j':
+      nthreads = atoi(optarg);
+      if (nthreads < 1) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'f':
+      lockstep = 1;
+      break;
+    case 'w':
+      nworkers = atoi(optarg);
+      if (nworkers < 0) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'u':
+      if (triple_parse_shard(optarg, &shard, &nshard)) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'W':
+      resultsfile = optarg;
+      break;
+    case 'J':
+      mergefile = optarg;
+      break;
+    case 'G':
+      ngenerate = atol(optarg);
+      if (ngenerate < 1) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'M':
+      if (triple_parse_population(optarg, &pop)) {
+        print_usage(stdout);
+        return(1);
+      }
+      break;
+    case 'l':
+      listenpath = optarg;
+      break;
+    case 'C':
+      input.checkpoint = optarg;
+      break;
+    case 'K':
+      input.checkpointdt = atof(optarg);
+      break;
+    case 'X':
+      resumefile = optarg;
+      break;
+    case 'E':
+      ic.screen = 1;
+      break;
+    case 'H':
+      cachefile = optarg;
+      break;
+    case 'Z':
+      compact = 1;
+      break;
+    case 'Y':
+      if (triple_parse_refine(optarg, &ref)) {
+        print_usage(stdout);
+        return(1);
+      }
+      refine = 1;
+      break;
+    case 'L':
+      if (triple_parse_parareal(optarg, &par)) {
+        print_usage(stdout);
+        return(1);
+      }
+      parareal = 1;
       break;
     case 'd':
       fb_debug = 1;
@@ -315,29 +1141,50 @@ int main(int argc, char *argv[])
     }
   }
   
+  /* the runs of a batch share the sinks, so only their summaries can be sent anywhere */
+  for (j=0; j<FB_NCHAN; j++) {
+    if (sinkspec[j] != NULL) {
+      nsink++;
+      nroute += (j != FB_CHAN_SUMMARY && strcmp(sinkspec[j], "null") != 0);
+    }
+  }
+
+  /* the slices of a Parareal run divide up the time to tstop, which has to be set */
+  if (parareal && (!tstopset || !isfinite(input.tstop))) {
+    fprintf(stderr, "-L needs a finite stopping time, given with -t.\n");
+    return(1);
+  }
+
   /* check to make sure there was nothing crazy on the command line */
-  if (optind < argc) {
+  if ((optind < argc) != (mergefile != NULL) || (nworkers > 0 && nthreads > 1) ||
+      ((shard >= 0) != (resultsfile != NULL)) || (shard >= 0 && batchfile == NULL) ||
+      (batchfile != NULL && (input.checkpoint != NULL || resumefile != NULL)) ||
+      (listenpath != NULL && (batchfile != NULL || nworkers > 0 || input.checkpoint != NULL || resumefile != NULL)) ||
+      (lockstep && (batchfile == NULL || nworkers > 0 || shard >= 0 || input.ks || cachefile != NULL || input.events)) ||
+      ((trajfile != NULL || nslot >= 0) && (batchfile != NULL || listenpath != NULL || refine || parareal || mergefile != NULL ||
+                            ngenerate > 0 || compact)) ||
+      (eps != 0.0 && (trajfile == NULL || eps < 0.0)) ||
+      (sinkspec[FB_CHAN_SUMMARY] != NULL && resumefile != NULL) ||
+      (nsink > 0 && (ngenerate > 0 || mergefile != NULL || compact)) ||
+      (nroute > 0 && (batchfile != NULL || listenpath != NULL || refine || parareal)) ||
+      (trajfile != NULL && sinkspec[FB_CHAN_TRAJ] != NULL) ||
+      (telemetry && (lockstep || listenpath != NULL || refine || parareal || ngenerate > 0 || mergefile != NULL || compact)) ||
+      (reducefile != NULL && batchfile == NULL && listenpath == NULL && !refine) ||
+      (compact && cachefile == NULL) ||
+      (refine && (batchfile != NULL || listenpath != NULL || nworkers > 0 || input.checkpoint != NULL || resumefile != NULL)) ||
+      (cachefile != NULL && !compact && batchfile == NULL && listenpath == NULL && !refine) ||
+      (parareal && (batchfile != NULL || listenpath != NULL || refine || mergefile != NULL || ngenerate > 0 ||
+                    nworkers > 0 || input.checkpoint != NULL || resumefile != NULL || input.ks))) {
     print_usage(stdout);
     return(1);
   }
 
-  // JMA 10-26-2013 -- If no seed given, draw random bits from
-  // /dev/urandom.
-  if (input_seed == FB_SEED) {
-    random_data = open("/dev/urandom", O_RDONLY);
-    result = read(random_data, &seed, sizeof seed);
-    close(random_data);
-  } else {
-    seed = input_seed;
+  /* events replace the records every outfreq steps, unless those were asked for too, and
+     reductions replace the trajectories altogether */
+  if ((input.events || reducefile != NULL) && !outfreqset) {
+    input.outfreq = -1;
   }
 
-  /* initialize a few things for integrator */
-  t = 0.0;
-  hier.nstarinit = 3;
-  hier.nstar = 3;
-  fb_malloc_hier(&hier);
-  fb_init_hier(&hier);
-
   /* put stuff in log entry */
   snprintf(input.firstlogentry, FB_MAX_LOGENTRY_LENGTH, "  command line:");
   for (i=0; i<argc; i++) {
@@ -346,162 +1193,269 @@ int main(int argc, char *argv[])
   }
   snprintf(&(input.firstlogentry[strlen(input.firstlogentry)]),
      FB_MAX_LOGENTRY_LENGTH-strlen(input.firstlogentry), "\n");
-  
-  /* print out values of paramaters */
-  fprintf(stderr, "PARAMETERS:\n");
-  fprintf(stderr, "  ks=%d  seed=%ld\n", input.ks, seed);
-  fprintf(stderr, "  a00=%.6g AU  e00=%.6g  m000=%.6g MSUN  m001=%.6g MSUN r=%.6g R_SCHW\n", \
-    a00/FB_CONST_AU, e00, m000/FB_CONST_MSUN, m001/FB_CONST_MSUN, r000);
-  fprintf(stderr, "  a0=%.6g AU  e0=%.6g  m01=%.6g MSUN\n", \
-    a0/FB_CONST_AU, e0, m01/FB_CONST_MSUN);
-  fprintf(stderr, "  inc=%.6g peri_in=%.6g peri_out=%.6g\n", \
-    inc * 180 / FB_CONST_PI, peri_in * 180 / FB_CONST_PI, peri_out * 180 / FB_CONST_PI);
-  fprintf(stderr, "  tstop=%.6g  tcpustop=%.6g\n", \
-    input.tstop, input.tcpustop);
-  fprintf(stderr, "  tidaltol=%.6g  speedtol=%.6g  abs_acc=%.6g rel_acc=%.6g  ncount=%d  fexp=%.6g  outfreq=%d\n", \
-    input.tidaltol, input.speedtol, input.absacc, input.relacc, input.ncount, input.fexp, input.outfreq);
-  fprintf(stderr, "  PN1=%d  PN2=%d  PN25=%d  PN3=%d  PN35=%d\n\n", \
-    input.PN1, input.PN2, input.PN25, input.PN3, input.PN35);
 
+  /* a failed system is reported in fb_ret_t.retval, so GSL must not abort the whole process */
+  gsl_set_error_handler_off();
 
-  /* initialize GSL rng */
-  gsl_rng_env_setup();
-  rng = gsl_rng_alloc(rng_type);
-  gsl_rng_set(rng, seed);
+  /* population mode: write initial conditions for a later batch run */
+  if (ngenerate > 0) {
+    return(triple_population(stdout, ngenerate, pop, ic));
+  }
 
-  /* create hierarchies */
-  hier.narr[2] = 1;
-  hier.narr[3] = 1;
-  /* inner binary of triple */
-  hier.hier[hier.hi[2]+0].obj[0] = &(hier.hier[hier.hi[1]+0]);
-  hier.hier[hier.hi[2]+0].obj[1] = &(hier.hier[hier.hi[1]+1]);
-  hier.hier[hier.hi[2]+0].t = t;
-  /* outer binary of triple */
-  hier.hier[hier.hi[3]+0].obj[0] = &(hier.hier[hier.hi[2]+0]);
-  hier.hier[hier.hi[3]+0].obj[1] = &(hier.hier[hier.hi[1]+2]);
-  hier.hier[hier.hi[3]+0].t = t;
+  /* merge mode: the shard results files are the rest of the command line */
+  if (mergefile != NULL) {
+    return(triple_merge(mergefile, argc - optind, &(argv[optind])));
+  }
 
-  /* give the objects some properties */
-  for (j=0; j<hier.nstar; j++) {
-    hier.hier[hier.hi[1]+j].ncoll = 1;
-    hier.hier[hier.hi[1]+j].id[0] = j;
-    snprintf(hier.hier[hier.hi[1]+j].idstring, FB_MAX_STRING_LENGTH, "%d", j);
-    hier.hier[hier.hi[1]+j].n = 1;
-    hier.hier[hier.hi[1]+j].obj[0] = NULL;
-    hier.hier[hier.hi[1]+j].obj[1] = NULL;
-    hier.hier[hier.hi[1]+j].Eint = 0.0;
-    hier.hier[hier.hi[1]+j].Lint[0] = 0.0;
-    hier.hier[hier.hi[1]+j].Lint[1] = 0.0;
-    hier.hier[hier.hi[1]+j].Lint[2] = 0.0;
-  }
-
-  /*
-  hier.hier[hier.hi[1]+0].R = r000;
-  hier.hier[hier.hi[1]+1].R = r001;
-  hier.hier[hier.hi[1]+2].R = r01;
-  */
+  /* cache maintenance */
+  if (compact) {
+    return(triple_cache_compact(cachefile));
+  }
 
-  // JMA 6-1-12 
-  hier.hier[hier.hi[1]+0].R = r000*2*FB_CONST_G*m000/(FB_CONST_C*FB_CONST_C);
-  hier.hier[hier.hi[1]+1].R = r000*2*FB_CONST_G*m001/(FB_CONST_C*FB_CONST_C);
-  hier.hier[hier.hi[1]+2].R = r000*2*FB_CONST_G*m01/(FB_CONST_C*FB_CONST_C);
+  if (cachefile != NULL && triple_cache_open(cachefile) != 0) {
+    return(1);
+  }
 
-  hier.hier[hier.hi[1]+0].m = m000;
-  hier.hier[hier.hi[1]+1].m = m001;
-  hier.hier[hier.hi[1]+2].m = m01;
+  for (j=0; j<FB_NCHAN; j++) {
+    if (sinkspec[j] != NULL) {
+      if (fb_sink_open(&(triple_sink[j]), sinkspec[j]) != 0) {
+        fprintf(stderr, "cannot open sink \"%s\"\n", sinkspec[j]);
+        return(1);
+      }
+      input.sink[j] = &(triple_sink[j]);
+    }
+  }
 
-  hier.hier[hier.hi[2]+0].m = m000 + m001;
-  hier.hier[hier.hi[3]+0].m = m000 + m001 + m01;
+  if (sinkspec[FB_CHAN_SUMMARY] != NULL && triple_summary_open(&(triple_sink[FB_CHAN_SUMMARY]), summarybinary) != 0) {
+    return(1);
+  }
 
-  hier.hier[hier.hi[2]+0].a = a00;
-  hier.hier[hier.hi[3]+0].a = a0;
-  
-  hier.hier[hier.hi[2]+0].e = e00;
-  hier.hier[hier.hi[3]+0].e = e0;
+  /* a live status block for each integration that can run at once */
+  if (telemetry) {
+    if (fb_telem_create(&triple_telem, FB_MAX(FB_MAX(nthreads, nworkers), 1)) != 0) {
+      fprintf(stderr, "cannot create the shared-memory segment for the live status\n");
+      return(1);
+    }
+    fprintf(stderr, "TELEMETRY:\n  segment=%s  nslot=%d  telemfreq=%d\n\n", triple_telem.name,
+      triple_telem.head->nslot, input.telemfreq);
+    input.telem = triple_telem.slot;
+  }
 
-  hier.nobj = 1;
-  hier.obj[0] = &(hier.hier[hier.hi[3]+0]);
-  hier.obj[1] = NULL;
-  hier.obj[2] = NULL;
+  if (reducefile != NULL && triple_reduce_open(reducefile) != 0) {
+    return(1);
+  }
 
-  /* get the units and normalize */
-  calc_units(hier.obj, &units);
-  fb_normalize(&hier, units);
-  
-  /* place triple at origin */
-  for (j=0; j<3; j++) {
-    hier.obj[0]->x[j] = 0.0;
-    hier.obj[0]->v[j] = 0.0;
+  /* refinement mode: the initial conditions come from the sweep */
+  if (refine) {
+    i = triple_refine(stdout, ref, ic, input, nthreads);
+    triple_close(stderr);
+    return(i);
   }
 
-  /* JMA 7-10-12 -- Partition the inclination about the invariant plane. */
-  inc_out = fb_incpartition(hier.obj, inc);
-  inc_in = inc - inc_out;
+  /* server mode: the initial conditions come from the clients */
+  if (listenpath != NULL) {
+    i = triple_server(listenpath, ic, input, nthreads);
+    triple_close(stderr);
+    return(i);
+  }
 
-  /* JMA 7-11-12 -- Debugging code. */
-  /*
-  fprintf(stderr, "inc: %g\n", inc);
-  fprintf(stderr, "inc_out: %g\n", inc_out);
-  fprintf(stderr, "inc_in: %g\n", inc_in);
-  */
+  /* shard mode: this process runs its share of a batch table split across machines */
+  if (shard >= 0) {
+    i = triple_shard(batchfile, shard, nshard, resultsfile, ic, input, nthreads, nworkers);
+    triple_close(stderr);
+    return(i);
+  }
 
-  /* randomize binary orientations and downsync */
-  fb_binaryorient(&(hier.hier[hier.hi[3]+0]), rng, inc_out, peri_out, 0.0);
-  fb_downsync(&(hier.hier[hier.hi[3]+0]), t);
-  fb_binaryorient(&(hier.hier[hier.hi[2]+0]), rng, inc_in, peri_in, FB_CONST_PI);
-  fb_downsync(&(hier.hier[hier.hi[2]+0]), t);
-  
-  fb_dprintf("triple x-coor: %g\n", hier.obj[0]->x[0]);
-  fb_dprintf("triple x-coor: %g\n", hier.hier[hier.hi[3]].x[0]);
-  fb_dprintf("binary x-coor: %g\n", hier.hier[hier.hi[2]].x[0]);
-  fb_dprintf("star coors: %.16f %.16f %.16f\n", hier.hier[hier.hi[1]].x[0], hier.hier[hier.hi[1]+1].x[0], hier.hier[hier.hi[1]+2].x[0]);
-  fb_dprintf("\n");
+  /* batch mode: the initial conditions come from a table instead of the command line */
+  if (batchfile != NULL) {
+    if (strcmp(batchfile, "-") == 0) {
+      batchstream = stdin;
+    } else if ((batchstream = fopen(batchfile, "r")) == NULL) {
+      fprintf(stderr, "cannot open batch file \"%s\"\n", batchfile);
+      return(1);
+    }
+    if (lockstep) {
+      i = triple_lockstep(batchstream, ic, input, nthreads);
+    } else if (nworkers > 0) {
+      i = triple_pool(batchstream, ic, input, nworkers);
+    } else if (nthreads > 1) {
+      i = triple_ensemble(batchstream, ic, input, nthreads);
+    } else {
+      i = triple_batch(batchstream, ic, input);
+    }
+    if (batchstream != stdin) {
+      fclose(batchstream);
+    }
+    triple_close(stderr);
+    return(i);
+  }
 
+  /* initialize GSL rng */
+  gsl_rng_env_setup();
+  rng = gsl_rng_alloc(rng_type);
 
-  /* JMA 7-10-12 -- Check to make sure the angle between the two binaries
-   * is still the inclination.  This can be removed later if the code
-   * proves to be working as expected.
-   */
-  /*
-  fprintf(stderr, "inner: %g, %g, %g\n", hier.hier[hier.hi[2]+0].Lhat[0], hier.hier[hier.hi[2]+0].Lhat[1], hier.hier[hier.hi[2]+0].Lhat[2]);
-  fprintf(stderr, "outer: %g, %g, %g\n", hier.hier[hier.hi[3]+0].Lhat[0], hier.hier[hier.hi[3]+0].Lhat[1], hier.hier[hier.hi[3]+0].Lhat[2]);
-  fprintf(stderr, "dot: %g\n", fb_dot(hier.hier[hier.hi[2]+0].Lhat, hier.hier[hier.hi[3]+0].Lhat));
-  fprintf(stderr, "cos i: %g\n", cos(inc));
-  assert(fb_dot(hier.hier[hier.hi[2]+0].Lhat, hier.hier[hier.hi[3]+0].Lhat) == cos(inc));
-  */
+  if (resumefile != NULL) {
+    /* carry on with a checkpointed integration: the physics is what the integration was
+       started with, and only the stopping, output and checkpointing parameters are new */
+    if ((i = fb_read_checkpoint(resumefile, &chk, rng)) != FB_OK) {
+      fprintf(stderr, "cannot resume from \"%s\": %s\n", resumefile, fb_strerror(i));
+      return(1);
+    }
+    chk.input.tstop = input.tstop;
+    chk.input.dt = input.dt;
+    chk.input.tcpustop = input.tcpustop;
+    chk.input.outfreq = input.outfreq;
+    chk.input.events = input.events;
+    chk.input.eventperi = input.eventperi;
+    chk.input.eventetol = input.eventetol;
+    chk.input.eventitol = input.eventitol;
+    chk.input.out = input.out;
+    chk.input.traj = input.traj;
+    chk.input.telem = input.telem;
+    chk.input.telemfreq = input.telemfreq;
+    memcpy(chk.input.sink, input.sink, sizeof(input.sink));
+    chk.input.checkpoint = input.checkpoint;
+    chk.input.checkpointdt = input.checkpointdt;
+    input = chk.input;
+    input.resume = &chk;
 
-  fprintf(stderr, "UNITS:\n");
-  fprintf(stderr, "  v=%.6g km/s  l=%.6g AU  t=t_dyn=%.6g yr\n", \
-    units.v/1.0e5, units.l/FB_CONST_AU, units.t/FB_CONST_YR);
-  fprintf(stderr, "  M=%.6g M_sun  E=%.6g erg\n\n", units.m/FB_CONST_MSUN, units.E);
+    hier = chk.hier;
+    units = chk.units;
+    t = chk.state.t;
+    Ei = chk.state.Ei;
+    for (j=0; j<3; j++) {
+      Li[j] = chk.state.Li[j];
+    }
 
-  /* trickle down properties (not sure if this is actually needed here, but it doesn't harm anything) */
-  fb_trickle(&hier, t);
+    fprintf(stderr, "RESUMING:\n");
+    fprintf(stderr, "  checkpoint=%s  t=%.6g  count=%ld\n", resumefile, t, chk.state.retval.count);
+    fprintf(stderr, "  tstop=%.6g  tcpustop=%.6g\n\n", input.tstop, input.tcpustop);
+  } else {
+    // JMA 10-26-2013 -- If no seed given, draw random bits from
+    // /dev/urandom.
+    if (ic.seed == FB_SEED) {
+      ic.seed = triple_urandom_seed();
+    }
 
-  fb_dprintf("after first trickle...\n");
-  fb_dprintf("triple x-coor: %g\n", hier.obj[0]->x[0]);
-  fb_dprintf("triple x-coor: %g\n", hier.hier[hier.hi[3]].x[0]);
-  fb_dprintf("binary x-coor: %g\n", hier.hier[hier.hi[2]].x[0]);
-  fb_dprintf("\n");
+    /* print out values of paramaters */
+    fprintf(stderr, "PARAMETERS:\n");
+    fprintf(stderr, "  ks=%d  seed=%ld\n", input.ks, ic.seed);
+    fprintf(stderr, "  a00=%.6g AU  e00=%.6g  m000=%.6g MSUN  m001=%.6g MSUN r=%.6g R_SCHW\n", \
+      ic.a00/FB_CONST_AU, ic.e00, ic.m000/FB_CONST_MSUN, ic.m001/FB_CONST_MSUN, ic.r000);
+    fprintf(stderr, "  a0=%.6g AU  e0=%.6g  m01=%.6g MSUN\n", \
+      ic.a0/FB_CONST_AU, ic.e0, ic.m01/FB_CONST_MSUN);
+    fprintf(stderr, "  inc=%.6g peri_in=%.6g peri_out=%.6g\n", \
+      ic.inc * 180 / FB_CONST_PI, ic.peri_in * 180 / FB_CONST_PI, ic.peri_out * 180 / FB_CONST_PI);
+    fprintf(stderr, "  tstop=%.6g  tcpustop=%.6g\n", \
+      input.tstop, input.tcpustop);
+    fprintf(stderr, "  tidaltol=%.6g  speedtol=%.6g  abs_acc=%.6g rel_acc=%.6g  ncount=%d  fexp=%.6g  outfreq=%d\n", \
+      input.tidaltol, input.speedtol, input.absacc, input.relacc, input.ncount, input.fexp, input.outfreq);
+    fprintf(stderr, "  PN1=%d  PN2=%d  PN25=%d  PN3=%d  PN35=%d\n\n", \
+      input.PN1, input.PN2, input.PN25, input.PN3, input.PN35);
 
-  /* store the initial energy and angular momentum*/
-  Ei = fb_petot(&(hier.hier[hier.hi[1]]), hier.nstar) + fb_ketot(&(hier.hier[hier.hi[1]]), hier.nstar) +
-    fb_einttot(&(hier.hier[hier.hi[1]]), hier.nstar);
-  fb_angmom(&(hier.hier[hier.hi[1]]), hier.nstar, Li);
-  fb_angmomint(&(hier.hier[hier.hi[1]]), hier.nstar, Lint);
-  for (j=0; j<3; j++) {
-    Li[j] += Lint[j];
+    gsl_rng_set(rng, ic.seed);
+
+    /* set up the triple */
+    hier.nstarinit = 3;
+    hier.nstar = 3;
+    fb_malloc_hier(&hier);
+    if ((i = triple_setup(ic, &hier, &units, &t, rng)) != FB_OK) {
+      fprintf(stderr, "cannot set up the triple: %s\n", fb_strerror(i));
+      return(1);
+    }
+
+    fprintf(stderr, "UNITS:\n");
+    fprintf(stderr, "  v=%.6g km/s  l=%.6g AU  t=t_dyn=%.6g yr\n", \
+      units.v/1.0e5, units.l/FB_CONST_AU, units.t/FB_CONST_YR);
+    fprintf(stderr, "  M=%.6g M_sun  E=%.6g erg\n\n", units.m/FB_CONST_MSUN, units.E);
+
+    if (ic.screen && (i = triple_screen(ic, input, &hier, units, &emax)) != TRIPLE_SCREEN_NONE) {
+      fprintf(stderr, "OUTCOME:\n");
+      fprintf(stderr, "  encounter SCREENED:  cannot merge before tstop (%s: e_in,max=%.6g)\n\n",
+        triple_screen_name(i), emax);
+      if (sinkspec[FB_CHAN_SUMMARY] != NULL) {
+        memset(&retval, 0, sizeof(fb_ret_t));
+        retval.Rmin = FB_RMIN;
+        retval.Rmin_i = -1;
+        retval.Rmin_j = -1;
+        triple_summary_single(ic, input, &hier, units, t, retval, i);
+      }
+      triple_close(stderr);
+      gsl_rng_free(rng);
+      fb_free_hier(hier);
+      return(0);
+    }
+
+    /* store the initial energy and angular momentum*/
+    Ei = fb_petot(&(hier.hier[hier.hi[1]]), hier.nstar) + fb_ketot(&(hier.hier[hier.hi[1]]), hier.nstar) +
+      fb_einttot(&(hier.hier[hier.hi[1]]), hier.nstar);
+    fb_angmom(&(hier.hier[hier.hi[1]]), hier.nstar, Li);
+    fb_angmomint(&(hier.hier[hier.hi[1]]), hier.nstar, Lint);
+    for (j=0; j<3; j++) {
+      Li[j] += Lint[j];
+    }
+  }
+
+  /* the trajectory goes to the binary file instead of stdout, and perhaps through the writer
+     thread */
+  if (trajfile != NULL) {
+    if ((trajstream = fopen(trajfile, "wb")) == NULL || fb_traj_open(&traj, trajstream, units, input, eps) != 0) {
+      fprintf(stderr, "cannot write trajectory file \"%s\"\n", trajfile);
+      return(1);
+    }
+    input.traj = &traj;
+  } else if (nslot >= 0 && fb_sink_stream(input.sink[FB_CHAN_TRAJ], input.out) != NULL) {
+    fb_traj_open_text(&traj, fb_sink_stream(input.sink[FB_CHAN_TRAJ], input.out));
+    input.traj = &traj;
+  }
+  if (input.traj != NULL && nslot >= 0 && fb_traj_start(&traj, nslot) != 0) {
+    fprintf(stderr, "cannot start the trajectory writer thread; writing synchronously\n");
   }
 
   /* integrate along */
   fb_dprintf("calling fewbody()...\n");
   
-  /* call fewbody! */
-  retval = fewbody(input, units, &hier, &t, rng);
+  /* call fewbody!  or many of them, one per time slice */
+  if (parareal) {
+    if (triple_parareal(par, input, units, &hier, &t, ic.seed, nthreads, &retval) != 0) {
+      return(1);
+    }
+  } else {
+    if (input.telem != NULL) {
+      fb_telem_start(input.telem, ic.id);
+    }
+    retval = fewbody(input, units, &hier, &t, rng);
+  }
+
+  if (input.traj != NULL) {
+    i = traj.async;
+    if (fb_traj_close(&traj) != 0 || (trajstream != NULL && fclose(trajstream) != 0)) {
+      fprintf(stderr, "error writing trajectory file \"%s\"\n", (trajstream != NULL ? trajfile : triple_traj_name(input)));
+    }
+    fprintf(stderr, "TRAJECTORY:\n");
+    if (trajstream != NULL) {
+      fprintf(stderr, "  file=%s  records=%ld  blocks=%ld\n", trajfile, traj.nrecord, traj.nblock);
+      if (eps > 0.0) {
+        fprintf(stderr, "  compression: eps=%.6g  ratio=%.6g  (%.6g bytes per value)\n",
+          eps, (traj.nbytecode > 0 ? (double) traj.nbyteraw / traj.nbytecode : 0.0),
+          (traj.nbyteraw > 0 ? (double) traj.nbytecode / traj.nbyteraw * sizeof(double) : 0.0));
+      }
+    } else {
+      fprintf(stderr, "  file=%s  records=%ld\n", triple_traj_name(input), traj.nrecord);
+    }
+    if (i) {
+      fprintf(stderr, "  writer: nslot=%d  batches=%ld (%.6g records each)  maxfill=%ld\n",
+        traj.nslot, traj.nbatch, (traj.nbatch > 0 ? (double) traj.nrecord / traj.nbatch : 0.0), traj.maxfill);
+      fprintf(stderr, "  back-pressure: stalls=%ld  t_stall=%.6g s\n", traj.nstall, traj.tstall);
+    }
+  }
 
   /* print information to screen */
   fprintf(stderr, "OUTCOME:\n");
-  if (retval.retval == 1) {
+  if (retval.retval < 0) {
+    fprintf(stderr, "  encounter FAILED:  t=%.6g (%.6g yr)  %s\n\n",
+      t, t * units.t/FB_CONST_YR, fb_strerror(retval.retval));
+  } else if (retval.retval == 1) {
     fprintf(stderr, "  encounter complete:  t=%.6g (%.6g yr)  %s  (%s)\n\n",
       t, t * units.t/FB_CONST_YR,
       fb_sprint_hier(hier, string1),
@@ -525,13 +1479,22 @@ int main(int argc, char *argv[])
   fprintf(stderr, "  Rmin=%.6g (%.6g RSUN)  Rmin_i=%d  Rmin_j=%d\n", \
     retval.Rmin, retval.Rmin*units.l/FB_CONST_RSUN, retval.Rmin_i, retval.Rmin_j);
   fprintf(stderr, "  Nosc=%d (%s)\n", retval.Nosc, (retval.Nosc>=1?"resonance":"non-resonance"));
+
+  if (sinkspec[FB_CHAN_SUMMARY] != NULL) {
+    triple_summary_single(ic, input, &hier, units, t, retval, TRIPLE_SCREEN_NONE);
+  }
+  triple_close(stderr);
   
   /* free GSL stuff */
   gsl_rng_free(rng);
 
   /* free our own stuff */
-  fb_free_hier(hier);
+  if (resumefile != NULL) {
+    fb_free_checkpoint(&chk);
+  } else {
+    fb_free_hier(hier);
+  }
 
   /* done! */
-  return(0);
+  return(retval.retval < 0 ? 1 : 0);
 }
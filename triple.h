@@ -18,6 +18,8 @@
    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+#include <stdint.h>
+
 #define FB_TIDALTOL 1.0e-5
 #define FB_SPEEDTOL 1.0e-4
 
@@ -65,12 +67,18 @@
 #define FB_RELACC 1.0e-14 /* relative accuracy of integrator */
 #define FB_NCOUNT 1 /* number of timesteps between calls to classify() */
 #define FB_OUTFREQ 1000 /* number of timesteps between printing orbital information */
+#define FB_EVENTETOL 0.01 /* how far e has to turn back from an extremum for an event */
+#define FB_EVENTITOL 1.0 /* the same for the mutual inclination, in degrees */
+#define FB_TELEMFREQ 1000 /* number of timesteps between updates of the live status */
 
 #define FB_KS 0
 
 #define FB_FEXP 3.0 /* expansion factor of merger product */
 
 #define FB_SEED 0UL
+#define FB_NTHREADS 1
+#define FB_NWORKERS 0
+#define FB_CHECKPOINTDT 600.0 /* cpu seconds between checkpoints */
 #define FB_DEBUG 0
 
 /* effective BH radius (in units of 2M); this has to be >~6.5, since otherwise 
@@ -80,5 +88,399 @@
 // 100 decreases the merger time only negligibly.
 #define FB_REFF_BH 10
 
+#define TRIPLE_HIER_LENGTH 128
+#define TRIPLE_RING_LENGTH 64 /* results buffered between a pool worker and the parent */
+
+/* the retval of a job whose worker process died (see triple_pool.c); the fewbody errors
+   (FB_E_*) are small negative numbers, so this cannot clash with them */
+#define TRIPLE_E_CRASH -100
+
+/* the retval of a job server request whose initial conditions are invalid */
+#define TRIPLE_E_REQUEST -101
+
+#define TRIPLE_QUEUE_LENGTH 64 /* requests the job server queues before it stops reading */
+
+/* why triple_screen() let a run skip its integration */
+#define TRIPLE_SCREEN_NONE 0 /* it did not: the run was integrated */
+#define TRIPLE_SCREEN_KOZAI 1 /* the quadrupole Kozai maximum eccentricity cannot bring the inner
+                                 binary close enough to merge */
+#define TRIPLE_SCREEN_PN 2 /* the same, once the 1PN precession that quenches the Kozai cycles
+                              is taken into account */
+
+/* margins of the screening; a system is only screened if it clears all of them */
+#define TRIPLE_SCREEN_EPSOCT 1.0e-3 /* largest octupole strength for which the quadrupole
+                                       maximum eccentricity is trusted */
+#define TRIPLE_SCREEN_RPERI 2.0 /* factor by which the inner pericentre at maximum eccentricity
+                                   must clear the merge radius */
+#define TRIPLE_SCREEN_TGW 10.0 /* factor by which the GW inspiral time at maximum eccentricity
+                                  must exceed tstop, with PN2.5 on */
+#define TRIPLE_SCREEN_NGRID 4096 /* eccentricities tried between e00 and 1 */
+
+/* default population for the generator (triple_population.c); semimajor axes in AU */
+#define TRIPLE_POP_A00MIN 0.1
+#define TRIPLE_POP_A00MAX 10.0
+#define TRIPLE_POP_A0MIN 10.0
+#define TRIPLE_POP_A0MAX 1000.0
+#define TRIPLE_POP_MAXDRAW 1000 /* draws per accepted system before the generator gives up */
+
+/* eccentricity distributions of the population generator */
+#define TRIPLE_EDIST_FIXED 0 /* the value given */
+#define TRIPLE_EDIST_THERMAL 1 /* f(e) = 2e */
+#define TRIPLE_EDIST_UNIFORM 2 /* f(e) = 1 */
+
+/* a population of triples: log-uniform semimajor axes, eccentricities from the chosen
+   distributions, isotropic mutual inclinations and uniform arguments of periapsis; the masses
+   are those of the command line */
+typedef struct{
+  double a00min; /* range of the inner semimajor axis, in AU */
+  double a00max;
+  double a0min; /* range of the outer semimajor axis, in AU */
+  double a0max;
+  int e00dist; /* TRIPLE_EDIST_* of the inner eccentricity */
+  double e00; /* the inner eccentricity, if fixed */
+  int e0dist; /* TRIPLE_EDIST_* of the outer eccentricity */
+  double e0; /* the outer eccentricity, if fixed */
+  int sobol; /* 1 to sample with the shifted Sobol sequence, 0 with the pseudo-random rng */
+  double incbias; /* width w of the proposal f(cos i) ~ exp(-|cos i|/w) for importance
+                     sampling near i=90, or 0 to sample isotropically */
+  double e00bias; /* index k of the proposal f(e00) ~ e00^k, or -1 to sample e00 as given */
+} triple_population_t;
+
+/* default sweep of the adaptive refinement driver (triple_refine.c) */
+#define TRIPLE_REFINE_INCMIN 0.0 /* mutual inclination, in degrees */
+#define TRIPLE_REFINE_INCMAX 180.0
+#define TRIPLE_REFINE_E0MIN 0.0 /* outer eccentricity */
+#define TRIPLE_REFINE_E0MAX 0.9
+#define TRIPLE_REFINE_RATIOMIN 5.0 /* a0/a00, log-uniform */
+#define TRIPLE_REFINE_RATIOMAX 100.0
+#define TRIPLE_REFINE_N 5 /* points per axis of the coarse grid */
+#define TRIPLE_REFINE_DEPTH 4 /* levels of refinement below the coarse grid */
+#define TRIPLE_REFINE_TTOL 0.3 /* largest difference in log10 of the merger time within a cell */
+
+/* an adaptive sweep over (inc, e0, a0/a00); the other initial conditions are those of the
+   command line */
+typedef struct{
+  double incmin; /* range of the mutual inclination, in degrees */
+  double incmax;
+  double e0min; /* range of the outer eccentricity */
+  double e0max;
+  double ratiomin; /* range of a0/a00 */
+  double ratiomax;
+  int n; /* points per axis of the coarse grid */
+  int depth; /* levels of refinement */
+  double ttol; /* cells whose merger times differ by more than this in log10 are refined */
+} triple_refine_t;
+
+/* default Parareal integration (triple_parareal.c) */
+#define TRIPLE_PARAREAL_NSLICE 0 /* time slices, or 0 for one per thread (at least two) */
+#define TRIPLE_PARAREAL_TOL 1.0e-6 /* largest change of a boundary state at convergence */
+#define TRIPLE_PARAREAL_COARSE 1.0e4 /* the coarse propagator's accuracies are this much looser */
+
+/* a Parareal integration of a single triple: [0,tstop] is cut into slices whose fine
+   integrations run side by side, corrected by a cheap coarse integration in sequence until
+   the states at the slice boundaries stop changing */
+typedef struct{
+  int nslice; /* time slices, or 0 for one per thread */
+  int maxiter; /* most iterations, or 0 for nslice (after which the result is exact) */
+  double tol; /* largest change of a boundary state, in N-body units, at convergence */
+  double coarse; /* factor by which absacc and relacc are loosened for the coarse propagator */
+} triple_parareal_t;
+
+/* FNV-1a, used to hash cache keys and manifests (see triple_fnv1a()) */
+#define TRIPLE_FNV_OFFSET 0xcbf29ce484222325ULL
+#define TRIPLE_FNV_PRIME 0x100000001b3ULL
+
+/* the header of the binary results file of one shard of a batch table (triple_shard.c); it
+   is followed by one triple_result_t per finished job, in the order they finished.  The
+   results are in the native layout, so the file is only good for the build that wrote it. */
+#define TRIPLE_SHARD_MAGIC "TRIPRES"
+typedef struct{
+  char magic[8]; /* TRIPLE_SHARD_MAGIC */
+  char version[16]; /* FB_VERSION */
+  int32_t size; /* sizeof(triple_result_t) */
+  int32_t shard; /* index of this shard */
+  int32_t nshard; /* number of shards the manifest was split into (1 once merged) */
+  int32_t pad;
+  int64_t njob; /* jobs in the whole manifest */
+  uint64_t manifest; /* FNV-1a hash of the manifest */
+  uint64_t seed; /* master seed the job seeds were derived from */
+} triple_shard_header_t;
+
+/* a running estimate of the merger fraction of an ensemble, weighted by the importance
+   weights; a merger is a completed run that ended with fewer than three stars */
+typedef struct{
+  long n; /* number of completed runs */
+  long nmerge; /* how many of those merged */
+  double sw; /* sum of the weights */
+  double sw2; /* sum of the squared weights */
+  double swm; /* sum of the weights of the mergers */
+  double sw2m; /* sum of the squared weights of the mergers */
+} triple_tally_t;
+
+/* the ensemble reductions (triple_reduce.c): weighted histograms and quantile sketches of
+   the merger time, of how close the inner binary came to e=1, and of the cpu time, and the
+   counts of the outcomes, accumulated as the runs finish */
+#define TRIPLE_REDUCE_NBIN 40 /* bins of each histogram */
+#define TRIPLE_REDUCE_TMIN -6.0 /* range of the histogram of log10(t_merge/yr) */
+#define TRIPLE_REDUCE_TMAX 10.0
+#define TRIPLE_REDUCE_EMIN -8.0 /* range of the histogram of log10(1 - e_max) */
+#define TRIPLE_REDUCE_EMAX 0.0
+#define TRIPLE_REDUCE_NOUTCOME 16 /* final hierarchies counted apart; the rest are "other" */
+#define TRIPLE_SKETCH_ALPHA 0.01 /* relative accuracy of the quantiles */
+#define TRIPLE_SKETCH_NBIN 4096 /* buckets of a quantile sketch, centred on 1; with the
+                                   accuracy above they span 1e-17 to 1e17 */
+
+/* The job server (triple_server.c) talks in frames: a triple_frame_t header followed by
+   length bytes of payload, a triple_request_t from the client or a triple_reply_t from the
+   server.  Everything is in the native byte order, since both ends are on the same machine.
+   Replies come back in the order the jobs finish, and carry the tag of their request. */
+#define TRIPLE_FRAME_REQUEST 0x51525054 /* "TPRQ" */
+#define TRIPLE_FRAME_REPLY 0x52525054 /* "TPRR" */
+
+typedef struct{
+  uint32_t type; /* TRIPLE_FRAME_REQUEST or TRIPLE_FRAME_REPLY */
+  uint32_t length; /* bytes of payload that follow */
+} triple_frame_t;
+
+/* initial conditions in the units of the batch table: a job server request, or one row of
+   a batch table */
+typedef struct{
+  uint64_t tag; /* the caller's job id, returned in the reply */
+  uint64_t seed; /* random seed (0 for one derived from the master seed and the tag) */
+  double m000; /* masses, in MSUN */
+  double m001;
+  double m01;
+  double r000; /* merge radius, in units of the Schwarzschild radius (0 for the default) */
+  double a00; /* semimajor axes, in AU */
+  double a0;
+  double e00; /* eccentricities */
+  double e0;
+  double inc; /* angles, in degrees (-1 for random) */
+  double peri_in;
+  double peri_out;
+} triple_request_t;
+
+/* the outcome of a job server request, in the units of the summary lines */
+typedef struct{
+  uint64_t tag; /* tag of the request */
+  uint64_t seed; /* seed actually used */
+  int32_t retval; /* fewbody()'s retval, or TRIPLE_E_REQUEST */
+  int32_t nstar; /* final number of stars */
+  int32_t nobj; /* final number of top-level objects */
+  int32_t Nosc; /* number of s^2 oscillations */
+  int64_t count; /* number of integration steps */
+  int64_t iclassify; /* number of calls to fb_classify() */
+  double t; /* final time, in units of t_dyn */
+  double t_yr; /* final time, in years */
+  double tcpu; /* cpu time, in seconds */
+  double DeltaEfrac; /* relative energy error */
+  double DeltaLfrac; /* relative angular momentum error */
+  double Rmin; /* closest approach, in RSUN */
+  double a_in; /* final inner semimajor axis, in AU */
+  double e_in; /* final inner eccentricity */
+  double a_out; /* final outer semimajor axis, in AU */
+  double e_out; /* final outer eccentricity */
+  double cosi; /* final cosine of the mutual inclination */
+  char hier[TRIPLE_HIER_LENGTH]; /* final hierarchy */
+  int32_t screen; /* TRIPLE_SCREEN_* reason the integration was skipped, or 0 */
+} triple_reply_t;
+
+/* initial conditions for a single triple, in cgs units and radians */
+typedef struct{
+  long id; /* job number */
+  unsigned long int seed; /* random seed (FB_SEED to draw one from /dev/urandom) */
+  double m000; /* mass of star 0 of inner binary */
+  double m001; /* mass of star 1 of inner binary */
+  double m01; /* mass of outer star */
+  double r000; /* merge radius, in units of the Schwarzschild radius */
+  double a00; /* inner semimajor axis */
+  double a0; /* outer semimajor axis */
+  double e00; /* inner eccentricity */
+  double e0; /* outer eccentricity */
+  double inc; /* mutual inclination (-1 for random) */
+  double peri_in; /* argument of periapsis of inner binary (-1 for random) */
+  double peri_out; /* argument of periapsis of outer binary (-1 for random) */
+  double weight; /* importance weight, for systems drawn from a biased proposal (otherwise 1) */
+  int screen; /* 1 to skip the integration if triple_screen() shows the system cannot merge */
+} triple_ic_t;
+
+/* the outcome of a single triple integration */
+typedef struct{
+  triple_ic_t ic; /* initial conditions, with the seed actually used */
+  fb_ret_t retval; /* what fewbody() returned */
+  fb_units_t units; /* units of the integration */
+  double t; /* final time, in units of t_dyn */
+  int nstar; /* final number of stars */
+  int nobj; /* final number of top-level objects */
+  double a_in; /* final inner semimajor axis, in units of units.l, as in the trajectory output */
+  double e_in; /* final inner eccentricity */
+  double a_out; /* final outer semimajor axis, in units of units.l */
+  double e_out; /* final outer eccentricity */
+  double cosi; /* final cosine of the mutual inclination */
+  char hier[TRIPLE_HIER_LENGTH]; /* final hierarchy, as from fb_sprint_hier_hr() */
+  char hierid[TRIPLE_HIER_LENGTH]; /* final hierarchy by star id, as from fb_sprint_hier() */
+  int screen; /* TRIPLE_SCREEN_* reason the integration was skipped, or TRIPLE_SCREEN_NONE */
+} triple_result_t;
+
+/* The summary records (triple_summary.c) are written once per run, as JSON lines or as a
+   binary file: a triple_summary_header_t followed by one triple_summary_t per run, in the
+   order the runs finished.  A binary record has the same fields, in the same order, as the
+   keys of a JSON line; it is in the native layout, so that a file loads as one array of
+   fixed-size records.  Quantities are in the units of the batch table and the one-line
+   summaries: masses in MSUN, lengths in AU (Rmin in RSUN), angles in degrees (-1 where
+   random), times in units of t_dyn unless they say otherwise, and cpu times in seconds. */
+#define TRIPLE_SUMMARY_MAGIC "TRIPSUM"
+typedef struct{
+  char magic[8]; /* TRIPLE_SUMMARY_MAGIC */
+  char version[16]; /* FB_VERSION */
+  int32_t size; /* sizeof(triple_summary_t) */
+  int32_t pad;
+} triple_summary_header_t;
+
+typedef struct{
+  int64_t id; /* initial conditions, as in triple_ic_t */
+  uint64_t seed;
+  double m000;
+  double m001;
+  double m01;
+  double r000;
+  double a00;
+  double a0;
+  double e00;
+  double e0;
+  double inc;
+  double peri_in;
+  double peri_out;
+  double weight;
+  int32_t screen; /* 1 if screening was asked for */
+  int32_t ks; /* the integration parameters, as in fb_input_t */
+  double tstop;
+  double tcpustop;
+  double absacc;
+  double relacc;
+  double tidaltol;
+  double speedtol;
+  double fexp;
+  int32_t ncount;
+  int32_t PN1;
+  int32_t PN2;
+  int32_t PN25;
+  int32_t PN3;
+  int32_t PN35;
+  double t_dyn; /* the units, in yr and AU */
+  double l;
+  int32_t retval; /* the outcome, as in fb_ret_t */
+  int32_t screened; /* TRIPLE_SCREEN_* reason the integration was skipped */
+  int64_t count;
+  int64_t iclassify;
+  int64_t nrhs;
+  double DeltaE;
+  double DeltaEfrac;
+  double DeltaL;
+  double DeltaLfrac;
+  double Rmin;
+  double emax;
+  int32_t Rmin_i;
+  int32_t Rmin_j;
+  int32_t Nosc;
+  int32_t nstar; /* the final state */
+  int32_t nobj;
+  int32_t pad;
+  double t;
+  double t_yr;
+  double a_in;
+  double e_in;
+  double a_out;
+  double e_out;
+  double cosi;
+  double tcpu; /* the timing: tcpu = tintegrate + tclassify + toutput */
+  double tintegrate;
+  double tclassify;
+  double toutput;
+  char hier[TRIPLE_HIER_LENGTH]; /* as from fb_sprint_hier() */
+  char hier_hr[TRIPLE_HIER_LENGTH]; /* as from fb_sprint_hier_hr() */
+} triple_summary_t;
+
+/* a job and its predicted cost, for sorting */
+typedef struct{
+  long id;
+  double cost;
+} triple_cost_t;
+
+/* triple.c */
 void print_usage(FILE *stream);
 int calc_units(fb_obj_t *obj[2], fb_units_t *units);
+unsigned long int triple_urandom_seed(void);
+int triple_setup(triple_ic_t ic, fb_hier_t *hier, fb_units_t *units, double *t, gsl_rng *rng);
+int triple_screen(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, fb_units_t units, double *emax);
+const char *triple_screen_name(int screen);
+int triple_start(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, gsl_rng *rng, triple_result_t *result);
+void triple_finish(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, triple_result_t *result);
+void triple_run(triple_ic_t ic, fb_input_t input, fb_hier_t *hier, gsl_rng *rng, triple_result_t *result);
+void triple_print_result_header(FILE *stream);
+void triple_print_result(FILE *stream, triple_result_t *result);
+void triple_tally(triple_tally_t *tally, triple_result_t *result);
+void triple_print_tally(FILE *stream, triple_tally_t *tally);
+
+/* triple_batch.c */
+const char *triple_request_ic(triple_request_t *req, triple_ic_t *ic);
+int triple_read_ic(FILE *stream, triple_ic_t *ic, long *line);
+long triple_read_table(FILE *stream, triple_ic_t defaults, triple_ic_t **ic, long *nbad);
+int triple_batch(FILE *stream, triple_ic_t defaults, fb_input_t input);
+
+/* triple_cache.c */
+int triple_cache_open(char *path);
+int triple_cache_lookup(triple_ic_t ic, fb_input_t input, triple_result_t *result);
+void triple_cache_store(triple_ic_t ic, fb_input_t input, triple_result_t *result);
+void triple_cache_close(FILE *stream);
+int triple_cache_compact(char *path);
+uint64_t triple_fnv1a(const void *buf, size_t len, uint64_t hash);
+
+/* triple_ensemble.c */
+unsigned long int triple_job_seed(unsigned long int seed, long id);
+double triple_predict_cost(triple_ic_t ic, fb_input_t input);
+int triple_compare_cost(const void *a, const void *b);
+long triple_ensemble_jobs(triple_ic_t *ic, long njob, unsigned long int seed, fb_input_t input, int nthreads);
+void triple_thread_setup(void);
+int triple_run_threads(void *(*worker)(void *), void *arg, int nthreads);
+int triple_ensemble(FILE *stream, triple_ic_t defaults, fb_input_t input, int nthreads);
+
+/* triple_lockstep.c */
+int triple_lockstep(FILE *stream, triple_ic_t defaults, fb_input_t input, int nthreads);
+
+/* triple_parareal.c */
+int triple_parse_parareal(char *spec, triple_parareal_t *par);
+int triple_parareal(triple_parareal_t par, fb_input_t input, fb_units_t units, fb_hier_t *hier,
+                    double *t, unsigned long int seed, int nthreads, fb_ret_t *retval);
+
+/* triple_pool.c */
+long triple_pool_jobs(triple_ic_t *ic, long njob, unsigned long int seed, fb_input_t input, int nworkers);
+int triple_pool(FILE *stream, triple_ic_t defaults, fb_input_t input, int nworkers);
+
+/* triple_population.c */
+int triple_parse_population(char *spec, triple_population_t *pop);
+int triple_population(FILE *stream, long n, triple_population_t pop, triple_ic_t defaults);
+
+/* triple_refine.c */
+int triple_parse_refine(char *spec, triple_refine_t *ref);
+int triple_refine(FILE *stream, triple_refine_t ref, triple_ic_t defaults, fb_input_t input, int nthreads);
+
+/* triple_shard.c */
+int triple_parse_shard(char *spec, int *shard, int *nshard);
+void triple_shard_store(triple_result_t *result);
+int triple_shard(char *manifest, int shard, int nshard, char *results, triple_ic_t defaults,
+                 fb_input_t input, int nthreads, int nworkers);
+int triple_merge(char *out, int nfile, char **file);
+
+/* triple_summary.c */
+int triple_summary_open(fb_sink_t *sink, int binary);
+void triple_summary(triple_result_t *result, fb_input_t input);
+void triple_summary_close(FILE *stream);
+
+/* triple_reduce.c */
+int triple_reduce_open(char *path);
+void triple_reduce(triple_result_t *result);
+void triple_reduce_close(FILE *stream);
+
+/* triple_server.c */
+int triple_server(char *path, triple_ic_t defaults, fb_input_t input, int nthreads);
@@ -0,0 +1,221 @@
+/* -*- linux-c -*- */
+/* triple_batch.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* convert an angle from the table (degrees, or -1 for random) to what triple_setup() expects */
+static double triple_angle(double angle)
+{
+  if (angle > 0.0) {
+    return(angle * FB_CONST_PI / 180.0);
+  } else {
+    return(angle);
+  }
+}
+
+/* check a set of initial conditions in table units and convert them to ic; the seed, and
+   r000 if it is not given, are left as they are in ic.  Returns NULL on success, or what is
+   wrong with them. */
+const char *triple_request_ic(triple_request_t *req, triple_ic_t *ic)
+{
+  if (req->e00 >= 1.0 || req->e0 >= 1.0) {
+    return("eccentricities must be less than 1");
+  }
+
+  if (req->inc > 180.0 || (req->inc < 0.0 && req->inc != -1.0)) {
+    return("inclination must be between 0 and 180 (or -1 for random inclination)");
+  }
+
+  if (req->peri_in > 360.0 || (req->peri_in < 0.0 && req->peri_in != -1.0) ||
+      req->peri_out > 360.0 || (req->peri_out < 0.0 && req->peri_out != -1.0)) {
+    return("argument of periapsis must be between 0 and 360 (or -1 for random argument)");
+  }
+
+  ic->m000 = req->m000 * FB_CONST_MSUN;
+  ic->m001 = req->m001 * FB_CONST_MSUN;
+  ic->m01 = req->m01 * FB_CONST_MSUN;
+  if (req->r000 > 0.0) {
+    ic->r000 = req->r000;
+  }
+  ic->a00 = req->a00 * FB_CONST_AU;
+  ic->a0 = req->a0 * FB_CONST_AU;
+  ic->e00 = req->e00;
+  ic->e0 = req->e0;
+  ic->inc = triple_angle(req->inc);
+  ic->peri_in = triple_angle(req->peri_in);
+  ic->peri_out = triple_angle(req->peri_out);
+
+  return(NULL);
+}
+
+/* read the next set of initial conditions from a batch table; fields not given in the table
+   (r000, and seed and weight if the columns are omitted) are left as they are in ic.  Returns 1 on success,
+   0 at end of file, and -1 if the line is malformed. */
+int triple_read_ic(FILE *stream, triple_ic_t *ic, long *line)
+{
+  int n;
+  unsigned long int seed;
+  double weight;
+  triple_request_t req;
+  const char *why;
+  char buf[FB_MAX_STRING_LENGTH], *ptr;
+
+  while (fgets(buf, FB_MAX_STRING_LENGTH, stream) != NULL) {
+    (*line)++;
+
+    /* skip blank lines and comments */
+    ptr = buf + strspn(buf, " \t");
+    if (*ptr == '#' || *ptr == '\n' || *ptr == '\0') {
+      continue;
+    }
+
+    n = sscanf(ptr, "%lf %lf %lf %lf %lf %lf %lf %lf %lf %lf %lu %lf",
+         &req.m000, &req.m001, &req.m01, &req.a00, &req.a0, &req.e00, &req.e0, &req.inc,
+         &req.peri_in, &req.peri_out, &seed, &weight);
+    if (n < 10) {
+      fprintf(stderr, "triple_read_ic(): line %ld: expected at least 10 columns, got %d\n", *line, n);
+      return(-1);
+    }
+
+    if (n == 12 && !(weight > 0.0)) {
+      fprintf(stderr, "triple_read_ic(): line %ld: weight must be positive\n", *line);
+      return(-1);
+    }
+
+    req.r000 = 0.0;
+    if ((why = triple_request_ic(&req, ic)) != NULL) {
+      fprintf(stderr, "triple_read_ic(): line %ld: %s\n", *line, why);
+      return(-1);
+    }
+    if (n >= 11) {
+      ic->seed = seed;
+    }
+    if (n == 12) {
+      ic->weight = weight;
+    }
+
+    return(1);
+  }
+
+  return(0);
+}
+
+/* read a whole batch table into a malloc()ed array, numbering the jobs from 0; lines without
+   a seed get FB_SEED.  Returns the number of jobs; *nbad is set to the number of malformed
+   lines, which are skipped. */
+long triple_read_table(FILE *stream, triple_ic_t defaults, triple_ic_t **ic, long *nbad)
+{
+  int status;
+  long line=0, njob=0, nalloc=1024;
+  triple_ic_t tmpic;
+
+  *ic = (triple_ic_t *) malloc(nalloc * sizeof(triple_ic_t));
+  *nbad = 0;
+  defaults.seed = FB_SEED;
+  tmpic = defaults;
+  while ((status = triple_read_ic(stream, &tmpic, &line)) != 0) {
+    if (status < 0) {
+      (*nbad)++;
+    } else {
+      if (njob == nalloc) {
+        nalloc *= 2;
+        *ic = (triple_ic_t *) realloc(*ic, nalloc * sizeof(triple_ic_t));
+      }
+      tmpic.id = njob;
+      (*ic)[njob++] = tmpic;
+    }
+    tmpic = defaults;
+  }
+
+  return(njob);
+}
+
+/* run every triple in the batch table in this process, reusing the hierarchy and rng, and
+   write one summary line per system to stderr */
+int triple_batch(FILE *stream, triple_ic_t defaults, fb_input_t input)
+{
+  int status;
+  long line=0, njob=0, nbad=0, nfail=0;
+  triple_ic_t ic;
+  triple_result_t result;
+  triple_tally_t tally;
+  fb_hier_t hier;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  /* these are allocated once and reused for every system */
+  gsl_rng_env_setup();
+  rng = gsl_rng_alloc(rng_type);
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  triple_print_result_header(stderr);
+  memset(&tally, 0, sizeof(triple_tally_t));
+
+  ic = defaults;
+  while ((status = triple_read_ic(stream, &ic, &line)) != 0) {
+    if (status < 0) {
+      nbad++;
+      ic = defaults;
+      continue;
+    }
+
+    ic.id = njob++;
+    if (ic.seed == FB_SEED) {
+      ic.seed = triple_urandom_seed();
+    }
+
+    triple_run(ic, input, &hier, rng, &result);
+    if (result.retval.retval < 0) {
+      fprintf(stderr, "triple_batch(): job %ld failed: %s\n", ic.id, fb_strerror(result.retval.retval));
+      nfail++;
+    }
+    triple_print_result(stderr, &result);
+    triple_summary(&result, input);
+    triple_reduce(&result);
+    triple_tally(&tally, &result);
+
+    ic = defaults;
+  }
+
+  triple_print_tally(stderr, &tally);
+  if (nbad) {
+    fprintf(stderr, "triple_batch(): skipped %ld malformed line(s)\n", nbad);
+  }
+  if (nfail) {
+    fprintf(stderr, "triple_batch(): %ld of %ld job(s) failed\n", nfail, njob);
+  }
+
+  /* free GSL stuff */
+  gsl_rng_free(rng);
+
+  /* free our own stuff */
+  fb_free_hier(hier);
+
+  return(nbad ? 1 : 0);
+}
@@ -0,0 +1,467 @@
+/* -*- linux-c -*- */
+/* triple_cache.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* The cache is a file of fixed-size records, each holding the canonicalized inputs of a run
+   and its result, and only ever appended to: a record goes out in a single write() to a
+   descriptor opened with O_APPEND, so records from concurrent threads and processes cannot
+   interleave, and a checksum over the record catches one torn by a crash.  Every process
+   using the cache holds a shared flock() on it, and compaction, which rewrites the file,
+   needs an exclusive one.  The records are in the native layout, so a cache is only good for
+   the build that wrote it; a record of another size is refused. */
+#define TRIPLE_CACHE_MAGIC 0x48434354 /* "TCCH" */
+
+/* everything a result depends on; padding is zeroed, so the bytes can be hashed */
+typedef struct{
+  char version[16]; /* FB_VERSION */
+  uint64_t seed;
+  double m000; /* initial conditions, as in triple_ic_t */
+  double m001;
+  double m01;
+  double r000;
+  double a00;
+  double a0;
+  double e00;
+  double e0;
+  double inc;
+  double peri_in;
+  double peri_out;
+  double tstop; /* the numeric fields of fb_input_t */
+  double dt;
+  double tcpustop;
+  double absacc;
+  double relacc;
+  double tidaltol;
+  double speedtol;
+  double fexp;
+  int32_t ks;
+  int32_t Dflag;
+  int32_t ncount;
+  int32_t outfreq;
+  int32_t PN1;
+  int32_t PN2;
+  int32_t PN25;
+  int32_t PN3;
+  int32_t PN35;
+  int32_t screen; /* triple_ic_t.screen */
+} triple_cache_key_t;
+
+typedef struct{
+  uint32_t magic; /* TRIPLE_CACHE_MAGIC */
+  uint32_t length; /* sizeof(triple_cache_record_t) */
+  uint64_t hash; /* FNV-1a hash of key */
+  triple_cache_key_t key;
+  triple_result_t result;
+  uint64_t check; /* FNV-1a hash of everything above */
+} triple_cache_record_t;
+
+/* an entry of the in-memory index: where the latest record with a given hash is */
+typedef struct{
+  uint64_t hash;
+  off_t offset; /* -1 for an empty slot */
+} triple_cache_slot_t;
+
+typedef struct{
+  int fd; /* the cache file, or -1 if there is no cache */
+  int readonly; /* set if the file is damaged, so that new records would be unreachable */
+  triple_cache_slot_t *slot; /* open-addressed hash table of the records */
+  long nslot; /* size of slot[], a power of two */
+  long nrecord; /* number of distinct keys in slot[] */
+  long nhit; /* lookups answered from the cache */
+  long nmiss; /* lookups that were not */
+  long nstore; /* records appended */
+  pthread_mutex_t lock; /* protects everything above but fd */
+} triple_cache_t;
+
+static triple_cache_t triple_cache = {-1, 0, NULL, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/* FNV-1a hash of len bytes, continuing from hash (start from TRIPLE_FNV_OFFSET) */
+uint64_t triple_fnv1a(const void *buf, size_t len, uint64_t hash)
+{
+  size_t i;
+  const unsigned char *p=buf;
+
+  for (i=0; i<len; i++) {
+    hash ^= p[i];
+    hash *= TRIPLE_FNV_PRIME;
+  }
+
+  return(hash);
+}
+
+/* a double with -0 folded onto +0, so that equal values hash alike */
+static double triple_cache_canon(double x)
+{
+  return(x == 0.0 ? 0.0 : x);
+}
+
+/* the canonical key of a run */
+static void triple_cache_key(triple_ic_t ic, fb_input_t input, triple_cache_key_t *key)
+{
+  memset(key, 0, sizeof(triple_cache_key_t));
+  strncpy(key->version, FB_VERSION, sizeof(key->version)-1);
+  key->seed = ic.seed;
+  key->m000 = triple_cache_canon(ic.m000);
+  key->m001 = triple_cache_canon(ic.m001);
+  key->m01 = triple_cache_canon(ic.m01);
+  key->r000 = triple_cache_canon(ic.r000);
+  key->a00 = triple_cache_canon(ic.a00);
+  key->a0 = triple_cache_canon(ic.a0);
+  key->e00 = triple_cache_canon(ic.e00);
+  key->e0 = triple_cache_canon(ic.e0);
+  key->inc = triple_cache_canon(ic.inc);
+  key->peri_in = triple_cache_canon(ic.peri_in);
+  key->peri_out = triple_cache_canon(ic.peri_out);
+  key->tstop = triple_cache_canon(input.tstop);
+  key->dt = triple_cache_canon(input.dt);
+  key->tcpustop = triple_cache_canon(input.tcpustop);
+  key->absacc = triple_cache_canon(input.absacc);
+  key->relacc = triple_cache_canon(input.relacc);
+  key->tidaltol = triple_cache_canon(input.tidaltol);
+  key->speedtol = triple_cache_canon(input.speedtol);
+  key->fexp = triple_cache_canon(input.fexp);
+  key->ks = input.ks;
+  key->Dflag = input.Dflag;
+  key->ncount = input.ncount;
+  key->outfreq = input.outfreq;
+  key->PN1 = input.PN1;
+  key->PN2 = input.PN2;
+  key->PN25 = input.PN25;
+  key->PN3 = input.PN3;
+  key->PN35 = input.PN35;
+  key->screen = ic.screen;
+}
+
+/* whether a record read back is whole */
+static int triple_cache_valid(triple_cache_record_t *rec)
+{
+  return(rec->magic == TRIPLE_CACHE_MAGIC && rec->length == sizeof(triple_cache_record_t) &&
+         rec->check == triple_fnv1a(rec, offsetof(triple_cache_record_t, check), TRIPLE_FNV_OFFSET));
+}
+
+/* point the index entry for hash at offset, growing the table as needed; the caller holds
+   the lock (or is the only thread) */
+static void triple_cache_insert(triple_cache_t *cache, uint64_t hash, off_t offset)
+{
+  long i, n;
+  triple_cache_slot_t *old;
+
+  if (2 * (cache->nrecord + 1) > cache->nslot) {
+    old = cache->slot;
+    n = cache->nslot;
+    cache->nslot = (n == 0 ? 1024 : 2 * n);
+    cache->slot = (triple_cache_slot_t *) malloc(cache->nslot * sizeof(triple_cache_slot_t));
+    for (i=0; i<cache->nslot; i++) {
+      cache->slot[i].offset = -1;
+    }
+    cache->nrecord = 0;
+    for (i=0; i<n; i++) {
+      if (old[i].offset >= 0) {
+        triple_cache_insert(cache, old[i].hash, old[i].offset);
+      }
+    }
+    free(old);
+  }
+
+  for (i=hash & (cache->nslot-1); cache->slot[i].offset >= 0; i=(i+1) & (cache->nslot-1)) {
+    if (cache->slot[i].hash == hash) {
+      /* a later record of the same key supersedes the earlier one */
+      cache->slot[i].offset = offset;
+      return;
+    }
+  }
+  cache->slot[i].hash = hash;
+  cache->slot[i].offset = offset;
+  cache->nrecord++;
+}
+
+/* the offset of the latest record with the given hash, or -1 */
+static off_t triple_cache_find(triple_cache_t *cache, uint64_t hash)
+{
+  long i;
+
+  if (cache->nslot == 0) {
+    return(-1);
+  }
+  for (i=hash & (cache->nslot-1); cache->slot[i].offset >= 0; i=(i+1) & (cache->nslot-1)) {
+    if (cache->slot[i].hash == hash) {
+      return(cache->slot[i].offset);
+    }
+  }
+
+  return(-1);
+}
+
+/* index the records of an open cache file; records of other code versions are left out if
+   thisversion is set.  A torn record at the end of the file is cut off if the file can be had
+   to ourselves: if shared is set, the caller holds a shared lock, and the cut is only made if
+   an exclusive one can be had without waiting; otherwise the cache is left read-only.
+   Returns the number of records read, or -1 if the file holds records of another build or is
+   damaged before its end, in which case what could be read is still indexed. */
+static long triple_cache_load(triple_cache_t *cache, char *path, int thisversion, int shared)
+{
+  long n=0;
+  off_t offset=0;
+  ssize_t len;
+  triple_cache_record_t rec;
+
+  while ((len = pread(cache->fd, &rec, sizeof(triple_cache_record_t), offset)) > 0) {
+    if (len >= offsetof(triple_cache_record_t, hash) &&
+        (rec.magic != TRIPLE_CACHE_MAGIC || rec.length != sizeof(triple_cache_record_t))) {
+      fprintf(stderr, "triple_cache: %s: not a record of this build at offset %ld\n", path, (long) offset);
+      return(-1);
+    } else if (len < sizeof(triple_cache_record_t)) {
+      if (shared && flock(cache->fd, LOCK_EX | LOCK_NB) != 0) {
+        /* a failed conversion may have dropped the shared lock */
+        flock(cache->fd, LOCK_SH);
+        fprintf(stderr, "triple_cache: %s: torn record at the end, but the cache is in use; not adding to it\n", path);
+        cache->readonly = 1;
+        break;
+      }
+      fprintf(stderr, "triple_cache: %s: dropping a torn record at the end\n", path);
+      len = ftruncate(cache->fd, offset);
+      if (shared) {
+        flock(cache->fd, LOCK_SH);
+      }
+      if (len != 0) {
+        return(-1);
+      }
+      break;
+    } else if (!triple_cache_valid(&rec)) {
+      fprintf(stderr, "triple_cache: %s: bad checksum at offset %ld\n", path, (long) offset);
+      return(-1);
+    }
+    if (!thisversion || strncmp(rec.key.version, FB_VERSION, sizeof(rec.key.version)) == 0) {
+      triple_cache_insert(cache, rec.hash, offset);
+    }
+    offset += sizeof(triple_cache_record_t);
+    n++;
+  }
+
+  return(len < 0 ? -1 : n);
+}
+
+/* open (creating it if need be) and index the cache file at path; from then on
+   triple_cache_lookup() and triple_cache_store() use it.  Returns 0 on success. */
+int triple_cache_open(char *path)
+{
+  long n;
+
+  if ((triple_cache.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0) {
+    fprintf(stderr, "triple_cache: cannot open %s: %s\n", path, strerror(errno));
+    return(1);
+  }
+
+  /* the shared lock keeps compaction away for as long as we run, and lets other sweeps share
+     the cache */
+  if (flock(triple_cache.fd, LOCK_SH) != 0) {
+    fprintf(stderr, "triple_cache: cannot lock %s: %s\n", path, strerror(errno));
+    close(triple_cache.fd);
+    triple_cache.fd = -1;
+    return(1);
+  }
+  if ((n = triple_cache_load(&triple_cache, path, 1, 1)) < 0) {
+    fprintf(stderr, "triple_cache: %s is damaged or from another build; only reading what comes before the damage\n", path);
+    triple_cache.readonly = 1;
+  }
+
+  fprintf(stderr, "triple_cache: %s: %ld results for version %s\n", path, triple_cache.nrecord, FB_VERSION);
+  return(0);
+}
+
+/* look a run up in the cache; on a hit, the stored result goes to result, with the job
+   number and weight of ic, and 1 is returned.  The trajectory of a run is not cached. */
+int triple_cache_lookup(triple_ic_t ic, fb_input_t input, triple_result_t *result)
+{
+  uint64_t hash;
+  off_t offset;
+  triple_cache_key_t key;
+  triple_cache_record_t rec;
+
+  if (triple_cache.fd < 0) {
+    return(0);
+  }
+
+  triple_cache_key(ic, input, &key);
+  hash = triple_fnv1a(&key, sizeof(triple_cache_key_t), TRIPLE_FNV_OFFSET);
+
+  pthread_mutex_lock(&(triple_cache.lock));
+  offset = triple_cache_find(&triple_cache, hash);
+  pthread_mutex_unlock(&(triple_cache.lock));
+
+  if (offset < 0 || pread(triple_cache.fd, &rec, sizeof(triple_cache_record_t), offset) != sizeof(triple_cache_record_t) ||
+      !triple_cache_valid(&rec) || memcmp(&key, &(rec.key), sizeof(triple_cache_key_t)) != 0) {
+    pthread_mutex_lock(&(triple_cache.lock));
+    triple_cache.nmiss++;
+    pthread_mutex_unlock(&(triple_cache.lock));
+    return(0);
+  }
+
+  *result = rec.result;
+  result->ic.id = ic.id;
+  result->ic.weight = ic.weight;
+
+  pthread_mutex_lock(&(triple_cache.lock));
+  triple_cache.nhit++;
+  pthread_mutex_unlock(&(triple_cache.lock));
+  return(1);
+}
+
+/* append the result of a run to the cache; failed runs, and runs cut short by tcpustop,
+   which would not come out the same next time, are not stored */
+void triple_cache_store(triple_ic_t ic, fb_input_t input, triple_result_t *result)
+{
+  off_t offset;
+  triple_cache_record_t rec;
+
+  if (triple_cache.fd < 0 || triple_cache.readonly ||
+      result->retval.retval < 0 || result->retval.tcpu >= input.tcpustop) {
+    return;
+  }
+
+  memset(&rec, 0, sizeof(triple_cache_record_t));
+  rec.magic = TRIPLE_CACHE_MAGIC;
+  rec.length = sizeof(triple_cache_record_t);
+  triple_cache_key(ic, input, &(rec.key));
+  rec.hash = triple_fnv1a(&(rec.key), sizeof(triple_cache_key_t), TRIPLE_FNV_OFFSET);
+  rec.result = *result;
+  rec.check = triple_fnv1a(&rec, offsetof(triple_cache_record_t, check), TRIPLE_FNV_OFFSET);
+
+  /* with O_APPEND the record lands wherever the end is at the time of the write, which
+     another process may have moved since any earlier lseek(); the position after the write
+     is where it ended up */
+  pthread_mutex_lock(&(triple_cache.lock));
+  if (write(triple_cache.fd, &rec, sizeof(triple_cache_record_t)) == sizeof(triple_cache_record_t)) {
+    offset = lseek(triple_cache.fd, 0, SEEK_CUR) - sizeof(triple_cache_record_t);
+    triple_cache_insert(&triple_cache, rec.hash, offset);
+    triple_cache.nstore++;
+  } else {
+    fprintf(stderr, "triple_cache: cannot append a result: %s\n", strerror(errno));
+    triple_cache.readonly = 1;
+  }
+  pthread_mutex_unlock(&(triple_cache.lock));
+}
+
+/* report on and close the cache */
+void triple_cache_close(FILE *stream)
+{
+  if (triple_cache.fd < 0) {
+    return;
+  }
+
+  if (triple_cache.nhit + triple_cache.nmiss > 0) {
+    fprintf(stream, "triple_cache: %ld hits  %ld misses  %ld stored\n",
+      triple_cache.nhit, triple_cache.nmiss, triple_cache.nstore);
+  }
+
+  close(triple_cache.fd);
+  triple_cache.fd = -1;
+  free(triple_cache.slot);
+  triple_cache.slot = NULL;
+  triple_cache.nslot = 0;
+  triple_cache.nrecord = 0;
+}
+
+/* sort offsets in increasing order */
+static int triple_cache_cmp_offset(const void *a, const void *b)
+{
+  off_t x=*((const off_t *) a), y=*((const off_t *) b);
+
+  return(x < y ? -1 : (x > y ? 1 : 0));
+}
+
+/* rewrite the cache at path with only the latest record of each key of this version, in
+   the order they were written; the new file replaces the old one only once it is complete.
+   Fails if anything else has the cache open.  Returns 0 on success. */
+int triple_cache_compact(char *path)
+{
+  int ok;
+  long i, n, nkeep=0;
+  off_t *offset;
+  char tmpname[FB_MAX_STRING_LENGTH];
+  triple_cache_t cache = {-1, 0, NULL, 0, 0, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+  triple_cache_record_t rec;
+  FILE *fp;
+
+  if ((cache.fd = open(path, O_RDWR)) < 0) {
+    fprintf(stderr, "triple_cache: cannot open %s: %s\n", path, strerror(errno));
+    return(1);
+  }
+  if (flock(cache.fd, LOCK_EX | LOCK_NB) != 0) {
+    fprintf(stderr, "triple_cache: %s is in use\n", path);
+    close(cache.fd);
+    return(1);
+  }
+
+  if ((n = triple_cache_load(&cache, path, 1, 0)) < 0) {
+    fprintf(stderr, "triple_cache: keeping what could be read of %s\n", path);
+  }
+
+  offset = (off_t *) malloc(FB_MAX(cache.nrecord, 1) * sizeof(off_t));
+  for (i=0; i<cache.nslot; i++) {
+    if (cache.slot[i].offset >= 0) {
+      offset[nkeep++] = cache.slot[i].offset;
+    }
+  }
+  qsort(offset, nkeep, sizeof(off_t), triple_cache_cmp_offset);
+
+  snprintf(tmpname, FB_MAX_STRING_LENGTH, "%s.tmp", path);
+  if ((fp = fopen(tmpname, "wb")) == NULL) {
+    fprintf(stderr, "triple_cache: cannot write %s: %s\n", tmpname, strerror(errno));
+    free(offset);
+    free(cache.slot);
+    close(cache.fd);
+    return(1);
+  }
+
+  ok = 1;
+  for (i=0; i<nkeep && ok; i++) {
+    ok = (pread(cache.fd, &rec, sizeof(triple_cache_record_t), offset[i]) == sizeof(triple_cache_record_t) &&
+          fwrite(&rec, sizeof(triple_cache_record_t), 1, fp) == 1);
+  }
+  ok = (ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0);
+  ok = (fclose(fp) == 0 && ok);
+  if (!ok || rename(tmpname, path) != 0) {
+    fprintf(stderr, "triple_cache: cannot compact %s\n", path);
+    remove(tmpname);
+    ok = 0;
+  } else {
+    fprintf(stderr, "triple_cache: %s: kept %ld of %ld records\n", path, nkeep, FB_MAX(n, nkeep));
+  }
+
+  free(offset);
+  free(cache.slot);
+  close(cache.fd);
+  return(ok ? 0 : 1);
+}
@@ -0,0 +1,454 @@
+/* -*- linux-c -*- */
+/* triple_ensemble.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* the jobs of one worker: indices into the ic array, from the most to the least expensive;
+   jobs head..tail-1 are still to do.  Jobs are coarse (seconds to an hour each), so a mutex
+   per deque costs nothing measurable. */
+typedef struct{
+  long *job; /* job indices */
+  long head; /* next job to do */
+  long tail; /* one past the last job to do */
+  double cost; /* predicted cost of the remaining jobs */
+  pthread_mutex_t lock; /* protects head, tail and cost */
+  long njob; /* number of jobs run by this worker */
+  long nstolen; /* how many of those were stolen from other workers */
+  long nfail; /* how many of those failed with an FB_E_* error */
+  double busy; /* wall-clock time spent integrating, in seconds */
+  double done; /* wall-clock time at which the worker ran out of work, in seconds */
+} triple_deque_t;
+
+/* the state shared by the worker threads; apart from the deques and the worker count, only
+   the output streams change once the threads have started, and they are protected by lock */
+typedef struct{
+  triple_ic_t *ic; /* initial conditions, one per job */
+  double *cost; /* predicted cost of each job */
+  long njob; /* number of jobs */
+  int nthreads; /* number of workers */
+  int nworker; /* number of workers that have started, which hands each its id */
+  triple_deque_t *deque; /* one per worker */
+  unsigned long int seed; /* master seed, from which the per-job seeds are derived */
+  int debug; /* value of fb_debug in the worker threads */
+  fb_input_t input; /* integration parameters, the same for every job */
+  struct timespec start; /* wall-clock time at which the workers were started */
+  triple_tally_t tally; /* merger fraction estimate (protected by lock) */
+  pthread_mutex_t lock; /* protects the output streams */
+} triple_ensemble_t;
+
+/* derive the seed of a job from the master seed and the job number (splitmix64); the result
+   is folded to 32 bits since that is all gsl_rng_mt19937 uses */
+unsigned long int triple_job_seed(unsigned long int seed, long id)
+{
+  unsigned long long z;
+
+  z = (unsigned long long) seed + 0x9e3779b97f4a7c15ULL * ((unsigned long long) id + 1ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z = z ^ (z >> 31);
+  z = (z ^ (z >> 32)) & 0xffffffffULL;
+
+  /* a seed of FB_SEED means "draw one from /dev/urandom" everywhere else */
+  return(z == FB_SEED ? 1UL : (unsigned long int) z);
+}
+
+/* copy everything in one stream to another */
+static void triple_copy_stream(FILE *from, FILE *to)
+{
+  size_t n;
+  char buf[65536];
+
+  rewind(from);
+  while ((n = fread(buf, 1, sizeof(buf), from)) > 0) {
+    fwrite(buf, 1, n, to);
+  }
+}
+
+/* predict the relative CPU cost of integrating a triple, in inner orbits weighted by how
+   hard the pericentre passages are to resolve.  The run covers tstop/(2 pi) inner orbits
+   (the time unit is the inner orbital period over 2 pi); if at least one Kozai cycle fits
+   in that time and the inclination is inside the Kozai window, the inner eccentricity
+   reaches the quadrupole e_max, and the number of steps per orbit grows roughly as
+   (1-e)^(-1/2).  Only the ordering of the jobs matters, so the constants are dropped. */
+double triple_predict_cost(triple_ic_t ic, fb_input_t input)
+{
+  double m00, Pin, Pout, tkozai, norbit, cosi2, e, emax;
+
+  m00 = ic.m000 + ic.m001;
+  Pin = 2.0 * FB_CONST_PI * sqrt(fb_cub(ic.a00) / (FB_CONST_G * m00));
+  Pout = 2.0 * FB_CONST_PI * sqrt(fb_cub(ic.a0) / (FB_CONST_G * (m00 + ic.m01)));
+
+  /* Kozai timescale, in units of the inner period */
+  tkozai = (m00 + ic.m01) / ic.m01 * fb_sqr(Pout / Pin) * pow(1.0 - fb_sqr(ic.e0), 1.5);
+  norbit = input.tstop / (2.0 * FB_CONST_PI);
+
+  /* a random inclination gets the isotropic average of cos^2 i */
+  if (ic.inc < 0.0) {
+    cosi2 = 1.0 / 3.0;
+  } else {
+    cosi2 = fb_sqr(cos(ic.inc));
+  }
+
+  e = ic.e00;
+  if (tkozai < norbit && cosi2 < 0.6) {
+    emax = sqrt(1.0 - 5.0 / 3.0 * cosi2);
+    e = FB_MAX(e, emax);
+  }
+  e = FB_MIN(e, 1.0 - 1.0e-6);
+
+  return(norbit / sqrt(1.0 - e));
+}
+
+/* wall-clock time since start, in seconds */
+static double triple_wall_time(struct timespec *start)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return((double) (now.tv_sec - start->tv_sec) + 1.0e-9 * (double) (now.tv_nsec - start->tv_nsec));
+}
+
+/* sort jobs from the most to the least expensive, for qsort() */
+int triple_compare_cost(const void *a, const void *b)
+{
+  double ca=((const triple_cost_t *) a)->cost, cb=((const triple_cost_t *) b)->cost;
+
+  if (ca > cb) {
+    return(-1);
+  } else if (ca < cb) {
+    return(1);
+  } else {
+    return((((const triple_cost_t *) a)->id < ((const triple_cost_t *) b)->id) ? -1 : 1);
+  }
+}
+
+/* take the most expensive job left in a deque; returns -1 if it is empty */
+static long triple_deque_pop(triple_ensemble_t *ens, triple_deque_t *deque)
+{
+  long i=-1;
+
+  pthread_mutex_lock(&(deque->lock));
+  if (deque->head < deque->tail) {
+    i = deque->job[deque->head++];
+    deque->cost -= ens->cost[i];
+    if (deque->head == deque->tail) {
+      deque->cost = 0.0;
+    }
+  }
+  pthread_mutex_unlock(&(deque->lock));
+
+  return(i);
+}
+
+/* find a job for worker id: its own most expensive one, or else the most expensive one of
+   the worker with the most predicted work left.  Thieves take from the head rather than the
+   tail, since with heavy-tailed run times the makespan is set by the long jobs, and handing
+   those out first (longest processing time first) is what keeps it short. */
+static long triple_next_job(triple_ensemble_t *ens, int id)
+{
+  int k, victim;
+  long i;
+  double maxcost;
+
+  if ((i = triple_deque_pop(ens, &(ens->deque[id]))) >= 0) {
+    return(i);
+  }
+
+  while (1) {
+    /* the costs are read unlocked, as a hint; the pop rechecks */
+    victim = -1;
+    maxcost = 0.0;
+    for (k=0; k<ens->nthreads; k++) {
+      if (k != id && ens->deque[k].head < ens->deque[k].tail && ens->deque[k].cost >= maxcost) {
+        victim = k;
+        maxcost = ens->deque[k].cost;
+      }
+    }
+
+    if (victim < 0) {
+      return(-1);
+    }
+
+    if ((i = triple_deque_pop(ens, &(ens->deque[victim]))) >= 0) {
+      ens->deque[id].nstolen++;
+      return(i);
+    }
+  }
+}
+
+/* run jobs until there are none left anywhere */
+static void *triple_ensemble_worker(void *arg)
+{
+  triple_ensemble_t *ens=(triple_ensemble_t *) arg;
+  int id=__sync_fetch_and_add(&(ens->nworker), 1);
+  long i;
+  double tstart;
+  triple_deque_t *deque=&(ens->deque[id]);
+  triple_ic_t ic;
+  triple_result_t result;
+  fb_input_t input;
+  fb_hier_t hier;
+  FILE *out;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  fb_debug = ens->debug;
+  input = ens->input;
+  /* each worker has a live status block of its own */
+  if (input.telem != NULL) {
+    input.telem = &(ens->input.telem[id]);
+  }
+
+  /* each thread has its own hierarchy and rng, reused for all of its jobs */
+  rng = gsl_rng_alloc(rng_type);
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  while ((i = triple_next_job(ens, id)) >= 0) {
+    ic = ens->ic[i];
+    if (ic.seed == FB_SEED) {
+      ic.seed = triple_job_seed(ens->seed, ic.id);
+    }
+
+    /* the trajectory of each job is collected in a temporary file, so that the merged output
+       is not interleaved */
+    if ((out = tmpfile()) == NULL) {
+      fprintf(stderr, "triple_ensemble_worker(): cannot create temporary file; writing output directly\n");
+      out = ens->input.out;
+    }
+    input.out = out;
+
+    tstart = triple_wall_time(&(ens->start));
+    triple_run(ic, input, &hier, rng, &result);
+    deque->busy += triple_wall_time(&(ens->start)) - tstart;
+    deque->njob++;
+
+    if (result.retval.retval < 0) {
+      deque->nfail++;
+    }
+    triple_reduce(&result);
+
+    pthread_mutex_lock(&(ens->lock));
+    if (result.retval.retval < 0) {
+      fprintf(stderr, "triple_ensemble_worker(): job %ld failed: %s\n", ic.id, fb_strerror(result.retval.retval));
+    }
+    if (out != ens->input.out) {
+      fprintf(ens->input.out, "# job %ld seed %lu\n", ic.id, ic.seed);
+      triple_copy_stream(out, ens->input.out);
+    }
+    triple_print_result(stderr, &result);
+    triple_summary(&result, ens->input);
+    triple_tally(&(ens->tally), &result);
+    triple_shard_store(&result);
+    pthread_mutex_unlock(&(ens->lock));
+
+    if (out != ens->input.out) {
+      fclose(out);
+    }
+  }
+
+  deque->done = triple_wall_time(&(ens->start));
+
+  /* free GSL stuff */
+  gsl_rng_free(rng);
+
+  /* free our own stuff */
+  fb_free_hier(hier);
+
+  return(NULL);
+}
+
+/* run the njob jobs in ic[] on nthreads threads; jobs without a seed get one derived from
+   the master seed.  The jobs are dealt to the workers most expensive first, by predicted
+   cost, and idle workers steal from the worker with the most predicted work left.  Returns
+   the number of jobs that failed. */
+long triple_ensemble_jobs(triple_ic_t *ic, long njob, unsigned long int seed, fb_input_t input, int nthreads)
+{
+  int i, k;
+  long j, nfail=0;
+  double makespan, busy;
+  triple_ensemble_t ens;
+  triple_cost_t *order;
+
+  ens.ic = ic;
+  ens.njob = njob;
+  ens.seed = seed;
+  ens.nthreads = nthreads;
+  ens.nworker = 0;
+  ens.debug = fb_debug;
+  ens.input = input;
+  memset(&(ens.tally), 0, sizeof(triple_tally_t));
+  pthread_mutex_init(&(ens.lock), NULL);
+
+  /* predict the cost of each job, and deal the jobs out round-robin from the most to the
+     least expensive, so that every deque starts sorted and with about the same total cost */
+  ens.cost = (double *) malloc(FB_MAX(ens.njob, 1) * sizeof(double));
+  order = (triple_cost_t *) malloc(FB_MAX(ens.njob, 1) * sizeof(triple_cost_t));
+  for (j=0; j<ens.njob; j++) {
+    ens.cost[j] = triple_predict_cost(ens.ic[j], input);
+    order[j].id = j;
+    order[j].cost = ens.cost[j];
+  }
+  qsort(order, ens.njob, sizeof(triple_cost_t), triple_compare_cost);
+
+  ens.deque = (triple_deque_t *) malloc(nthreads * sizeof(triple_deque_t));
+  for (k=0; k<nthreads; k++) {
+    ens.deque[k].job = (long *) malloc((ens.njob / nthreads + 1) * sizeof(long));
+    ens.deque[k].head = 0;
+    ens.deque[k].tail = 0;
+    ens.deque[k].cost = 0.0;
+    ens.deque[k].njob = 0;
+    ens.deque[k].nstolen = 0;
+    ens.deque[k].nfail = 0;
+    ens.deque[k].busy = 0.0;
+    ens.deque[k].done = 0.0;
+    pthread_mutex_init(&(ens.deque[k].lock), NULL);
+  }
+  for (j=0; j<ens.njob; j++) {
+    k = j % nthreads;
+    ens.deque[k].job[ens.deque[k].tail++] = order[j].id;
+    ens.deque[k].cost += order[j].cost;
+  }
+  free(order);
+
+  if (fb_debug) {
+    for (j=0; j<ens.njob; j++) {
+      fprintf(stderr, "triple_ensemble(): job %ld predicted cost %.6g\n", j, ens.cost[j]);
+    }
+  }
+
+  triple_print_result_header(stderr);
+
+  clock_gettime(CLOCK_MONOTONIC, &(ens.start));
+
+  /* the workers that could not be started leave their jobs to be stolen; if none could be
+     started at all, the work is done here, by worker 0 */
+  triple_run_threads(triple_ensemble_worker, &ens, nthreads);
+
+  /* per-worker utilization: the fraction of the makespan spent integrating */
+  makespan = triple_wall_time(&(ens.start));
+  busy = 0.0;
+  fprintf(stderr, "# worker njob nstolen busy/s idle/s utilization\n");
+  for (i=0; i<ens.nworker; i++) {
+    busy += ens.deque[i].busy;
+    nfail += ens.deque[i].nfail;
+    fprintf(stderr, "# %d %ld %ld %.6g %.6g %.4f\n", i, ens.deque[i].njob, ens.deque[i].nstolen,
+      ens.deque[i].busy, makespan - ens.deque[i].busy, makespan > 0.0 ? ens.deque[i].busy / makespan : 1.0);
+  }
+  fprintf(stderr, "triple_ensemble(): makespan=%.6g s  busy/nthreads=%.6g s  efficiency=%.4f\n",
+    makespan, busy / ens.nworker, makespan > 0.0 ? busy / ens.nworker / makespan : 1.0);
+
+  triple_print_tally(stderr, &(ens.tally));
+  if (nfail) {
+    fprintf(stderr, "triple_ensemble(): %ld of %ld job(s) failed\n", nfail, ens.njob);
+  }
+
+  for (k=0; k<nthreads; k++) {
+    pthread_mutex_destroy(&(ens.deque[k].lock));
+    free(ens.deque[k].job);
+  }
+  free(ens.deque);
+  pthread_mutex_destroy(&(ens.lock));
+  free(ens.cost);
+
+  return(nfail);
+}
+
+static pthread_once_t triple_thread_once=PTHREAD_ONCE_INIT;
+
+static void triple_thread_init(void)
+{
+  /* this reads the environment, so do it once before there are several threads */
+  gsl_rng_env_setup();
+}
+
+/* what has to be done before the first worker thread of the process is started */
+void triple_thread_setup(void)
+{
+  pthread_once(&triple_thread_once, triple_thread_init);
+}
+
+/* run worker(arg) on nthreads threads and wait for them all; if no thread could be started,
+   run it here instead.  Returns the number of threads started. */
+int triple_run_threads(void *(*worker)(void *), void *arg, int nthreads)
+{
+  int i, nstarted=0;
+  pthread_t *threads;
+
+  triple_thread_setup();
+
+  threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  for (i=0; i<nthreads; i++) {
+    if (pthread_create(&(threads[i]), NULL, worker, arg) != 0) {
+      fprintf(stderr, "triple_run_threads(): cannot create thread %d\n", i);
+      break;
+    }
+    nstarted++;
+  }
+  for (i=0; i<nstarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  if (nstarted == 0) {
+    worker(arg);
+  }
+
+  return(nstarted);
+}
+
+/* run every triple in the batch table on nthreads threads (see triple_ensemble_jobs()); the
+   master seed is the one in defaults, or drawn from /dev/urandom if not set */
+int triple_ensemble(FILE *stream, triple_ic_t defaults, fb_input_t input, int nthreads)
+{
+  long njob, nbad;
+  unsigned long int seed;
+  triple_ic_t *ic;
+
+  /* the master seed */
+  if (defaults.seed == FB_SEED) {
+    seed = triple_urandom_seed();
+  } else {
+    seed = defaults.seed;
+  }
+  fprintf(stderr, "triple_ensemble(): master seed=%lu  nthreads=%d\n", seed, nthreads);
+
+  /* read the whole table, which the threads then share read-only */
+  njob = triple_read_table(stream, defaults, &ic, &nbad);
+
+  if (nbad) {
+    fprintf(stderr, "triple_ensemble(): skipped %ld malformed line(s)\n", nbad);
+  }
+
+  triple_ensemble_jobs(ic, njob, seed, input, nthreads);
+  free(ic);
+
+  return(nbad ? 1 : 0);
+}
@@ -0,0 +1,322 @@
+/* -*- linux-c -*- */
+/* triple_lockstep.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* a job in a lane of a thread's lockstep integrator */
+typedef struct{
+  long job; /* index of the job in the ic array, or -1 if the lane is empty */
+  triple_ic_t ic; /* initial conditions, with the seed actually used */
+  triple_result_t result; /* the result so far */
+  fb_hier_t hier; /* the hierarchy, which the integrator only updates when the lane stops */
+  gsl_rng *rng; /* for the mergers of this job */
+  double Ei; /* initial energy */
+  double Li[3]; /* initial angular momentum */
+} triple_lane_t;
+
+/* the state shared by the threads; the jobs are handed out one at a time, most expensive
+   first, to whichever lane becomes empty */
+typedef struct{
+  triple_ic_t *ic; /* initial conditions, one per job */
+  long *order; /* job indices, from the most to the least expensive */
+  long njob; /* number of jobs */
+  long next; /* next entry of order to hand out */
+  unsigned long int seed; /* master seed, from which the per-job seeds are derived */
+  int nthreads; /* number of threads */
+  int debug; /* value of fb_debug in the threads */
+  fb_input_t input; /* integration parameters, the same for every job */
+  long nstep; /* lockstep steps, summed over the threads */
+  long nlane; /* lanes integrated, summed over the steps */
+  long nreject; /* of which rejected */
+  long nfail; /* jobs that failed with an FB_E_* error */
+  triple_tally_t tally; /* merger fraction estimate */
+  pthread_mutex_t lock; /* protects everything that changes once the threads have started */
+} triple_lockstep_t;
+
+/* print the summary of a finished job and add it to the tally */
+static void triple_lockstep_report(triple_lockstep_t *ls, triple_result_t *result)
+{
+  pthread_mutex_lock(&(ls->lock));
+  if (result->retval.retval < 0) {
+    ls->nfail++;
+    fprintf(stderr, "triple_lockstep(): job %ld failed: %s\n", result->ic.id, fb_strerror(result->retval.retval));
+  }
+  triple_print_result(stderr, result);
+  triple_summary(result, ls->input);
+  triple_reduce(result);
+  triple_tally(&(ls->tally), result);
+  pthread_mutex_unlock(&(ls->lock));
+}
+
+/* load the next job that has to be integrated into an empty lane; the jobs that need no
+   integration (screened, or failed to set up) are reported on the way.  Returns 0 if
+   there are no jobs left. */
+static int triple_lockstep_load(triple_lockstep_t *ls, fb_simd_t *simd, int l, triple_lane_t *lane)
+{
+  int i;
+  long j;
+  double Lint[3];
+  fb_hier_t *hier=&(lane->hier);
+
+  while (1) {
+    pthread_mutex_lock(&(ls->lock));
+    j = (ls->next < ls->njob ? ls->order[ls->next++] : -1);
+    pthread_mutex_unlock(&(ls->lock));
+    if (j < 0) {
+      return(0);
+    }
+
+    lane->ic = ls->ic[j];
+    if (lane->ic.seed == FB_SEED) {
+      lane->ic.seed = triple_job_seed(ls->seed, lane->ic.id);
+    }
+
+    if (!triple_start(lane->ic, ls->input, hier, lane->rng, &(lane->result))) {
+      triple_finish(lane->ic, ls->input, hier, &(lane->result));
+      triple_lockstep_report(ls, &(lane->result));
+    } else {
+      break;
+    }
+  }
+
+  /* start from a flat hierarchy, with the initial energy and angular momentum, as fewbody() does */
+  fb_init_hier(hier);
+  lane->Ei = fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) +
+    fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar);
+  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, lane->Li);
+  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
+  for (i=0; i<3; i++) {
+    lane->Li[i] += Lint[i];
+  }
+
+  lane->job = j;
+  fb_simd_load(simd, l, hier, lane->result.units, lane->result.t);
+
+  return(1);
+}
+
+/* deal with a lane that the integrator stopped, as fewbody() would at the end of that step:
+   classify it and carry on if it is not done, merge the stars that touch, and at the end of
+   the run do the final classification and fill in the result.  Lockstep runs write no
+   trajectories, so fb_collide() gets no stream for the state before a merger. */
+static void triple_lockstep_stop(triple_lockstep_t *ls, fb_simd_t *simd, int l, triple_lane_t *lane)
+{
+  int i, status, err=FB_OK;
+  double E, Lint[3], L[3], DeltaL[3];
+  fb_input_t input=ls->input;
+  fb_units_t units=lane->result.units;
+  fb_hier_t *hier=&(lane->hier);
+  fb_ret_t *retval=&(simd->retval[l]);
+
+  fb_simd_store(simd, l, hier, &(lane->result.t));
+
+  switch (simd->status[l]) {
+  case FB_SIMD_CLASSIFY:
+    status = fb_classify(hier, lane->result.t, input.tidaltol, input.speedtol, units, input);
+    retval->iclassify++;
+    fb_track_extrema(hier, retval);
+    if (status < 0) {
+      err = status;
+    } else if (!status && hier->nobj != 2) {
+      fb_simd_resume(simd, l);
+      if (simd->status[l] == FB_SIMD_RUNNING) {
+        return;
+      }
+    }
+    break;
+  case FB_SIMD_COLLISION:
+    /* a merger in a triple leaves two stars, which ends the run */
+    if ((status = fb_collide(hier, input.fexp, units, lane->rng, &(lane->result.t), NULL, NULL)) < 0) {
+      err = status;
+    }
+    break;
+  case FB_SIMD_GSL:
+    err = FB_E_GSL;
+    break;
+  default:
+    break;
+  }
+
+  if (err) {
+    retval->retval = err;
+  } else {
+    retval->retval = fb_classify(hier, lane->result.t, input.tidaltol, input.speedtol, units, input);
+    retval->iclassify++;
+    fb_track_extrema(hier, retval);
+  }
+
+  E = fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) +
+    fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar);
+  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, L);
+  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
+  for (i=0; i<3; i++) {
+    L[i] += Lint[i];
+    DeltaL[i] = L[i] - lane->Li[i];
+  }
+  retval->DeltaE = E - lane->Ei;
+  retval->DeltaEfrac = E/lane->Ei - 1.0;
+  retval->DeltaL = fb_mod(DeltaL);
+  retval->DeltaLfrac = fb_mod(DeltaL)/fb_mod(lane->Li);
+
+  lane->result.retval = *retval;
+  triple_finish(lane->ic, input, hier, &(lane->result));
+  triple_lockstep_report(ls, &(lane->result));
+
+  fb_simd_unload(simd, l);
+  lane->job = -1;
+}
+
+/* integrate jobs FB_SIMD_WIDTH at a time until there are none left, refilling each lane as
+   soon as its job ends; a table too short to fill every lane of every thread is spread
+   evenly over the threads to begin with */
+static void *triple_lockstep_worker(void *arg)
+{
+  int l, nrun;
+  long nfirst;
+  triple_lockstep_t *ls=(triple_lockstep_t *) arg;
+  triple_lane_t lane[FB_SIMD_WIDTH];
+  fb_simd_t simd;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  fb_debug = ls->debug;
+
+  nfirst = (ls->njob + ls->nthreads - 1) / ls->nthreads;
+  fb_simd_init(&simd, ls->input);
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    lane[l].job = -1;
+    lane[l].rng = gsl_rng_alloc(rng_type);
+    lane[l].hier.nstarinit = 3;
+    lane[l].hier.nstar = 3;
+    fb_malloc_hier(&(lane[l].hier));
+    if (l < nfirst) {
+      triple_lockstep_load(ls, &simd, l, &(lane[l]));
+    }
+  }
+
+  do {
+    if (fb_simd_step(&simd) > 0) {
+      for (l=0; l<FB_SIMD_WIDTH; l++) {
+        if (lane[l].job >= 0 && simd.status[l] != FB_SIMD_RUNNING) {
+          triple_lockstep_stop(ls, &simd, l, &(lane[l]));
+          if (lane[l].job < 0) {
+            triple_lockstep_load(ls, &simd, l, &(lane[l]));
+          }
+        }
+      }
+    }
+
+    nrun = 0;
+    for (l=0; l<FB_SIMD_WIDTH; l++) {
+      nrun += (lane[l].job >= 0);
+    }
+  } while (nrun);
+
+  pthread_mutex_lock(&(ls->lock));
+  ls->nstep += simd.nstep;
+  ls->nlane += simd.nlane;
+  ls->nreject += simd.nreject;
+  pthread_mutex_unlock(&(ls->lock));
+
+  for (l=0; l<FB_SIMD_WIDTH; l++) {
+    gsl_rng_free(lane[l].rng);
+    fb_free_hier(lane[l].hier);
+  }
+
+  return(NULL);
+}
+
+/* run every triple in the batch table on nthreads threads, each of which integrates
+   FB_SIMD_WIDTH of them in lockstep with fb_simd_step() instead of one at a time with
+   fewbody(); the jobs go out most expensive first, as in triple_ensemble(), so that the
+   lanes run dry together at the end.  No trajectories are written, and the result cache is
+   not used, since its results are those of fewbody()'s integrator.  The master seed is the
+   one in defaults, or drawn from /dev/urandom if not set. */
+int triple_lockstep(FILE *stream, triple_ic_t defaults, fb_input_t input, int nthreads)
+{
+  long j, nbad;
+  triple_lockstep_t ls;
+  triple_cost_t *order;
+
+  /* the master seed */
+  if (defaults.seed == FB_SEED) {
+    ls.seed = triple_urandom_seed();
+  } else {
+    ls.seed = defaults.seed;
+  }
+  fprintf(stderr, "triple_lockstep(): master seed=%lu  nthreads=%d  width=%d\n", ls.seed, nthreads, FB_SIMD_WIDTH);
+
+  /* read the whole table, which the threads then share read-only */
+  ls.njob = triple_read_table(stream, defaults, &(ls.ic), &nbad);
+  if (nbad) {
+    fprintf(stderr, "triple_lockstep(): skipped %ld malformed line(s)\n", nbad);
+  }
+
+  order = (triple_cost_t *) malloc(FB_MAX(ls.njob, 1) * sizeof(triple_cost_t));
+  ls.order = (long *) malloc(FB_MAX(ls.njob, 1) * sizeof(long));
+  for (j=0; j<ls.njob; j++) {
+    order[j].id = j;
+    order[j].cost = triple_predict_cost(ls.ic[j], input);
+  }
+  qsort(order, ls.njob, sizeof(triple_cost_t), triple_compare_cost);
+  for (j=0; j<ls.njob; j++) {
+    ls.order[j] = order[j].id;
+  }
+  free(order);
+
+  ls.next = 0;
+  ls.nthreads = nthreads;
+  ls.debug = fb_debug;
+  ls.input = input;
+  ls.nstep = 0;
+  ls.nlane = 0;
+  ls.nreject = 0;
+  ls.nfail = 0;
+  memset(&(ls.tally), 0, sizeof(triple_tally_t));
+  pthread_mutex_init(&(ls.lock), NULL);
+
+  triple_print_result_header(stderr);
+
+  triple_run_threads(triple_lockstep_worker, &ls, nthreads);
+
+  /* how full the lanes were kept, and how many lane-steps were thrown away */
+  fprintf(stderr, "triple_lockstep(): %ld lockstep steps  lane utilization=%.4f  rejected=%.4f\n",
+    ls.nstep, ls.nstep > 0 ? ((double) ls.nlane) / ((double) (ls.nstep * FB_SIMD_WIDTH)) : 1.0,
+    ls.nlane > 0 ? ((double) ls.nreject) / ((double) ls.nlane) : 0.0);
+
+  triple_print_tally(stderr, &(ls.tally));
+  if (ls.nfail) {
+    fprintf(stderr, "triple_lockstep(): %ld of %ld job(s) failed\n", ls.nfail, ls.njob);
+  }
+
+  pthread_mutex_destroy(&(ls.lock));
+  free(ls.order);
+  free(ls.ic);
+
+  return(nbad ? 1 : 0);
+}
@@ -0,0 +1,461 @@
+/* -*- linux-c -*- */
+/* triple_parareal.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* Parareal (Lions, Maday & Turinici 2001) on the star positions and velocities.  With U_n^k
+   the state at the start of slice n after iteration k, F the fine propagator (fewbody() as
+   asked for) and G the coarse one (fewbody() with looser accuracies), iteration 0 is a coarse
+   sweep U_{n+1}^0 = G(U_n^0), and iteration k runs F(U_n^{k-1}) on every slice at once and
+   then corrects in sequence,
+     U_{n+1}^k = G(U_n^k) + F(U_n^{k-1}) - G(U_n^{k-1}).
+   After iteration k the first k boundary states are those of a sequential run, so at most
+   nslice iterations are needed.  A slice whose integration does not reach its end with three
+   stars (a merger, say) has no state to correct, and the sweep stops there until the slice
+   before it is exact.  The converged solution is that of fewbody() restarted at every slice
+   boundary, which differs from one uninterrupted run by the integration error. */
+
+typedef struct{
+  triple_parareal_t par;
+  fb_input_t fine; /* input of the fine propagator */
+  fb_input_t coarse; /* input of the coarse propagator */
+  fb_units_t units;
+  unsigned long int seed; /* from which the seed of each slice is derived */
+  int debug; /* value of fb_debug in the worker threads */
+  int nslice;
+  double *tb; /* tb[n]: start of slice n, n=0..nslice */
+  fb_hier_t *u; /* u[n]: start state of slice n in the current iterate */
+  fb_hier_t *f; /* f[n]: fine end of slice n, from the start state of the previous iterate */
+  fb_hier_t *g; /* g[n]: coarse end of slice n, from the start state of the previous iterate */
+  int *flive; /* whether f[n] and g[n] are three-body states at the end of the slice */
+  int *glive;
+  double *tf; /* time at which the fine integration of slice n stopped */
+  fb_ret_t *fret; /* what the fine integration of slice n returned */
+  FILE **out; /* trajectory output of the latest fine integration of each slice */
+  long next; /* next slice of the current fine sweep to be taken by a worker */
+  long last; /* end of the current fine sweep */
+} triple_parareal_run_t;
+
+/* parse a Parareal spec, a comma-separated list of
+     slices=<time slices, 0 for one per thread>  iter=<most iterations>
+     tol=<convergence tolerance>
+     coarse=<factor by which the coarse propagator's accuracies are loosened>
+   into par, which should hold the defaults; returns 0 on success */
+int triple_parse_parareal(char *spec, triple_parareal_t *par)
+{
+  int status=0;
+  char buf[FB_MAX_STRING_LENGTH], *item, *value, *saveptr, *end;
+
+  strncpy(buf, spec, FB_MAX_STRING_LENGTH-1);
+  buf[FB_MAX_STRING_LENGTH-1] = '\0';
+
+  for (item=strtok_r(buf, ",", &saveptr); item!=NULL; item=strtok_r(NULL, ",", &saveptr)) {
+    if ((value = strchr(item, '=')) == NULL) {
+      status = 1;
+      break;
+    }
+    *(value++) = '\0';
+
+    if (strcmp(item, "slices") == 0) {
+      par->nslice = strtol(value, &end, 10);
+      status = (*end != '\0' || par->nslice < 0);
+    } else if (strcmp(item, "iter") == 0) {
+      par->maxiter = strtol(value, &end, 10);
+      status = (*end != '\0' || par->maxiter < 1);
+    } else if (strcmp(item, "tol") == 0) {
+      par->tol = strtod(value, &end);
+      status = (*end != '\0' || par->tol <= 0.0);
+    } else if (strcmp(item, "coarse") == 0) {
+      par->coarse = strtod(value, &end);
+      status = (*end != '\0' || par->coarse < 1.0);
+    } else {
+      status = 1;
+    }
+
+    if (status) {
+      break;
+    }
+  }
+
+  if (status) {
+    fprintf(stderr, "triple_parse_parareal(): cannot parse \"%s\"\n", spec);
+  }
+
+  return(status);
+}
+
+/* integrate start over slice n into end; returns whether end is a three-body state at the end
+   of the slice, to which the Parareal correction can be applied */
+static int triple_parareal_prop(triple_parareal_run_t *pr, fb_input_t input, int n, fb_hier_t *start,
+                                fb_hier_t *end, gsl_rng *rng, fb_ret_t *ret, double *t)
+{
+  *t = pr->tb[n];
+  fb_hiercpy(end, start);
+  input.tstop = pr->tb[n+1];
+  gsl_rng_set(rng, triple_job_seed(pr->seed, n));
+  *ret = fewbody(input, pr->units, end, t, rng);
+
+  return(ret->retval >= 0 && end->nstar == 3 && *t >= pr->tb[n+1]);
+}
+
+/* run the fine integrations of the current sweep until there are none left */
+static void *triple_parareal_worker(void *arg)
+{
+  long n;
+  triple_parareal_run_t *pr=(triple_parareal_run_t *) arg;
+  fb_input_t input;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  fb_debug = pr->debug;
+  rng = gsl_rng_alloc(rng_type);
+
+  while ((n = __sync_fetch_and_add(&(pr->next), 1)) < pr->last) {
+    /* only the latest trajectory of each slice is kept */
+    rewind(pr->out[n]);
+    if (ftruncate(fileno(pr->out[n]), 0) != 0) {
+      perror("triple_parareal(): ftruncate");
+    }
+    input = pr->fine;
+    input.out = pr->out[n];
+    pr->flive[n] = triple_parareal_prop(pr, input, n, &(pr->u[n]), &(pr->f[n]), rng, &(pr->fret[n]), &(pr->tf[n]));
+    fflush(pr->out[n]);
+  }
+
+  gsl_rng_free(rng);
+
+  return(NULL);
+}
+
+/* the largest change of a star's position or velocity between two states, in N-body units */
+static double triple_parareal_change(fb_hier_t *a, fb_hier_t *b)
+{
+  int i, k;
+  double d=0.0;
+
+  if (a->nstar != b->nstar) {
+    return(GSL_POSINF);
+  }
+
+  for (i=0; i<a->nstar; i++) {
+    for (k=0; k<3; k++) {
+      d = FB_MAX(d, fabs(a->hier[a->hi[1]+i].x[k] - b->hier[b->hi[1]+i].x[k]));
+      d = FB_MAX(d, fabs(a->hier[a->hi[1]+i].v[k] - b->hier[b->hi[1]+i].v[k]));
+    }
+  }
+
+  return(d);
+}
+
+/* u += f - g, star by star */
+static void triple_parareal_correct(fb_hier_t *u, fb_hier_t *f, fb_hier_t *g)
+{
+  int i, k;
+
+  for (i=0; i<u->nstar; i++) {
+    for (k=0; k<3; k++) {
+      u->hier[u->hi[1]+i].x[k] += f->hier[f->hi[1]+i].x[k] - g->hier[g->hi[1]+i].x[k];
+      u->hier[u->hi[1]+i].v[k] += f->hier[f->hi[1]+i].v[k] - g->hier[g->hi[1]+i].v[k];
+    }
+  }
+}
+
+/* the total energy and angular momentum of the stars in hier */
+static double triple_parareal_energy(fb_hier_t *hier, double L[3])
+{
+  int k;
+  double Lint[3];
+
+  fb_angmom(&(hier->hier[hier->hi[1]]), hier->nstar, L);
+  fb_angmomint(&(hier->hier[hier->hi[1]]), hier->nstar, Lint);
+  for (k=0; k<3; k++) {
+    L[k] += Lint[k];
+  }
+
+  return(fb_petot(&(hier->hier[hier->hi[1]]), hier->nstar) + fb_ketot(&(hier->hier[hier->hi[1]]), hier->nstar) +
+         fb_einttot(&(hier->hier[hier->hi[1]]), hier->nstar));
+}
+
+/* the time a sweep of fine integrations of the given cpu times would take on nthreads threads
+   taking the slices in order, as the workers do */
+static double triple_parareal_makespan(double *tcpu, long n, int nthreads)
+{
+  int i, imin;
+  long j;
+  double *load, makespan=0.0;
+
+  load = (double *) calloc(nthreads, sizeof(double));
+  for (j=0; j<n; j++) {
+    for (i=1, imin=0; i<nthreads; i++) {
+      if (load[i] < load[imin]) {
+        imin = i;
+      }
+    }
+    load[imin] += tcpu[j];
+    makespan = FB_MAX(makespan, load[imin]);
+  }
+  free(load);
+
+  return(makespan);
+}
+
+/* integrate the triple set up in hier from *t to input.tstop by Parareal, with the fine
+   integrations on nthreads threads, and leave the final state in hier and *t as fewbody()
+   would.  The trajectory output of the converged fine integrations is written to input.out in
+   order once the iteration is over; the iterations, the cpu time spent and the speedup over
+   a sequential run are reported on stderr.  The seed of each slice is derived from seed.
+   Returns 0, or 1 if the integration could not be started. */
+int triple_parareal(triple_parareal_t par, fb_input_t input, fb_units_t units, fb_hier_t *hier,
+                    double *t, unsigned long int seed, int nthreads, fb_ret_t *retval)
+{
+  int i, n, k, nstarted, nexact=0, nlive, nend=0, maxiter;
+  long nrun;
+  double tg, change, Ei, Li[3], E, L[3], DeltaL[3], tcoarse=0.0, tfine=0.0, tserial=0.0, tmodel=0.0, twall, *tsweep;
+  char buf[BUFSIZ];
+  size_t len;
+  struct timespec start, stop;
+  triple_parareal_run_t pr;
+  fb_hier_t gnew, unew;
+  fb_ret_t ret;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+  FILE *devnull;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  pr.par = par;
+  pr.nslice = (par.nslice > 0 ? par.nslice : nthreads);
+  maxiter = (par.maxiter > 0 ? FB_MIN(par.maxiter, pr.nslice) : pr.nslice);
+  pr.units = units;
+  pr.seed = seed;
+  pr.debug = fb_debug;
+
+  /* the coarse integrations are only there to be corrected, so they write nothing */
+  if ((devnull = fopen("/dev/null", "w")) == NULL) {
+    fprintf(stderr, "triple_parareal(): cannot open /dev/null\n");
+    return(1);
+  }
+  pr.fine = input;
+  pr.fine.tstopexact = 1;
+  pr.fine.checkpoint = NULL;
+  pr.fine.resume = NULL;
+  pr.coarse = pr.fine;
+  pr.coarse.absacc *= par.coarse;
+  pr.coarse.relacc *= par.coarse;
+  pr.coarse.out = devnull;
+  pr.coarse.outfreq = -1;
+  pr.coarse.Dflag = 0;
+
+  pr.tb = (double *) malloc((pr.nslice + 1) * sizeof(double));
+  pr.u = (fb_hier_t *) malloc((pr.nslice + 1) * sizeof(fb_hier_t));
+  pr.f = (fb_hier_t *) malloc(pr.nslice * sizeof(fb_hier_t));
+  pr.g = (fb_hier_t *) malloc(pr.nslice * sizeof(fb_hier_t));
+  pr.flive = (int *) calloc(pr.nslice, sizeof(int));
+  pr.glive = (int *) calloc(pr.nslice, sizeof(int));
+  pr.tf = (double *) calloc(pr.nslice, sizeof(double));
+  pr.fret = (fb_ret_t *) calloc(pr.nslice, sizeof(fb_ret_t));
+  pr.out = (FILE **) malloc(pr.nslice * sizeof(FILE *));
+  tsweep = (double *) malloc(pr.nslice * sizeof(double));
+  for (n=0; n<=pr.nslice; n++) {
+    pr.tb[n] = *t + (input.tstop - *t) * ((double) n) / ((double) pr.nslice);
+    pr.u[n].nstarinit = 3;
+    pr.u[n].nstar = 3;
+    fb_malloc_hier(&(pr.u[n]));
+    if (n == pr.nslice) {
+      break;
+    }
+    pr.f[n].nstarinit = 3;
+    pr.f[n].nstar = 3;
+    fb_malloc_hier(&(pr.f[n]));
+    pr.g[n].nstarinit = 3;
+    pr.g[n].nstar = 3;
+    fb_malloc_hier(&(pr.g[n]));
+    if ((pr.out[n] = tmpfile()) == NULL) {
+      perror("triple_parareal(): tmpfile");
+      pr.out[n] = devnull;
+    }
+  }
+  gnew.nstarinit = 3;
+  gnew.nstar = 3;
+  fb_malloc_hier(&gnew);
+  unew.nstarinit = 3;
+  unew.nstar = 3;
+  fb_malloc_hier(&unew);
+  fb_hiercpy(&(pr.u[0]), hier);
+  Ei = triple_parareal_energy(hier, Li);
+
+  triple_thread_setup();
+  rng = gsl_rng_alloc(rng_type);
+
+  /* iteration 0: a coarse sweep */
+  for (n=0, nlive=0; n<pr.nslice; n++) {
+    nlive = n + 1;
+    pr.glive[n] = triple_parareal_prop(&pr, pr.coarse, n, &(pr.u[n]), &(pr.g[n]), rng, &ret, &tg);
+    tcoarse += ret.tcpu;
+    if (!pr.glive[n]) {
+      break;
+    }
+    fb_hiercpy(&(pr.u[n+1]), &(pr.g[n]));
+  }
+  tmodel += tcoarse;
+  fprintf(stderr, "triple_parareal(): %d slices of %.6g  nthreads=%d  coarse accuracy x%.6g  coarse sweep %.6g s\n",
+    pr.nslice, pr.tb[1] - pr.tb[0], nthreads, par.coarse, tcoarse);
+
+  for (k=1; k<=maxiter; k++) {
+    /* the fine integrations of every slice not yet exact, side by side */
+    pr.next = nexact;
+    pr.last = nlive;
+    nstarted = triple_run_threads(triple_parareal_worker, &pr, nthreads);
+
+    nrun = pr.last - nexact;
+    for (n=nexact; n<pr.last; n++) {
+      tsweep[n-nexact] = pr.fret[n].tcpu;
+      tfine += pr.fret[n].tcpu;
+    }
+    tmodel += triple_parareal_makespan(tsweep, nrun, FB_MAX(nstarted, 1));
+
+    /* the slice after the last exact one is now exact too; if it did not get to its end, the
+       integration ends there */
+    fb_hiercpy(&(pr.u[nexact+1]), &(pr.f[nexact]));
+    if (!pr.flive[nexact]) {
+      nend = nexact + 1;
+      fprintf(stderr, "triple_parareal(): iteration %d: %ld fine integrations, the integration ends in slice %d\n",
+        k, nrun, nexact);
+      break;
+    }
+    nexact++;
+
+    /* correct the rest in sequence */
+    change = 0.0;
+    for (n=nexact, nlive=nexact; n<pr.nslice; n++) {
+      nlive = n + 1;
+      i = triple_parareal_prop(&pr, pr.coarse, n, &(pr.u[n]), &gnew, rng, &ret, &tg);
+      tcoarse += ret.tcpu;
+      tmodel += ret.tcpu;
+      fb_hiercpy(&unew, &gnew);
+      if (i && pr.flive[n] && pr.glive[n]) {
+        triple_parareal_correct(&unew, &(pr.f[n]), &(pr.g[n]));
+      }
+      change = FB_MAX(change, triple_parareal_change(&(pr.u[n+1]), &unew));
+      fb_hiercpy(&(pr.u[n+1]), &unew);
+      fb_hiercpy(&(pr.g[n]), &gnew);
+      pr.glive[n] = i;
+      if (!i) {
+        change = GSL_POSINF;
+        break;
+      }
+    }
+
+    fprintf(stderr, "triple_parareal(): iteration %d: %ld fine integrations, %d slices exact, largest change %.6g\n",
+      k, nrun, nexact, change);
+
+    /* the change means nothing until every slice has had a fine integration */
+    if (nexact == pr.nslice || (pr.last == pr.nslice && nlive == pr.nslice && change < par.tol)) {
+      nend = pr.nslice;
+      break;
+    }
+  }
+  if (k > maxiter) {
+    k = maxiter;
+    nend = pr.last;
+    fprintf(stderr, "triple_parareal(): NOT converged after %d iterations\n", maxiter);
+  }
+
+  /* the converged solution is the fine integrations of the slices, one after another */
+  memset(retval, 0, sizeof(fb_ret_t));
+  retval->Rmin = FB_RMIN;
+  retval->Rmin_i = -1;
+  retval->Rmin_j = -1;
+  for (n=0; n<nend; n++) {
+    tserial += pr.fret[n].tcpu;
+    retval->count += pr.fret[n].count;
+    retval->iclassify += pr.fret[n].iclassify;
+    retval->nrhs += pr.fret[n].nrhs;
+    retval->tclassify += pr.fret[n].tclassify;
+    retval->toutput += pr.fret[n].toutput;
+    retval->Nosc += pr.fret[n].Nosc;
+    retval->emax = FB_MAX(retval->emax, pr.fret[n].emax);
+    if (pr.fret[n].Rmin < retval->Rmin) {
+      retval->Rmin = pr.fret[n].Rmin;
+      retval->Rmin_i = pr.fret[n].Rmin_i;
+      retval->Rmin_j = pr.fret[n].Rmin_j;
+    }
+    rewind(pr.out[n]);
+    while ((len = fread(buf, 1, BUFSIZ, pr.out[n])) > 0) {
+      fwrite(buf, 1, len, input.out);
+    }
+  }
+  retval->retval = pr.fret[nend-1].retval;
+  retval->tcpu = tcoarse + tfine;
+  fb_hiercpy(hier, &(pr.f[nend-1]));
+  *t = pr.tf[nend-1];
+
+  E = triple_parareal_energy(hier, L);
+  for (i=0; i<3; i++) {
+    DeltaL[i] = L[i] - Li[i];
+  }
+  retval->DeltaE = E - Ei;
+  retval->DeltaEfrac = E/Ei - 1.0;
+  retval->DeltaL = fb_mod(DeltaL);
+  retval->DeltaLfrac = fb_mod(DeltaL)/fb_mod(Li);
+
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+  twall = ((double) (stop.tv_sec - start.tv_sec)) + 1.0e-9 * ((double) (stop.tv_nsec - start.tv_nsec));
+  fprintf(stderr, "triple_parareal(): %d iterations  cpu: %.6g s fine + %.6g s coarse  wall: %.6g s\n",
+    k, tfine, tcoarse, twall);
+  fprintf(stderr, "triple_parareal(): speedup over a sequential run (%.6g s): %.3g achieved, %.3g on %d cores from the cpu times, at most %.3g with %d iterations\n",
+    tserial, tserial / twall, tserial / tmodel, nthreads, ((double) nend) / ((double) k), k);
+  fprintf(stderr, "\n");
+
+  for (n=0; n<=pr.nslice; n++) {
+    fb_free_hier(pr.u[n]);
+    if (n < pr.nslice) {
+      fb_free_hier(pr.f[n]);
+      fb_free_hier(pr.g[n]);
+      if (pr.out[n] != devnull) {
+        fclose(pr.out[n]);
+      }
+    }
+  }
+  fb_free_hier(gnew);
+  fb_free_hier(unew);
+  free(pr.tb);
+  free(pr.u);
+  free(pr.f);
+  free(pr.g);
+  free(pr.flive);
+  free(pr.glive);
+  free(pr.tf);
+  free(pr.fret);
+  free(pr.out);
+  free(tsweep);
+  gsl_rng_free(rng);
+  fclose(devnull);
+
+  return(0);
+}
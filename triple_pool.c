@@ -0,0 +1,426 @@
+/* -*- linux-c -*- */
+/* triple_pool.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* what a worker sends back for each job: the result, and where its trajectory is in the
+   worker's trajectory file */
+typedef struct{
+  triple_result_t result;
+  long job; /* index of the job in the ic array, which need not be its id */
+  long offset; /* start of the trajectory output in the file */
+  long length; /* length of the trajectory output */
+} triple_record_t;
+
+/* results travel from a worker to the parent through a single-producer, single-consumer ring
+   in shared memory, one per worker slot; the worker only moves head and the parent only moves
+   tail, so no locks are needed, and a worker that dies while writing a record has not
+   published it */
+typedef struct{
+  volatile long head; /* number of records written */
+  volatile long tail; /* number of records read */
+  triple_record_t slot[TRIPLE_RING_LENGTH];
+} triple_ring_t;
+
+/* the pool; everything pointed to here that the workers write to is in shared memory */
+typedef struct{
+  triple_ic_t *ic; /* initial conditions, one per job (shared, read-only) */
+  long njob; /* number of jobs */
+  volatile long *next; /* next job to hand out (shared) */
+  volatile long *current; /* job each worker slot is running, or -1 (shared) */
+  triple_ring_t *ring; /* one result ring per worker slot (shared) */
+  FILE **traj; /* one trajectory file per worker slot */
+  pid_t *pid; /* process id of each worker slot, or 0 */
+  unsigned long int seed; /* master seed, from which the per-job seeds are derived */
+  fb_input_t input; /* integration parameters, the same for every job */
+  triple_tally_t tally; /* merger fraction estimate */
+} triple_pool_t;
+
+/* allocate memory that stays shared with the children after fork() */
+static void *triple_shm_alloc(size_t size)
+{
+  void *ptr;
+
+  ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) {
+    return(NULL);
+  }
+
+  return(ptr);
+}
+
+/* release memory from triple_shm_alloc(), which may have failed */
+static void triple_shm_free(volatile void *ptr, size_t size)
+{
+  if (ptr != NULL) {
+    munmap((void *) ptr, size);
+  }
+}
+
+/* release everything triple_pool_jobs() set up for nworkers workers, however far it got */
+static void triple_pool_free(triple_pool_t *pool, int nworkers)
+{
+  int i;
+
+  if (pool->traj != NULL) {
+    for (i=0; i<nworkers; i++) {
+      if (pool->traj[i] != NULL) {
+        fclose(pool->traj[i]);
+      }
+    }
+  }
+  triple_shm_free(pool->ic, FB_MAX(pool->njob, 1) * sizeof(triple_ic_t));
+  triple_shm_free(pool->next, sizeof(long));
+  triple_shm_free(pool->current, nworkers * sizeof(long));
+  triple_shm_free(pool->ring, nworkers * sizeof(triple_ring_t));
+  free(pool->traj);
+  free(pool->pid);
+}
+
+/* the body of a worker process: run jobs until there are none left, then exit */
+static void triple_pool_worker(triple_pool_t *pool, int id)
+{
+  long i, offset;
+  triple_ring_t *ring=&(pool->ring[id]);
+  triple_record_t *record;
+  triple_ic_t ic;
+  triple_result_t result;
+  fb_input_t input;
+  fb_hier_t hier;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  input = pool->input;
+  input.out = pool->traj[id];
+  /* each worker has a live status block of its own, in the segment it inherited */
+  if (input.telem != NULL) {
+    input.telem = &(pool->input.telem[id]);
+  }
+
+  rng = gsl_rng_alloc(rng_type);
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  /* a worker that died may have left a partial trajectory behind */
+  fseek(input.out, 0, SEEK_END);
+
+  while ((i = __sync_fetch_and_add(pool->next, 1)) < pool->njob) {
+    pool->current[id] = i;
+    __sync_synchronize();
+
+    ic = pool->ic[i];
+    if (ic.seed == FB_SEED) {
+      ic.seed = triple_job_seed(pool->seed, ic.id);
+    }
+
+    offset = ftell(input.out);
+    triple_run(ic, input, &hier, rng, &result);
+    fflush(input.out);
+
+    /* wait for room in the ring, then publish */
+    while (ring->head - ring->tail >= TRIPLE_RING_LENGTH) {
+      usleep(1000);
+    }
+    record = &(ring->slot[ring->head % TRIPLE_RING_LENGTH]);
+    record->result = result;
+    record->job = i;
+    record->offset = offset;
+    record->length = ftell(input.out) - offset;
+    __sync_synchronize();
+    ring->head++;
+    __sync_synchronize();
+    pool->current[id] = -1;
+  }
+
+  gsl_rng_free(rng);
+  fb_free_hier(hier);
+
+  _exit(0);
+}
+
+/* start a worker in slot id; returns 0 on success */
+static int triple_pool_spawn(triple_pool_t *pool, int id)
+{
+  pid_t pid;
+
+  /* anything still buffered would be written twice */
+  fflush(stdout);
+  fflush(stderr);
+  fflush(pool->traj[id]);
+
+  if ((pid = fork()) < 0) {
+    perror("triple_pool_spawn(): fork");
+    return(1);
+  } else if (pid == 0) {
+    triple_pool_worker(pool, id);
+  }
+
+  pool->current[id] = -1;
+  pool->pid[id] = pid;
+  return(0);
+}
+
+/* copy part of a file to a stream */
+static void triple_copy_range(FILE *from, long offset, long length, FILE *to)
+{
+  size_t n;
+  ssize_t m;
+  char buf[65536];
+
+  while (length > 0) {
+    n = FB_MIN((size_t) length, sizeof(buf));
+    if ((m = pread(fileno(from), buf, n, offset)) <= 0) {
+      break;
+    }
+    fwrite(buf, 1, m, to);
+    offset += m;
+    length -= m;
+  }
+}
+
+/* take all published records out of a worker's ring and print them; returns the number read */
+static long triple_pool_drain(triple_pool_t *pool, int id, char *done)
+{
+  long n=0;
+  triple_ring_t *ring=&(pool->ring[id]);
+  triple_record_t record;
+
+  while (ring->tail < ring->head) {
+    __sync_synchronize();
+    record = ring->slot[ring->tail % TRIPLE_RING_LENGTH];
+    __sync_synchronize();
+    ring->tail++;
+
+    fprintf(pool->input.out, "# job %ld seed %lu\n", record.result.ic.id, record.result.ic.seed);
+    triple_copy_range(pool->traj[id], record.offset, record.length, pool->input.out);
+    if (record.result.retval.retval < 0) {
+      fprintf(stderr, "triple_pool(): job %ld failed: %s\n", record.result.ic.id, fb_strerror(record.result.retval.retval));
+    }
+    triple_print_result(stderr, &(record.result));
+    triple_summary(&(record.result), pool->input);
+    triple_reduce(&(record.result));
+    triple_tally(&(pool->tally), &(record.result));
+    triple_shard_store(&(record.result));
+
+    done[record.job] = 1;
+    n++;
+  }
+
+  return(n);
+}
+
+/* print a result for a job whose worker died, or that was never run */
+static void triple_pool_fail(triple_pool_t *pool, long j)
+{
+  triple_result_t result;
+
+  memset(&result, 0, sizeof(triple_result_t));
+  result.ic = pool->ic[j];
+  if (result.ic.seed == FB_SEED) {
+    result.ic.seed = triple_job_seed(pool->seed, result.ic.id);
+  }
+  result.retval.retval = TRIPLE_E_CRASH;
+  result.retval.Rmin_i = -1;
+  result.retval.Rmin_j = -1;
+  snprintf(result.hier, TRIPLE_HIER_LENGTH, "crashed");
+  snprintf(result.hierid, TRIPLE_HIER_LENGTH, "crashed");
+  triple_print_result(stderr, &result);
+  triple_summary(&result, pool->input);
+  triple_reduce(&result);
+  triple_shard_store(&result);
+}
+
+/* run the njob jobs in ic[] in nworkers forked processes.  Jobs are handed out with
+   an atomic counter in shared memory, and the results come back through one lock-free ring per
+   worker; each worker writes its trajectories to its own file, which the parent copies to the
+   output as the results arrive.  A worker that dies is replaced, and its job is recorded as
+   failed with retval TRIPLE_E_CRASH.  Returns the number of crashed jobs, or -1 if the pool
+   could not be set up. */
+long triple_pool_jobs(triple_ic_t *ic, long njob, unsigned long int seed, fb_input_t input, int nworkers)
+{
+  int i, status, nlive=0;
+  long j, ndone=0, ncrash=0;
+  char *done;
+  triple_pool_t pool;
+  pid_t pid;
+
+  pool.seed = seed;
+  pool.njob = njob;
+
+  /* set up the shared memory */
+  pool.ic = (triple_ic_t *) triple_shm_alloc(FB_MAX(pool.njob, 1) * sizeof(triple_ic_t));
+  pool.next = (volatile long *) triple_shm_alloc(sizeof(long));
+  pool.current = (volatile long *) triple_shm_alloc(nworkers * sizeof(long));
+  pool.ring = (triple_ring_t *) triple_shm_alloc(nworkers * sizeof(triple_ring_t));
+  pool.traj = (FILE **) calloc(nworkers, sizeof(FILE *));
+  pool.pid = (pid_t *) malloc(nworkers * sizeof(pid_t));
+  if (pool.ic == NULL || pool.next == NULL || pool.current == NULL || pool.ring == NULL) {
+    perror("triple_pool(): mmap");
+    triple_pool_free(&pool, nworkers);
+    return(-1);
+  }
+  memcpy(pool.ic, ic, pool.njob * sizeof(triple_ic_t));
+  *(pool.next) = 0;
+
+  for (i=0; i<nworkers; i++) {
+    if ((pool.traj[i] = tmpfile()) == NULL) {
+      perror("triple_pool(): tmpfile");
+      triple_pool_free(&pool, nworkers);
+      return(-1);
+    }
+    pool.ring[i].head = 0;
+    pool.ring[i].tail = 0;
+    pool.current[i] = -1;
+    pool.pid[i] = 0;
+  }
+  pool.input = input;
+  memset(&(pool.tally), 0, sizeof(triple_tally_t));
+  done = (char *) calloc(FB_MAX(pool.njob, 1), sizeof(char));
+
+  /* this reads the environment, so do it once for all the workers */
+  gsl_rng_env_setup();
+
+  triple_print_result_header(stderr);
+
+  for (i=0; i<nworkers; i++) {
+    if (triple_pool_spawn(&pool, i) == 0) {
+      nlive++;
+    }
+  }
+
+  while (nlive > 0) {
+    j = 0;
+    for (i=0; i<nworkers; i++) {
+      j += triple_pool_drain(&pool, i, done);
+    }
+    ndone += j;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+      for (i=0; i<nworkers; i++) {
+        if (pool.pid[i] == pid) {
+          break;
+        }
+      }
+      if (i == nworkers) {
+        continue;
+      }
+      nlive--;
+      pool.pid[i] = 0;
+      j++;
+
+      /* anything it published before dying still counts */
+      ndone += triple_pool_drain(&pool, i, done);
+
+      if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        continue;
+      }
+
+      if (WIFSIGNALED(status)) {
+        fprintf(stderr, "triple_pool(): worker %d (pid %d) killed by signal %d",
+          i, (int) pid, WTERMSIG(status));
+      } else {
+        fprintf(stderr, "triple_pool(): worker %d (pid %d) exited with status %d",
+          i, (int) pid, WEXITSTATUS(status));
+      }
+      if (pool.current[i] >= 0 && !done[pool.current[i]]) {
+        fprintf(stderr, " while running job %ld\n", pool.current[i]);
+        triple_pool_fail(&pool, pool.current[i]);
+        done[pool.current[i]] = 1;
+        ncrash++;
+      } else {
+        fprintf(stderr, "\n");
+      }
+      pool.current[i] = -1;
+
+      /* replace it if there is work left */
+      if (*(pool.next) < pool.njob && triple_pool_spawn(&pool, i) == 0) {
+        nlive++;
+      }
+    }
+
+    /* nothing happened; the jobs take seconds at least, so there is no hurry */
+    if (j == 0) {
+      usleep(1000);
+    }
+  }
+
+  /* jobs that were never finished, e.g. because a worker was killed between taking a job and
+     marking it as its own, or because no worker could be started */
+  for (j=0; j<pool.njob; j++) {
+    if (!done[j]) {
+      fprintf(stderr, "triple_pool(): job %ld was not run to completion\n", j);
+      triple_pool_fail(&pool, j);
+      ncrash++;
+    }
+  }
+
+  triple_print_tally(stderr, &(pool.tally));
+  if (ncrash) {
+    fprintf(stderr, "triple_pool(): %ld of %ld job(s) crashed\n", ncrash, pool.njob);
+  }
+  fprintf(stderr, "triple_pool(): %ld of %ld job(s) completed\n", ndone, pool.njob);
+
+  triple_pool_free(&pool, nworkers);
+  free(done);
+
+  return(ncrash);
+}
+
+/* run every triple in the batch table in nworkers forked processes (see triple_pool_jobs());
+   the master seed is the one in defaults, or drawn from /dev/urandom if not set.  Returns
+   nonzero if the table had bad lines, the pool could not be set up, or any job was lost to a
+   crashed worker. */
+int triple_pool(FILE *stream, triple_ic_t defaults, fb_input_t input, int nworkers)
+{
+  long njob, nbad, ncrash;
+  unsigned long int seed;
+  triple_ic_t *ic;
+
+  /* the master seed */
+  if (defaults.seed == FB_SEED) {
+    seed = triple_urandom_seed();
+  } else {
+    seed = defaults.seed;
+  }
+  fprintf(stderr, "triple_pool(): master seed=%lu  nworkers=%d\n", seed, nworkers);
+
+  njob = triple_read_table(stream, defaults, &ic, &nbad);
+  if (nbad) {
+    fprintf(stderr, "triple_pool(): skipped %ld malformed line(s)\n", nbad);
+  }
+
+  ncrash = triple_pool_jobs(ic, njob, seed, input, nworkers);
+  free(ic);
+
+  return((nbad || ncrash != 0) ? 1 : 0);
+}
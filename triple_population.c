@@ -0,0 +1,340 @@
+/* -*- linux-c -*- */
+/* triple_population.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_qrng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* the dimensions of the sample: one per randomly drawn parameter */
+#define TRIPLE_POP_A00 0
+#define TRIPLE_POP_A0 1
+#define TRIPLE_POP_E00 2
+#define TRIPLE_POP_E0 3
+#define TRIPLE_POP_COSI 4
+#define TRIPLE_POP_PERI_IN 5
+#define TRIPLE_POP_PERI_OUT 6
+#define TRIPLE_POP_DIM 7
+
+/* parse "thermal", "uniform" or a fixed value for an eccentricity */
+static int triple_parse_edist(char *value, int *dist, double *e)
+{
+  char *end;
+
+  if (strcmp(value, "thermal") == 0) {
+    *dist = TRIPLE_EDIST_THERMAL;
+  } else if (strcmp(value, "uniform") == 0) {
+    *dist = TRIPLE_EDIST_UNIFORM;
+  } else {
+    *dist = TRIPLE_EDIST_FIXED;
+    *e = strtod(value, &end);
+    if (*end != '\0' || *e < 0.0 || *e >= 1.0) {
+      return(1);
+    }
+  }
+
+  return(0);
+}
+
+/* parse "<min>:<max>" (or a single fixed value) for a semimajor axis, in AU */
+static int triple_parse_range(char *value, double *min, double *max)
+{
+  char *end;
+
+  *min = strtod(value, &end);
+  if (*end == ':') {
+    *max = strtod(end+1, &end);
+  } else {
+    *max = *min;
+  }
+
+  return(*end != '\0' || *min <= 0.0 || *max < *min);
+}
+
+/* parse a population spec, a comma-separated list of
+     a00=<min>:<max>  a0=<min>:<max>  (AU, log-uniform; a single value fixes it)
+     e00=<dist>  e0=<dist>  (thermal, uniform, or a fixed value)
+     sampler=sobol|random
+     incbias=<w>  e00bias=<k>  (importance sampling proposals; see triple_population())
+   into pop, which should hold the defaults; returns 0 on success */
+int triple_parse_population(char *spec, triple_population_t *pop)
+{
+  int status=0;
+  char buf[FB_MAX_STRING_LENGTH], *item, *value, *saveptr, *end;
+
+  strncpy(buf, spec, FB_MAX_STRING_LENGTH-1);
+  buf[FB_MAX_STRING_LENGTH-1] = '\0';
+
+  for (item=strtok_r(buf, ",", &saveptr); item!=NULL; item=strtok_r(NULL, ",", &saveptr)) {
+    if ((value = strchr(item, '=')) == NULL) {
+      status = 1;
+      break;
+    }
+    *(value++) = '\0';
+
+    if (strcmp(item, "a00") == 0) {
+      status = triple_parse_range(value, &(pop->a00min), &(pop->a00max));
+    } else if (strcmp(item, "a0") == 0) {
+      status = triple_parse_range(value, &(pop->a0min), &(pop->a0max));
+    } else if (strcmp(item, "e00") == 0) {
+      status = triple_parse_edist(value, &(pop->e00dist), &(pop->e00));
+    } else if (strcmp(item, "e0") == 0) {
+      status = triple_parse_edist(value, &(pop->e0dist), &(pop->e0));
+    } else if (strcmp(item, "incbias") == 0) {
+      pop->incbias = strtod(value, &end);
+      status = (*end != '\0' || pop->incbias < 0.0);
+    } else if (strcmp(item, "e00bias") == 0) {
+      pop->e00bias = strtod(value, &end);
+      status = (*end != '\0' || pop->e00bias < 0.0);
+    } else if (strcmp(item, "sampler") == 0 && strcmp(value, "sobol") == 0) {
+      pop->sobol = 1;
+    } else if (strcmp(item, "sampler") == 0 && strcmp(value, "random") == 0) {
+      pop->sobol = 0;
+    } else {
+      status = 1;
+    }
+
+    if (status) {
+      break;
+    }
+  }
+
+  if (status) {
+    fprintf(stderr, "triple_parse_population(): cannot parse \"%s\"\n", spec);
+  }
+
+  return(status);
+}
+
+/* an eccentricity from a uniform deviate */
+static double triple_draw_e(int dist, double e, double u)
+{
+  if (dist == TRIPLE_EDIST_THERMAL) {
+    return(sqrt(u));
+  } else if (dist == TRIPLE_EDIST_UNIFORM) {
+    return(u);
+  } else {
+    return(e);
+  }
+}
+
+/* the cosine of the inclination from a uniform deviate, and its importance weight: isotropic
+   if w is 0, and otherwise from the proposal q(c) = exp(-|c|/w) / (2 w (1 - exp(-1/w))),
+   which concentrates the draws near i=90 degrees, where the Kozai cycles are strongest;
+   the weight is p(c)/q(c) with the isotropic p(c) = 1/2 */
+static double triple_draw_cosi(double w, double u, double *weight)
+{
+  double c, v, norm;
+
+  if (w <= 0.0) {
+    *weight = 1.0;
+    return(2.0 * u - 1.0);
+  }
+
+  /* the first half of the deviate picks the sign, and the rest of it the magnitude, so that
+     a stratified u gives a stratified c */
+  v = (u < 0.5 ? 2.0 * u : 2.0 * u - 1.0);
+  norm = 1.0 - exp(-1.0/w);
+  c = -w * log(1.0 - v * norm);
+  *weight = w * norm * exp(c/w);
+
+  return(u < 0.5 ? -c : c);
+}
+
+/* an eccentricity from a uniform deviate and its importance weight: drawn from dist, or if
+   k >= 0 from the proposal q(e) = (k+1) e^k, which for k > 1 favours high eccentricities;
+   the weight is p(e)/q(e) */
+static double triple_draw_e_biased(int dist, double e, double k, double u, double *weight)
+{
+  double ebias;
+
+  if (k < 0.0 || dist == TRIPLE_EDIST_FIXED) {
+    *weight = 1.0;
+    return(triple_draw_e(dist, e, u));
+  }
+
+  ebias = pow(u, 1.0/(k+1.0));
+  if (dist == TRIPLE_EDIST_THERMAL) {
+    *weight = 2.0 * ebias / ((k+1.0) * pow(ebias, k));
+  } else {
+    *weight = 1.0 / ((k+1.0) * pow(ebias, k));
+  }
+
+  return(ebias);
+}
+
+/* write n dynamically stable triples drawn from pop to stream as a batch table, with the
+   masses of defaults and no seed column, so that the seeds come from the master seed of the
+   run.  With the Sobol sampler every point of the sequence is shifted by the same random
+   vector (a Cranley-Patterson rotation), drawn with the seed in defaults, so that runs with
+   different seeds give independent estimates with the low discrepancy of the sequence; n a
+   power of two gives a sample that is stratified in every dimension.  Draws that fail
+   fb_mardling() are skipped.
+
+   With a biased proposal (incbias or e00bias), the rows also carry a seed column of 0 (a
+   derived seed) and the importance weight p/q of the draw, which the ensemble uses to
+   estimate the merger fraction of the target population.  The stability cut is the same for
+   the target and the proposal, so the self-normalized estimate is unaffected by it. */
+int triple_population(FILE *stream, long n, triple_population_t pop, triple_ic_t defaults)
+{
+  int d, status, biased;
+  long naccept=0, ndraw=0, nunstable=0, nfail=0;
+  unsigned long int seed;
+  double u[TRIPLE_POP_DIM], shift[TRIPLE_POP_DIM], t, wcosi, we00, weight, sw=0.0, sw2=0.0;
+  triple_request_t req;
+  triple_ic_t ic;
+  fb_hier_t hier;
+  fb_units_t units;
+  gsl_rng *rng, *setuprng;
+  gsl_qrng *qrng=NULL;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  if (defaults.seed == FB_SEED) {
+    seed = triple_urandom_seed();
+  } else {
+    seed = defaults.seed;
+  }
+
+  gsl_rng_env_setup();
+  rng = gsl_rng_alloc(rng_type);
+  gsl_rng_set(rng, seed);
+  /* the orbital phases drawn by triple_setup() do not matter to the stability test, but they
+     must not use up the sampling rng */
+  setuprng = gsl_rng_alloc(rng_type);
+  gsl_rng_set(setuprng, seed);
+
+  if (pop.sobol) {
+    qrng = gsl_qrng_alloc(gsl_qrng_sobol, TRIPLE_POP_DIM);
+    for (d=0; d<TRIPLE_POP_DIM; d++) {
+      shift[d] = gsl_rng_uniform(rng);
+    }
+    if (n & (n-1)) {
+      fprintf(stderr, "triple_population(): n=%ld is not a power of two, so the sample is not fully stratified\n", n);
+    }
+  }
+
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  biased = (pop.incbias > 0.0 || (pop.e00bias >= 0.0 && pop.e00dist != TRIPLE_EDIST_FIXED));
+
+  fprintf(stream, "# population: n=%ld  sampler=%s  seed=%lu\n", n, pop.sobol ? "sobol" : "random", seed);
+  fprintf(stream, "# a00=%.6g:%.6g AU  a0=%.6g:%.6g AU  e00=%s  e0=%s  (log-uniform a, isotropic inc)\n",
+    pop.a00min, pop.a00max, pop.a0min, pop.a0max,
+    pop.e00dist == TRIPLE_EDIST_THERMAL ? "thermal" : (pop.e00dist == TRIPLE_EDIST_UNIFORM ? "uniform" : "fixed"),
+    pop.e0dist == TRIPLE_EDIST_THERMAL ? "thermal" : (pop.e0dist == TRIPLE_EDIST_UNIFORM ? "uniform" : "fixed"));
+  if (biased) {
+    fprintf(stream, "# importance sampling: incbias=%.6g  e00bias=%.6g\n", pop.incbias, pop.e00bias);
+    fprintf(stream, "# m000 m001 m01 a00 a0 e00 e0 inc peri_in peri_out seed weight\n");
+  } else {
+    fprintf(stream, "# m000 m001 m01 a00 a0 e00 e0 inc peri_in peri_out\n");
+  }
+
+  req.tag = 0;
+  req.seed = 0;
+  req.m000 = defaults.m000 / FB_CONST_MSUN;
+  req.m001 = defaults.m001 / FB_CONST_MSUN;
+  req.m01 = defaults.m01 / FB_CONST_MSUN;
+  req.r000 = defaults.r000;
+
+  while (naccept < n && ndraw < TRIPLE_POP_MAXDRAW * n) {
+    ndraw++;
+    if (pop.sobol) {
+      gsl_qrng_get(qrng, u);
+      for (d=0; d<TRIPLE_POP_DIM; d++) {
+        u[d] += shift[d];
+        if (u[d] >= 1.0) {
+          u[d] -= 1.0;
+        }
+      }
+    } else {
+      for (d=0; d<TRIPLE_POP_DIM; d++) {
+        u[d] = gsl_rng_uniform(rng);
+      }
+    }
+
+    req.a00 = pop.a00min * pow(pop.a00max/pop.a00min, u[TRIPLE_POP_A00]);
+    req.a0 = pop.a0min * pow(pop.a0max/pop.a0min, u[TRIPLE_POP_A0]);
+    req.e00 = triple_draw_e_biased(pop.e00dist, pop.e00, pop.e00bias, u[TRIPLE_POP_E00], &we00);
+    req.e0 = triple_draw_e(pop.e0dist, pop.e0, u[TRIPLE_POP_E0]);
+    req.inc = acos(triple_draw_cosi(pop.incbias, u[TRIPLE_POP_COSI], &wcosi)) * 180.0 / FB_CONST_PI;
+    req.peri_in = 360.0 * u[TRIPLE_POP_PERI_IN];
+    req.peri_out = 360.0 * u[TRIPLE_POP_PERI_OUT];
+
+    /* set the triple up as the integration would, and keep it only if it is stable */
+    weight = wcosi * we00;
+    if (!isfinite(weight)) {
+      nfail++;
+      continue;
+    }
+
+    ic = defaults;
+    if (triple_request_ic(&req, &ic) != NULL || req.a0 <= req.a00) {
+      nunstable++;
+      continue;
+    }
+    if ((status = triple_setup(ic, &hier, &units, &t, setuprng)) != FB_OK) {
+      fb_dprintf("triple_population(): cannot set up draw %ld: %s\n", ndraw, fb_strerror(status));
+      nfail++;
+      continue;
+    }
+    if (!fb_mardling(&(hier.hier[hier.hi[3]+0]), 0, 1)) {
+      nunstable++;
+      continue;
+    }
+
+    fprintf(stream, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g",
+      req.m000, req.m001, req.m01, req.a00, req.a0, req.e00, req.e0, req.inc, req.peri_in, req.peri_out);
+    if (biased) {
+      fprintf(stream, " 0 %.9g", weight);
+    }
+    fprintf(stream, "\n");
+    sw += weight;
+    sw2 += weight * weight;
+    naccept++;
+  }
+
+  fprintf(stream, "# %ld accepted of %ld drawn: %ld unstable, %ld failed to set up\n",
+    naccept, ndraw, nunstable, nfail);
+  if (biased && naccept > 0) {
+    fprintf(stream, "# mean weight=%.6g  ESS=%.6g\n", sw / naccept, sw * sw / sw2);
+  }
+  if (naccept < n) {
+    fprintf(stderr, "triple_population(): gave up after %ld draws with only %ld stable systems\n", ndraw, naccept);
+  }
+
+  /* free GSL stuff */
+  if (qrng != NULL) {
+    gsl_qrng_free(qrng);
+  }
+  gsl_rng_free(setuprng);
+  gsl_rng_free(rng);
+
+  /* free our own stuff */
+  fb_free_hier(hier);
+
+  return(naccept < n ? 1 : 0);
+}
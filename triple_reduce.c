@@ -0,0 +1,426 @@
+/* -*- linux-c -*- */
+/* triple_reduce.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* Every thread that finishes runs adds them to its own partial reduction, without taking a
+   lock; the partials are merged when the reductions are closed.  A quantile sketch keeps
+   the weight of the values falling in each of a fixed set of buckets whose edges grow
+   geometrically by gamma = (1+alpha)/(1-alpha), so that the middle of a bucket is within a
+   fraction alpha of every value in it (Masson, Rim & Lee 2019); sketches merge by adding
+   up the buckets, so the merged quantiles are as good as those of a single sketch. */
+
+/* a histogram with equal bins between lo and hi */
+typedef struct{
+  double lo;
+  double hi;
+  double w[TRIPLE_REDUCE_NBIN+2]; /* weight of the underflow, the bins and the overflow */
+} triple_hist_t;
+
+/* a quantile sketch of positive values */
+typedef struct{
+  long n; /* values added */
+  double sw; /* their total weight */
+  double min; /* smallest and largest value */
+  double max;
+  double zero; /* weight of the values that were not positive */
+  double w[TRIPLE_SKETCH_NBIN]; /* weight of bucket i, (gamma^(i-1-NBIN/2), gamma^(i-NBIN/2)] */
+} triple_sketch_t;
+
+/* a count of one final hierarchy */
+typedef struct{
+  char hier[TRIPLE_HIER_LENGTH];
+  long n;
+  double w;
+} triple_outcome_t;
+
+typedef struct triple_reduce_part{
+  long n; /* runs */
+  long nfail; /* runs that failed */
+  long nscreen; /* runs screened out */
+  long ncomplete; /* runs whose encounter was complete */
+  long nmerge; /* completed or not, runs that ended with fewer than three stars */
+  double sw; /* the same, weighted by the importance weights */
+  double swfail;
+  double swscreen;
+  double swcomplete;
+  double swmerge;
+  int noutcome; /* entries in outcome[], the last being "other" once it is full */
+  triple_outcome_t outcome[TRIPLE_REDUCE_NOUTCOME];
+  triple_hist_t htmerge; /* log10(t_merge/yr) of the mergers */
+  triple_hist_t hemax; /* log10(1 - e_max) of the integrated runs */
+  triple_sketch_t qtmerge; /* t_merge/yr of the mergers */
+  triple_sketch_t qemax; /* 1 - e_max of the integrated runs */
+  triple_sketch_t qtcpu; /* t_cpu/s of the integrated runs */
+  struct triple_reduce_part *next; /* the partial of the next thread */
+} triple_reduce_t;
+
+typedef struct{
+  char *path; /* where the report goes, or NULL for no reductions */
+  triple_reduce_t *part; /* the partials of all the threads */
+  pthread_mutex_t lock; /* protects part */
+} triple_reduce_out_t;
+
+static triple_reduce_out_t triple_reduce_out = {NULL, NULL, PTHREAD_MUTEX_INITIALIZER};
+
+/* the partial reduction of this thread */
+static __thread triple_reduce_t *triple_reduce_mine = NULL;
+
+/* the quantiles reported */
+static const double triple_reduce_q[] = {0.01, 0.05, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99};
+#define TRIPLE_REDUCE_NQ ((int) (sizeof(triple_reduce_q) / sizeof(double)))
+
+static void triple_hist_init(triple_hist_t *hist, double lo, double hi)
+{
+  memset(hist, 0, sizeof(triple_hist_t));
+  hist->lo = lo;
+  hist->hi = hi;
+}
+
+static void triple_hist_add(triple_hist_t *hist, double x, double w)
+{
+  int i;
+
+  if (!(x >= hist->lo)) {
+    i = 0;
+  } else if (x >= hist->hi) {
+    i = TRIPLE_REDUCE_NBIN + 1;
+  } else {
+    i = 1 + (int) ((x - hist->lo) / (hist->hi - hist->lo) * TRIPLE_REDUCE_NBIN);
+    i = FB_MIN(i, TRIPLE_REDUCE_NBIN);
+  }
+  hist->w[i] += w;
+}
+
+static void triple_hist_merge(triple_hist_t *dst, triple_hist_t *src)
+{
+  int i;
+
+  for (i=0; i<TRIPLE_REDUCE_NBIN+2; i++) {
+    dst->w[i] += src->w[i];
+  }
+}
+
+/* print a histogram as "hist <name> <lo> <hi> <weight>" lines, the underflow and overflow
+   bins with infinite edges */
+static void triple_hist_print(FILE *stream, const char *name, triple_hist_t *hist)
+{
+  int i;
+  double dx=(hist->hi - hist->lo) / TRIPLE_REDUCE_NBIN;
+
+  fprintf(stream, "hist %s -inf %.6g %.9g\n", name, hist->lo, hist->w[0]);
+  for (i=1; i<=TRIPLE_REDUCE_NBIN; i++) {
+    fprintf(stream, "hist %s %.6g %.6g %.9g\n", name, hist->lo + (i-1) * dx, hist->lo + i * dx, hist->w[i]);
+  }
+  fprintf(stream, "hist %s %.6g inf %.9g\n", name, hist->hi, hist->w[TRIPLE_REDUCE_NBIN+1]);
+}
+
+static void triple_sketch_init(triple_sketch_t *sk)
+{
+  memset(sk, 0, sizeof(triple_sketch_t));
+  sk->min = GSL_POSINF;
+  sk->max = GSL_NEGINF;
+}
+
+static double triple_sketch_gamma(void)
+{
+  return((1.0 + TRIPLE_SKETCH_ALPHA) / (1.0 - TRIPLE_SKETCH_ALPHA));
+}
+
+static void triple_sketch_add(triple_sketch_t *sk, double x, double w)
+{
+  int i;
+
+  if (!(x == x)) {
+    return;
+  }
+
+  sk->n++;
+  sk->sw += w;
+  sk->min = FB_MIN(sk->min, x);
+  sk->max = FB_MAX(sk->max, x);
+  if (x <= 0.0) {
+    sk->zero += w;
+    return;
+  }
+
+  i = (int) FB_MAX(FB_MIN(ceil(log(x) / log(triple_sketch_gamma())) + TRIPLE_SKETCH_NBIN/2,
+                          TRIPLE_SKETCH_NBIN - 1), 0);
+  sk->w[i] += w;
+}
+
+static void triple_sketch_merge(triple_sketch_t *dst, triple_sketch_t *src)
+{
+  int i;
+
+  dst->n += src->n;
+  dst->sw += src->sw;
+  dst->min = FB_MIN(dst->min, src->min);
+  dst->max = FB_MAX(dst->max, src->max);
+  dst->zero += src->zero;
+  for (i=0; i<TRIPLE_SKETCH_NBIN; i++) {
+    dst->w[i] += src->w[i];
+  }
+}
+
+/* the q quantile of a sketch: the middle of the bucket where the cumulative weight passes
+   q of the total, kept within the values seen */
+static double triple_sketch_quantile(triple_sketch_t *sk, double q)
+{
+  int i;
+  double gamma=triple_sketch_gamma(), rank=q*sk->sw, cum=sk->zero;
+
+  if (cum > rank) {
+    return(sk->min);
+  }
+  for (i=0; i<TRIPLE_SKETCH_NBIN-1; i++) {
+    cum += sk->w[i];
+    if (cum > rank) {
+      break;
+    }
+  }
+
+  return(FB_MAX(FB_MIN(2.0 * pow(gamma, i - TRIPLE_SKETCH_NBIN/2) / (gamma + 1.0), sk->max), sk->min));
+}
+
+/* print the quantiles of a sketch as a "quantile <name> <n> <weight> <min> <q...> <max>"
+   line */
+static void triple_sketch_print(FILE *stream, const char *name, triple_sketch_t *sk)
+{
+  int i;
+
+  fprintf(stream, "quantile %s %ld %.9g", name, sk->n, sk->sw);
+  if (sk->n == 0) {
+    for (i=0; i<TRIPLE_REDUCE_NQ+2; i++) {
+      fprintf(stream, " nan");
+    }
+  } else {
+    fprintf(stream, " %.6g", sk->min);
+    for (i=0; i<TRIPLE_REDUCE_NQ; i++) {
+      fprintf(stream, " %.6g", triple_sketch_quantile(sk, triple_reduce_q[i]));
+    }
+    fprintf(stream, " %.6g", sk->max);
+  }
+  fprintf(stream, "\n");
+}
+
+static triple_reduce_t *triple_reduce_new(void)
+{
+  triple_reduce_t *red;
+
+  red = (triple_reduce_t *) calloc(1, sizeof(triple_reduce_t));
+  triple_hist_init(&(red->htmerge), TRIPLE_REDUCE_TMIN, TRIPLE_REDUCE_TMAX);
+  triple_hist_init(&(red->hemax), TRIPLE_REDUCE_EMIN, TRIPLE_REDUCE_EMAX);
+  triple_sketch_init(&(red->qtmerge));
+  triple_sketch_init(&(red->qemax));
+  triple_sketch_init(&(red->qtcpu));
+
+  return(red);
+}
+
+/* count n runs of weight w that ended in the final hierarchy hier */
+static void triple_reduce_outcome(triple_reduce_t *red, const char *hier, long n, double w)
+{
+  int i;
+
+  for (i=0; i<red->noutcome; i++) {
+    if (strcmp(red->outcome[i].hier, hier) == 0) {
+      break;
+    }
+  }
+  if (i == red->noutcome) {
+    if (red->noutcome == TRIPLE_REDUCE_NOUTCOME) {
+      i = TRIPLE_REDUCE_NOUTCOME - 1;
+      strcpy(red->outcome[i].hier, "other");
+    } else {
+      red->noutcome++;
+      snprintf(red->outcome[i].hier, TRIPLE_HIER_LENGTH, "%s", hier);
+    }
+  }
+  red->outcome[i].n += n;
+  red->outcome[i].w += w;
+}
+
+static void triple_reduce_merge(triple_reduce_t *dst, triple_reduce_t *src)
+{
+  int i;
+
+  dst->n += src->n;
+  dst->nfail += src->nfail;
+  dst->nscreen += src->nscreen;
+  dst->ncomplete += src->ncomplete;
+  dst->nmerge += src->nmerge;
+  dst->sw += src->sw;
+  dst->swfail += src->swfail;
+  dst->swscreen += src->swscreen;
+  dst->swcomplete += src->swcomplete;
+  dst->swmerge += src->swmerge;
+  for (i=0; i<src->noutcome; i++) {
+    triple_reduce_outcome(dst, src->outcome[i].hier, src->outcome[i].n, src->outcome[i].w);
+  }
+  triple_hist_merge(&(dst->htmerge), &(src->htmerge));
+  triple_hist_merge(&(dst->hemax), &(src->hemax));
+  triple_sketch_merge(&(dst->qtmerge), &(src->qtmerge));
+  triple_sketch_merge(&(dst->qemax), &(src->qemax));
+  triple_sketch_merge(&(dst->qtcpu), &(src->qtcpu));
+}
+
+/* accumulate the reductions of runs, writing the report to path ("-" for stdout) when
+   they are closed.  Returns 0 on success. */
+int triple_reduce_open(char *path)
+{
+  FILE *fp;
+
+  /* find out now rather than after the runs if the report cannot be written */
+  if (strcmp(path, "-") != 0) {
+    if ((fp = fopen(path, "w")) == NULL) {
+      fprintf(stderr, "triple_reduce: cannot open %s: %s\n", path, strerror(errno));
+      return(1);
+    }
+    fclose(fp);
+  }
+
+  triple_reduce_out.path = path;
+  return(0);
+}
+
+/* add a finished run to the partial reduction of this thread, if reductions were asked for */
+void triple_reduce(triple_result_t *result)
+{
+  double w=result->ic.weight, tmerge;
+  triple_reduce_t *red;
+
+  if (triple_reduce_out.path == NULL) {
+    return;
+  }
+
+  if ((red = triple_reduce_mine) == NULL) {
+    red = triple_reduce_mine = triple_reduce_new();
+    pthread_mutex_lock(&(triple_reduce_out.lock));
+    red->next = triple_reduce_out.part;
+    triple_reduce_out.part = red;
+    pthread_mutex_unlock(&(triple_reduce_out.lock));
+  }
+
+  red->n++;
+  red->sw += w;
+  if (result->retval.retval < 0) {
+    red->nfail++;
+    red->swfail += w;
+    return;
+  }
+
+  triple_reduce_outcome(red, result->hier, 1, w);
+  if (result->retval.retval == 1) {
+    red->ncomplete++;
+    red->swcomplete += w;
+  }
+  if (result->nstar < 3) {
+    red->nmerge++;
+    red->swmerge += w;
+    tmerge = result->t * result->units.t / FB_CONST_YR;
+    triple_hist_add(&(red->htmerge), log10(tmerge), w);
+    triple_sketch_add(&(red->qtmerge), tmerge, w);
+  }
+
+  /* a screened run was never integrated, so there is no e_max or cpu time to speak of */
+  if (result->screen != TRIPLE_SCREEN_NONE) {
+    red->nscreen++;
+    red->swscreen += w;
+    return;
+  }
+
+  triple_hist_add(&(red->hemax), log10(1.0 - result->retval.emax), w);
+  triple_sketch_add(&(red->qemax), 1.0 - result->retval.emax, w);
+  triple_sketch_add(&(red->qtcpu), result->retval.tcpu, w);
+}
+
+/* merge the partial reductions of all the threads and write the report, saying on stream
+   where it went */
+void triple_reduce_close(FILE *stream)
+{
+  int i;
+  FILE *fp;
+  triple_reduce_t *red, *part;
+
+  if (triple_reduce_out.path == NULL) {
+    return;
+  }
+
+  red = triple_reduce_new();
+  while ((part = triple_reduce_out.part) != NULL) {
+    triple_reduce_merge(red, part);
+    triple_reduce_out.part = part->next;
+    free(part);
+  }
+  triple_reduce_mine = NULL;
+
+  if (strcmp(triple_reduce_out.path, "-") == 0) {
+    fp = stdout;
+  } else if ((fp = fopen(triple_reduce_out.path, "w")) == NULL) {
+    fprintf(stderr, "triple_reduce: cannot open %s: %s\n", triple_reduce_out.path, strerror(errno));
+    free(red);
+    triple_reduce_out.path = NULL;
+    return;
+  }
+
+  fprintf(fp, "# ensemble reductions of %ld runs (weights are the importance weights)\n", red->n);
+  fprintf(fp, "# count <what> <runs> <weight>\n");
+  fprintf(fp, "count runs %ld %.9g\n", red->n, red->sw);
+  fprintf(fp, "count failed %ld %.9g\n", red->nfail, red->swfail);
+  fprintf(fp, "count screened %ld %.9g\n", red->nscreen, red->swscreen);
+  fprintf(fp, "count complete %ld %.9g\n", red->ncomplete, red->swcomplete);
+  fprintf(fp, "count merged %ld %.9g\n", red->nmerge, red->swmerge);
+  fprintf(fp, "# outcome <runs> <weight> <final hierarchy>  (runs that did not fail)\n");
+  for (i=0; i<red->noutcome; i++) {
+    fprintf(fp, "outcome %ld %.9g %s\n", red->outcome[i].n, red->outcome[i].w, red->outcome[i].hier);
+  }
+  fprintf(fp, "# quantile <what> <runs> <weight> <min>");
+  for (i=0; i<TRIPLE_REDUCE_NQ; i++) {
+    fprintf(fp, " <q=%g>", triple_reduce_q[i]);
+  }
+  fprintf(fp, " <max>  (to within %g of the value)\n", TRIPLE_SKETCH_ALPHA);
+  triple_sketch_print(fp, "t_merge/yr", &(red->qtmerge));
+  triple_sketch_print(fp, "1-e_max", &(red->qemax));
+  triple_sketch_print(fp, "t_cpu/s", &(red->qtcpu));
+  fprintf(fp, "# hist <what> <lo> <hi> <weight>\n");
+  triple_hist_print(fp, "log10(t_merge/yr)", &(red->htmerge));
+  triple_hist_print(fp, "log10(1-e_max)", &(red->hemax));
+
+  if (fp != stdout) {
+    if (fclose(fp) != 0) {
+      fprintf(stderr, "triple_reduce: cannot write %s: %s\n", triple_reduce_out.path, strerror(errno));
+    } else {
+      fprintf(stream, "triple_reduce: reductions of %ld runs written to %s\n", red->n, triple_reduce_out.path);
+    }
+  }
+
+  free(red);
+  triple_reduce_out.path = NULL;
+}
@@ -0,0 +1,405 @@
+/* -*- linux-c -*- */
+/* triple_refine.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* The sweep lives on a lattice of (inc, e0, log(a0/a00)) with (n-1)*2^depth+1 points per
+   axis, so that a point keeps its integer coordinates through every level of refinement.  A
+   cell of level l spans 2^(depth-l) lattice spacings along each axis; it is split into eight
+   if its corners disagree, and the new points of all the cells split at one level are run
+   together, as one generation, on the worker threads. */
+#define TRIPLE_REFINE_BITS 21 /* bits per lattice coordinate in a packed key */
+
+typedef struct{
+  int x[3]; /* lattice coordinates */
+  int level; /* level of the cell that first needed the point */
+  triple_result_t result;
+} triple_point_t;
+
+typedef struct{
+  int x[3]; /* lattice coordinates of the lower corner */
+  int level;
+} triple_cell_t;
+
+typedef struct{
+  triple_refine_t ref; /* the sweep */
+  int size; /* lattice points per axis */
+  triple_ic_t defaults; /* initial conditions not swept */
+  fb_input_t input; /* integration parameters, the same for every point */
+  unsigned long int seed; /* master seed, from which the per-point seeds are derived */
+  int debug; /* value of fb_debug in the worker threads */
+  triple_point_t *point; /* every point run so far, in the order they were added */
+  long npoint;
+  long nalloc;
+  long *table; /* open-addressed hash table of indices into point[], -1 for empty */
+  long ntable; /* size of table[], a power of two */
+  long next; /* next point of the current generation to be taken by a worker */
+  long last; /* end of the current generation in point[] */
+} triple_sweep_t;
+
+/* parse "<min>:<max>" (or a single fixed value) */
+static int triple_refine_range(char *value, double *min, double *max)
+{
+  char *end;
+
+  *min = strtod(value, &end);
+  if (*end == ':') {
+    *max = strtod(end+1, &end);
+  } else {
+    *max = *min;
+  }
+
+  return(*end != '\0' || *max < *min);
+}
+
+/* parse a refinement spec, a comma-separated list of
+     inc=<min>:<max>  (degrees)  e0=<min>:<max>  ratio=<min>:<max>  (a0/a00, log-uniform)
+     n=<points per axis of the coarse grid>  depth=<levels of refinement>
+     ttol=<largest difference in log10 of the merger time within a cell>
+   into ref, which should hold the defaults; returns 0 on success */
+int triple_parse_refine(char *spec, triple_refine_t *ref)
+{
+  int status=0;
+  char buf[FB_MAX_STRING_LENGTH], *item, *value, *saveptr, *end;
+
+  strncpy(buf, spec, FB_MAX_STRING_LENGTH-1);
+  buf[FB_MAX_STRING_LENGTH-1] = '\0';
+
+  for (item=strtok_r(buf, ",", &saveptr); item!=NULL; item=strtok_r(NULL, ",", &saveptr)) {
+    if ((value = strchr(item, '=')) == NULL) {
+      status = 1;
+      break;
+    }
+    *(value++) = '\0';
+
+    if (strcmp(item, "inc") == 0) {
+      status = (triple_refine_range(value, &(ref->incmin), &(ref->incmax)) ||
+                ref->incmin < 0.0 || ref->incmax > 180.0);
+    } else if (strcmp(item, "e0") == 0) {
+      status = (triple_refine_range(value, &(ref->e0min), &(ref->e0max)) ||
+                ref->e0min < 0.0 || ref->e0max >= 1.0);
+    } else if (strcmp(item, "ratio") == 0) {
+      status = (triple_refine_range(value, &(ref->ratiomin), &(ref->ratiomax)) ||
+                ref->ratiomin <= 1.0);
+    } else if (strcmp(item, "n") == 0) {
+      ref->n = strtol(value, &end, 10);
+      status = (*end != '\0' || ref->n < 2);
+    } else if (strcmp(item, "depth") == 0) {
+      ref->depth = strtol(value, &end, 10);
+      status = (*end != '\0' || ref->depth < 0);
+    } else if (strcmp(item, "ttol") == 0) {
+      ref->ttol = strtod(value, &end);
+      status = (*end != '\0' || ref->ttol <= 0.0);
+    } else {
+      status = 1;
+    }
+
+    if (status) {
+      break;
+    }
+  }
+
+  /* the lattice coordinates have to fit in a packed key */
+  if (!status && (((long) ref->n - 1) << ref->depth) >= (1L << TRIPLE_REFINE_BITS)) {
+    status = 1;
+  }
+
+  if (status) {
+    fprintf(stderr, "triple_parse_refine(): cannot parse \"%s\"\n", spec);
+  }
+
+  return(status);
+}
+
+/* the lattice coordinates of a point packed into one number */
+static unsigned long int triple_refine_key(int x[3])
+{
+  return((((unsigned long int) x[0]) << (2 * TRIPLE_REFINE_BITS)) |
+         (((unsigned long int) x[1]) << TRIPLE_REFINE_BITS) | ((unsigned long int) x[2]));
+}
+
+/* slot of the point with coordinates x in sw->table, which is either empty or holds it */
+static long triple_refine_slot(triple_sweep_t *sw, int x[3])
+{
+  long i;
+  unsigned long int key=triple_refine_key(x);
+
+  for (i=(key * 0x9e3779b97f4a7c15UL) & (sw->ntable-1); sw->table[i] >= 0; i=(i+1) & (sw->ntable-1)) {
+    if (triple_refine_key(sw->point[sw->table[i]].x) == key) {
+      break;
+    }
+  }
+
+  return(i);
+}
+
+/* the index of the point with coordinates x, adding it to be run in the next generation if
+   it is new */
+static long triple_refine_point(triple_sweep_t *sw, int x[3], int level)
+{
+  long i, j;
+
+  /* keep the table at most half full */
+  if (2 * (sw->npoint + 1) > sw->ntable) {
+    free(sw->table);
+    sw->ntable *= 2;
+    sw->table = (long *) malloc(sw->ntable * sizeof(long));
+    for (i=0; i<sw->ntable; i++) {
+      sw->table[i] = -1;
+    }
+    for (j=0; j<sw->npoint; j++) {
+      sw->table[triple_refine_slot(sw, sw->point[j].x)] = j;
+    }
+  }
+
+  i = triple_refine_slot(sw, x);
+  if (sw->table[i] >= 0) {
+    return(sw->table[i]);
+  }
+
+  if (sw->npoint == sw->nalloc) {
+    sw->nalloc *= 2;
+    sw->point = (triple_point_t *) realloc(sw->point, sw->nalloc * sizeof(triple_point_t));
+  }
+  j = sw->npoint++;
+  memcpy(sw->point[j].x, x, 3 * sizeof(int));
+  sw->point[j].level = level;
+  sw->table[i] = j;
+
+  return(j);
+}
+
+/* the initial conditions at point j */
+static triple_ic_t triple_refine_ic(triple_sweep_t *sw, long j)
+{
+  double f[3];
+  int k;
+  triple_ic_t ic=sw->defaults;
+
+  for (k=0; k<3; k++) {
+    f[k] = (sw->size > 1 ? ((double) sw->point[j].x[k]) / ((double) (sw->size - 1)) : 0.0);
+  }
+
+  ic.id = j;
+  ic.inc = (sw->ref.incmin + f[0] * (sw->ref.incmax - sw->ref.incmin)) * FB_CONST_PI / 180.0;
+  ic.e0 = sw->ref.e0min + f[1] * (sw->ref.e0max - sw->ref.e0min);
+  ic.a0 = ic.a00 * exp(log(sw->ref.ratiomin) + f[2] * (log(sw->ref.ratiomax) - log(sw->ref.ratiomin)));
+  /* the seed follows the point, not the order in which the points happen to be run */
+  ic.seed = triple_job_seed(sw->seed, (long) triple_refine_key(sw->point[j].x));
+
+  return(ic);
+}
+
+/* run the points of the current generation until there are none left */
+static void *triple_refine_worker(void *arg)
+{
+  long j;
+  triple_sweep_t *sw=(triple_sweep_t *) arg;
+  fb_hier_t hier;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  fb_debug = sw->debug;
+
+  rng = gsl_rng_alloc(rng_type);
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  while ((j = __sync_fetch_and_add(&(sw->next), 1)) < sw->last) {
+    triple_run(triple_refine_ic(sw, j), sw->input, &hier, rng, &(sw->point[j].result));
+  }
+
+  gsl_rng_free(rng);
+  fb_free_hier(hier);
+
+  return(NULL);
+}
+
+/* whether two points have different outcomes: a different retval, one merging and the other
+   not, or merger times more than ttol apart in log10 */
+static int triple_refine_differ(triple_sweep_t *sw, long a, long b)
+{
+  triple_result_t *ra=&(sw->point[a].result), *rb=&(sw->point[b].result);
+
+  if (ra->retval.retval != rb->retval.retval || (ra->nstar < 3) != (rb->nstar < 3)) {
+    return(1);
+  }
+
+  return(ra->nstar < 3 && ra->t > 0.0 && rb->t > 0.0 && fabs(log10(ra->t / rb->t)) > sw->ref.ttol);
+}
+
+/* the index of corner c (a bit per axis) of a cell */
+static long triple_refine_corner(triple_sweep_t *sw, triple_cell_t *cell, int c)
+{
+  int k, x[3], s=1<<(sw->ref.depth-cell->level);
+
+  for (k=0; k<3; k++) {
+    x[k] = cell->x[k] + ((c >> k) & 1) * s;
+  }
+
+  return(triple_refine_point(sw, x, cell->level));
+}
+
+/* map the outcome of triples over (inc, e0, a0/a00) by adaptive refinement: a coarse grid
+   of ref.n points per axis is run first, and every cell whose eight corners have different
+   outcomes (see triple_refine_differ()) is split into eight, down to ref.depth levels.  The
+   points are run on nthreads threads, one generation at a time; the other initial conditions
+   are those of defaults.  Each point gets a summary line on stderr, and a line of the map
+     inc/deg e0 a0/a00 level retval nstar t_final/yr
+   on stream.  The trajectories are not written. */
+int triple_refine(FILE *stream, triple_refine_t ref, triple_ic_t defaults, fb_input_t input, int nthreads)
+{
+  int i, k, c, d, x[3], h;
+  long j, first, ncell, nnext, ncellalloc, nsplit, nuniform;
+  triple_sweep_t sw;
+  triple_cell_t *cell, *next, *tmp;
+  triple_result_t *result;
+  FILE *devnull;
+
+  sw.ref = ref;
+  sw.size = ((ref.n - 1) << ref.depth) + 1;
+  sw.debug = fb_debug;
+  sw.seed = (defaults.seed == FB_SEED ? triple_urandom_seed() : defaults.seed);
+  sw.defaults = defaults;
+  sw.defaults.seed = FB_SEED;
+  fprintf(stderr, "triple_refine(): master seed=%lu  nthreads=%d  lattice=%d^3\n", sw.seed, nthreads, sw.size);
+
+  /* the points run side by side, so their trajectories and stories go nowhere */
+  if ((devnull = fopen("/dev/null", "w")) == NULL) {
+    fprintf(stderr, "triple_refine(): cannot open /dev/null\n");
+    return(1);
+  }
+  sw.input = input;
+  sw.input.out = devnull;
+
+  sw.nalloc = 1024;
+  sw.point = (triple_point_t *) malloc(sw.nalloc * sizeof(triple_point_t));
+  sw.npoint = 0;
+  sw.ntable = 2048;
+  sw.table = (long *) malloc(sw.ntable * sizeof(long));
+  for (j=0; j<sw.ntable; j++) {
+    sw.table[j] = -1;
+  }
+
+  /* the coarse cells */
+  ncellalloc = FB_MAX((long) (ref.n-1) * (ref.n-1) * (ref.n-1), 8);
+  cell = (triple_cell_t *) malloc(ncellalloc * sizeof(triple_cell_t));
+  next = (triple_cell_t *) malloc(ncellalloc * sizeof(triple_cell_t));
+  ncell = 0;
+  for (x[0]=0; x[0]<ref.n-1; x[0]++) {
+    for (x[1]=0; x[1]<ref.n-1; x[1]++) {
+      for (x[2]=0; x[2]<ref.n-1; x[2]++) {
+        for (k=0; k<3; k++) {
+          cell[ncell].x[k] = x[k] << ref.depth;
+        }
+        cell[ncell].level = 0;
+        for (c=0; c<8; c++) {
+          triple_refine_corner(&sw, &(cell[ncell]), c);
+        }
+        ncell++;
+      }
+    }
+  }
+
+  triple_print_result_header(stderr);
+  fprintf(stream, "# inc/deg e0 a0/a00 level retval nstar t_final/yr\n");
+
+  first = 0;
+  for (d=0; ncell>0; d++) {
+    /* run the new points */
+    sw.next = first;
+    sw.last = sw.npoint;
+    triple_run_threads(triple_refine_worker, &sw, nthreads);
+
+    for (j=first; j<sw.last; j++) {
+      result = &(sw.point[j].result);
+      triple_print_result(stderr, result);
+      triple_summary(result, sw.input);
+      triple_reduce(result);
+      fprintf(stream, "%.9g %.9g %.9g %d %d %d %.9g\n", result->ic.inc * 180.0 / FB_CONST_PI, result->ic.e0,
+        result->ic.a0 / result->ic.a00, sw.point[j].level, result->retval.retval, result->nstar,
+        result->t * result->units.t / FB_CONST_YR);
+    }
+    fflush(stream);
+
+    /* split the cells whose corners disagree; their points are the next generation */
+    nnext = 0;
+    nsplit = 0;
+    for (j=0; j<ncell; j++) {
+      if (cell[j].level == ref.depth) {
+        continue;
+      }
+      for (c=1, h=0; c<8 && !h; c++) {
+        for (i=0; i<c && !h; i++) {
+          h = triple_refine_differ(&sw, triple_refine_corner(&sw, &(cell[j]), i), triple_refine_corner(&sw, &(cell[j]), c));
+        }
+      }
+      if (!h) {
+        continue;
+      }
+
+      nsplit++;
+      if (nnext + 8 > ncellalloc) {
+        ncellalloc *= 2;
+        next = (triple_cell_t *) realloc(next, ncellalloc * sizeof(triple_cell_t));
+        cell = (triple_cell_t *) realloc(cell, ncellalloc * sizeof(triple_cell_t));
+      }
+      for (c=0; c<8; c++) {
+        for (k=0; k<3; k++) {
+          next[nnext].x[k] = cell[j].x[k] + ((c >> k) & 1) * (1 << (ref.depth - cell[j].level - 1));
+        }
+        next[nnext].level = cell[j].level + 1;
+        for (i=0; i<8; i++) {
+          triple_refine_corner(&sw, &(next[nnext]), i);
+        }
+        nnext++;
+      }
+    }
+
+    fprintf(stderr, "triple_refine(): level %d: %ld cells, %ld split, %ld new points\n",
+      d, ncell, nsplit, sw.npoint - sw.last);
+
+    first = sw.last;
+    tmp = cell;
+    cell = next;
+    next = tmp;
+    ncell = nnext;
+  }
+
+  nuniform = (long) sw.size * sw.size * sw.size;
+  fprintf(stderr, "triple_refine(): %ld points run, %.4g%% of the %ld of a uniform grid at the finest level\n",
+    sw.npoint, 100.0 * sw.npoint / nuniform, nuniform);
+
+  free(cell);
+  free(next);
+  free(sw.table);
+  free(sw.point);
+  fclose(devnull);
+
+  return(0);
+}
@@ -0,0 +1,393 @@
+/* -*- linux-c -*- */
+/* triple_server.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* the server: the reading side puts requests into a bounded queue, which the worker threads
+   empty; a full queue stops the reading, so a client that submits faster than the workers
+   can integrate is held back by the socket rather than by the server's memory */
+typedef struct{
+  triple_request_t queue[TRIPLE_QUEUE_LENGTH]; /* requests waiting for a worker */
+  int head; /* next request to run */
+  int count; /* number of requests in the queue */
+  long inflight; /* requests of the current connection that are queued or running */
+  int closing; /* set when there will be no more requests; the workers then exit */
+  pthread_mutex_t lock; /* protects everything above */
+  pthread_cond_t nonempty; /* signalled when a request is queued, or on closing */
+  pthread_cond_t nonfull; /* signalled when a request is taken from the queue */
+  pthread_cond_t idle; /* signalled when inflight drops to zero */
+  int fdout; /* where the replies of the current connection go */
+  int writeerr; /* set once writing to fdout has failed; further replies are dropped */
+  pthread_mutex_t writelock; /* protects fdout and writeerr, and keeps replies whole */
+  long nrequest; /* number of requests served */
+  long nfail; /* how many of those failed */
+  triple_ic_t defaults; /* initial conditions not given in a request */
+  unsigned long int seed; /* master seed, from which the per-job seeds are derived */
+  int debug; /* value of fb_debug in the worker threads */
+  fb_input_t input; /* integration parameters, the same for every job */
+} triple_server_t;
+
+/* read exactly n bytes; returns 1 on success, 0 on end of file before the first byte, and -1
+   on error or end of file part way through */
+static int triple_read_all(int fd, void *buf, size_t n)
+{
+  size_t done=0;
+  ssize_t len;
+
+  while (done < n) {
+    len = read(fd, (char *) buf + done, n - done);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    } else if (len <= 0) {
+      return(done == 0 && len == 0 ? 0 : -1);
+    }
+    done += len;
+  }
+
+  return(1);
+}
+
+/* write exactly n bytes; returns 0 on success and -1 on error */
+static int triple_write_all(int fd, const void *buf, size_t n)
+{
+  size_t done=0;
+  ssize_t len;
+
+  while (done < n) {
+    len = write(fd, (const char *) buf + done, n - done);
+    if (len < 0 && errno == EINTR) {
+      continue;
+    } else if (len <= 0) {
+      return(-1);
+    }
+    done += len;
+  }
+
+  return(0);
+}
+
+/* fill in a reply from the outcome of a job */
+static void triple_reply(triple_result_t *result, triple_reply_t *reply)
+{
+  memset(reply, 0, sizeof(triple_reply_t));
+  reply->tag = result->ic.id;
+  reply->seed = result->ic.seed;
+  reply->retval = result->retval.retval;
+  reply->nstar = result->nstar;
+  reply->nobj = result->nobj;
+  reply->Nosc = result->retval.Nosc;
+  reply->count = result->retval.count;
+  reply->iclassify = result->retval.iclassify;
+  reply->t = result->t;
+  reply->t_yr = result->t * result->units.t / FB_CONST_YR;
+  reply->tcpu = result->retval.tcpu;
+  reply->DeltaEfrac = result->retval.DeltaEfrac;
+  reply->DeltaLfrac = result->retval.DeltaLfrac;
+  reply->Rmin = result->retval.Rmin * result->units.l / FB_CONST_RSUN;
+  reply->a_in = result->a_in * result->units.l / FB_CONST_AU;
+  reply->e_in = result->e_in;
+  reply->a_out = result->a_out * result->units.l / FB_CONST_AU;
+  reply->e_out = result->e_out;
+  reply->cosi = result->cosi;
+  memcpy(reply->hier, result->hier, TRIPLE_HIER_LENGTH);
+  reply->screen = result->screen;
+}
+
+/* take requests off the queue and run them until the server closes */
+static void *triple_server_worker(void *arg)
+{
+  triple_server_t *srv=(triple_server_t *) arg;
+  triple_request_t req;
+  triple_ic_t ic;
+  triple_result_t result;
+  triple_reply_t reply;
+  triple_frame_t frame;
+  const char *why;
+  fb_hier_t hier;
+  gsl_rng *rng;
+  const gsl_rng_type *rng_type=gsl_rng_mt19937;
+
+  fb_debug = srv->debug;
+
+  /* each thread has its own hierarchy and rng, reused for all of its jobs */
+  rng = gsl_rng_alloc(rng_type);
+  hier.nstarinit = 3;
+  hier.nstar = 3;
+  fb_malloc_hier(&hier);
+
+  while (1) {
+    pthread_mutex_lock(&(srv->lock));
+    while (srv->count == 0 && !srv->closing) {
+      pthread_cond_wait(&(srv->nonempty), &(srv->lock));
+    }
+    if (srv->count == 0) {
+      pthread_mutex_unlock(&(srv->lock));
+      break;
+    }
+    req = srv->queue[srv->head];
+    srv->head = (srv->head + 1) % TRIPLE_QUEUE_LENGTH;
+    srv->count--;
+    pthread_cond_signal(&(srv->nonfull));
+    pthread_mutex_unlock(&(srv->lock));
+
+    ic = srv->defaults;
+    ic.id = req.tag;
+    ic.seed = (req.seed == FB_SEED ? triple_job_seed(srv->seed, req.tag) : req.seed);
+    if ((why = triple_request_ic(&req, &ic)) != NULL) {
+      fprintf(stderr, "triple_server_worker(): request %lu: %s\n", (unsigned long) req.tag, why);
+      memset(&result, 0, sizeof(triple_result_t));
+      result.ic = ic;
+      result.retval.retval = TRIPLE_E_REQUEST;
+      result.units.t = 1.0;
+      result.units.l = 1.0;
+      strncpy(result.hier, "invalid", TRIPLE_HIER_LENGTH-1);
+      strncpy(result.hierid, "invalid", TRIPLE_HIER_LENGTH-1);
+    } else {
+      triple_run(ic, srv->input, &hier, rng, &result);
+    }
+    triple_summary(&result, srv->input);
+    triple_reduce(&result);
+    triple_reply(&result, &reply);
+
+    frame.type = TRIPLE_FRAME_REPLY;
+    frame.length = sizeof(triple_reply_t);
+    pthread_mutex_lock(&(srv->writelock));
+    if (!srv->writeerr &&
+        (triple_write_all(srv->fdout, &frame, sizeof(triple_frame_t)) != 0 ||
+         triple_write_all(srv->fdout, &reply, sizeof(triple_reply_t)) != 0)) {
+      fprintf(stderr, "triple_server_worker(): cannot write reply: %s; dropping the rest\n", strerror(errno));
+      srv->writeerr = 1;
+    }
+    pthread_mutex_unlock(&(srv->writelock));
+
+    pthread_mutex_lock(&(srv->lock));
+    srv->nrequest++;
+    if (reply.retval < 0) {
+      srv->nfail++;
+    }
+    if (--(srv->inflight) == 0) {
+      pthread_cond_broadcast(&(srv->idle));
+    }
+    pthread_mutex_unlock(&(srv->lock));
+  }
+
+  /* free GSL stuff */
+  gsl_rng_free(rng);
+
+  /* free our own stuff */
+  fb_free_hier(hier);
+
+  return(NULL);
+}
+
+/* serve one connection: queue its requests until it is closed, then wait for its replies */
+static void triple_serve(triple_server_t *srv, int fdin, int fdout)
+{
+  int status;
+  triple_frame_t frame;
+  triple_request_t req;
+
+  pthread_mutex_lock(&(srv->writelock));
+  srv->fdout = fdout;
+  srv->writeerr = 0;
+  pthread_mutex_unlock(&(srv->writelock));
+
+  while ((status = triple_read_all(fdin, &frame, sizeof(triple_frame_t))) == 1) {
+    if (frame.type != TRIPLE_FRAME_REQUEST || frame.length != sizeof(triple_request_t)) {
+      fprintf(stderr, "triple_serve(): malformed frame (type=%#x length=%u); closing the connection\n",
+        (unsigned int) frame.type, (unsigned int) frame.length);
+      break;
+    }
+    if ((status = triple_read_all(fdin, &req, sizeof(triple_request_t))) != 1) {
+      break;
+    }
+
+    pthread_mutex_lock(&(srv->lock));
+    while (srv->count == TRIPLE_QUEUE_LENGTH) {
+      pthread_cond_wait(&(srv->nonfull), &(srv->lock));
+    }
+    srv->queue[(srv->head + srv->count) % TRIPLE_QUEUE_LENGTH] = req;
+    srv->count++;
+    srv->inflight++;
+    pthread_cond_signal(&(srv->nonempty));
+    pthread_mutex_unlock(&(srv->lock));
+  }
+  if (status < 0) {
+    fprintf(stderr, "triple_serve(): truncated frame; closing the connection\n");
+  }
+
+  /* the next connection's replies must not go to this one */
+  pthread_mutex_lock(&(srv->lock));
+  while (srv->inflight > 0) {
+    pthread_cond_wait(&(srv->idle), &(srv->lock));
+  }
+  pthread_mutex_unlock(&(srv->lock));
+}
+
+/* listen on a Unix domain socket, serving one connection after another for good */
+static int triple_listen(triple_server_t *srv, char *path)
+{
+  int fd, conn;
+  struct sockaddr_un addr;
+  struct stat st;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "triple_listen(): socket path \"%s\" is too long\n", path);
+    return(1);
+  }
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+    fprintf(stderr, "triple_listen(): socket(): %s\n", strerror(errno));
+    return(1);
+  }
+
+  /* a socket left behind by an earlier server is in the way, but nothing else is removed */
+  if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+    unlink(path);
+  }
+
+  memset(&addr, 0, sizeof(struct sockaddr_un));
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_un)) != 0 || listen(fd, 8) != 0) {
+    fprintf(stderr, "triple_listen(): cannot listen on \"%s\": %s\n", path, strerror(errno));
+    close(fd);
+    return(1);
+  }
+
+  while (1) {
+    if ((conn = accept(fd, NULL, NULL)) < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      fprintf(stderr, "triple_listen(): accept(): %s\n", strerror(errno));
+      break;
+    }
+    fb_dprintf("triple_listen(): new connection\n");
+    triple_serve(srv, conn, conn);
+    close(conn);
+    fb_dprintf("triple_listen(): connection closed: %ld request(s) served so far\n", srv->nrequest);
+  }
+
+  close(fd);
+  unlink(path);
+  return(1);
+}
+
+/* run as a job server on nthreads threads, taking requests from the Unix domain socket at
+   path, or from stdin with replies on stdout if path is "-" (until end of file).  Requests
+   without a seed get one derived from the master seed in defaults, as in the ensemble. */
+int triple_server(char *path, triple_ic_t defaults, fb_input_t input, int nthreads)
+{
+  int i, nstarted, status;
+  triple_server_t srv;
+  pthread_t *threads;
+
+  /* the master seed */
+  if (defaults.seed == FB_SEED) {
+    srv.seed = triple_urandom_seed();
+  } else {
+    srv.seed = defaults.seed;
+  }
+  fprintf(stderr, "triple_server(): listening on %s  master seed=%lu  nthreads=%d\n",
+    path, srv.seed, nthreads);
+
+  /* only the replies go back to the client; trajectories are thrown away */
+  if ((input.out = fopen("/dev/null", "w")) == NULL) {
+    fprintf(stderr, "triple_server(): cannot open /dev/null\n");
+    return(1);
+  }
+  input.outfreq = -1;
+
+  srv.defaults = defaults;
+  srv.input = input;
+  srv.debug = fb_debug;
+  srv.head = 0;
+  srv.count = 0;
+  srv.inflight = 0;
+  srv.closing = 0;
+  srv.fdout = -1;
+  srv.writeerr = 0;
+  srv.nrequest = 0;
+  srv.nfail = 0;
+  pthread_mutex_init(&(srv.lock), NULL);
+  pthread_mutex_init(&(srv.writelock), NULL);
+  pthread_cond_init(&(srv.nonempty), NULL);
+  pthread_cond_init(&(srv.nonfull), NULL);
+  pthread_cond_init(&(srv.idle), NULL);
+
+  /* a client that goes away shows up as a failed write, not a signal */
+  signal(SIGPIPE, SIG_IGN);
+
+  triple_thread_setup();
+
+  threads = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+  nstarted = 0;
+  for (i=0; i<nthreads; i++) {
+    if (pthread_create(&(threads[i]), NULL, triple_server_worker, &srv) != 0) {
+      fprintf(stderr, "triple_server(): cannot create thread %d\n", i);
+      break;
+    }
+    nstarted++;
+  }
+
+  if (nstarted == 0) {
+    status = 1;
+  } else if (strcmp(path, "-") == 0) {
+    triple_serve(&srv, STDIN_FILENO, STDOUT_FILENO);
+    status = 0;
+  } else {
+    status = triple_listen(&srv, path);
+  }
+
+  pthread_mutex_lock(&(srv.lock));
+  srv.closing = 1;
+  pthread_cond_broadcast(&(srv.nonempty));
+  pthread_mutex_unlock(&(srv.lock));
+  for (i=0; i<nstarted; i++) {
+    pthread_join(threads[i], NULL);
+  }
+
+  fprintf(stderr, "triple_server(): %ld request(s) served, %ld failed\n", srv.nrequest, srv.nfail);
+
+  pthread_cond_destroy(&(srv.idle));
+  pthread_cond_destroy(&(srv.nonfull));
+  pthread_cond_destroy(&(srv.nonempty));
+  pthread_mutex_destroy(&(srv.writelock));
+  pthread_mutex_destroy(&(srv.lock));
+  free(threads);
+  fclose(input.out);
+
+  return(status);
+}
@@ -0,0 +1,373 @@
+/* -*- linux-c -*- */
+/* triple_shard.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* A batch table (the manifest) is split across machines by running it once per shard: shard
+   i of n runs the jobs whose number is i modulo n, so that every shard gets a fair share of
+   the expensive systems wherever they sit in the table.  The master seed is the one given
+   with --seed or else the hash of the manifest, and the seed of every job without one is
+   derived from the master seed and the job number, so that a job gets the same seed whichever
+   shard runs it and however often.  Each shard writes its results to a binary file with a
+   header naming the manifest, and triple_merge() checks a set of such files for missing and
+   duplicated jobs and concatenates them. */
+
+/* the results file of the running shard, written to from the ensemble threads or the pool */
+typedef struct{
+  FILE *fp; /* NULL when not running a shard */
+  char *path;
+  long nstore; /* results written */
+  pthread_mutex_t lock;
+} triple_shard_t;
+
+static triple_shard_t triple_shard_out = {NULL, NULL, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/* parse a shard spec "<i>/<n>"; returns 0 on success */
+int triple_parse_shard(char *spec, int *shard, int *nshard)
+{
+  char *end;
+
+  *shard = (int) strtol(spec, &end, 10);
+  if (end == spec || *end != '/') {
+    return(1);
+  }
+  spec = end + 1;
+  *nshard = (int) strtol(spec, &end, 10);
+  if (end == spec || *end != '\0' || *nshard < 1 || *shard < 0 || *shard >= *nshard) {
+    return(1);
+  }
+
+  return(0);
+}
+
+/* append a result to the results file of the running shard, if any; the file is flushed after
+   every result, so a shard that is killed loses only the jobs it was running */
+void triple_shard_store(triple_result_t *result)
+{
+  if (triple_shard_out.fp == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&(triple_shard_out.lock));
+  if (fwrite(result, sizeof(triple_result_t), 1, triple_shard_out.fp) != 1 ||
+      fflush(triple_shard_out.fp) != 0) {
+    fprintf(stderr, "triple_shard: cannot write to %s: %s\n", triple_shard_out.path, strerror(errno));
+  } else {
+    triple_shard_out.nstore++;
+  }
+  pthread_mutex_unlock(&(triple_shard_out.lock));
+}
+
+/* read the whole of a file ("-" for stdin) into a malloc()ed buffer; returns NULL on failure */
+static char *triple_shard_slurp(char *path, size_t *len)
+{
+  size_t n, nalloc=65536;
+  char *buf;
+  FILE *fp;
+
+  if (strcmp(path, "-") == 0) {
+    fp = stdin;
+  } else if ((fp = fopen(path, "r")) == NULL) {
+    return(NULL);
+  }
+
+  buf = (char *) malloc(nalloc);
+  *len = 0;
+  while ((n = fread(&(buf[*len]), 1, nalloc - *len, fp)) > 0) {
+    *len += n;
+    if (*len == nalloc) {
+      nalloc *= 2;
+      buf = (char *) realloc(buf, nalloc);
+    }
+  }
+  if (ferror(fp)) {
+    free(buf);
+    buf = NULL;
+  }
+
+  if (fp != stdin) {
+    fclose(fp);
+  }
+
+  return(buf);
+}
+
+/* run shard shard of nshard of the batch table in manifest, on nthreads threads or, if
+   nworkers>0, in nworkers worker processes, and write the results to results.  The summary
+   lines and trajectories are written as in an unsharded run. */
+int triple_shard(char *manifest, int shard, int nshard, char *results, triple_ic_t defaults,
+                 fb_input_t input, int nthreads, int nworkers)
+{
+  long j, njob, nmine=0, nbad, nfail;
+  size_t len;
+  char *buf;
+  triple_ic_t *ic;
+  triple_shard_header_t head;
+  FILE *stream;
+
+  /* the whole manifest is hashed, so that the shards of different tables cannot be mixed */
+  if ((buf = triple_shard_slurp(manifest, &len)) == NULL) {
+    fprintf(stderr, "triple_shard: cannot read manifest %s\n", manifest);
+    return(1);
+  }
+  if (len == 0 || (stream = fmemopen(buf, len, "r")) == NULL) {
+    fprintf(stderr, "triple_shard: manifest %s is empty\n", manifest);
+    free(buf);
+    return(1);
+  }
+
+  memset(&head, 0, sizeof(triple_shard_header_t));
+  strncpy(head.magic, TRIPLE_SHARD_MAGIC, sizeof(head.magic));
+  strncpy(head.version, FB_VERSION, sizeof(head.version) - 1);
+  head.size = sizeof(triple_result_t);
+  head.shard = shard;
+  head.nshard = nshard;
+  head.manifest = triple_fnv1a(buf, len, TRIPLE_FNV_OFFSET);
+  head.seed = (defaults.seed == FB_SEED ? head.manifest : (uint64_t) defaults.seed);
+
+  njob = triple_read_table(stream, defaults, &ic, &nbad);
+  fclose(stream);
+  free(buf);
+  head.njob = njob;
+
+  if (nbad) {
+    fprintf(stderr, "triple_shard: skipped %ld malformed line(s)\n", nbad);
+  }
+
+  /* keep this shard's jobs, which keep their numbers in the whole table */
+  for (j=0; j<njob; j++) {
+    if (ic[j].id % nshard == shard) {
+      ic[nmine++] = ic[j];
+    }
+  }
+
+  fprintf(stderr, "triple_shard: shard %d/%d: %ld of %ld job(s)  manifest=%016llx  master seed=%llu\n",
+    shard, nshard, nmine, njob, (unsigned long long) head.manifest, (unsigned long long) head.seed);
+
+  if ((triple_shard_out.fp = fopen(results, "w")) == NULL ||
+      fwrite(&head, sizeof(triple_shard_header_t), 1, triple_shard_out.fp) != 1) {
+    fprintf(stderr, "triple_shard: cannot write %s: %s\n", results, strerror(errno));
+    free(ic);
+    return(1);
+  }
+  triple_shard_out.path = results;
+  triple_shard_out.nstore = 0;
+
+  if (nworkers > 0) {
+    nfail = triple_pool_jobs(ic, nmine, (unsigned long int) head.seed, input, nworkers);
+  } else {
+    nfail = triple_ensemble_jobs(ic, nmine, (unsigned long int) head.seed, input, nthreads);
+  }
+
+  fclose(triple_shard_out.fp);
+  triple_shard_out.fp = NULL;
+  fprintf(stderr, "triple_shard: wrote %ld result(s) to %s\n", triple_shard_out.nstore, results);
+  free(ic);
+
+  return((nbad || nfail < 0 || (nworkers > 0 && nfail > 0) || triple_shard_out.nstore < nmine) ? 1 : 0);
+}
+
+/* print a sorted list of job numbers as ranges */
+static void triple_merge_print_jobs(FILE *stream, const char *what, long *job, long n)
+{
+  long i, j;
+
+  fprintf(stream, "triple_merge: %ld %s job(s):", n, what);
+  for (i=0; i<n; i=j) {
+    for (j=i+1; j<n && job[j] == job[j-1] + 1; j++);
+    if (j - i > 1) {
+      fprintf(stream, " %ld-%ld", job[i], job[j-1]);
+    } else {
+      fprintf(stream, " %ld", job[i]);
+    }
+  }
+  fprintf(stream, "\n");
+}
+
+/* check the results files of the shards of a manifest against each other, report missing and
+   duplicated shards and jobs, and concatenate the results, first copy of each job only, into
+   out as the results file of a single shard; with out "-", print them as summary lines to
+   stdout instead.  Returns 0 only if the files were consistent and every job is there once. */
+int triple_merge(char *out, int nfile, char **file)
+{
+  int i, ok=1;
+  long j, n, nmissing=0, ndup=0, nkeep=0, *list;
+  char *seenshard=NULL;
+  unsigned char *count=NULL;
+  triple_shard_header_t first, head, merged;
+  triple_result_t result;
+  triple_tally_t tally;
+  FILE *fp, *outfp=NULL;
+
+  memset(&tally, 0, sizeof(triple_tally_t));
+
+  for (i=0; i<nfile; i++) {
+    if ((fp = fopen(file[i], "r")) == NULL) {
+      fprintf(stderr, "triple_merge: cannot open %s: %s\n", file[i], strerror(errno));
+      ok = 0;
+      continue;
+    }
+    if (fread(&head, sizeof(triple_shard_header_t), 1, fp) != 1 ||
+        strncmp(head.magic, TRIPLE_SHARD_MAGIC, sizeof(head.magic)) != 0 ||
+        head.nshard < 1 || head.shard < 0 || head.shard >= head.nshard || head.njob < 0) {
+      fprintf(stderr, "triple_merge: %s is not a results file\n", file[i]);
+      fclose(fp);
+      ok = 0;
+      continue;
+    }
+    if (head.size != sizeof(triple_result_t) || strncmp(head.version, FB_VERSION, sizeof(head.version)) != 0) {
+      fprintf(stderr, "triple_merge: %s was written by another build (version %.16s)\n", file[i], head.version);
+      fclose(fp);
+      ok = 0;
+      continue;
+    }
+
+    /* the first good file sets the manifest the others must match */
+    if (count == NULL) {
+      first = head;
+      count = (unsigned char *) calloc(FB_MAX(first.njob, 1), sizeof(unsigned char));
+      seenshard = (char *) calloc(first.nshard, sizeof(char));
+      if (strcmp(out, "-") == 0) {
+        triple_print_result_header(stdout);
+      } else {
+        if ((outfp = fopen(out, "w")) == NULL) {
+          fprintf(stderr, "triple_merge: cannot write %s: %s\n", out, strerror(errno));
+          fclose(fp);
+          free(count);
+          free(seenshard);
+          return(1);
+        }
+        merged = first;
+        merged.shard = 0;
+        merged.nshard = 1;
+        fwrite(&merged, sizeof(triple_shard_header_t), 1, outfp);
+      }
+    } else if (head.manifest != first.manifest || head.seed != first.seed ||
+               head.njob != first.njob || head.nshard != first.nshard) {
+      fprintf(stderr, "triple_merge: %s is from another manifest, seed or split\n", file[i]);
+      fclose(fp);
+      ok = 0;
+      continue;
+    }
+
+    if (seenshard[head.shard]) {
+      fprintf(stderr, "triple_merge: shard %d/%d appears more than once (again in %s)\n",
+        head.shard, head.nshard, file[i]);
+      ok = 0;
+    }
+    seenshard[head.shard] = 1;
+
+    n = 0;
+    while (fread(&result, sizeof(triple_result_t), 1, fp) == 1) {
+      n++;
+      if (result.ic.id < 0 || result.ic.id >= first.njob) {
+        fprintf(stderr, "triple_merge: %s: result %ld has no job %ld in the manifest\n", file[i], n, result.ic.id);
+        ok = 0;
+        continue;
+      }
+      if (count[result.ic.id] < 255) {
+        count[result.ic.id]++;
+      }
+      if (count[result.ic.id] > 1) {
+        continue;
+      }
+      nkeep++;
+      if (outfp != NULL) {
+        fwrite(&result, sizeof(triple_result_t), 1, outfp);
+      } else {
+        triple_print_result(stdout, &result);
+        triple_tally(&tally, &result);
+      }
+    }
+    if (!feof(fp) || ferror(fp)) {
+      fprintf(stderr, "triple_merge: error reading %s\n", file[i]);
+      ok = 0;
+    } else if (ftell(fp) != (long) (sizeof(triple_shard_header_t) + n * sizeof(triple_result_t))) {
+      fprintf(stderr, "triple_merge: %s ends in a partial result, which is ignored\n", file[i]);
+    }
+    fprintf(stderr, "triple_merge: %s: shard %d/%d  %ld result(s)\n", file[i], head.shard, head.nshard, n);
+    fclose(fp);
+  }
+
+  if (count == NULL) {
+    fprintf(stderr, "triple_merge: no results to merge\n");
+    return(1);
+  }
+
+  for (i=0; i<first.nshard; i++) {
+    if (!seenshard[i]) {
+      fprintf(stderr, "triple_merge: shard %d/%d is missing\n", i, first.nshard);
+      ok = 0;
+    }
+  }
+
+  for (j=0; j<first.njob; j++) {
+    if (count[j] == 0) {
+      nmissing++;
+    } else if (count[j] > 1) {
+      ndup++;
+    }
+  }
+  list = (long *) malloc(FB_MAX(FB_MAX(nmissing, ndup), 1) * sizeof(long));
+  if (nmissing) {
+    for (j=0, n=0; j<first.njob; j++) {
+      if (count[j] == 0) {
+        list[n++] = j;
+      }
+    }
+    triple_merge_print_jobs(stderr, "missing", list, n);
+    ok = 0;
+  }
+  if (ndup) {
+    for (j=0, n=0; j<first.njob; j++) {
+      if (count[j] > 1) {
+        list[n++] = j;
+      }
+    }
+    triple_merge_print_jobs(stderr, "duplicated", list, n);
+    ok = 0;
+  }
+  free(list);
+
+  if (outfp != NULL) {
+    if (fclose(outfp) != 0) {
+      fprintf(stderr, "triple_merge: cannot write %s: %s\n", out, strerror(errno));
+      ok = 0;
+    }
+  } else {
+    triple_print_tally(stdout, &tally);
+  }
+
+  fprintf(stderr, "triple_merge: %ld of %ld job(s)  manifest=%016llx  master seed=%llu  %s\n",
+    nkeep, (long) first.njob, (unsigned long long) first.manifest, (unsigned long long) first.seed,
+    ok ? "complete" : "INCOMPLETE");
+
+  free(count);
+  free(seenshard);
+
+  return(ok ? 0 : 1);
+}
@@ -0,0 +1,288 @@
+/* -*- linux-c -*- */
+/* triple_summary.c
+
+   Copyright (C) 2002-2004 John M. Fregeau
+   
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <gsl/gsl_rng.h>
+#include "fewbody.h"
+#include "triple.h"
+
+/* A summary record goes out in a single fwrite(), flushed at once, under a lock, so the
+   records of concurrent threads cannot interleave and a run that is killed loses nothing
+   that finished before it.  The destination is the summary sink (see fewbody_sink.c): a
+   file, or an inherited descriptor ("&3"), so that the records can go down a pipe to whatever
+   collects them. */
+#define TRIPLE_SUMMARY_LENGTH 4096 /* longest JSON line */
+
+typedef struct{
+  FILE *fp; /* NULL when no summaries are written */
+  int binary; /* 1 for binary records, 0 for JSON lines */
+  long nrecord; /* records written */
+  pthread_mutex_t lock;
+} triple_summary_out_t;
+
+static triple_summary_out_t triple_summary_out = {NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+/* an angle of triple_ic_t in degrees, or -1 for random, as in the batch table */
+static double triple_summary_angle(double angle)
+{
+  return(angle > 0.0 ? angle * 180.0 / FB_CONST_PI : angle);
+}
+
+/* the summary record of a run */
+static void triple_summary_fill(triple_result_t *result, fb_input_t input, triple_summary_t *rec)
+{
+  memset(rec, 0, sizeof(triple_summary_t));
+
+  rec->id = result->ic.id;
+  rec->seed = result->ic.seed;
+  rec->m000 = result->ic.m000 / FB_CONST_MSUN;
+  rec->m001 = result->ic.m001 / FB_CONST_MSUN;
+  rec->m01 = result->ic.m01 / FB_CONST_MSUN;
+  rec->r000 = result->ic.r000;
+  rec->a00 = result->ic.a00 / FB_CONST_AU;
+  rec->a0 = result->ic.a0 / FB_CONST_AU;
+  rec->e00 = result->ic.e00;
+  rec->e0 = result->ic.e0;
+  rec->inc = triple_summary_angle(result->ic.inc);
+  rec->peri_in = triple_summary_angle(result->ic.peri_in);
+  rec->peri_out = triple_summary_angle(result->ic.peri_out);
+  rec->weight = result->ic.weight;
+  rec->screen = result->ic.screen;
+
+  rec->ks = input.ks;
+  rec->tstop = input.tstop;
+  rec->tcpustop = input.tcpustop;
+  rec->absacc = input.absacc;
+  rec->relacc = input.relacc;
+  rec->tidaltol = input.tidaltol;
+  rec->speedtol = input.speedtol;
+  rec->fexp = input.fexp;
+  rec->ncount = input.ncount;
+  rec->PN1 = input.PN1;
+  rec->PN2 = input.PN2;
+  rec->PN25 = input.PN25;
+  rec->PN3 = input.PN3;
+  rec->PN35 = input.PN35;
+  rec->t_dyn = result->units.t / FB_CONST_YR;
+  rec->l = result->units.l / FB_CONST_AU;
+
+  rec->retval = result->retval.retval;
+  rec->screened = result->screen;
+  rec->count = result->retval.count;
+  rec->iclassify = result->retval.iclassify;
+  rec->nrhs = result->retval.nrhs;
+  rec->DeltaE = result->retval.DeltaE;
+  rec->DeltaEfrac = result->retval.DeltaEfrac;
+  rec->DeltaL = result->retval.DeltaL;
+  rec->DeltaLfrac = result->retval.DeltaLfrac;
+  rec->Rmin = result->retval.Rmin * result->units.l / FB_CONST_RSUN;
+  rec->emax = result->retval.emax;
+  rec->Rmin_i = result->retval.Rmin_i;
+  rec->Rmin_j = result->retval.Rmin_j;
+  rec->Nosc = result->retval.Nosc;
+
+  rec->nstar = result->nstar;
+  rec->nobj = result->nobj;
+  rec->t = result->t;
+  rec->t_yr = result->t * result->units.t / FB_CONST_YR;
+  rec->a_in = result->a_in * result->units.l / FB_CONST_AU;
+  rec->e_in = result->e_in;
+  rec->a_out = result->a_out * result->units.l / FB_CONST_AU;
+  rec->e_out = result->e_out;
+  rec->cosi = result->cosi;
+
+  rec->tcpu = result->retval.tcpu;
+  rec->tclassify = result->retval.tclassify;
+  rec->toutput = result->retval.toutput;
+  rec->tintegrate = FB_MAX(rec->tcpu - rec->tclassify - rec->toutput, 0.0);
+
+  memcpy(rec->hier, result->hierid, TRIPLE_HIER_LENGTH);
+  memcpy(rec->hier_hr, result->hier, TRIPLE_HIER_LENGTH);
+}
+
+/* append "key":x, to buf at len; JSON has no infinities or NaNs, so those are null */
+static int triple_summary_double(char *buf, int len, const char *key, double x)
+{
+  if (isfinite(x)) {
+    return(len + snprintf(&(buf[len]), TRIPLE_SUMMARY_LENGTH - len, "\"%s\":%.17g,", key, x));
+  } else {
+    return(len + snprintf(&(buf[len]), TRIPLE_SUMMARY_LENGTH - len, "\"%s\":null,", key));
+  }
+}
+
+static int triple_summary_long(char *buf, int len, const char *key, long long x)
+{
+  return(len + snprintf(&(buf[len]), TRIPLE_SUMMARY_LENGTH - len, "\"%s\":%lld,", key, x));
+}
+
+/* the hierarchy strings are brackets, colons and star ids, so they need no escaping */
+static int triple_summary_string(char *buf, int len, const char *key, const char *x)
+{
+  return(len + snprintf(&(buf[len]), TRIPLE_SUMMARY_LENGTH - len, "\"%s\":\"%s\",", key, x));
+}
+
+/* a summary record as a JSON line, with the fields of triple_summary_t in order; returns its
+   length */
+static int triple_summary_json(triple_summary_t *rec, char *buf)
+{
+  int len=1;
+
+  buf[0] = '{';
+  len = triple_summary_long(buf, len, "id", rec->id);
+  len += snprintf(&(buf[len]), TRIPLE_SUMMARY_LENGTH - len, "\"seed\":%llu,", (unsigned long long) rec->seed);
+  len = triple_summary_double(buf, len, "m000", rec->m000);
+  len = triple_summary_double(buf, len, "m001", rec->m001);
+  len = triple_summary_double(buf, len, "m01", rec->m01);
+  len = triple_summary_double(buf, len, "r000", rec->r000);
+  len = triple_summary_double(buf, len, "a00", rec->a00);
+  len = triple_summary_double(buf, len, "a0", rec->a0);
+  len = triple_summary_double(buf, len, "e00", rec->e00);
+  len = triple_summary_double(buf, len, "e0", rec->e0);
+  len = triple_summary_double(buf, len, "inc", rec->inc);
+  len = triple_summary_double(buf, len, "peri_in", rec->peri_in);
+  len = triple_summary_double(buf, len, "peri_out", rec->peri_out);
+  len = triple_summary_double(buf, len, "weight", rec->weight);
+  len = triple_summary_long(buf, len, "screen", rec->screen);
+  len = triple_summary_long(buf, len, "ks", rec->ks);
+  len = triple_summary_double(buf, len, "tstop", rec->tstop);
+  len = triple_summary_double(buf, len, "tcpustop", rec->tcpustop);
+  len = triple_summary_double(buf, len, "absacc", rec->absacc);
+  len = triple_summary_double(buf, len, "relacc", rec->relacc);
+  len = triple_summary_double(buf, len, "tidaltol", rec->tidaltol);
+  len = triple_summary_double(buf, len, "speedtol", rec->speedtol);
+  len = triple_summary_double(buf, len, "fexp", rec->fexp);
+  len = triple_summary_long(buf, len, "ncount", rec->ncount);
+  len = triple_summary_long(buf, len, "PN1", rec->PN1);
+  len = triple_summary_long(buf, len, "PN2", rec->PN2);
+  len = triple_summary_long(buf, len, "PN25", rec->PN25);
+  len = triple_summary_long(buf, len, "PN3", rec->PN3);
+  len = triple_summary_long(buf, len, "PN35", rec->PN35);
+  len = triple_summary_double(buf, len, "t_dyn", rec->t_dyn);
+  len = triple_summary_double(buf, len, "l", rec->l);
+  len = triple_summary_long(buf, len, "retval", rec->retval);
+  len = triple_summary_long(buf, len, "screened", rec->screened);
+  len = triple_summary_long(buf, len, "count", rec->count);
+  len = triple_summary_long(buf, len, "iclassify", rec->iclassify);
+  len = triple_summary_long(buf, len, "nrhs", rec->nrhs);
+  len = triple_summary_double(buf, len, "DeltaE", rec->DeltaE);
+  len = triple_summary_double(buf, len, "DeltaEfrac", rec->DeltaEfrac);
+  len = triple_summary_double(buf, len, "DeltaL", rec->DeltaL);
+  len = triple_summary_double(buf, len, "DeltaLfrac", rec->DeltaLfrac);
+  len = triple_summary_double(buf, len, "Rmin", rec->Rmin);
+  len = triple_summary_double(buf, len, "emax", rec->emax);
+  len = triple_summary_long(buf, len, "Rmin_i", rec->Rmin_i);
+  len = triple_summary_long(buf, len, "Rmin_j", rec->Rmin_j);
+  len = triple_summary_long(buf, len, "Nosc", rec->Nosc);
+  len = triple_summary_long(buf, len, "nstar", rec->nstar);
+  len = triple_summary_long(buf, len, "nobj", rec->nobj);
+  len = triple_summary_double(buf, len, "t", rec->t);
+  len = triple_summary_double(buf, len, "t_yr", rec->t_yr);
+  len = triple_summary_double(buf, len, "a_in", rec->a_in);
+  len = triple_summary_double(buf, len, "e_in", rec->e_in);
+  len = triple_summary_double(buf, len, "a_out", rec->a_out);
+  len = triple_summary_double(buf, len, "e_out", rec->e_out);
+  len = triple_summary_double(buf, len, "cosi", rec->cosi);
+  len = triple_summary_double(buf, len, "tcpu", rec->tcpu);
+  len = triple_summary_double(buf, len, "tintegrate", rec->tintegrate);
+  len = triple_summary_double(buf, len, "tclassify", rec->tclassify);
+  len = triple_summary_double(buf, len, "toutput", rec->toutput);
+  len = triple_summary_string(buf, len, "hier", rec->hier);
+  len = triple_summary_string(buf, len, "hier_hr", rec->hier_hr);
+
+  /* the last comma closes the object instead */
+  buf[len-1] = '}';
+  buf[len++] = '\n';
+
+  return(len);
+}
+
+/* start writing summary records to the open sink, as binary records if binary is set or as
+   JSON lines; the binary header goes out at once.  Nothing is written to a discarding sink.
+   Returns 0 on success. */
+int triple_summary_open(fb_sink_t *sink, int binary)
+{
+  triple_summary_header_t head;
+
+  if ((triple_summary_out.fp = sink->stream) == NULL) {
+    return(0);
+  }
+
+  triple_summary_out.binary = binary;
+  triple_summary_out.nrecord = 0;
+  if (binary) {
+    memset(&head, 0, sizeof(triple_summary_header_t));
+    strncpy(head.magic, TRIPLE_SUMMARY_MAGIC, sizeof(head.magic));
+    strncpy(head.version, FB_VERSION, sizeof(head.version) - 1);
+    head.size = sizeof(triple_summary_t);
+    if (fwrite(&head, sizeof(triple_summary_header_t), 1, triple_summary_out.fp) != 1 ||
+        fflush(triple_summary_out.fp) != 0) {
+      fprintf(stderr, "triple_summary: cannot write to %s: %s\n", sink->name, strerror(errno));
+      return(1);
+    }
+  }
+
+  return(0);
+}
+
+/* write the summary record of a finished run, if summaries were asked for */
+void triple_summary(triple_result_t *result, fb_input_t input)
+{
+  int len;
+  triple_summary_t rec;
+  char buf[TRIPLE_SUMMARY_LENGTH];
+
+  if (triple_summary_out.fp == NULL) {
+    return;
+  }
+
+  triple_summary_fill(result, input, &rec);
+
+  pthread_mutex_lock(&(triple_summary_out.lock));
+  if (triple_summary_out.binary) {
+    len = (fwrite(&rec, sizeof(triple_summary_t), 1, triple_summary_out.fp) == 1 ? 0 : -1);
+  } else {
+    len = triple_summary_json(&rec, buf);
+    len = (fwrite(buf, 1, len, triple_summary_out.fp) == (size_t) len ? 0 : -1);
+  }
+  if (len != 0 || fflush(triple_summary_out.fp) != 0) {
+    fprintf(stderr, "triple_summary: cannot write summary of job %ld: %s\n", result->ic.id, strerror(errno));
+  } else {
+    triple_summary_out.nrecord++;
+  }
+  pthread_mutex_unlock(&(triple_summary_out.lock));
+}
+
+/* finish with the summaries, reporting how many were written to stream (the sink is closed
+   by whoever opened it) */
+void triple_summary_close(FILE *stream)
+{
+  if (triple_summary_out.fp == NULL) {
+    return;
+  }
+
+  fprintf(stream, "triple_summary: %ld records written\n", triple_summary_out.nrecord);
+  triple_summary_out.fp = NULL;
+}